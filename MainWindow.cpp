@@ -9,6 +9,8 @@
 #include <QFileDialog>
 #include <QDebug>
 
+#include <string.h>
+
 #include "dialogwait.h"
 
 #include "MemeServoAPI/MemeServoAPI.h"
@@ -34,14 +36,19 @@ MainWindow::MainWindow(QWidget *parent) :
 
     statusBar()->showMessage(QObject::tr("Copyright (C) 2016-2017 Meme Robotics Corp."));
 
-    qRegisterMetaType<QVector<unsigned char> >("QVector<unsigned char>");
-
     QObject::connect(this, SIGNAL(sig_updateScriptLabel(short)), this, SLOT(on_scriptLabel(short)));
     QObject::connect(this, SIGNAL(sig_localError(unsigned char, unsigned char)), this, SLOT(on_localError(unsigned char, unsigned char)));
     QObject::connect(this, SIGNAL(sig_nodeError(unsigned char, unsigned char)), this, SLOT(on_nodeError(unsigned char, unsigned char)));
     QObject::connect(this, SIGNAL(sig_log(unsigned char, QString)), this, SLOT(on_log(unsigned char, QString)));
 
+    QObject::connect(&telemetryTimer, SIGNAL(timeout()), this, SLOT(on_telemetryTimer()));
+    QObject::connect(&txTimer, SIGNAL(timeout()), this, SLOT(on_serialDataToDevice()));
+
     lastLabel = 0;
+    txHalted = false;
+    realTime = false;
+
+    scriptThread.setTelemetryPolling(20);
 }
 
 MainWindow::~MainWindow()
@@ -55,6 +62,13 @@ MainWindow::~MainWindow()
 }
 
 
+void MainWindow::setRealTimeConfig(const RealTimeConfig &config)
+{
+    scriptThread.setRealTimeConfig(config);
+    realTime = config.enabled;
+}
+
+
 void MainWindow::log(unsigned char node_addr, const char *msg)
 {
     emit sig_log(node_addr, QString(msg));
@@ -97,26 +111,44 @@ void MainWindow::on_nodeError(unsigned char node_addr, unsigned char err)
 }
 
 
-void MainWindow::sendDataCallback(uint8_t addr, uint8_t *data, uint8_t size)
+// Called by the script, executor or poller thread, one at a time since they share the API
+bool MainWindow::sendDataCallback(uint8_t addr, uint8_t *data, uint8_t size)
 {
-    QVector<unsigned char> arr;
+    uint8_t framed[1 + 255];
 
-    for (int i=0; i<size; i++)
-    {
-        arr << *data;
-        data++;
-    }
+    Q_UNUSED(addr);
+
+    framed[0] = size;
+    memcpy(framed + 1, data, size);
 
-    emit sig_serialData(addr, arr);
+    // Ring full: frame is dropped & reported as a local error by the script thread
+    if (!txRing.push(framed, size + 1))
+        return false;
+
+    // Posting an event allocates, the timer polls the ring instead
+    if (!realTime)
+        emit sig_serialDataQueued();
+
+    return true;
 }
 
 
-void MainWindow::on_serialDataToDevice(unsigned char addr, QVector<unsigned char> data)
+void MainWindow::on_serialDataToDevice()
 {
-    Q_UNUSED(addr);
+    uint8_t size;
+    uint8_t data[255];
+
+    while (txRing.pop(size))
+    {
+        for (int i = 0; i < size; i++)
+            txRing.pop(data[i]);
+
+        if (txHalted)
+            continue;
 
-    qDebug() << "Data to device: " << data;
-    serialPort.write((const char*)data.constData(), data.size());
+        qDebug() << "Data to device: " << QByteArray((const char*)data, size).toHex();
+        serialPort.write((const char*)data, size);
+    }
 }
 
 
@@ -166,7 +198,7 @@ void MainWindow::on_scriptLabel(int16_t currLabel)
     else if (currLabel < 0)
     {
         QMessageBox msgBox;
-        msgBox.setText(QObject::tr("Error when executing script: '%1'").arg(currLabel));
+        msgBox.setText(QObject::tr("Error when executing script: '%1' at %2").arg(currLabel).arg(scriptThread.source(lastLabel)));
         msgBox.exec();
     }
     else
@@ -313,6 +345,10 @@ void MainWindow::on_pushButton_ScriptLoad_clicked()
         line = bytes.data();
         line = line.trimmed();
 
+        // #CONST, #MACRO & #INCLUDE are resolved by ScriptThread::init()
+        if (line.startsWith('#'))
+            continue;
+
         QStringList splitted = line.split(":");
 
         if (splitted.size() != 2)
@@ -352,35 +388,87 @@ void MainWindow::on_pushButton_ScriptLoad_clicked()
     }
     else
     {
-        msgBox.setText(QObject::tr("Failed when loading script: %d").arg(nextLabel));
+        msgBox.setText(QObject::tr("Failed when loading script: %1 %2").arg(nextLabel).arg(scriptThread.errorSource()));
         msgBox.exec();
     }
 }
 
 
+// Put the global stop frame on the wire ahead of anything queued
+void MainWindow::emergencyStop()
+{
+    const std::vector<uint8_t> &frame = scriptThread.globalStopFrame();
+
+    txHalted = true;
+    scriptThread.requestStop();
+
+    if (!serialPort.isOpen() || frame.empty())
+        return;
+
+    // Queued after the frame being written, nodes must see it whole to resync on the stop frame
+    serialPort.write((const char*)frame.data(), frame.size());
+    serialPort.flush();
+}
+
+
+// Status of the nodes of the script, read from the table the poller fills, no bus access
+void MainWindow::on_telemetryTimer()
+{
+    QStringList nodes;
+
+    for (int node = 1; node < 256; node++)
+    {
+        MMSCRIPT_NODE_STATUS status;
+
+        if (!scriptThread.nodeStatus((uint8_t)node, &status))
+            continue;
+
+        if (status.status == MMS_CTRL_STATUS_NO_CONTROL)
+            nodes << QObject::tr("%1: no control").arg(node, 2, 16, QLatin1Char('0'));
+        else if (status.in_position)
+            nodes << QObject::tr("%1: in position").arg(node, 2, 16, QLatin1Char('0'));
+        else
+            nodes << QObject::tr("%1: moving").arg(node, 2, 16, QLatin1Char('0'));
+    }
+
+    if (!nodes.isEmpty())
+        statusBar()->showMessage(nodes.join(", "));
+
+    if (scriptThread.status() == ScriptThread::STOPPED)
+        telemetryTimer.stop();
+}
+
+
 void MainWindow::on_pushButton_ScriptStop_clicked()
 {
+    emergencyStop();
+
     DialogWait wait(this);
     wait.show();
 
     scriptThread.stop();
 
-    //while (scriptThread.status() != ScriptThread::STOPPED)
-    //    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
-
+    on_serialDataToDevice();            // Drop frames queued while unwinding
     QCoreApplication::processEvents();	// To process remaining UART data
-    MMS_GlobalStop();
+    txHalted = false;
+
+    // Once more now that the bus is quiet, captured by init() from the API instance of the bus
+    if (!scriptThread.globalStopFrame().empty())
+        serialPort.write((const char*)scriptThread.globalStopFrame().data(), scriptThread.globalStopFrame().size());
+
     QCoreApplication::processEvents();	// To process remaining stop data
 
     // Disconnect signal/slot
     QObject::disconnect(&serialPort, SIGNAL(readyRead()),
                      this, SLOT(on_serialDataFromDevice()));
 
-    QObject::disconnect(this, SIGNAL(sig_serialData(unsigned char, QVector<unsigned char>)),
-                     this, SLOT(on_serialDataToDevice(unsigned char, QVector<unsigned char>)));
+    QObject::disconnect(this, SIGNAL(sig_serialDataQueued()),
+                     this, SLOT(on_serialDataToDevice()));
+    txTimer.stop();
 
     ui->pushButton_ScriptExec->setText(QObject::tr("Exec"));
     on_scriptLabel(0);
+    telemetryTimer.stop();
 
     ui->pushButton_Port->setEnabled(true);
     ui->pushButton_ScriptLoad->setEnabled(true);
@@ -403,10 +491,16 @@ void MainWindow::on_pushButton_ScriptExec_clicked()
             QObject::connect(&serialPort, SIGNAL(readyRead()),
                              this, SLOT(on_serialDataFromDevice()));
 
-            QObject::connect(this, SIGNAL(sig_serialData(unsigned char, QVector<unsigned char>)),
-                             this, SLOT(on_serialDataToDevice(unsigned char, QVector<unsigned char>)));
+            QObject::connect(this, SIGNAL(sig_serialDataQueued()),
+                             this, SLOT(on_serialDataToDevice()));
+
+            txRing.clear();
+
+            if (realTime)
+                txTimer.start(1);
 
             scriptThread.start();
+            telemetryTimer.start(250);
         }
         else
             scriptThread.resume();
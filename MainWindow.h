@@ -5,6 +5,7 @@
 
 #include <QString>
 #include <QSemaphore>
+#include <QTimer>
 #include <QtSerialPort/QSerialPort>
 #include <functional>
 
@@ -26,13 +27,15 @@ public:
     void localErrorCallback(uint8_t node_addr, uint8_t err);
     void nodeErrorCallback(uint8_t node_addr, uint8_t err);
 
-    void sendDataCallback(uint8_t addr, uint8_t *data, uint8_t size);
+    bool sendDataCallback(uint8_t addr, uint8_t *data, uint8_t size);
 
     void log(unsigned char node_addr, const char* msg);
 
+    void setRealTimeConfig(const RealTimeConfig &config);
+
 signals:
     void sig_updateScriptLabel(short currentLabel);
-    void sig_serialData(unsigned char addr, QVector<unsigned char> arr);
+    void sig_serialDataQueued();
     void sig_localError(unsigned char node_addr, unsigned char err);
     void sig_nodeError(unsigned char node_addr, unsigned char err);
     void sig_log(unsigned char node_addr, QString msg);
@@ -42,10 +45,11 @@ private slots:
     void on_nodeError(unsigned char node_addr, unsigned char err);
     void on_log(unsigned char node_addr, QString msg);
 
-    void on_serialDataToDevice(unsigned char addr, QVector<unsigned char> data);
+    void on_serialDataToDevice();
     void on_serialDataFromDevice();
 
     void on_scriptLabel(short currentLabel);
+    void on_telemetryTimer();
 
     void on_pushButton_PortRefresh_clicked();
 
@@ -66,8 +70,18 @@ private:
     int16_t lastLabel;
 
     void updateScriptLabel(int16_t currentLabel);
+    void emergencyStop();
+
+    bool txHalted;  // Drop frames queued before an emergency stop
+
+    // Frames of the script, each one after its size byte. Pushed without allocating by the thread
+    // owning the API, written by the GUI thread when signaled, or every txTimer tick in real-time mode.
+    SpscRing<uint8_t, 4096> txRing;
+    bool realTime;
+    QTimer txTimer;
 
     ScriptThread scriptThread;
+    QTimer telemetryTimer;  // Shows status polled by the script thread while running
 };
 
 #endif // MAINWINDOW_H
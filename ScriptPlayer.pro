@@ -28,15 +28,38 @@ SOURCES += main.cpp\
     MemeServoAPI/MemeServoAPI.c \
     user/ScriptThread.cpp \
     user/ScriptProcessor.c \
+    user/ScriptCommands.c \
+    user/ScriptPreprocessor.c \
+    user/RttEstimator.c \
+    user/BusScheduler.c \
+    user/Telemetry.c \
+    user/TrajectoryStream.c \
+    user/TrajectoryGen.c \
+    user/ScriptEstimator.c \
+    user/VirtualBus.c \
+    user/RealTime.cpp \
     dialogwait.cpp
 
 HEADERS  += MainWindow.h \
     MemeServoAPI/MemeServoAPI.h \
     user/ScriptProcessor.h \
+    user/ScriptCommands.h \
+    user/ScriptPreprocessor.h \
+    user/RttEstimator.h \
+    user/BusScheduler.h \
+    user/Telemetry.h \
+    user/TrajectoryStream.h \
+    user/TrajectoryGen.h \
+    user/ScriptEstimator.h \
+    user/VirtualBus.h \
     user/ScriptThread.h \
+    user/RealTime.h \
+    user/SpscRing.h \
     dialogwait.h
 
 FORMS    += MainWindow.ui \
     dialogwait.ui
 
 QT += serialport
+
+include(user/ApiInstance.pri)
@@ -1,10 +1,34 @@
 #include "MainWindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    QCommandLineOption realTimeOption("realtime", QObject::tr("Run scripts in real-time mode (SCHED_FIFO, mlockall)."));
+    QCommandLineOption priorityOption("rt-priority", QObject::tr("SCHED_FIFO priority of the script thread."), "priority", "80");
+    QCommandLineOption cpuOption("rt-cpu", QObject::tr("CPU to pin the script thread to."), "cpu", "-1");
+
+    parser.addHelpOption();
+    parser.addOption(realTimeOption);
+    parser.addOption(priorityOption);
+    parser.addOption(cpuOption);
+    parser.process(a);
+
     MainWindow w;
+
+    if (parser.isSet(realTimeOption))
+    {
+        RealTimeConfig config;
+
+        config.enabled = true;
+        config.priority = parser.value(priorityOption).toInt();
+        config.cpu = parser.value(cpuOption).toInt();
+        w.setRealTimeConfig(config);
+    }
+
     w.show();
 
     return a.exec();
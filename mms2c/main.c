@@ -0,0 +1,247 @@
+
+// mms2c: compile a MemeServo script to C & optionally build it as a shared library
+//
+// The library is loaded by ScriptThread::loadNative() (mmsplay --native) for the same script,
+// lines it doesn't compile are still interpreted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ScriptProcessor.h"
+#include "ScriptCompiler.h"
+#include "ScriptPreprocessor.h"
+#include "ScriptEstimator.h"
+
+
+#define EXIT_COMPILED       0
+#define EXIT_SCRIPT_ERROR   1
+#define EXIT_SETUP_ERROR    2
+
+#ifndef MMS2C_INCLUDE
+#define MMS2C_INCLUDE       "."     /* Root of the sources, holding user/ & MemeServoAPI/ */
+#endif
+
+#define MMS2C_COMMAND_US    1000    /* One API call at 230400 baud, status poll included */
+
+#ifndef MMS2C_CC
+#define MMS2C_CC            "cc -O2 -shared -fPIC"
+#endif
+
+
+static void usage()
+{
+    fprintf(stderr, "usage: mms2c [-o <source.c>] [--shared <library>] [--cc <command>] [-I <root>] [--no-optimize] <script>\n"
+                    "       mms2c --estimate [--profile <velocity>,<acceleration>] [--command-us <us>] [--no-optimize] <script>\n"
+                    "  -o        C source to write, <library>.c or stdout by default\n"
+                    "  --shared  build the source into a shared library for mmsplay --native\n"
+                    "  --cc      compiler & flags building shared libraries, default \"" MMS2C_CC "\"\n"
+                    "  -I        root of the sources, default \"" MMS2C_INCLUDE "\"\n"
+                    "  --no-optimize  compile the script as written, for mmsplay --no-optimize\n"
+                    "  --estimate     print the estimated cycle time instead of compiling\n"
+                    "  --profile      profile of AP & RP moves, counts/s & counts/s^2, not modeled by default\n"
+                    "  --command-us   bus time of one API call, default %d\n", MMS2C_COMMAND_US);
+}
+
+
+static int16_t printEstimate(const MMSCRIPT_ESTIMATE_CONFIG *config)
+{
+    MMSCRIPT_ESTIMATE estimate;
+    int16_t ret = MMScript_Estimate(config, &estimate);
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "mms2c: failed when estimating: %d\n", ret);
+        return ret;
+    }
+
+    printf("total %.3f ms%s: delays %.3f ms, bus %.3f ms, waits %.3f ms\n",
+           estimate.total_us / 1000.0, estimate.endless ? " to the endless loop" : "",
+           estimate.delay_us / 1000.0, estimate.bus_us / 1000.0, estimate.wait_us / 1000.0);
+
+    for (uint8_t i = 0; i < estimate.loop_count; i++)
+    {
+        const MMSCRIPT_LOOP_ESTIMATE *loop = &estimate.loops[i];
+
+        printf("loop %d..%d: %.3f ms per pass", loop->start_label, loop->end_label, loop->pass_us / 1000.0);
+
+        if (loop->passes > 0)
+            printf(", %u passes", loop->passes);
+
+        printf("\n");
+    }
+
+    // Critical path: time the script was blocked by each node
+    for (uint8_t i = 0; i < estimate.node_count; i++)
+    {
+        const MMSCRIPT_NODE_ESTIMATE *node = &estimate.nodes[i];
+
+        printf("node %x: %u moves, %.3f ms moving, %.3f ms waited\n",
+               node->node, node->moves, node->motion_us / 1000.0, node->waited_us / 1000.0);
+    }
+
+    if (estimate.unmodeled > 0)
+        printf("%u lines not modeled, counted as taking no time\n", estimate.unmodeled);
+
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *script = NULL;
+    const char *source = NULL;
+    const char *library = NULL;
+    const char *cc = MMS2C_CC;
+    const char *include = MMS2C_INCLUDE;
+    uint8_t optimize = 1;
+    uint8_t estimate = 0;
+    MMSCRIPT_ESTIMATE_CONFIG config = { 0, 0, MMS2C_COMMAND_US };
+    MMSCRIPT_OPTIMIZE_REPORT report;
+    MMSCRIPT_SOURCE_MAP map;
+    char sourceBuf[1024];
+    uint16_t compiled;
+    size_t size;
+    char *buf;
+    FILE *out;
+    int16_t ret;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            source = argv[++i];
+        else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc)
+            library = argv[++i];
+        else if (strcmp(argv[i], "--cc") == 0 && i + 1 < argc)
+            cc = argv[++i];
+        else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc)
+            include = argv[++i];
+        else if (strcmp(argv[i], "--no-optimize") == 0)
+            optimize = 0;
+        else if (strcmp(argv[i], "--estimate") == 0)
+            estimate = 1;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc &&
+                 sscanf(argv[i + 1], "%u,%u", &config.velocity, &config.acceleration) == 2)
+            i++;
+        else if (strcmp(argv[i], "--command-us") == 0 && i + 1 < argc)
+            config.command_us = (uint32_t)atoi(argv[++i]);
+        else if (argv[i][0] != '-' && script == NULL)
+            script = argv[i];
+        else
+        {
+            usage();
+            return EXIT_SETUP_ERROR;
+        }
+    }
+
+    if (script == NULL)
+    {
+        usage();
+        return EXIT_SETUP_ERROR;
+    }
+
+    // The compiler needs the source on disk
+    if (source == NULL && library != NULL)
+    {
+        int n = snprintf(sourceBuf, sizeof(sourceBuf), "%s.c", library);
+
+        if (n < 0 || (size_t)n >= sizeof(sourceBuf))
+        {
+            fprintf(stderr, "mms2c: library path too long\n");
+            return EXIT_SETUP_ERROR;
+        }
+
+        source = sourceBuf;
+    }
+
+    // Directives resolved as mmsplay does, for the hash to match
+    ret = MMScript_Preprocess(script, &buf, &size, &map);
+
+    if (ret == MMS_PARSE_ERR_FILE)
+    {
+        fprintf(stderr, "mms2c: can't read '%s'\n", script);
+        MMScript_FreeSourceMap(&map);
+        return EXIT_SETUP_ERROR;
+    }
+
+    if (ret != 0)
+    {
+        if (map.file_count > 0)
+            fprintf(stderr, "%s:%u: ", map.files[map.error.file], map.error.line);
+
+        fprintf(stderr, "mms2c: failed when preprocessing '%s': %d\n", script, ret);
+        MMScript_FreeSourceMap(&map);
+        return EXIT_SCRIPT_ERROR;
+    }
+
+    MMScript_FreeSourceMap(&map);
+
+    // Lines are compiled as the interpreter runs them, optimized alike
+    MMScript_SetOptimize(optimize);
+    MMScript_SetScriptPath(script);
+    ret = MMScript_ParseScript(buf, size);
+
+    if (ret <= 0)
+    {
+        fprintf(stderr, "mms2c: failed when parsing '%s': %d\n", script, ret);
+        return EXIT_SCRIPT_ERROR;
+    }
+
+    MMScript_GetOptimizeReport(&report);
+
+    if (optimize)
+        fprintf(stderr, "mms2c: optimized: %u folded, %u delays merged, %u jumps threaded, %u calls inlined, %u lines removed\n",
+                report.folded, report.merged_delays, report.threaded_jumps, report.inlined_calls, report.removed_lines);
+
+    if (estimate)
+    {
+        ret = printEstimate(&config);
+        MMScript_Clean();
+        return (ret == 0) ? EXIT_COMPILED : EXIT_SETUP_ERROR;
+    }
+
+    out = source ? fopen(source, "w") : stdout;
+
+    if (out == NULL)
+    {
+        fprintf(stderr, "mms2c: can't write '%s'\n", source);
+        MMScript_Clean();
+        return EXIT_SETUP_ERROR;
+    }
+
+    ret = MMScript_Compile(out, &compiled);
+
+    if (source && fclose(out) != 0)
+        ret = MMS_PARSE_ERR_FILE;
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "mms2c: failed when compiling '%s': %d\n", script, ret);
+        MMScript_Clean();
+        return EXIT_SETUP_ERROR;
+    }
+
+    fprintf(stderr, "mms2c: %u of %u lines compiled\n", compiled, MMScript_LineCount());
+    MMScript_Clean();
+
+    if (library)
+    {
+        char command[4096];
+        int n = snprintf(command, sizeof(command), "%s -I\"%s\" -I\"%s/user\" -o \"%s\" \"%s\"", cc, include, include, library, source);
+
+        // A truncated command could build another file
+        if (n < 0 || (size_t)n >= sizeof(command))
+        {
+            fprintf(stderr, "mms2c: compiler command too long\n");
+            return EXIT_SETUP_ERROR;
+        }
+
+        if (system(command) != 0)
+        {
+            fprintf(stderr, "mms2c: failed: %s\n", command);
+            return EXIT_SETUP_ERROR;
+        }
+    }
+
+    return EXIT_COMPILED;
+}
@@ -0,0 +1,44 @@
+#-------------------------------------------------
+#
+# Script to C compiler, no Qt
+#
+#-------------------------------------------------
+
+QT -= core gui
+
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = mms2c
+TEMPLATE = app
+
+INCLUDEPATH += ../user/ ..
+
+# Headers of the generated sources are found from here
+DEFINES += MMS2C_INCLUDE=\\\"$$clean_path($$PWD/..)\\\"
+
+SOURCES += main.c \
+    ../MemeServoAPI/MemeServoAPI.c \
+    ../user/ScriptProcessor.c \
+    ../user/ScriptCommands.c \
+    ../user/ScriptPreprocessor.c \
+    ../user/ScriptCompiler.c \
+    ../user/ScriptEstimator.c \
+    ../user/RttEstimator.c \
+    ../user/Telemetry.c \
+    ../user/TrajectoryStream.c \
+    ../user/TrajectoryGen.c
+
+HEADERS += \
+    ../MemeServoAPI/MemeServoAPI.h \
+    ../user/ScriptProcessor.h \
+    ../user/ScriptCommands.h \
+    ../user/ScriptPreprocessor.h \
+    ../user/ScriptCompiler.h \
+    ../user/ScriptEstimator.h \
+    ../user/RttEstimator.h \
+    ../user/Telemetry.h \
+    ../user/TrajectoryStream.h \
+    ../user/TrajectoryGen.h
+
+unix: LIBS += -lm
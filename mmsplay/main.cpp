@@ -0,0 +1,673 @@
+
+// mmsplay: run MemeServo scripts without GUI & print a JSON summary on stdout
+//
+// Each bus has its own serial port, SerialLink I/O thread & ScriptThread,
+// the main thread runs a poll() loop on a signal pipe & a completion pipe.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ScriptThread.h"
+#include "SerialLink.h"
+#include "ScriptProcessor.h"
+#include "RttEstimator.h"
+#include "VirtualBus.h"
+
+
+#define EXIT_FINISHED       0
+#define EXIT_SCRIPT_ERROR   1
+#define EXIT_SETUP_ERROR    2
+#define EXIT_LINK_DOWN      3
+#define EXIT_INTERRUPTED    130
+
+#define DRY_RUN_COMMAND_US  1000
+
+
+static int signalPipe[2];
+static int donePipe[2];
+static bool verbose = false;
+static bool dryRun = false;
+static FILE *timeline = NULL;   // CSV of the dry run, written by all script threads
+
+
+// One bus: serial port, interpreter context & executor thread
+struct Bus
+{
+    explicit Bus(uint8_t index) : thread(index), steps(0), label(0), localErrors(0), nodeErrors(0) {}
+
+    QString device;
+    QString script;
+    ScriptThread thread;
+    SerialLink link;
+
+    std::atomic<uint64_t> steps;
+    std::atomic<int16_t> label;     // Label being executed
+    std::atomic<uint32_t> localErrors;
+    std::atomic<uint32_t> nodeErrors;
+};
+
+
+#define WAKE_SIGNAL         0
+#define WAKE_LINK_DOWN      1
+
+
+static void onSignal(int)
+{
+    char c = WAKE_SIGNAL;
+    ssize_t ret = write(signalPipe[1], &c, 1);
+    (void)ret;
+}
+
+
+// From the I/O thread of a bus whose device hung up: stop all buses as on a signal
+static void onLinkDown()
+{
+    char c = WAKE_LINK_DOWN;
+    ssize_t ret = write(signalPipe[1], &c, 1);
+    (void)ret;
+}
+
+
+static void onLabel(Bus *bus, int16_t label)
+{
+    if (label > 0)
+    {
+        bus->steps++;
+        bus->label = label;
+        return;
+    }
+
+    // Run of this bus ended
+    char c = (char)bus->thread.bus();
+    ssize_t ret = write(donePipe[1], &c, 1);
+    (void)ret;
+}
+
+
+static void onLocalError(Bus *bus, uint8_t node, uint8_t err)
+{
+    bus->localErrors++;
+    fprintf(stderr, "bus %d: local error: node 0x%02x, error 0x%02x\n", bus->thread.bus(), node, err);
+}
+
+
+static void onNodeError(Bus *bus, uint8_t node, uint8_t err)
+{
+    bus->nodeErrors++;
+    fprintf(stderr, "bus %d: node error: node 0x%02x, error 0x%02x\n", bus->thread.bus(), node, err);
+}
+
+
+static void onLog(Bus *bus, uint8_t node, const char *msg)
+{
+    if (verbose)
+        fprintf(stderr, "bus %d: node 0x%02x: %s\n", bus->thread.bus(), node, msg);
+}
+
+
+static void onTrace(Bus *bus, const MMSCRIPT_VIRTUAL_EVENT &event)
+{
+    fprintf(timeline, "%d,%llu,%s,%d,%d\n", bus->thread.bus(), (unsigned long long)event.time_us,
+            MMScript_VirtualEventName(event.type), event.node, (int)event.value);
+}
+
+
+// Control characters as \u00XX, JSON doesn't allow them raw
+static QString jsonString(const QString &str)
+{
+    QString escaped;
+
+    for (QChar c : str)
+    {
+        if (c == '\\' || c == '"')
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QLatin1Char('0'));
+        else
+            escaped += c;
+    }
+
+    return "\"" + escaped + "\"";
+}
+
+
+static const char *statusName(ScriptThread::STATUS status)
+{
+    switch (status)
+    {
+    case ScriptThread::NEW:     return "new";
+    case ScriptThread::INIT:    return "init";
+    case ScriptThread::RUNNING: return "running";
+    case ScriptThread::PAUSED:  return "paused";
+    case ScriptThread::STOPPED: return "stopped";
+    }
+
+    return "unknown";
+}
+
+
+// CPU of bus index from a comma separated list, -1 if not given
+static int cpuOf(const QString &list, int index)
+{
+    QStringList cpus = list.split(",");
+
+    if (index >= cpus.size())
+        return -1;
+
+    bool ok;
+    int cpu = cpus.at(index).toInt(&ok);
+
+    return ok ? cpu : -1;
+}
+
+
+// One line per bus on stderr
+static void printStatus(const std::vector<Bus*> &buses)
+{
+    for (Bus *bus : buses)
+    {
+        fprintf(stderr, "bus %d: %s, label %d, steps %llu, errors %u/%u\n",
+                bus->thread.bus(), statusName(bus->thread.status()), bus->label.load(),
+                (unsigned long long)bus->steps.load(), bus->localErrors.load(), bus->nodeErrors.load());
+
+        // Nodes polled by the telemetry poller, if enabled
+        for (int node = 1; node < 256; node++)
+        {
+            MMSCRIPT_NODE_STATUS status;
+
+            if (!bus->thread.nodeStatus((uint8_t)node, &status))
+                continue;
+
+            if (status.has_position)
+                fprintf(stderr, "  node 0x%02x: control %d, in position %d, position %d\n", node, status.status, status.in_position, status.position);
+            else
+                fprintf(stderr, "  node 0x%02x: control %d, in position %d\n", node, status.status, status.in_position);
+        }
+    }
+}
+
+
+// Virtual time, calls, variables & simulated nodes at the end of a dry run
+static void printDryRun(const Bus *bus)
+{
+    MMSCRIPT_VIRTUAL_STATS stats = bus->thread.virtualStats();
+
+    printf("      \"dry_run\": {\n");
+    printf("        \"virtual_us\": %llu, \"bus_us\": %llu, \"delay_us\": %llu, \"limit_reached\": %s,\n",
+           (unsigned long long)stats.now_us, (unsigned long long)stats.bus_us, (unsigned long long)stats.delay_us,
+           stats.limit_reached ? "true" : "false");
+    printf("        \"calls\": {");
+
+    for (int type = 0; type < MMSCRIPT_VIRTUAL_EVENT_COUNT; type++)
+        printf("%s \"%s\": %u", type ? "," : "", MMScript_VirtualEventName((uint8_t)type), stats.counts[type]);
+
+    printf(" },\n");
+    printf("        \"variables\": {");
+
+    std::vector<int16_t> vars = bus->thread.variables();
+
+    for (size_t i = 0; i < vars.size(); i++)
+        printf("%s \"%c\": %d", i ? "," : "", (char)('A' + i), vars[i]);
+
+    printf(" },\n");
+    printf("        \"nodes\": [");
+
+    bool first = true;
+
+    for (int node = 1; node < 256; node++)
+    {
+        int32_t position;
+        uint8_t status;
+
+        if (!bus->thread.virtualNode((uint8_t)node, &position, &status))
+            continue;
+
+        printf("%s\n          { \"node\": %d, \"position\": %d, \"control\": %d }", first ? "" : ",", node, position, status);
+        first = false;
+    }
+
+    printf("%s]\n      },\n", first ? "" : "\n        ");
+}
+
+
+static void printBus(const Bus *bus, const char *status, int16_t result, bool ran)
+{
+    uint8_t index = bus->thread.bus();
+
+    printf("    {\n");
+    printf("      \"bus\": %d,\n", index);
+    printf("      \"device\": %s,\n", jsonString(bus->device).toUtf8().constData());
+    printf("      \"script\": %s,\n", jsonString(bus->script).toUtf8().constData());
+    printf("      \"status\": \"%s\",\n", status);
+    printf("      \"result\": %d,\n", result);
+    printf("      \"steps\": %llu,\n", (unsigned long long)bus->steps.load());
+
+    // File & line of the last label run, or of the directive the script failed to load at
+    QString source = ran ? bus->thread.source(bus->label) : bus->thread.errorSource();
+    printf("      \"source\": %s,\n", jsonString(source).toUtf8().constData());
+    printf("      \"local_errors\": %u,\n", bus->localErrors.load());
+    printf("      \"node_errors\": %u,\n", bus->nodeErrors.load());
+
+    if (ran)
+    {
+        const JitterStats &jitter = bus->thread.jitterStats();
+
+        printf("      \"jitter_us\": { \"count\": %llu, \"min\": %lld, \"avg\": %lld, \"max\": %lld },\n",
+               (unsigned long long)jitter.count(), (long long)jitter.min(), (long long)jitter.average(), (long long)jitter.max());
+
+        static const char *PRIORITY_NAMES[MMSCRIPT_PRIORITY_COUNT] = { "stop", "motion", "config", "poll" };
+
+        printf("      \"scheduler\": {");
+
+        for (int priority = 0; priority < MMSCRIPT_PRIORITY_COUNT; priority++)
+        {
+            MMSCRIPT_SCHEDULER_STATS stats = bus->thread.schedulerStats((MMSCRIPT_PRIORITY)priority);
+
+            printf("%s\n        \"%s\": { \"transactions\": %u, \"avg_latency_us\": %llu, \"max_latency_us\": %u, \"bus_us\": %llu, \"wire_us\": %llu }",
+                   priority ? "," : "", PRIORITY_NAMES[priority], stats.transactions,
+                   (unsigned long long)(stats.transactions ? stats.total_latency_us / stats.transactions : 0),
+                   stats.max_latency_us, (unsigned long long)stats.busy_us, (unsigned long long)stats.wire_us);
+        }
+
+        printf("\n      },\n");
+
+        MMSCRIPT_STREAM_STATS stream = bus->thread.streamStats();
+
+        printf("      \"stream\": { \"frames\": %u, \"sent\": %u, \"late\": %u, \"underruns\": %u, \"errors\": %u, \"max_late_us\": %u },\n",
+               stream.frames, stream.sent, stream.late, stream.underruns, stream.errors, stream.max_late_us);
+
+        MMSCRIPT_OPTIMIZE_REPORT optimized = bus->thread.optimizeReport();
+
+        printf("      \"optimized\": { \"folded\": %u, \"merged_delays\": %u, \"threaded_jumps\": %u, \"inlined_calls\": %u, \"removed_lines\": %u },\n",
+               optimized.folded, optimized.merged_delays, optimized.threaded_jumps, optimized.inlined_calls, optimized.removed_lines);
+
+        MMSCRIPT_GEAR_STATS gear = bus->thread.gearStats();
+
+        printf("      \"gear\": { \"updates\": %u, \"errors\": %u, \"avg_latency_us\": %llu, \"max_latency_us\": %u, \"max_interval_us\": %u },\n",
+               gear.updates, gear.errors, (unsigned long long)(gear.updates ? gear.total_latency_us / gear.updates : 0),
+               gear.max_latency_us, gear.max_interval_us);
+
+        if (dryRun)
+            printDryRun(bus);
+    }
+
+    printf("      \"nodes\": [");
+
+    bool first = true;
+
+    for (int node = 1; node < 256; node++)
+    {
+        MMSCRIPT_RTT_STATS stats;
+        MMScript_GetBusRttStats(index, (uint8_t)node, &stats);
+
+        if (stats.samples == 0 && stats.timeouts == 0)
+            continue;
+
+        printf("%s\n        { \"node\": %d, \"rtt_samples\": %u, \"rtt_timeouts\": %u, \"srtt_us\": %u, \"rttvar_us\": %u, \"timeout_ms\": %u }",
+               first ? "" : ",", node, stats.samples, stats.timeouts, stats.srtt_us, stats.rttvar_us, stats.timeout_ms);
+        first = false;
+    }
+
+    printf("%s]\n    }", first ? "" : "\n      ");
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);   // Arguments & translations only, its event loop is never run
+
+    QCommandLineParser parser;
+    QCommandLineOption deviceOption(QStringList() << "d" << "device", QObject::tr("Serial device, or pty of a simulator. Repeat for each bus, in the order of scripts."), "device");
+    QCommandLineOption baudOption(QStringList() << "b" << "baud", QObject::tr("Baud rate of all buses."), "baud", "115200");
+    QCommandLineOption verboseOption(QStringList() << "v" << "verbose", QObject::tr("Log executed commands to stderr."));
+    QCommandLineOption statusOption(QStringList() << "s" << "status", QObject::tr("Print status of all buses to stderr every interval ms."), "interval", "0");
+    QCommandLineOption asyncOption("async", QObject::tr("Run bus commands on an executor thread, FORKed tasks go on while one waits for a response."));
+    QCommandLineOption pollShareOption("poll-share", QObject::tr("Max share of bus time in % for status polls with --async."), "percent", "25");
+    QCommandLineOption telemetryOption("telemetry", QObject::tr("Poll status of the nodes of each bus in the background, one node every interval ms, WAIT reads it from there."), "interval", "0");
+    QCommandLineOption positionOption("telemetry-position", QObject::tr("Also poll the position with --telemetry."));
+    QCommandLineOption realTimeOption("realtime", QObject::tr("Run script & I/O threads in real-time mode (SCHED_FIFO, mlockall)."));
+    QCommandLineOption priorityOption("rt-priority", QObject::tr("SCHED_FIFO priority of script threads, I/O threads get one more."), "priority", "80");
+    QCommandLineOption cpuOption("rt-cpu", QObject::tr("CPUs to pin script threads to, one per bus, comma separated."), "cpus", "");
+    QCommandLineOption ioCpuOption("io-cpu", QObject::tr("CPUs to pin I/O threads to, one per bus, comma separated."), "cpus", "");
+    QCommandLineOption noOptimizeOption("no-optimize", QObject::tr("Run scripts as written, without folding constants, merging DELAYs, threading jumps, inlining CALLs & removing unreachable lines. mms2c must be given the same option."));
+    QCommandLineOption dryRunOption("dry-run", QObject::tr("Run scripts on simulated nodes & a virtual clock, without devices, as fast as they execute."));
+    QCommandLineOption limitOption("limit", QObject::tr("Virtual time a dry run is stopped at, 0 to run until END."), "seconds", "0");
+    QCommandLineOption commandUsOption("command-us", QObject::tr("Bus time of one API call in a dry run."), "us", QString::number(DRY_RUN_COMMAND_US));
+    QCommandLineOption profileOption("profile", QObject::tr("Profile of the simulated nodes until set by the script, counts/s & counts/s^2; moves are done at once by default."), "velocity,acceleration", "");
+    QCommandLineOption timelineOption("timeline", QObject::tr("Write lines & calls of a dry run with their virtual time to a CSV file."), "file");
+    QCommandLineOption nativeOption("native", QObject::tr("Shared library compiled from the script by mms2c. Repeat for each bus, in the order of scripts."), "library");
+
+    parser.setApplicationDescription(QObject::tr("Run MemeServo scripts headless, one per bus, & print a JSON summary."));
+    parser.addHelpOption();
+    parser.addOption(deviceOption);
+    parser.addOption(baudOption);
+    parser.addOption(verboseOption);
+    parser.addOption(statusOption);
+    parser.addOption(asyncOption);
+    parser.addOption(pollShareOption);
+    parser.addOption(telemetryOption);
+    parser.addOption(positionOption);
+    parser.addOption(realTimeOption);
+    parser.addOption(priorityOption);
+    parser.addOption(cpuOption);
+    parser.addOption(ioCpuOption);
+    parser.addOption(noOptimizeOption);
+    parser.addOption(nativeOption);
+    parser.addOption(dryRunOption);
+    parser.addOption(limitOption);
+    parser.addOption(commandUsOption);
+    parser.addOption(profileOption);
+    parser.addOption(timelineOption);
+    parser.addPositionalArgument("scripts", QObject::tr("Script file to run on each bus."), "<script>...");
+    parser.process(app);
+
+    QStringList devices = parser.values(deviceOption);
+    QStringList scripts = parser.positionalArguments();
+    QStringList natives = parser.values(nativeOption);
+
+    dryRun = parser.isSet(dryRunOption);
+
+    if (scripts.size() == 0 || (!dryRun && devices.size() != scripts.size()) || scripts.size() > MMSCRIPT_MAX_BUSES ||
+        (natives.size() > 0 && natives.size() != scripts.size()))
+    {
+        fprintf(stderr, "usage: mmsplay -d <device> [-d <device>...] [--native <library>...] [options] <script> [<script>...]\n");
+        fprintf(stderr, "       mmsplay --dry-run [--limit <seconds>] [--profile <velocity>,<acceleration>] [--timeline <file>] [options] <script> [<script>...]\n");
+        return EXIT_SETUP_ERROR;
+    }
+
+    MMSCRIPT_VIRTUAL_CONFIG virtualConfig;
+    memset(&virtualConfig, 0, sizeof(virtualConfig));
+
+    if (dryRun)
+    {
+        QStringList profile = parser.value(profileOption).split(",");
+
+        virtualConfig.command_us = parser.value(commandUsOption).toUInt();
+        virtualConfig.limit_us = (uint64_t)(parser.value(limitOption).toDouble() * 1000000.0);
+
+        if (profile.size() == 2)
+        {
+            virtualConfig.velocity = profile.at(0).toUInt();
+            virtualConfig.acceleration = profile.at(1).toUInt();
+        }
+
+        if (parser.isSet(timelineOption))
+        {
+            timeline = fopen(parser.value(timelineOption).toLocal8Bit().constData(), "w");
+
+            if (timeline == NULL)
+            {
+                perror("timeline");
+                return EXIT_SETUP_ERROR;
+            }
+
+            fprintf(timeline, "bus,time_us,event,node,value\n");
+        }
+    }
+
+    verbose = parser.isSet(verboseOption);
+    int statusInterval = parser.value(statusOption).toInt();
+
+    if (pipe(signalPipe) != 0 || pipe(donePipe) != 0)
+    {
+        perror("pipe");
+        return EXIT_SETUP_ERROR;
+    }
+
+    //
+    // Open & load all buses before any of them starts
+
+    std::vector<Bus*> buses;
+    int setupResult = EXIT_FINISHED;
+
+    for (int i = 0; i < scripts.size(); i++)
+    {
+        Bus *bus = new Bus((uint8_t)i);
+        RealTimeConfig scriptConfig, ioConfig;
+        QString error;
+
+        buses.push_back(bus);
+        bus->device = dryRun ? QString("dry-run") : devices.at(i);
+        bus->script = scripts.at(i);
+
+        if (parser.isSet(realTimeOption))
+        {
+            scriptConfig.enabled = true;
+            scriptConfig.priority = parser.value(priorityOption).toInt();
+            scriptConfig.cpu = cpuOf(parser.value(cpuOption), i);
+
+            // Responses must be drained ahead of the script thread consuming them
+            ioConfig = scriptConfig;
+            ioConfig.priority = scriptConfig.priority + 1;
+            ioConfig.cpu = cpuOf(parser.value(ioCpuOption), i);
+        }
+
+        bus->thread.setRealTimeConfig(scriptConfig);
+        bus->thread.setAsyncExecution(parser.isSet(asyncOption));
+        bus->thread.setBusScheduling(parser.value(baudOption).toInt(), parser.value(pollShareOption).toInt());
+        bus->thread.setTelemetryPolling(parser.value(telemetryOption).toInt(), parser.isSet(positionOption));
+        bus->thread.setOptimization(!parser.isSet(noOptimizeOption));
+        bus->link.setRealTimeConfig(ioConfig);
+        bus->link.setLinkDownCallback(onLinkDown);
+
+        if (dryRun)
+        {
+            if (timeline)
+                bus->thread.setDryRun(true, virtualConfig, [bus](const MMSCRIPT_VIRTUAL_EVENT &event) { onTrace(bus, event); });
+            else
+                bus->thread.setDryRun(true, virtualConfig);
+        }
+        else if (!bus->link.open(bus->device, parser.value(baudOption).toInt(),
+                            [bus](uint8_t data) { bus->thread.onSerialData(data); }, &error))
+        {
+            fprintf(stderr, "bus %d: %s\n", i, error.toLocal8Bit().constData());
+            setupResult = EXIT_SETUP_ERROR;
+            break;
+        }
+
+        int16_t startLabel = bus->thread.init(
+                    bus->script,
+                    [bus](int16_t label) { onLabel(bus, label); },
+                    [bus](uint8_t addr, uint8_t *data, uint8_t size) { Q_UNUSED(addr); return bus->link.send(data, size); },
+                    [bus](uint8_t node, uint8_t err) { onLocalError(bus, node, err); },
+                    [bus](uint8_t node, uint8_t err) { onNodeError(bus, node, err); },
+                    [bus](uint8_t node, const char *msg) { onLog(bus, node, msg); });
+
+        if (startLabel <= 0)
+        {
+            QString source = bus->thread.errorSource();
+
+            if (!source.isEmpty())
+                fprintf(stderr, "%s: ", source.toLocal8Bit().constData());
+
+            fprintf(stderr, "bus %d: failed when loading script '%s': %d\n", i, bus->script.toLocal8Bit().constData(), startLabel);
+            setupResult = EXIT_SETUP_ERROR;
+            break;
+        }
+
+        int16_t nativeResult = natives.isEmpty() ? 0 : bus->thread.loadNative(natives.at(i));
+
+        if (nativeResult != 0)
+        {
+            fprintf(stderr, "bus %d: failed when loading native script '%s': %d\n", i, natives.at(i).toLocal8Bit().constData(), nativeResult);
+            setupResult = EXIT_SETUP_ERROR;
+            break;
+        }
+    }
+
+    if (setupResult != EXIT_FINISHED)
+    {
+        printf("{\n  \"status\": \"setup_error\",\n  \"elapsed_us\": 0,\n  \"buses\": [\n");
+
+        for (size_t i = 0; i < buses.size(); i++)
+        {
+            buses[i]->link.close();
+            printBus(buses[i], "not_started", 0, false);
+            printf("%s\n", (i + 1 < buses.size()) ? "," : "");
+        }
+
+        printf("  ]\n}\n");
+        fflush(stdout);
+
+        for (Bus *bus : buses)
+            delete bus;
+
+        if (timeline)
+            fclose(timeline);
+
+        return setupResult;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (Bus *bus : buses)
+        bus->thread.start();
+
+    //
+    // Event loop
+
+    bool interrupted = false;
+    bool linkDown = false;
+    size_t running = buses.size();
+
+    while (running > 0)
+    {
+        struct pollfd fds[2];
+
+        fds[0].fd = signalPipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = donePipe[0];
+        fds[1].events = POLLIN;
+
+        int ret = poll(fds, 2, statusInterval > 0 ? statusInterval : -1);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("poll");
+            interrupted = true;
+            break;
+        }
+
+        if (ret == 0)
+        {
+            printStatus(buses);
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char c = WAKE_SIGNAL;
+
+            if (read(signalPipe[0], &c, 1) == 1 && c == WAKE_LINK_DOWN)
+                linkDown = true;
+
+            interrupted = true;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char c;
+
+            if (read(donePipe[0], &c, 1) == 1)
+                running--;
+        }
+    }
+
+    if (interrupted)
+    {
+        // Stop frames first on every bus, then unwind the scripts
+        for (Bus *bus : buses)
+        {
+            const std::vector<uint8_t> &frame = bus->thread.globalStopFrame();
+
+            if (!frame.empty() && !dryRun && !bus->link.sendUrgent(frame.data(), frame.size()))
+                fprintf(stderr, "bus %d: stop frame not sent, previous one still pending\n", bus->thread.bus());
+
+            bus->thread.requestStop();
+        }
+
+        for (Bus *bus : buses)
+        {
+            const std::vector<uint8_t> &frame = bus->thread.globalStopFrame();
+
+            bus->thread.stop();
+
+            if (!frame.empty() && !dryRun)
+                bus->link.send(frame.data(), frame.size());
+        }
+    }
+    else
+    {
+        for (Bus *bus : buses)
+            bus->thread.wait();
+    }
+
+    qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+
+    //
+    // Summary
+
+    int exitCode = linkDown ? EXIT_LINK_DOWN : (interrupted ? EXIT_INTERRUPTED : EXIT_FINISHED);
+    const char *overall = linkDown ? "link_down" : (interrupted ? "interrupted" : "finished");
+
+    for (Bus *bus : buses)
+    {
+        bus->link.close();
+
+        if (!interrupted && bus->thread.result() != 0)
+        {
+            exitCode = EXIT_SCRIPT_ERROR;
+            overall = "error";
+        }
+    }
+
+    printf("{\n");
+    printf("  \"status\": \"%s\",\n", overall);
+    printf("  \"elapsed_us\": %lld,\n", (long long)elapsedUs);
+    printf("  \"buses\": [\n");
+
+    for (size_t i = 0; i < buses.size(); i++)
+    {
+        Bus *bus = buses[i];
+        int16_t result = bus->thread.result();
+        const char *status = bus->link.isDown() ? "link_down" : (interrupted ? "interrupted" : (result == 0 ? "finished" : "error"));
+
+        printBus(bus, status, result, true);
+        printf("%s\n", (i + 1 < buses.size()) ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+    fflush(stdout);
+
+    for (Bus *bus : buses)
+        delete bus;
+
+    if (timeline)
+        fclose(timeline);
+
+    return exitCode;
+}
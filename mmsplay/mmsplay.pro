@@ -0,0 +1,54 @@
+#-------------------------------------------------
+#
+# Headless script runner, no GUI & no Qt event loop
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = mmsplay
+TEMPLATE = app
+
+INCLUDEPATH += ../user/ ..
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += main.cpp \
+    ../MemeServoAPI/MemeServoAPI.c \
+    ../user/ScriptThread.cpp \
+    ../user/ScriptProcessor.c \
+    ../user/ScriptCommands.c \
+    ../user/ScriptPreprocessor.c \
+    ../user/RttEstimator.c \
+    ../user/BusScheduler.c \
+    ../user/Telemetry.c \
+    ../user/TrajectoryStream.c \
+    ../user/TrajectoryGen.c \
+    ../user/ScriptEstimator.c \
+    ../user/VirtualBus.c \
+    ../user/RealTime.cpp \
+    ../user/SerialLink.cpp
+
+HEADERS += \
+    ../MemeServoAPI/MemeServoAPI.h \
+    ../user/ScriptProcessor.h \
+    ../user/ScriptCommands.h \
+    ../user/ScriptPreprocessor.h \
+    ../user/RttEstimator.h \
+    ../user/BusScheduler.h \
+    ../user/Telemetry.h \
+    ../user/TrajectoryStream.h \
+    ../user/TrajectoryGen.h \
+    ../user/ScriptEstimator.h \
+    ../user/VirtualBus.h \
+    ../user/ScriptThread.h \
+    ../user/RealTime.h \
+    ../user/SpscRing.h \
+    ../user/SerialLink.h
+
+include(../user/ApiInstance.pri)
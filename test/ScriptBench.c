@@ -0,0 +1,108 @@
+
+/* Interpreter vs the native program mms2c compiled from the same script, bus commands excluded */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#include "ScriptProcessor.h"
+
+
+extern const MMSCRIPT_NATIVE_PROGRAM mmscript_native_program;   /* ScriptBenchNative.c */
+
+
+static char *ReadScript(const char *path, size_t *size)
+{
+  FILE *file = fopen(path, "rb");
+  char *buf;
+  long length;
+
+  if (file == NULL)
+    return NULL;
+
+  fseek(file, 0, SEEK_END);
+  length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  buf = (char *)malloc(length + 1);
+
+  if (buf == NULL || fread(buf, 1, length, file) != (size_t)length)
+  {
+    free(buf);
+    fclose(file);
+    return NULL;
+  }
+
+  buf[length] = '\0';
+  *size = length + 1;
+
+  fclose(file);
+  return buf;
+}
+
+
+/* Seconds to run the script runs times */
+static double RunScript(uint32_t runs, uint64_t *steps)
+{
+  clock_t start = clock();
+  int16_t ret;
+
+  *steps = 0;
+
+  for (uint32_t i = 0; i < runs; i++)
+  {
+    MMScript_Rewind();
+
+    while ((ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL)) > 0)
+      (*steps)++;
+
+    if (ret < 0)
+    {
+      printf("script error %d\n", ret);
+      exit(-1);
+    }
+  }
+
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *path = (argc > 1) ? argv[1] : "ScriptBench.txt";
+  uint32_t runs = (argc > 2) ? (uint32_t)atoi(argv[2]) : 20;
+  uint64_t interpreted_steps, native_steps;
+  double interpreted_s, native_s;
+  size_t size;
+  char *buf;
+
+  buf = ReadScript(path, &size);
+
+  /* Optimized as mms2c does by default, for the hash to match */
+  MMScript_SetOptimize(1);
+
+  if (buf == NULL || MMScript_ParseScript(buf, size) <= 0)
+  {
+    printf("can't load %s\n", path);
+    return -1;
+  }
+
+  interpreted_s = RunScript(runs, &interpreted_steps);
+
+  if (MMScript_AttachNative(&mmscript_native_program) != 0)
+  {
+    printf("ScriptBenchNative.c not compiled from %s\n", path);
+    return -1;
+  }
+
+  native_s = RunScript(runs, &native_steps);
+
+  printf("interpreted: %llu steps, %.3f s, %.1f ns/step\n", (unsigned long long)interpreted_steps, interpreted_s, interpreted_s * 1e9 / interpreted_steps);
+  printf("native:      %llu steps, %.3f s, %.1f ns/step\n", (unsigned long long)native_steps, native_s, native_s * 1e9 / native_steps);
+  printf("speedup:     %.1fx\n", (native_s > 0) ? interpreted_s / native_s : 0.0);
+
+  MMScript_Clean();
+  return (interpreted_steps == native_steps) ? 0 : -1;
+}
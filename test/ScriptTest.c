@@ -2,9 +2,31 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
-
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MKDIR(dir) _mkdir(dir)
+#define RMDIR(dir) _rmdir(dir)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define MKDIR(dir) mkdir(dir, 0755)
+#define RMDIR(dir) rmdir(dir)
+#endif
 
 #include "ScriptProcessor.h"
+#include "RttEstimator.h"
+#include "BusScheduler.h"
+#include "Telemetry.h"
+#include "TrajectoryStream.h"
+#include "TrajectoryGen.h"
+#include "ScriptCompiler.h"
+#include "ScriptCommands.h"
+#include "ScriptPreprocessor.h"
+#include "ScriptEstimator.h"
+#include "VirtualBus.h"
+#include "ApiInstance.h"
 
 #define SCRIPT_ASSERT(test_id, result)                 \
 {                                                      \
@@ -18,6 +40,178 @@
 }
 
 
+static uint64_t fake_us = 0;
+static uint32_t fake_rtt_us = 0;
+
+static uint64_t FakeMicroSeconds(void)
+{
+  fake_us += fake_rtt_us;
+  return fake_us;
+}
+
+static uint64_t FakeClock(void)
+{
+  return fake_us;
+}
+
+static MMSCRIPT_TRANSACTION *submitted = NULL;
+
+static void FakeSubmit(MMSCRIPT_TRANSACTION *transaction)
+{
+  submitted = transaction;
+}
+
+static void FakeWaitCompletion(uint64_t deadline_us)
+{
+  (void)deadline_us;
+}
+
+/* Executor thread run in place: completes the transaction submitted */
+static void RunSubmitted(uint64_t deadline_us)
+{
+  (void)deadline_us;
+  if (submitted && !MMScript_TransactionDone(submitted))
+    MMScript_RunTransaction(submitted, NULL, NULL, NULL, NULL);
+}
+
+static uint64_t last_deadline_us = 0;
+
+static void FakeDelayUntil(uint64_t deadline_us)
+{
+  last_deadline_us = deadline_us;
+  if (fake_us < deadline_us)
+    fake_us = deadline_us;
+}
+
+static uint32_t telemetry_delays = 0;
+
+/* Poller stand-in: node 1 in position after 3 delays of WAIT, polled as the fake clock goes */
+static void TelemetryDelay(uint32_t ms)
+{
+  MMSCRIPT_NODE_STATUS status = { MMS_CTRL_STATUS_POSITION_CONTROL, 0, 0, 0, 0, 0, 0 };
+
+  fake_us += (uint64_t)ms * 1000;
+  telemetry_delays++;
+
+  status.in_position = (telemetry_delays >= 3);
+  status.sampled_us = fake_us;
+  MMScript_TelemetryPublish(0, 1, &status);
+}
+
+
+/* Poller stand-in: node 1 moves 200 counts per delay of UNTIL */
+static void PositionDelay(uint32_t ms)
+{
+  MMSCRIPT_NODE_STATUS status = { MMS_CTRL_STATUS_POSITION_CONTROL, 0, 1, 0, 0, 0, 0 };
+
+  fake_us += (uint64_t)ms * 1000;
+  telemetry_delays++;
+
+  status.position = (int32_t)telemetry_delays * 200;
+  status.sampled_us = fake_us;
+  MMScript_TelemetryPublish(0, 1, &status);
+}
+
+
+/* Poller: stub node stays at 0, in position */
+static void PollerDelay(uint32_t ms)
+{
+  fake_us += (uint64_t)ms * 1000;
+  telemetry_delays++;
+
+  MMScript_PollTelemetry(1, 1, NULL);
+}
+
+
+/* Poller: stub nodes 1 to 3 stay at 0 */
+static void GearDelay(uint32_t ms)
+{
+  fake_us += (uint64_t)ms * 1000;
+
+  for (uint8_t node=1; node<=3; node++)
+    MMScript_PollTelemetry(node, 1, NULL);
+}
+
+
+static uint32_t link_down_calls = 0;
+static uint32_t retry_delays[64];
+static uint32_t retry_delay_count = 0;
+static uint32_t retry_errors = 0;
+
+/* Node of a bus whose link is down */
+static uint8_t LinkDownMove(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+  (void)node_addr;
+  (void)position;
+  (void)callback;
+  link_down_calls++;
+  return MMS_RESP_FAIL;
+}
+
+static void RetryDelay(uint32_t ms)
+{
+  if (retry_delay_count < sizeof(retry_delays) / sizeof(retry_delays[0]))
+    retry_delays[retry_delay_count++] = ms;
+}
+
+static void RetryError(uint8_t node_addr, uint8_t err)
+{
+  (void)node_addr;
+  (void)err;
+  retry_errors++;
+}
+
+
+static uint32_t virtual_moves = 0;
+static uint32_t virtual_errors = 0;
+
+/* Timeline of the dry run: moves of node 2 */
+static void VirtualTrace(const MMSCRIPT_VIRTUAL_EVENT *event)
+{
+  if (event->type == MMSCRIPT_VIRTUAL_ABSOLUTE_POSITION_MOVE && event->node == 2)
+    virtual_moves++;
+}
+
+
+static void VirtualError(uint8_t node_addr, uint8_t err)
+{
+  (void)node_addr;
+  (void)err;
+  virtual_errors++;
+}
+
+
+/* Lines of script26 as mms2c would compile them, but for values telling them apart */
+static int16_t NativeLet(MMSCRIPT_NATIVE_FRAME *f)
+{
+  f->vars[0] = 5;
+  return 0;
+}
+
+static int16_t NativeCommands(MMSCRIPT_NATIVE_FRAME *f)
+{
+  f->ops[0].type = MMSCRIPT_OP_AP;
+  f->ops[0].node = 0x01;
+  f->ops[0].args[0] = f->vars[0];
+  f->ops[1].type = MMSCRIPT_OP_STOP;
+  f->ops[1].node = 0x02;
+  f->opCount = 2;
+  return 0;
+}
+
+static int16_t NativeGoto(MMSCRIPT_NATIVE_FRAME *f)
+{
+  f->nextLabel = 7;
+  f->nextLine = 6;
+  return 0;
+}
+
+static const MMSCRIPT_NATIVE_LINE native_lines[10] =
+{
+  NativeLet, NativeCommands, NULL, NULL, NULL, NativeGoto, NULL, NULL, NULL, NULL
+};
+
+
 int main(int argc, char **argv)
 {
   (void)argc;
@@ -121,6 +315,174 @@ int main(int argc, char **argv)
   char script13[] =
   " 1: RET\r\n";
 
+  char script14[] =
+  "1: RETRY LINK,3,0,0,4\r\n"
+  "2: RETRY SERVO,0,10,100\r\n"
+  "3: RETRY SERVO,0,100,10\r\n"
+  "4: RETRY BUS,3,0,0\r\n";
+
+  char script15[] =
+  "1: PERIOD 10\r\n"
+  "2: UDELAY 250\r\n"
+  "3: GOTO 1\r\n";
+
+  char script16[] =
+  "1: FORK 10\r\n"
+  "2: LET A = 1\r\n"
+  "3: JOIN\r\n"
+  "4: END\r\n"
+  "10: LET B = 2\r\n"
+  "11: DELAY 5\r\n"
+  "12: END\r\n";
+
+  char script17[] =
+  "1: 1,HALT;2,HALT;3,HALT;4,HALT;5,HALT;6,HALT;7,HALT;8,HALT;9,HALT;A,HALT;B,HALT;C,HALT;D,HALT;E,HALT;F,HALT;10,HALT;11,HALT\r\n"
+  "2: 1,HALT;2,FOO\r\n"
+  "3: 1,HALT;2,STOP\r\n";
+
+  char script19[] =
+  "1: UNTIL 1,POS > 500\r\n"
+  "2: UNTIL 1,VEL < 100\r\n"
+  "3: END\r\n";
+
+  char script20[] =
+  "1: BLEND 1,2000\r\n"
+  "2: 1,AP 1000;1,RP 500\r\n"
+  "3: WAIT 1\r\n"
+  "4: BLEND 1,0\r\n"
+  "5: END\r\n";
+
+  char script21[] =
+  "1: STREAM stream_test.mmst\r\n"
+  "2: END\r\n";
+
+  char script22[] =
+  "1: SCURVE 10000,100000,1000000,1000;1,1000\r\n"
+  "2: SPLINE 50,1000;1,100,300,0\r\n"
+  "3: SPLINE 50,1000;1,100;2,100,200\r\n"
+  "4: END\r\n";
+
+  char script23[] =
+  "1: GEAR 2,1,3,2\r\n"
+  "2: CAM 3,1,1000,0,100,0,-100\r\n"
+  "3: GEAR 2,0\r\n"
+  "4: GEAR 2,1,1,0\r\n"
+  "5: END\r\n";
+
+  char script24[] =
+  "1: TABLE T,I32,1000,-2000,30000\r\n"
+  "2: TABLE T,I32,5\r\n"
+  "3: TABLE S,I8,FILE \"table test.bin\"\r\n"
+  "4: LET I=1\r\n"
+  "5: LET A=T[I]+S[2]+2003\r\n"
+  "6: IF (A==0) THEN 8\r\n"
+  "7: END\r\n"
+  "8: 1,AP T[I];1,PAP S[0],S[ 1 ],U[0]\r\n"
+  "9: IF (T[3]==5) THEN 11\r\n"
+  "10: END\r\n"
+  "11: LET A=T[4]\r\n"
+  "12: END\r\n"
+  "13: TABLE U,I32,70000\r\n";
+
+  char script25[] =
+  "1: LET S=0\r\n"
+  "2: FOR I=1 TO 3\r\n"
+  "3: FOR J=0 TO 10 STEP 5\r\n"
+  "4: LET S=S+1\r\n"
+  "5: NEXT J\r\n"
+  "6: NEXT\r\n"
+  "7: IF (S==9) THEN 9\r\n"
+  "8: END\r\n"
+  "9: FOR K=5 TO 1\r\n"
+  "10: LET S=0\r\n"
+  "11: NEXT K\r\n"
+  "12: IF (S==9) THEN 14\r\n"
+  "13: END\r\n"
+  "14: IF (I==3) THEN 16\r\n"
+  "15: END\r\n"
+  "16: END\r\n";
+
+  char script26[] =
+  "1: LET A=2\r\n"
+  "2: 1,AP A;2,STOP\r\n"
+  "3: LET B=A\r\n"
+  "4: IF (B==5) THEN 6\r\n"
+  "5: END\r\n"
+  "6: GOTO 1\r\n"
+  "7: END\r\n"
+  "8: WAIT 1\r\n"
+  "9: LET C=T[1]\r\n";
+
+  char script27[] =
+  "1: LETA=1\r\n"
+  "2: IF (A==1) THEN 4\r\n"
+  "3: END\r\n"
+  "4: 1,PVM A,2;2,VM A\r\n";
+
+  char script28[] =
+  "1: LET A=2*3+1\r\n"
+  "2: IF (1==1) THEN 4\r\n"
+  "3: LET A=0\r\n"
+  "4: DELAY 10\r\n"
+  "5: DELAY 20\r\n"
+  "6: CALL 20\r\n"
+  "7: IF (2>3) THEN 3\r\n"
+  "8: GOTO 10\r\n"
+  "9: END\r\n"
+  "10: GOTO 12\r\n"
+  "11: END\r\n"
+  "12: IF (B==8) THEN 14\r\n"
+  "13: END\r\n"
+  "14: END\r\n"
+  "20: LET B=A+1\r\n"
+  "21: RET\r\n";
+
+  char script29[] =
+  "#CONST SPEED 2000\r\n"
+  "#CONST FAST SPEED*2+100\r\n"
+  "#CONST BACK 0-500\r\n"
+  "#MACRO SCALE(DEST,FACTOR) LET DEST=DEST*FACTOR\r\n"
+  "#MACRO MOVE(NODE,TARGET) NODE,PAP FAST,SPEED,TARGET\r\n"
+  "1: LET A=SPEED/2\r\n"
+  "2: SCALE(A,FAST/1000)\r\n"
+  "3: LET B=A+FAST\r\n"
+  "4: CALL 100\r\n"
+  "5: END\r\n"
+  "6: MOVE(2,BACK);MOVE(3,SPEED)\r\n"
+  "#INCLUDE \"pre_test.inc\"\r\n";
+
+  char script29_inc[] =
+  "#CONST EXPECTED 8100\r\n"
+  "100: IF (B!=EXPECTED) THEN 102\r\n"
+  "101: RET\r\n"
+  "102: END\r\n";
+
+  char script30[] =
+  "1: 2,AP 10000\r\n"
+  "2: WAIT 2\r\n"
+  "3: DELAY 10\r\n"
+  "4: FOR I=1 TO 5\r\n"
+  "5: 3,RP 400\r\n"
+  "6: DELAY 5\r\n"
+  "7: NEXT I\r\n"
+  "8: 2,AP 0\r\n"
+  "9: UNTIL 2,POS < 5000\r\n"
+  "10: DELAY 20\r\n"
+  "11: GOTO 8\r\n";
+
+  char script31[] =
+  "1: LET A=0\r\n"
+  "2: 2,AP 10000\r\n"
+  "3: WAIT 2\r\n"
+  "4: LET A=A+1\r\n"
+  "5: 2,AP 0\r\n"
+  "6: WAIT 2\r\n"
+  "7: GOTO 2\r\n";
+
+  char script18[] =
+  "1: WAIT 1\r\n"
+  "2: END\r\n";
+
   
   int16_t ret;
 
@@ -536,8 +898,1333 @@ int main(int argc, char **argv)
   ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
   printf("return value = %d\n", ret);
   SCRIPT_ASSERT(2, ret == MMS_ERR_EMPTY_STACK);
-  
-  
+
+
+  /* Script 14 */
+  printf("\n---------------------------------------\n");
+  printf("script 14 : \n%s\n", script14);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script14, strlen(script14) + 1);
+  printf("return value = %d\n", ret);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  printf("test %d: %s\n", 2, "RETRY");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  printf("return value = %d\n", ret);
+  SCRIPT_ASSERT(2, ret == 2);
+
+  {
+    MMSCRIPT_RETRY_POLICY policy;
+    MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &policy);
+    SCRIPT_ASSERT(3, policy.max_attempts == 3 && policy.initial_delay_ms == 0 && policy.error_label == 4);
+  }
+
+  printf("test %d: %s\n", 4, "RETRY");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  printf("return value = %d\n", ret);
+  SCRIPT_ASSERT(4, ret == 3);
+
+  printf("test %d: %s\n", 5, "RETRY");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  printf("return value = %d\n", ret);
+  SCRIPT_ASSERT(5, ret == MMS_ERR_MISSING_RETRY_PARAM);
+
+  MMScript_SetLabelToExec(4);
+  printf("test %d: %s\n", 6, "RETRY");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  printf("return value = %d\n", ret);
+  SCRIPT_ASSERT(6, ret == MMS_ERR_MISSING_RETRY_PARAM);
+
+  {
+    MMSCRIPT_VIRTUAL_CONFIG config = { 0, 0, 0, 0, 0, 0 };
+    MMSCRIPT_RETRY_POLICY policy, host;
+    MMSCRIPT_BUS bus = *MMScript_VirtualBus();
+    char *retry;
+
+    bus.AbsolutePositionMove = LinkDownMove;
+    MMScript_VirtualInit(0, &config, NULL);
+    MMScript_SetBus(&bus);
+
+    /* Doubled up to the max, local error on the first failure & when giving up */
+    printf("test %d: %s\n", 7, "Backoff sequence");
+    retry = strdup("1: RETRY LINK,5,10,40,3\r\n2: 2,AP 100\r\n3: END\r\n");
+    ret = MMScript_ParseScript(retry, strlen(retry) + 1);
+    SCRIPT_ASSERT(7, ret == 1 && MMScript_ExecOneStep(RetryError, NULL, RetryDelay, NULL) == 2);
+
+    ret = MMScript_ExecOneStep(RetryError, NULL, RetryDelay, NULL);
+    SCRIPT_ASSERT(8, link_down_calls == 5 && retry_delay_count == 4 && retry_errors == 2);
+    SCRIPT_ASSERT(9, retry_delays[0] == 10 && retry_delays[1] == 20 && retry_delays[2] == 40 && retry_delays[3] == 40);
+
+    printf("test %d: %s\n", 10, "Escalated to the error label");
+    SCRIPT_ASSERT(10, ret == 3);
+
+    printf("test %d: %s\n", 11, "Policy of the script until rewound");
+    MMScript_Rewind();
+    MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &policy);
+    SCRIPT_ASSERT(11, policy.max_attempts == 0 && policy.initial_delay_ms == 2 && policy.error_label == 0);
+    MMScript_Clean();
+
+    /* Doubling past UINT32_MAX / 2 must not wrap to 0 */
+    printf("test %d: %s\n", 12, "Max delay near UINT32_MAX");
+    link_down_calls = 0;
+    retry_delay_count = 0;
+    retry = strdup("1: RETRY LINK,40,1,4294967295\r\n2: 2,AP 100\r\n3: END\r\n");
+    ret = MMScript_ParseScript(retry, strlen(retry) + 1);
+    MMScript_ExecOneStep(RetryError, NULL, RetryDelay, NULL);
+    ret = MMScript_ExecOneStep(RetryError, NULL, RetryDelay, NULL);
+    SCRIPT_ASSERT(12, ret == MMS_ERR_RETRY_EXHAUSTED && link_down_calls == 40 && retry_delay_count == 39);
+    SCRIPT_ASSERT(13, retry_delays[31] == 2147483648u && retry_delays[32] == 4294967295u && retry_delays[38] == 4294967295u);
+    MMScript_Clean();
+
+    /* Transaction runs with the policy of its line, not the one set meanwhile */
+    printf("test %d: %s\n", 14, "Policy as submitted");
+    link_down_calls = 0;
+    submitted = NULL;
+    MMScript_Rewind();
+    MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &host);
+    MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+    MMScript_SetExecutor(FakeSubmit, FakeWaitCompletion);
+    retry = strdup("1: RETRY LINK,3,0,0\r\n2: 2,AP 100\r\n3: END\r\n");
+    ret = MMScript_ParseScript(retry, strlen(retry) + 1);
+    MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    policy.max_attempts = 1;
+    policy.initial_delay_ms = 0;
+    policy.max_delay_ms = 0;
+    policy.error_label = 0;
+    MMScript_SetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &policy);
+    MMScript_RunTransaction(submitted, NULL, NULL, RetryDelay, NULL);
+    SCRIPT_ASSERT(14, ret == 2 && submitted != NULL && link_down_calls == 3);
+    MMScript_SetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &host);
+    MMScript_Rewind();
+    MMScript_Clean();
+
+    /* END of the main task waits for the transaction of a parked child */
+    printf("test %d: %s\n", 15, "Drained at END");
+    link_down_calls = 0;
+    submitted = NULL;
+    MMScript_SetBus(MMScript_VirtualBus());
+    MMScript_SetExecutor(FakeSubmit, RunSubmitted);
+    retry = strdup("1: FORK 10\r\n2: DELAY 1\r\n3: END\r\n10: 2,AP 100\r\n11: DELAY 1000\r\n12: END\r\n");
+    ret = MMScript_ParseScript(retry, strlen(retry) + 1);
+    for (int i=0; i<10 && ret > 0; i++)
+      ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(15, ret == 0 && submitted != NULL && MMScript_TransactionDone(submitted));
+    submitted = NULL;
+
+    MMScript_SetExecutor(NULL, NULL);
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Rewind();
+
+    MMScript_SetBus(NULL);
+    MMScript_Clean();
+  }
+
+
+  /* RTT estimator */
+  printf("\n---------------------------------------\n");
+  printf("RTT estimator\n");
+
+  {
+    MMSCRIPT_RTT_STATS stats;
+    int i;
+
+    MMScript_RttInit(FakeMicroSeconds, NULL, NULL);
+    MMScript_GetRttStats(2, &stats);
+    SCRIPT_ASSERT(1, stats.timeout_ms == MMSCRIPT_RTT_DEFAULT_CEILING_MS);
+
+    fake_rtt_us = 2000;
+    for (i=0; i<32; i++)
+    {
+      MMScript_RttBegin(2);
+      MMScript_RttEnd(2, MMS_RESP_SUCCESS, 0);
+    }
+
+    MMScript_GetRttStats(2, &stats);
+    printf("srtt = %u, rttvar = %u, timeout = %u\n", stats.srtt_us, stats.rttvar_us, stats.timeout_ms);
+    SCRIPT_ASSERT(2, stats.samples == 32 && stats.srtt_us == 2000);
+    SCRIPT_ASSERT(3, stats.timeout_ms == MMSCRIPT_RTT_DEFAULT_FLOOR_MS);
+
+    fake_rtt_us = stats.timeout_ms * 1000;
+    MMScript_RttBegin(2);
+    MMScript_RttEnd(2, MMS_RESP_TIMEOUT, 0);
+    MMScript_GetRttStats(2, &stats);
+    SCRIPT_ASSERT(4, stats.timeouts == 1 && stats.timeout_ms == 2 * MMSCRIPT_RTT_DEFAULT_FLOOR_MS);
+
+    /* Error responses in time are no timeouts */
+    fake_rtt_us = 2000;
+    MMScript_RttBegin(2);
+    MMScript_RttEnd(2, MMS_RESP_SERVO_ERROR, 0);
+    MMScript_GetRttStats(2, &stats);
+    SCRIPT_ASSERT(5, stats.timeouts == 1 && stats.timeout_ms == 2 * MMSCRIPT_RTT_DEFAULT_FLOOR_MS);
+
+    MMScript_RttBegin(2);
+    MMScript_RttEnd(2, MMS_RESP_SUCCESS, 1);
+    MMScript_GetRttStats(2, &stats);
+    SCRIPT_ASSERT(6, stats.samples == 32);
+
+    /* Commands of another bus in between don't restart the timing */
+    {
+      MMSCRIPT_CONTEXT *ctx = MMScript_CreateContext(1);
+
+      MMScript_SelectContext(ctx);
+      MMScript_RttInit(FakeClock, NULL, NULL);
+      MMScript_SelectContext(NULL);
+
+      fake_rtt_us = 0;
+      fake_us += 1000;
+      MMScript_RttBegin(2);
+      fake_us += 3000;
+      MMScript_SelectContext(ctx);
+      MMScript_RttBegin(2);
+      MMScript_RttEnd(2, MMS_RESP_SUCCESS, 0);
+      MMScript_SelectContext(NULL);
+      MMScript_RttEnd(2, MMS_RESP_SUCCESS, 0);
+
+      MMScript_GetRttStats(2, &stats);
+      printf("test %d: %s\n", 7, "Timing per bus");
+      SCRIPT_ASSERT(7, stats.samples == 33 && stats.last_rtt_us == 3000);
+      MMScript_GetBusRttStats(1, 2, &stats);
+      SCRIPT_ASSERT(8, stats.samples == 1 && stats.last_rtt_us == 0);
+
+      MMScript_SelectContext(ctx);
+      MMScript_RttInit(NULL, NULL, NULL);
+      MMScript_SelectContext(NULL);
+      MMScript_DestroyContext(ctx);
+    }
+
+    MMScript_RttInit(NULL, NULL, NULL);
+  }
+
+
+  /* Script 15 */
+  printf("\n---------------------------------------\n");
+  printf("script 15 : \n%s\n", script15);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script15, strlen(script15) + 1);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  fake_us = 1000;
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+
+  printf("test %d: %s\n", 2, "PERIOD");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(2, ret == 2 && last_deadline_us == 11000);
+
+  printf("test %d: %s\n", 3, "UDELAY");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(3, ret == 3 && last_deadline_us == 11250);
+
+  fake_us += 3000;  /* Loop body time */
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(4, ret == 1);
+
+  printf("test %d: %s\n", 5, "PERIOD");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(5, ret == 2 && last_deadline_us == 21000);
+
+  fake_us += 50000;  /* Overrun, re-anchor */
+  MMScript_SetLabelToExec(1);
+  printf("test %d: %s\n", 6, "PERIOD");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(6, ret == 2 && last_deadline_us == 81000);
+
+  /* Two tasks looping on the same PERIOD line, each one keeps its own deadline */
+  {
+    char *forked = strdup("1: FORK 2\r\n2: PERIOD 10\r\n3: GOTO 2\r\n");
+    int i;
+
+    fake_us = 1000;
+    ret = MMScript_ParseScript(forked, strlen(forked) + 1);
+
+    printf("test %d: %s\n", 7, "PERIOD per task");
+    for (i=0; i<7; i++)
+      ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(7, ret == 3 && fake_us == 11000);
+
+    for (i=0; i<5; i++)
+      ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(8, ret == 3 && fake_us == 31000);
+
+    MMScript_Clean();
+  }
+
+  MMScript_SetTimeBase(NULL, NULL);
+
+
+  /* Script 16 */
+  printf("\n---------------------------------------\n");
+  printf("script 16 : \n%s\n", script16);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script16, strlen(script16) + 1);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  fake_us = 1000;
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+
+  printf("test %d: %s\n", 2, "FORK");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(2, ret == 2);
+
+  /* Tasks alternate line by line, the label of the main task is returned */
+  {
+    int16_t vars[26];
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    MMScript_GetVariables(vars);
+    SCRIPT_ASSERT(3, ret == 2 && vars['B' - 'A'] == 2);
+  }
+
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(4, ret == 3);
+
+  printf("test %d: %s\n", 5, "DELAY yields");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(5, ret == 3 && fake_us == 1000);
+
+  printf("test %d: %s\n", 6, "JOIN");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(6, ret == 3);
+
+  /* Main task joining, sleep until the forked task is due, it ends */
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(7, ret == 3 && fake_us == 6000);
+
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(8, ret == 4);
+
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(9, ret == 0);
+
+  /* The forked task ends first, JOIN waits for the task it forked */
+  {
+    char *grandchild = strdup("1: FORK 10\r\n2: JOIN\r\n3: END\r\n10: FORK 20\r\n11: END\r\n20: DELAY 5\r\n21: LET C = 7\r\n22: END\r\n");
+    int16_t vars[26];
+    int i;
+
+    printf("test %d: %s\n", 10, "JOIN waits for grandchildren");
+    ret = MMScript_ParseScript(grandchild, strlen(grandchild) + 1);
+
+    for (i=0; i<20 && ret > 0; i++)
+      ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    MMScript_GetVariables(vars);
+    SCRIPT_ASSERT(10, ret == 0 && vars['C' - 'A'] == 7 && fake_us == 11000);
+
+    MMScript_Clean();
+  }
+
+  MMScript_SetTimeBase(NULL, NULL);
+
+
+  /* Script 17 */
+  printf("\n---------------------------------------\n");
+  printf("script 17 : \n%s\n", script17);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script17, strlen(script17) + 1);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+  MMScript_SetExecutor(FakeSubmit, FakeWaitCompletion);
+
+  printf("test %d: %s\n", 2, "Too many commands");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(2, ret == MMS_ERR_TOO_MANY_COMMANDS && submitted == NULL);
+
+  /* Whole line parsed before anything is sent */
+  MMScript_SetLabelToExec(2);
+  printf("test %d: %s\n", 3, "Unknown command");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(3, ret == MMS_ERR_UNKNOWN_COMMAND && submitted == NULL);
+
+  /* Task parked on its line until the transaction completes */
+  MMScript_SetLabelToExec(3);
+  printf("test %d: %s\n", 4, "Submit");
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(4, ret == 3 && submitted != NULL);
+
+  /* Refused by the executor, see MMScript_FailTransaction() */
+  printf("test %d: %s\n", 5, "Bus queue full");
+  MMScript_FailTransaction(submitted, MMS_ERR_BUS_QUEUE_FULL);
+  ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+  SCRIPT_ASSERT(5, ret == MMS_ERR_BUS_QUEUE_FULL);
+  submitted = NULL;
+
+  MMScript_SetExecutor(NULL, NULL);
+  MMScript_SetTimeBase(NULL, NULL);
+  MMScript_Rewind();
+
+
+  /* Contexts */
+  printf("\n---------------------------------------\n");
+  printf("Contexts\n");
+
+  {
+    MMSCRIPT_CONTEXT *ctx = MMScript_CreateContext(1);
+    MMSCRIPT_RETRY_POLICY policy;
+    char *script = strdup("1: RETRY LINK,5,0,0\r\n2: END\r\n");   /* Freed with the context */
+
+    SCRIPT_ASSERT(1, ctx != NULL && MMScript_CreateContext(MMSCRIPT_MAX_BUSES) == NULL);
+
+    MMScript_SelectContext(ctx);
+    SCRIPT_ASSERT(2, MMScript_CurrentBus() == 1);
+
+    ret = MMScript_ParseScript(script, strlen(script) + 1);
+    SCRIPT_ASSERT(3, ret == 1);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &policy);
+    SCRIPT_ASSERT(4, ret == 2 && policy.max_attempts == 5);
+
+    /* Default context keeps its own policy */
+    MMScript_SelectContext(NULL);
+    MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS_LINK, &policy);
+    SCRIPT_ASSERT(5, MMScript_CurrentBus() == 0 && policy.max_attempts == 0);
+
+    MMScript_DestroyContext(ctx);
+  }
+
+
+  /* API instances */
+  printf("\n---------------------------------------\n");
+  printf("API instances\n");
+
+  {
+    uint8_t distinct = 1;
+
+    /* Copies of the API linked together, one per bus */
+    for (int i=0; i<MMSCRIPT_MAX_BUSES; i++)
+    {
+      for (int j=0; j<i; j++)
+      {
+        if (MMScript_ApiInstance(i) == MMScript_ApiInstance(j) ||
+            MMScript_ApiInstance(i)->calls.AbsolutePositionMove == MMScript_ApiInstance(j)->calls.AbsolutePositionMove)
+          distinct = 0;
+      }
+    }
+
+    SCRIPT_ASSERT(1, distinct && MMScript_ApiInstanceIndex(7) == 7);
+    SCRIPT_ASSERT(2, MMScript_ApiInstance(MMSCRIPT_MAX_BUSES) == NULL);
+  }
+
+
+  /* Bus scheduler */
+  printf("\n---------------------------------------\n");
+  printf("Bus scheduler\n");
+
+  {
+    static MMSCRIPT_SCHEDULER scheduler;
+    MMSCRIPT_SCHEDULER_CONFIG config = { 115200, 25 };
+    MMSCRIPT_SCHEDULER_STATS stats;
+    MMSCRIPT_CONTEXT *ctx1 = MMScript_CreateContext(1);
+    MMSCRIPT_CONTEXT *ctx2 = MMScript_CreateContext(2);
+    MMSCRIPT_TRANSACTION *poll, *motion, *stop;
+    uint64_t wake_us;
+
+    /* Transactions of 3 contexts, only queued with the class under test, never run */
+    poll = MMScript_PollTransaction(1, 0);
+    MMScript_SelectContext(ctx1);
+    motion = MMScript_PollTransaction(1, 0);
+    MMScript_SelectContext(ctx2);
+    stop = MMScript_PollTransaction(1, 0);
+    MMScript_SelectContext(NULL);
+
+    MMScript_SchedulerInit(&scheduler, &config);
+
+    /* Strict priority, whatever the queuing order */
+    MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 0);
+    MMScript_SchedulerPush(&scheduler, motion, MMSCRIPT_PRIORITY_MOTION, 3, 0);
+    MMScript_SchedulerPush(&scheduler, stop, MMSCRIPT_PRIORITY_STOP, 1, 100);
+
+    SCRIPT_ASSERT(1, MMScript_SchedulerPop(&scheduler, 100, &wake_us) == stop);
+    MMScript_SchedulerDone(&scheduler, 100, 600);
+
+    SCRIPT_ASSERT(2, MMScript_SchedulerPop(&scheduler, 600, &wake_us) == motion);
+    MMScript_SchedulerDone(&scheduler, 600, 2000);
+
+    /* Poll of 1 call 2083us on the wire at 25% share, whatever its measured time: next one not before 6249us later */
+    SCRIPT_ASSERT(3, MMScript_SchedulerPop(&scheduler, 2000, &wake_us) == poll);
+    MMScript_SchedulerDone(&scheduler, 2000, 3000);
+
+    MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 3000);
+    SCRIPT_ASSERT(4, MMScript_SchedulerPop(&scheduler, 3000, &wake_us) == NULL && wake_us == 9249);
+
+    /* Motion still runs while the poll waits */
+    MMScript_SchedulerPush(&scheduler, motion, MMSCRIPT_PRIORITY_MOTION, 3, 3500);
+    SCRIPT_ASSERT(5, MMScript_SchedulerPop(&scheduler, 3500, &wake_us) == motion);
+    MMScript_SchedulerDone(&scheduler, 4000, 5000);
+
+    SCRIPT_ASSERT(6, MMScript_SchedulerPop(&scheduler, 9249, &wake_us) == poll);
+    MMScript_SchedulerDone(&scheduler, 9249, 9749);
+
+    /* 2 motions of 3 calls, 24 bytes of 10 bits each at 115200 baud */
+    MMScript_GetSchedulerStats(&scheduler, MMSCRIPT_PRIORITY_MOTION, &stats);
+    SCRIPT_ASSERT(7, stats.transactions == 2 && stats.busy_us == 2400 && stats.max_latency_us == 600 && stats.wire_us == 2 * 6250);
+
+    MMScript_GetSchedulerStats(&scheduler, MMSCRIPT_PRIORITY_POLL, &stats);
+    SCRIPT_ASSERT(8, stats.transactions == 2 && stats.total_latency_us == 8249);
+
+    /* Baud rate unknown: measured time, 1000us at the default 25% share */
+    MMScript_SchedulerInit(&scheduler, NULL);
+    MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 0);
+    MMScript_SchedulerPop(&scheduler, 0, &wake_us);
+    MMScript_SchedulerDone(&scheduler, 0, 1000);
+    MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 1000);
+    SCRIPT_ASSERT(9, MMScript_SchedulerPop(&scheduler, 1000, &wake_us) == NULL && wake_us == 4000);
+
+    /* Full class refused, see MMScript_FailTransaction() */
+    for (int i=1; i<MMSCRIPT_SCHEDULER_QUEUE_SIZE; i++)
+      MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 1000);
+    SCRIPT_ASSERT(10, MMScript_SchedulerPush(&scheduler, poll, MMSCRIPT_PRIORITY_POLL, 1, 1000) == 0);
+
+    MMScript_DestroyContext(ctx1);
+    MMScript_DestroyContext(ctx2);
+  }
+
+
+  /* Telemetry */
+  printf("\n---------------------------------------\n");
+  printf("Telemetry\n");
+
+  {
+    MMSCRIPT_NODE_STATUS status = { MMS_CTRL_STATUS_POSITION_CONTROL, 1, 1, -1200, 5000, 0, 0 };
+    MMSCRIPT_NODE_STATUS snapshot;
+
+    MMScript_TelemetryReset(2);
+    SCRIPT_ASSERT(1, MMScript_TelemetryNextNode(2, 0) == 0 && MMScript_TelemetryRead(2, 3, &snapshot) == 0);
+
+    MMScript_TelemetryWatch(2, 5);
+    MMScript_TelemetryWatch(2, 3);
+    SCRIPT_ASSERT(2, MMScript_TelemetryNextNode(2, 0) == 3 && MMScript_TelemetryNextNode(2, 3) == 5 && MMScript_TelemetryNextNode(2, 5) == 3);
+
+    MMScript_TelemetryPublish(2, 3, &status);
+    ret = MMScript_TelemetryRead(2, 3, &snapshot);
+    SCRIPT_ASSERT(3, ret == 1 && snapshot.position == -1200 && snapshot.has_position == 1 && snapshot.sampled_us == 5000);
+  }
+
+  printf("script 18 : \n%s\n", script18);
+
+  ret = MMScript_ParseScript(script18, strlen(script18) + 1);
+  SCRIPT_ASSERT(4, ret == 1);
+
+  /* WAIT reads the table until node 1 is in position, trusted once the motion had 100ms to start */
+  MMScript_TelemetryReset(0);
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+  MMScript_SetTelemetry(1);
+
+  {
+    uint64_t start_us = fake_us;
+
+    ret = MMScript_ExecOneStep(NULL, NULL, TelemetryDelay, NULL);
+    SCRIPT_ASSERT(5, ret == 2 && telemetry_delays == 10 && fake_us - start_us == 100000 && MMScript_TelemetryNextNode(0, 0) == 1);
+  }
+
+  MMScript_SetTelemetry(0);
+  MMScript_SetTimeBase(NULL, NULL);
+  MMScript_Rewind();
+
+
+  /* Script 19 */
+  printf("\n---------------------------------------\n");
+  printf("script 19 : \n%s\n", script19);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script19, strlen(script19) + 1);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+
+  printf("test %d: %s\n", 2, "No telemetry");
+  ret = MMScript_ExecOneStep(NULL, NULL, PositionDelay, NULL);
+  SCRIPT_ASSERT(2, ret == MMS_ERR_NO_TELEMETRY);
+
+  /* Goes on once past 500, not in position */
+  MMScript_TelemetryReset(0);
+  MMScript_SetTelemetry(1);
+  MMScript_SetLabelToExec(1);
+  telemetry_delays = 0;
+
+  printf("test %d: %s\n", 3, "UNTIL POS");
+  ret = MMScript_ExecOneStep(NULL, NULL, PositionDelay, NULL);
+  SCRIPT_ASSERT(3, ret == 2 && telemetry_delays == 3);
+
+  /* Stub position doesn't move: velocity 0 once polled twice */
+  fake_us += 10000;
+  MMScript_PollTelemetry(1, 1, NULL);
+  fake_us += 10000;
+  MMScript_PollTelemetry(1, 1, NULL);
+
+  printf("test %d: %s\n", 4, "UNTIL VEL");
+  ret = MMScript_ExecOneStep(NULL, NULL, PositionDelay, NULL);
+  SCRIPT_ASSERT(4, ret == 3);
+
+  MMScript_SetTelemetry(0);
+  MMScript_SetTimeBase(NULL, NULL);
+  MMScript_Rewind();
+
+
+  /* Script 20 */
+  printf("\n---------------------------------------\n");
+  printf("script 20 : \n%s\n", script20);
+
+  printf("test %d: %s\n", 1, "MMScript_ParseScript");
+  ret = MMScript_ParseScript(script20, strlen(script20) + 1);
+  SCRIPT_ASSERT(1, ret == 1);
+
+  MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+
+  printf("test %d: %s\n", 2, "No telemetry");
+  ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+  SCRIPT_ASSERT(2, ret == MMS_ERR_NO_TELEMETRY);
+
+  MMScript_TelemetryReset(0);
+  MMScript_SetTelemetry(1);
+  MMScript_SetLabelToExec(1);
+
+  ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+  SCRIPT_ASSERT(3, ret == 2);
+
+  /* Both moves queued, relative one made absolute from the first target */
+  printf("test %d: %s\n", 4, "Queue");
+  ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+  SCRIPT_ASSERT(4, ret == 3);
+
+  /* One move sent per poll within radius, then status polled 100ms after the last one */
+  printf("test %d: %s\n", 5, "WAIT drains the queue");
+  telemetry_delays = 0;
+  ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+  SCRIPT_ASSERT(5, ret == 4 && telemetry_delays == 12);
+
+  ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+  SCRIPT_ASSERT(6, ret == 5);
+
+  MMScript_SetTelemetry(0);
+  MMScript_SetTimeBase(NULL, NULL);
+  MMScript_Rewind();
+
+
+  /* Script 21 */
+  printf("\n---------------------------------------\n");
+  printf("script 21 : \n%s\n", script21);
+
+  {
+    /* 2 nodes, 1ms period, 4 frames */
+    static const uint8_t trajectory[] =
+    {
+      'M', 'M', 'S', 'T', 1, 0, 2, 0, 0xE8, 0x03, 0, 0, 4, 0, 0, 0,
+      1, 2, 0, 0,
+      0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00,
+      0x64, 0x00, 0x00, 0x00,  0x9C, 0xFF, 0xFF, 0xFF,
+      0xC8, 0x00, 0x00, 0x00,  0x38, 0xFF, 0xFF, 0xFF,
+      0x2C, 0x01, 0x00, 0x00,  0xD4, 0xFE, 0xFF, 0xFF
+    };
+    MMSCRIPT_STREAM stream;
+    MMSCRIPT_STREAM_STATS stats;
+    FILE *file;
+    uint64_t start_us;
+
+    ret = MMScript_StreamAttach(trajectory, sizeof(trajectory) - 4, &stream);
+    SCRIPT_ASSERT(1, ret == MMS_ERR_STREAM_FILE);
+
+    ret = MMScript_StreamAttach(trajectory, sizeof(trajectory), &stream);
+    SCRIPT_ASSERT(2, ret == 0 && stream.frame_count == 4 && stream.period_us == 1000 &&
+                     MMScript_StreamSetpoint(&stream, 3, 1) == -300);
+
+    file = fopen("stream_test.mmst", "wb");
+    fwrite(trajectory, 1, sizeof(trajectory), file);
+    fclose(file);
+
+    ret = MMScript_ParseScript(script21, strlen(script21) + 1);
+    SCRIPT_ASSERT(3, ret == 1);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(4, ret == MMS_ERR_MISSING_STREAM_PARAM);
+
+    /* Frames at their time */
+    MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+    MMScript_SetLabelToExec(1);
+    start_us = fake_us;
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    MMScript_GetStreamStats(&stats);
+    SCRIPT_ASSERT(5, ret == 2 && stats.sent == 4 && stats.underruns == 0 && stats.late == 0 && fake_us == start_us + 3000);
+
+    /* Every call takes 1.5ms, more than a period: overdue frames dropped, the last one sent */
+    MMScript_SetTimeBase(FakeMicroSeconds, FakeDelayUntil);
+    MMScript_SetLabelToExec(1);
+    fake_rtt_us = 1500;
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    MMScript_GetStreamStats(&stats);
+    SCRIPT_ASSERT(6, ret == 2 && stats.underruns > 0 && stats.sent + stats.underruns == 4);
+
+    fake_rtt_us = 0;
+
+    /* Forked task goes on between frames */
+    {
+      char *forked = strdup("1: FORK 10\r\n2: STREAM stream_test.mmst\r\n3: END\r\n10: LET A = A + 1\r\n11: UDELAY 500\r\n12: GOTO 10\r\n");
+      int16_t vars[26];
+      int i;
+
+      printf("test %d: %s\n", 7, "Stream yields to forked tasks");
+      MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+      ret = MMScript_ParseScript(forked, strlen(forked) + 1);
+      start_us = fake_us;
+
+      for (i=0; i<100 && ret > 0; i++)
+        ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+
+      MMScript_GetVariables(vars);
+      MMScript_GetStreamStats(&stats);
+      SCRIPT_ASSERT(7, ret == 0 && stats.sent == 4 && stats.late == 0 && fake_us == start_us + 3000 && vars[0] >= 6);
+
+      MMScript_Clean();
+    }
+
+    /* File relative to the script, not to the working directory */
+    {
+      char *relative = strdup("1: STREAM \"stream test.mmst\"\r\n2: END\r\n");
+
+      printf("test %d: %s\n", 8, "Stream file of the script directory");
+      MKDIR("stream_dir");
+      file = fopen("stream_dir/stream test.mmst", "wb");
+      fwrite(trajectory, 1, sizeof(trajectory), file);
+      fclose(file);
+
+      MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+      MMScript_SetScriptPath("stream_dir/script.txt");
+      ret = MMScript_ParseScript(relative, strlen(relative) + 1);
+
+      if (ret == 1)
+        ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+
+      MMScript_GetStreamStats(&stats);
+      SCRIPT_ASSERT(8, ret == 2 && stats.sent == 4);
+
+      MMScript_SetScriptPath(NULL);
+      MMScript_Clean();
+      remove("stream_dir/stream test.mmst");
+      RMDIR("stream_dir");
+    }
+
+    remove("stream_test.mmst");
+
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Rewind();
+  }
+
+
+  /* Script 22 */
+  printf("\n---------------------------------------\n");
+  printf("script 22 : \n%s\n", script22);
+
+  {
+    static const uint8_t nodes[2] = { 1, 2 };
+    static const int32_t start[2] = { 0, 500 };
+    static const int32_t target[2] = { 1000, 0 };
+    static const double knots[4] = { 0, 100, 300, 0 };
+    MMSCRIPT_SCURVE profile;
+    MMSCRIPT_SPLINE spline;
+    MMSCRIPT_STREAM stream;
+    MMSCRIPT_STREAM_STATS stats;
+    double t[3], s[3], p[4];
+    uint8_t *trajectory;
+    size_t size;
+
+    /* Too short to reach vmax, symmetric */
+    printf("test %d: %s\n", 1, "S-curve");
+    ret = MMScript_SCurvePlan(&profile, 1000, 10000, 100000, 1000000);
+    t[0] = 0;
+    t[1] = profile.duration / 2;
+    t[2] = profile.duration;
+    MMScript_SCurveSample(&profile, t, s, 3);
+    SCRIPT_ASSERT(1, ret == 1 && profile.velocity < 10000 && s[0] == 0 && s[1] > 0.499 && s[1] < 0.501 && s[2] == 1);
+
+    printf("test %d: %s\n", 2, "Spline through knots");
+    ret = MMScript_SplinePlan(&spline, knots, 1, 4, 0.05);
+    MMScript_SplineSample(&spline, 0, 0.05, 4, p);
+    SCRIPT_ASSERT(2, ret == 1 && p[0] == 0 && p[1] > 99.999 && p[1] < 100.001 && p[2] > 299.999 && p[2] < 300.001 && p[3] > -0.001 && p[3] < 0.001);
+
+    /* Straight line, last frame on target */
+    printf("test %d: %s\n", 3, "Generate");
+    trajectory = MMScript_GenerateSCurve(nodes, start, target, 2, 10000, 100000, 1000000, 1000, &size);
+    ret = MMScript_StreamAttach(trajectory, size, &stream);
+    SCRIPT_ASSERT(3, ret == 0 && stream.node_count == 2 && stream.frame_count > 2 &&
+                     MMScript_StreamSetpoint(&stream, 0, 0) == 0 && MMScript_StreamSetpoint(&stream, 0, 1) == 500 &&
+                     MMScript_StreamSetpoint(&stream, stream.frame_count - 1, 0) == 1000 &&
+                     MMScript_StreamSetpoint(&stream, stream.frame_count - 1, 1) == 0);
+    free(trajectory);
+
+    ret = MMScript_ParseScript(script22, strlen(script22) + 1);
+    SCRIPT_ASSERT(4, ret == 1);
+
+    MMScript_SetTimeBase(FakeClock, FakeDelayUntil);
+
+    printf("test %d: %s\n", 5, "No telemetry");
+    ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+    SCRIPT_ASSERT(5, ret == MMS_ERR_NO_TELEMETRY);
+
+    MMScript_TelemetryReset(0);
+    MMScript_SetTelemetry(1);
+    MMScript_SetLabelToExec(1);
+
+    /* From the polled position, stub node at 0 */
+    ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+    MMScript_GetStreamStats(&stats);
+    SCRIPT_ASSERT(6, ret == 2 && stats.frames > 2 && stats.sent == stats.frames && stats.underruns == 0);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+    MMScript_GetStreamStats(&stats);
+    SCRIPT_ASSERT(7, ret == 3 && stats.frames == 151 && stats.sent == 151);
+
+    printf("test %d: %s\n", 8, "Waypoints per node differ");
+    ret = MMScript_ExecOneStep(NULL, NULL, PollerDelay, NULL);
+    SCRIPT_ASSERT(8, ret == MMS_ERR_MISSING_PATH_PARAM);
+
+    MMScript_SetTelemetry(0);
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Rewind();
+  }
+
+
+
+  /* Script 23 */
+  printf("\n---------------------------------------\n");
+  printf("script 23 : \n%s\n", script23);
+
+  {
+    MMSCRIPT_GEAR_STATS stats;
+
+    ret = MMScript_ParseScript(script23, strlen(script23) + 1);
+    SCRIPT_ASSERT(1, ret == 1);
+
+    MMScript_SetTimeBase(FakeMicroSeconds, FakeDelayUntil);
+
+    printf("test %d: %s\n", 2, "No telemetry");
+    ret = MMScript_ExecOneStep(NULL, NULL, GearDelay, NULL);
+    SCRIPT_ASSERT(2, ret == MMS_ERR_NO_TELEMETRY);
+
+    MMScript_TelemetryReset(0);
+    MMScript_SetTelemetry(1);
+    MMScript_SetLabelToExec(1);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, GearDelay, NULL);
+    SCRIPT_ASSERT(3, ret == 2);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, GearDelay, NULL);
+    SCRIPT_ASSERT(4, ret == 3);
+
+    /* One leader read & one setpoint per follower & poll, 200us each: half of the read counted in the latency */
+    printf("test %d: %s\n", 5, "Followers updated by the poller");
+    fake_rtt_us = 200;
+    MMScript_PollGear(NULL);
+    MMScript_PollGear(NULL);
+    MMScript_GetGearStats(&stats);
+    SCRIPT_ASSERT(5, stats.updates == 4 && stats.errors == 0 && stats.max_latency_us == 300 && stats.total_latency_us == 4 * 300 &&
+                     stats.max_interval_us > 0);
+
+    printf("test %d: %s\n", 6, "Disengage");
+    ret = MMScript_ExecOneStep(NULL, NULL, GearDelay, NULL);
+    MMScript_PollGear(NULL);
+    MMScript_GetGearStats(&stats);
+    SCRIPT_ASSERT(6, ret == 4 && stats.updates == 5);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, GearDelay, NULL);
+    SCRIPT_ASSERT(7, ret == MMS_ERR_MISSING_GEAR_PARAM);
+
+    fake_rtt_us = 0;
+    MMScript_SetTelemetry(0);
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Rewind();
+  }
+
+
+  /* Script 24 */
+  printf("\n---------------------------------------\n");
+  printf("script 24 : \n%s\n", script24);
+
+  {
+    static const int8_t values[3] = { 10, 20, -3 };
+    FILE *file;
+    char *bad;
+
+    file = fopen("table test.bin", "wb");
+    fwrite(values, 1, sizeof(values), file);
+    fclose(file);
+
+    printf("test %d: %s\n", 1, "Out of range of I8");
+    bad = strdup("1: TABLE T,I8,300\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    SCRIPT_ASSERT(1, ret == MMS_PARSE_ERR_TABLE);
+
+    /* Quoted, from the directory of the script */
+    MMScript_SetScriptPath("./script24.txt");
+    ret = MMScript_ParseScript(script24, strlen(script24) + 1);
+    SCRIPT_ASSERT(2, ret == 1);
+    MMScript_SetScriptPath(NULL);
+    remove("table test.bin");
+
+    /* Declared once by the parser */
+    printf("test %d: %s\n", 3, "TABLE skipped");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(3, ret == 4);
+
+    printf("test %d: %s\n", 4, "Items in expressions");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(4, ret == 8);
+
+    printf("test %d: %s\n", 5, "Items as operands");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(5, ret == 9);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(6, ret == 11);
+
+    printf("test %d: %s\n", 7, "Index out of range");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(7, ret == MMS_ERR_TABLE_INDEX);
+
+    /* Only commands take 32 bit operands */
+    printf("test %d: %s\n", 8, "I32 out of range of expressions");
+    bad = strdup("1: TABLE T,I32,70000\r\n2: LET A=T[0]\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    SCRIPT_ASSERT(8, ret == MMS_PARSE_ERR_TABLE);
+
+    printf("test %d: %s\n", 9, "Unterminated quote");
+    bad = strdup("1: TABLE S,I8,FILE \"table test.bin\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    SCRIPT_ASSERT(9, ret == MMS_PARSE_ERR_TABLE);
+
+    MMScript_Rewind();
+  }
+
+
+  /* Script 25 */
+  printf("\n---------------------------------------\n");
+  printf("script 25 : \n%s\n", script25);
+
+  {
+    char *bad;
+    int steps;
+
+    printf("test %d: %s\n", 1, "NEXT without FOR");
+    bad = strdup("1: NEXT\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    SCRIPT_ASSERT(1, ret == MMS_PARSE_ERR_LOOP);
+
+    printf("test %d: %s\n", 2, "NEXT of another VAR");
+    bad = strdup("1: FOR I=1 TO 2\r\n2: NEXT J\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    SCRIPT_ASSERT(2, ret == MMS_PARSE_ERR_LOOP);
+
+    ret = MMScript_ParseScript(script25, strlen(script25) + 1);
+    SCRIPT_ASSERT(3, ret == 1);
+
+    /* LET, FOR, 3 * (FOR, 3 * (LET, NEXT), NEXT), IF */
+    printf("test %d: %s\n", 4, "Nested loops");
+    for (steps=0; steps<27; steps++)
+        ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(4, ret == 9);
+
+    printf("test %d: %s\n", 5, "Loop skipped");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(5, ret == 12);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(6, ret == 14);
+
+    printf("test %d: %s\n", 7, "VAR keeps last value");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(7, ret == 16);
+
+    MMScript_Rewind();
+  }
+
+
+  /* Script 26 */
+  printf("\n---------------------------------------\n");
+  printf("script 26 : \n%s\n", script26);
+
+  {
+    MMSCRIPT_NATIVE_PROGRAM program;
+    char body[1024];
+
+    ret = MMScript_ParseScript(script26, strlen(script26) + 1);
+    SCRIPT_ASSERT(1, ret == 1);
+
+    printf("test %d: %s\n", 2, "Lines compiled");
+    SCRIPT_ASSERT(2, MMScript_CompileLine(0, body, sizeof(body)) == 1 && strstr(body, "f->vars[0] = r;") != NULL);
+    SCRIPT_ASSERT(3, MMScript_CompileLine(1, body, sizeof(body)) == 1 && strstr(body, "f->ops[1].type = MMSCRIPT_OP_STOP;") != NULL);
+    SCRIPT_ASSERT(4, MMScript_CompileLine(5, body, sizeof(body)) == 1 && strstr(body, "f->nextLine = 0;") != NULL);
+
+    printf("test %d: %s\n", 5, "Lines left to the interpreter");
+    SCRIPT_ASSERT(5, MMScript_CompileLine(7, body, sizeof(body)) == 0 && MMScript_CompileLine(8, body, sizeof(body)) == 0);
+
+    printf("test %d: %s\n", 6, "Program of another script");
+    program.version = MMSCRIPT_NATIVE_VERSION;
+    program.line_count = MMScript_LineCount();
+    program.hash = MMScript_ScriptHash() + 1;
+    program.lines = native_lines;
+    ret = MMScript_AttachNative(&program);
+    SCRIPT_ASSERT(6, ret == MMS_PARSE_ERR_NATIVE && program.line_count == 10);
+
+    program.hash = MMScript_ScriptHash();
+    ret = MMScript_AttachNative(&program);
+    SCRIPT_ASSERT(7, ret == 0);
+
+    printf("test %d: %s\n", 8, "Native & interpreted lines mixed");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(8, ret == 6);
+
+    printf("test %d: %s\n", 9, "Jump of native line");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(9, ret == 7);
+
+    MMScript_Rewind();
+  }
+
+
+  /* Script 27 */
+  printf("\n---------------------------------------\n");
+  printf("script 27 : \n%s\n", script27);
+
+  {
+    uint8_t length, all = 1;
+    int8_t i;
+
+    printf("test %d: %s\n", 1, "Keywords & commands recognized");
+    for (i=0; i<MMSCRIPT_KEYWORD_COUNT; i++)
+      all = all && MMScript_Keyword(MMScript_KeywordName(i), &length) == i && length == strlen(MMScript_KeywordName(i));
+    SCRIPT_ASSERT(1, all);
+
+    for (i=0; i<MMSCRIPT_OP_COUNT; i++)
+      all = all && MMScript_NodeCommand(MMScript_NodeCommandName(i, NULL), &length) == i && length == strlen(MMScript_NodeCommandName(i, NULL));
+    SCRIPT_ASSERT(2, all);
+
+    printf("test %d: %s\n", 3, "Longest prefix");
+    SCRIPT_ASSERT(3, MMScript_NodeCommand("PVM 1,2", &length) == MMSCRIPT_OP_PVM && length == 3);
+    SCRIPT_ASSERT(4, MMScript_NodeCommand("VMA", &length) == MMSCRIPT_OP_VM && length == 2);
+    SCRIPT_ASSERT(5, MMScript_Keyword("FORK 3", &length) == MMSCRIPT_KEYWORD_FORK && MMScript_Keyword("FORI=1 TO 3", &length) == MMSCRIPT_KEYWORD_FOR && length == 3);
+    SCRIPT_ASSERT(6, MMScript_Keyword("RETRY LINK,3,1,4", &length) == MMSCRIPT_KEYWORD_RETRY && MMScript_Keyword("RET", &length) == MMSCRIPT_KEYWORD_RET);
+
+    printf("test %d: %s\n", 7, "Unknown");
+    SCRIPT_ASSERT(7, MMScript_Keyword("1,AP 5", &length) == -1 && MMScript_Keyword("START 1", &length) == -1 && MMScript_NodeCommand("JOG", &length) == -1);
+
+    ret = MMScript_ParseScript(script27, strlen(script27) + 1);
+    SCRIPT_ASSERT(8, ret == 1);
+
+    printf("test %d: %s\n", 9, "Lines dispatched");
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(9, ret == 4);
+
+    ret = MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(10, ret == 0);
+
+    MMScript_Rewind();
+  }
+
+
+
+  /* Script 28 */
+  printf("\n---------------------------------------\n");
+  printf("script 28 : \n%s\n", script28);
+
+  {
+    MMSCRIPT_OPTIMIZE_REPORT report;
+    char *buf = (char*)malloc(sizeof(script28));
+    int16_t label;
+    uint64_t start_us;
+
+    MMScript_SetOptimize(1);
+    MMScript_SetTimeBase(FakeMicroSeconds, FakeDelayUntil);
+    fake_rtt_us = 0;
+
+    memcpy(buf, script28, sizeof(script28));
+    ret = MMScript_ParseScript(buf, sizeof(script28));
+    SCRIPT_ASSERT(1, ret == 1);
+
+    printf("test %d: %s\n", 2, "Report");
+    MMScript_GetOptimizeReport(&report);
+    SCRIPT_ASSERT(2, report.folded == 3 && report.merged_delays == 1 && report.threaded_jumps == 1);
+    SCRIPT_ASSERT(3, report.inlined_calls == 1 && report.removed_lines == 7);
+
+    printf("test %d: %s\n", 4, "Lines rewritten");
+    SCRIPT_ASSERT(4, strcmp(MMScript_LineText(0, &label), "LET A=7") == 0 && strcmp(MMScript_LineText(1, &label), "GOTO 4") == 0);
+    SCRIPT_ASSERT(5, strcmp(MMScript_LineText(3, &label), "DELAY 30") == 0 && MMScript_LineText(4, &label) == NULL);
+    SCRIPT_ASSERT(6, strcmp(MMScript_LineText(5, &label), "LET B=A+1") == 0 && strcmp(MMScript_LineText(7, &label), "GOTO 12") == 0);
+
+    printf("test %d: %s\n", 7, "Same run, fewer steps");
+    start_us = fake_us;
+    SCRIPT_ASSERT(7, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 2 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 4);
+    SCRIPT_ASSERT(8, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 6 && fake_us - start_us == 30000);
+    SCRIPT_ASSERT(9, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 8 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 12);
+    SCRIPT_ASSERT(10, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 14 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 0);
+
+    printf("test %d: %s\n", 11, "Optimizer disabled");
+    MMScript_SetOptimize(0);
+    MMScript_Clean();
+    buf = (char*)malloc(sizeof(script28));
+    memcpy(buf, script28, sizeof(script28));
+    ret = MMScript_ParseScript(buf, sizeof(script28));
+    MMScript_GetOptimizeReport(&report);
+    SCRIPT_ASSERT(11, ret == 1 && report.folded == 0 && report.removed_lines == 0 && strcmp(MMScript_LineText(4, &label), "DELAY 20") == 0);
+
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Clean();
+  }
+
+
+
+  /* Script 29 */
+  printf("\n---------------------------------------\n");
+  printf("script 29 : \n%s\n", script29);
+
+  {
+    MMSCRIPT_SOURCE_MAP map;
+    const char *file;
+    uint16_t line;
+    int16_t vars[26];
+    int16_t label;
+    size_t size;
+    char body[1024];
+    char *buf, *zero;
+    FILE *out;
+
+    out = fopen("pre_test.txt", "wb");
+    fputs(script29, out);
+    fclose(out);
+    out = fopen("pre_test.inc", "wb");
+    fputs(script29_inc, out);
+    fclose(out);
+
+    ret = MMScript_Preprocess("pre_test.txt", &buf, &size, &map);
+    SCRIPT_ASSERT(1, ret == 0 && map.file_count == 2);
+
+    ret = MMScript_ParseScript(buf, size);
+    SCRIPT_ASSERT(2, ret == 1);
+
+    printf("test %d: %s\n", 3, "Constants & macros replaced");
+    SCRIPT_ASSERT(3, strcmp(MMScript_LineText(0, &label), "LET A=2000/2") == 0 && strcmp(MMScript_LineText(1, &label), "LET A=A*4") == 0);
+    SCRIPT_ASSERT(4, strcmp(MMScript_LineText(2, &label), "LET B=A+4100") == 0);
+    SCRIPT_ASSERT(5, strcmp(MMScript_LineText(5, &label), "2,PAP 4100,2000,-500;3,PAP 4100,2000,2000") == 0);
+
+    printf("test %d: %s\n", 6, "Included lines");
+    SCRIPT_ASSERT(6, strcmp(MMScript_LineText(6, &label), "IF (B!=8100) THEN 102") == 0 && label == 100);
+
+    printf("test %d: %s\n", 7, "Source map");
+    file = MMScript_SourceLine(&map, 5, &line);
+    SCRIPT_ASSERT(7, file && strcmp(file, "pre_test.txt") == 0 && line == 11);
+    file = MMScript_SourceLine(&map, 6, &line);
+    SCRIPT_ASSERT(8, file && strcmp(file, "pre_test.inc") == 0 && line == 2 && MMScript_SourceLine(&map, map.line_count, &line) == NULL);
+
+    printf("test %d: %s\n", 9, "Run");
+    SCRIPT_ASSERT(9, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 2 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 3);
+    SCRIPT_ASSERT(10, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 4 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 100);
+    SCRIPT_ASSERT(11, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 101 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == 5);
+
+    MMScript_FreeSourceMap(&map);
+    MMScript_Clean();
+
+    printf("test %d: %s\n", 12, "Invalid directives");
+    out = fopen("pre_test.txt", "wb");
+    fputs("1: END\r\n#CONST STEP 5\r\n", out);
+    fclose(out);
+    ret = MMScript_Preprocess("pre_test.txt", &buf, &size, &map);
+    SCRIPT_ASSERT(12, ret == MMS_PARSE_ERR_DIRECTIVE && map.error.line == 2 && buf == NULL);
+    MMScript_FreeSourceMap(&map);
+
+    out = fopen("pre_test.txt", "wb");
+    fputs("#MACRO TWICE(VALUE) VALUE*2\r\n1: LET A=TWICE(1,2)\r\n", out);
+    fclose(out);
+    ret = MMScript_Preprocess("pre_test.txt", &buf, &size, &map);
+    SCRIPT_ASSERT(13, ret == MMS_PARSE_ERR_DIRECTIVE && map.error.line == 2);
+    MMScript_FreeSourceMap(&map);
+
+    printf("test %d: %s\n", 14, "Included by itself");
+    out = fopen("pre_test.inc", "wb");
+    fputs("#INCLUDE pre_test.inc\n", out);
+    fclose(out);
+    ret = MMScript_Preprocess("pre_test.inc", &buf, &size, &map);
+    SCRIPT_ASSERT(14, ret == MMS_PARSE_ERR_INCLUDE);
+    MMScript_FreeSourceMap(&map);
+
+    printf("test %d: %s\n", 15, "Script without directive as read");
+    out = fopen("pre_test.txt", "wb");
+    fputs(script28, out);
+    fclose(out);
+    ret = MMScript_Preprocess("pre_test.txt", &buf, &size, &map);
+    SCRIPT_ASSERT(15, ret == 0 && size == sizeof(script28) && memcmp(buf, script28, size) == 0);
+    MMScript_FreeSourceMap(&map);
+    free(buf);
+
+    printf("test %d: %s\n", 16, "Negative constant in expressions");
+    out = fopen("pre_test.txt", "wb");
+    fputs("#CONST BACK 0-5\r\n1: LET A = BACK\r\n2: LET B=10+BACK\r\n3: IF (A==BACK) THEN 5\r\n4: END\r\n5: LET C=A*BACK\r\n6: END\r\n", out);
+    fclose(out);
+    ret = MMScript_Preprocess("pre_test.txt", &buf, &size, &map);
+    SCRIPT_ASSERT(16, ret == 0 && MMScript_ParseScript(buf, size) == 1 && strcmp(MMScript_LineText(0, &label), "LET A = -5") == 0);
+    MMScript_FreeSourceMap(&map);
+
+    for (int i=0; i<10 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) > 0; i++)
+      ;
+
+    MMScript_GetVariables(vars);
+    SCRIPT_ASSERT(17, vars[0] == -5 && vars[1] == 5 && vars[2] == 25);
+    MMScript_Clean();
+
+    /* Not folded, reported when the line runs, natively too */
+    printf("test %d: %s\n", 18, "Division by 0");
+    zero = strdup("1: LET A=4/0\r\n2: LET B=0\r\n3: LET C=8/B\r\n4: END\r\n");
+    MMScript_SetOptimize(1);
+    ret = MMScript_ParseScript(zero, strlen(zero) + 1);
+    SCRIPT_ASSERT(18, ret == 1 && MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == MMS_ERR_DIVISION_BY_ZERO);
+
+    MMScript_SetLabelToExec(2);
+    MMScript_ExecOneStep(NULL, NULL, NULL, NULL);
+    SCRIPT_ASSERT(19, MMScript_ExecOneStep(NULL, NULL, NULL, NULL) == MMS_ERR_DIVISION_BY_ZERO);
+    SCRIPT_ASSERT(20, MMScript_CompileLine(2, body, sizeof(body)) == 1 && strstr(body, "return MMS_ERR_DIVISION_BY_ZERO;") != NULL);
+    MMScript_SetOptimize(0);
+    MMScript_Clean();
+
+    remove("pre_test.txt");
+    remove("pre_test.inc");
+  }
+
+
+
+  /* Script 30 */
+  printf("\n---------------------------------------\n");
+  printf("script 30 : \n%s\n", script30);
+
+  {
+    /* 10000 counts/s reached in 100ms & 500 counts */
+    MMSCRIPT_ESTIMATE_CONFIG config = { 10000, 100000, 1000 };
+    MMSCRIPT_ESTIMATE estimate;
+    char *bad;
+
+    printf("test %d: %s\n", 1, "Trapezoidal & triangular moves");
+    SCRIPT_ASSERT(1, MMScript_MoveTime(10000, 10000, 100000) == 1100000 && MMScript_MoveTime(400, 10000, 100000) == 126491);
+
+    ret = MMScript_ParseScript(script30, strlen(script30) + 1);
+    SCRIPT_ASSERT(2, ret == 1);
+
+    /* Moves of node 2 waited for, node 3 moving behind DELAY */
+    printf("test %d: %s\n", 3, "Totals");
+    ret = MMScript_Estimate(&config, &estimate);
+    SCRIPT_ASSERT(3, ret == 0 && estimate.endless && estimate.unmodeled == 0);
+    SCRIPT_ASSERT(4, estimate.delay_us == 55000 && estimate.bus_us == 8000 && estimate.wait_us == 1649000);
+    SCRIPT_ASSERT(5, estimate.total_us == 1712000);
+
+    printf("test %d: %s\n", 6, "Loops");
+    SCRIPT_ASSERT(6, estimate.loop_count == 2 && estimate.loops[0].start_label == 4 && estimate.loops[0].end_label == 7);
+    SCRIPT_ASSERT(7, estimate.loops[0].passes == 5 && estimate.loops[0].pass_us == 6000);
+    SCRIPT_ASSERT(8, estimate.loops[1].start_label == 8 && estimate.loops[1].end_label == 11 && estimate.loops[1].pass_us == 21000);
+
+    printf("test %d: %s\n", 9, "Critical path per node");
+    SCRIPT_ASSERT(9, estimate.node_count == 2 && estimate.nodes[0].node == 2 && estimate.nodes[0].moves == 2 && estimate.nodes[0].waited_us == 1649000);
+    SCRIPT_ASSERT(10, estimate.nodes[1].node == 3 && estimate.nodes[1].moves == 5 && estimate.nodes[1].motion_us == 5 * 126491 && estimate.nodes[1].waited_us == 0);
+
+    printf("test %d: %s\n", 11, "Velocity moves not modeled");
+    bad = strdup("1: 2,VM 100\r\n2: WAIT 2\r\n3: END\r\n");
+    ret = MMScript_ParseScript(bad, strlen(bad) + 1);
+    ret = MMScript_Estimate(&config, &estimate);
+    SCRIPT_ASSERT(11, ret == 0 && !estimate.endless && estimate.unmodeled == 1 && estimate.total_us == 2000);
+
+    MMScript_Clean();
+  }
+
+
+
+  /* Script 31 */
+  printf("\n---------------------------------------\n");
+  printf("script 31 : \n%s\n", script31);
+
+  {
+    /* 1.1s per move, stopped after a minute of virtual time */
+    MMSCRIPT_VIRTUAL_CONFIG config = { 1000, 10000, 100000, 60000000, 0, 0 };
+    MMSCRIPT_VIRTUAL_STATS stats;
+    int16_t vars[26];
+    int16_t label;
+    uint32_t steps = 0;
+    int32_t position;
+    uint8_t status;
+    char *stop;
+
+    MMScript_VirtualInit(0, &config, VirtualTrace);
+    MMScript_SetBus(MMScript_VirtualBus());
+    MMScript_SetTimeBase(MMScript_VirtualMicroSeconds, MMScript_VirtualDelayUntil);
+
+    ret = MMScript_ParseScript(script31, strlen(script31) + 1);
+    SCRIPT_ASSERT(1, ret == 1);
+
+    label = ret;
+    while (label > 0 && MMScript_VirtualLine(label))
+    {
+      label = MMScript_ExecOneStep(NULL, NULL, MMScript_VirtualDelay, NULL);
+      steps++;
+    }
+
+    /* 27 passes of 2 moves, 11 polls & 11 delays of WAIT each, the last one crossing the minute */
+    printf("test %d: %s\n", 2, "Endless script stopped at the limit");
+    MMScript_GetVirtualStats(0, &stats);
+    SCRIPT_ASSERT(2, label > 0 && stats.limit_reached && stats.now_us == 60048000);
+    SCRIPT_ASSERT(3, stats.bus_us == 27 * 24000 && stats.delay_us == 54 * 1100000);
+
+    printf("test %d: %s\n", 4, "Calls traced");
+    SCRIPT_ASSERT(4, virtual_moves == 54 && stats.counts[MMSCRIPT_VIRTUAL_ABSOLUTE_POSITION_MOVE] == 54);
+    SCRIPT_ASSERT(5, stats.counts[MMSCRIPT_VIRTUAL_GET_CONTROL_STATUS] == 594 && stats.counts[MMSCRIPT_VIRTUAL_LINE] == steps && steps == 162);
+
+    printf("test %d: %s\n", 6, "Variables & nodes at the end");
+    MMScript_GetVariables(vars);
+    SCRIPT_ASSERT(6, vars[0] == 27 && MMScript_VirtualNode(0, 2, &position, &status) && position == 0 && status == MMS_CTRL_STATUS_POSITION_CONTROL);
+    SCRIPT_ASSERT(7, MMScript_VirtualNode(0, 3, &position, &status) == 0);
+
+    printf("test %d: %s\n", 8, "Moves refused until restarted");
+    stop = strdup("1: 2,AP 500\r\n2: 2,STOP\r\n3: 2,AP 900\r\n4: 2,START 1\r\n5: 2,AP 900\r\n6: WAIT 2\r\n7: END\r\n");
+    config.limit_us = 0;
+    MMScript_VirtualInit(0, &config, NULL);
+    ret = MMScript_ParseScript(stop, strlen(stop) + 1);
+    SCRIPT_ASSERT(8, MMScript_ExecOneStep(VirtualError, NULL, MMScript_VirtualDelay, NULL) == 2 && MMScript_ExecOneStep(VirtualError, NULL, MMScript_VirtualDelay, NULL) == 3);
+    MMScript_VirtualNode(0, 2, &position, &status);
+    SCRIPT_ASSERT(9, status == MMS_CTRL_STATUS_NO_CONTROL && MMScript_ExecOneStep(VirtualError, NULL, MMScript_VirtualDelay, NULL) == 4 && virtual_errors == 1);
+
+    label = 4;
+    while (label > 0)
+      label = MMScript_ExecOneStep(VirtualError, NULL, MMScript_VirtualDelay, NULL);
+
+    MMScript_VirtualNode(0, 2, &position, &status);
+    SCRIPT_ASSERT(10, label == 0 && virtual_errors == 1 && status == MMS_CTRL_STATUS_POSITION_CONTROL && position == 900);
+    free(stop);
+
+    /* Velocity move from 1ms, 1001 counts at 1002ms when RP is sent */
+    printf("test %d: %s\n", 11, "Relative move from where a velocity move got");
+    stop = strdup("1: 2,VM 1000\r\n2: DELAY 1000\r\n3: 2,RP 500\r\n4: WAIT 2\r\n5: END\r\n");
+    MMScript_VirtualInit(0, &config, NULL);
+    ret = MMScript_ParseScript(stop, strlen(stop) + 1);
+
+    label = ret;
+    while (label > 0)
+      label = MMScript_ExecOneStep(VirtualError, NULL, MMScript_VirtualDelay, NULL);
+
+    MMScript_VirtualNode(0, 2, &position, &status);
+    SCRIPT_ASSERT(11, label == 0 && virtual_errors == 1 && position == 1501);
+
+    MMScript_SetBus(NULL);
+    MMScript_SetTimeBase(NULL, NULL);
+    MMScript_Clean();
+  }
+
   printf("\nAll tests done.");
   return 0;
 }
@@ -13,10 +13,30 @@ INCLUDEPATH += ../user/ ../MemeServoAPI/ . ..
 
 HEADERS += \
     ../user/ScriptProcessor.h \
+    ../user/ScriptCommands.h \
+    ../user/ScriptPreprocessor.h \
+    ../user/RttEstimator.h \
+    ../user/BusScheduler.h \
+    ../user/Telemetry.h \
+    ../user/TrajectoryStream.h \
+    ../user/TrajectoryGen.h \
+    ../user/ScriptCompiler.h \
+    ../user/ScriptEstimator.h \
+    ../user/VirtualBus.h \
     ../MemeServoAPI/MemeServoAPI.h
 
 SOURCES += ScriptTest.c \
     ../user/ScriptProcessor.c \
+    ../user/ScriptCommands.c \
+    ../user/ScriptPreprocessor.c \
+    ../user/RttEstimator.c \
+    ../user/BusScheduler.c \
+    ../user/Telemetry.c \
+    ../user/TrajectoryStream.c \
+    ../user/TrajectoryGen.c \
+    ../user/ScriptCompiler.c \
+    ../user/ScriptEstimator.c \
+    ../user/VirtualBus.c \
     ../MemeServoAPI/MemeServoAPI.c
 
 # The following define makes your compiler emit warnings if you use
@@ -30,4 +50,6 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(../user/ApiInstance.pri)
+
 
@@ -0,0 +1,62 @@
+/**
+  * Instances of the API by bus, each one compiled by its ApiInstanceN.c.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ApiInstance.h"
+
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Defined by ApiInstanceN.c */
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_0;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_1;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_2;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_3;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_4;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_5;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_6;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_7;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_8;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_9;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_10;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_11;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_12;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_13;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_14;
+extern const MMSCRIPT_API_INSTANCE MMS_Instance_15;
+
+static const MMSCRIPT_API_INSTANCE *const _instances[MMSCRIPT_API_INSTANCES] =
+{
+    &MMS_Instance_0,
+    &MMS_Instance_1,
+    &MMS_Instance_2,
+    &MMS_Instance_3,
+    &MMS_Instance_4,
+    &MMS_Instance_5,
+    &MMS_Instance_6,
+    &MMS_Instance_7,
+    &MMS_Instance_8,
+    &MMS_Instance_9,
+    &MMS_Instance_10,
+    &MMS_Instance_11,
+    &MMS_Instance_12,
+    &MMS_Instance_13,
+    &MMS_Instance_14,
+    &MMS_Instance_15
+};
+
+
+/* Exported functions --------------------------------------------------------*/
+
+const MMSCRIPT_API_INSTANCE *MMScript_ApiInstance(uint8_t bus)
+{
+    return (bus < MMSCRIPT_API_INSTANCES) ? _instances[bus] : NULL;
+}
+
+
+uint8_t MMScript_ApiInstanceIndex(uint8_t bus)
+{
+    return bus;
+}
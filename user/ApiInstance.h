@@ -0,0 +1,59 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __API_INSTANCE_H__
+#define __API_INSTANCE_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/* A copy of MemeServoAPI, compiled once per instance since the API keeps a single protocol state.
+   Each bus has its own, with commands & responses in flight at the same time as the other buses. */
+typedef struct
+{
+    MMSCRIPT_BUS calls;         /* Node calls, for MMScript_SetBus() */
+    void (*SetProtocol)(uint8_t address, void (*send)(uint8_t, uint8_t*, uint8_t));   /* UART */
+    void (*SetTimerFunction)(uint32_t (*get_ms)(void), void (*delay_ms)(uint32_t));
+    void (*SetCommandTimeOut)(uint16_t ms);
+    void (*OnData)(uint8_t data);
+    uint8_t (*GlobalStop)(void);
+}   MMSCRIPT_API_INSTANCE;
+
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_API_INSTANCES  MMSCRIPT_MAX_BUSES  /* One per bus, see MMScript_ApiInstance() */
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Get the API instance of a bus
+  * @note   Bus n uses instance n, never shared with another bus. The threads of one bus still
+  *         serialize their commands, see MMScript_SetApiLock().
+  * @param  bus: bus index
+  * @retval instance, NULL if bus isn't less than MMSCRIPT_API_INSTANCES
+  */
+const MMSCRIPT_API_INSTANCE *MMScript_ApiInstance(uint8_t bus);
+
+
+/**
+  * @brief  Get the index of the API instance of a bus
+  * @param  bus: bus index, less than MMSCRIPT_API_INSTANCES
+  * @retval index, the bus index
+  */
+uint8_t MMScript_ApiInstanceIndex(uint8_t bus);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __API_INSTANCE_H__ */
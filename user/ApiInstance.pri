@@ -0,0 +1,35 @@
+# One copy of MemeServoAPI per bus, see ApiInstance.h
+# MemeServoAPI.c is compiled in each ApiInstanceN.c, every symbol of the object but MMS_Instance_N
+# is then made local, so that the copies & the plain MemeServoAPI.c link together.
+
+API_INSTANCES = \
+    $$PWD/ApiInstance0.c \
+    $$PWD/ApiInstance1.c \
+    $$PWD/ApiInstance2.c \
+    $$PWD/ApiInstance3.c \
+    $$PWD/ApiInstance4.c \
+    $$PWD/ApiInstance5.c \
+    $$PWD/ApiInstance6.c \
+    $$PWD/ApiInstance7.c \
+    $$PWD/ApiInstance8.c \
+    $$PWD/ApiInstance9.c \
+    $$PWD/ApiInstance10.c \
+    $$PWD/ApiInstance11.c \
+    $$PWD/ApiInstance12.c \
+    $$PWD/ApiInstance13.c \
+    $$PWD/ApiInstance14.c \
+    $$PWD/ApiInstance15.c
+
+api_instance.input = API_INSTANCES
+api_instance.output = ${QMAKE_FILE_BASE}$${first(QMAKE_EXT_OBJ)}
+api_instance.commands = $$QMAKE_CC -c $(CFLAGS) $(INCPATH) -fno-common -o ${QMAKE_FILE_OUT} ${QMAKE_FILE_NAME} && \
+    objcopy --wildcard --keep-global-symbol="MMS_Instance_*" ${QMAKE_FILE_OUT}
+api_instance.depends = $$PWD/ApiInstanceImpl.h $$PWD/ApiInstance.h
+api_instance.variable_out = OBJECTS
+QMAKE_EXTRA_COMPILERS += api_instance
+
+SOURCES += $$PWD/ApiInstance.c
+
+HEADERS += \
+    $$PWD/ApiInstance.h \
+    $$PWD/ApiInstanceImpl.h
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 0, see ApiInstance.h */
+#define API_INSTANCE    0
+#include "ApiInstanceImpl.h"
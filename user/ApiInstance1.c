@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 1, see ApiInstance.h */
+#define API_INSTANCE    1
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 10, see ApiInstance.h */
+#define API_INSTANCE    10
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 11, see ApiInstance.h */
+#define API_INSTANCE    11
+#include "ApiInstanceImpl.h"
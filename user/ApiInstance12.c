@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 12, see ApiInstance.h */
+#define API_INSTANCE    12
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 13, see ApiInstance.h */
+#define API_INSTANCE    13
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 14, see ApiInstance.h */
+#define API_INSTANCE    14
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 15, see ApiInstance.h */
+#define API_INSTANCE    15
+#include "ApiInstanceImpl.h"
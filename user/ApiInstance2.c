@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 2, see ApiInstance.h */
+#define API_INSTANCE    2
+#include "ApiInstanceImpl.h"
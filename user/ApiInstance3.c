@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 3, see ApiInstance.h */
+#define API_INSTANCE    3
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 4, see ApiInstance.h */
+#define API_INSTANCE    4
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 5, see ApiInstance.h */
+#define API_INSTANCE    5
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 6, see ApiInstance.h */
+#define API_INSTANCE    6
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 7, see ApiInstance.h */
+#define API_INSTANCE    7
+#include "ApiInstanceImpl.h"
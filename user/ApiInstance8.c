@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 8, see ApiInstance.h */
+#define API_INSTANCE    8
+#include "ApiInstanceImpl.h"
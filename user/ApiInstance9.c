@@ -0,0 +1,3 @@
+/* MemeServoAPI instance 9, see ApiInstance.h */
+#define API_INSTANCE    9
+#include "ApiInstanceImpl.h"
@@ -0,0 +1,62 @@
+/**
+  * Body of an API instance, included by ApiInstanceN.c with API_INSTANCE defined to N.
+  * MemeServoAPI.c is compiled in with its names unchanged, its protocol state being static,
+  * each instance gets its own. The build then makes every symbol of ApiInstanceN.o local but
+  * MMS_Instance_N (objcopy --keep-global-symbol, see ApiInstance.pri), so that the instances
+  * & the plain MemeServoAPI.o link together whatever MemeServoAPI.c defines.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ApiInstance.h"
+
+
+/* Private define ------------------------------------------------------------*/
+
+#ifndef API_INSTANCE
+#error "API_INSTANCE must be defined to the index of the instance"
+#endif
+
+#define API_NAME(name)              API_NAME_(name, API_INSTANCE)
+#define API_NAME_(name, n)          API_NAME__(name, n)
+#define API_NAME__(name, n)         MMS_##name##_##n
+
+
+/* Private variables ---------------------------------------------------------*/
+
+#include "MemeServoAPI/MemeServoAPI.c"
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static void MMScript_ApiSetProtocol(uint8_t address, void (*send)(uint8_t, uint8_t*, uint8_t))
+{
+    MMS_SetProtocol(MMS_PROTOCOL_UART, address, send, NULL);
+}
+
+
+/* Exported variables --------------------------------------------------------*/
+
+const MMSCRIPT_API_INSTANCE API_NAME(Instance) =
+{
+    {
+        MMS_GetControlStatus,
+        MMS_GetAbsolutePosition,
+        MMS_StartServo,
+        MMS_ResetError,
+        MMS_StopServo,
+        MMS_HaltServo,
+        MMS_SetProfileAcceleration,
+        MMS_SetProfileVelocity,
+        MMS_ProfiledVelocityMove,
+        MMS_AbsolutePositionMove,
+        MMS_ProfiledAbsolutePositionMove,
+        MMS_RelativePositionMove,
+        MMS_ProfiledRelativePositionMove
+    },
+    MMScript_ApiSetProtocol,
+    MMS_SetTimerFunction,
+    MMS_SetCommandTimeOut,
+    MMS_OnData,
+    MMS_GlobalStop
+};
@@ -0,0 +1,148 @@
+
+/**
+  * Transaction scheduling of one bus:
+  *   Classes are served in strict priority order, FIFO within a class.
+  *   Polls are rate limited so that they take at most poll_share_percent of bus time:
+  *   after a poll occupying the bus for T, the next one may not start before T * (100 - share) / share.
+  *   T is the wire time at the configured baud rate, the measured time if unknown, which also
+  *   counts retry delays & host latency.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "BusScheduler.h"
+
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define BITS_PER_BYTE   10      /* 8N1 */
+
+
+/* Private macro -------------------------------------------------------------*/
+
+
+/* Private variables ---------------------------------------------------------*/
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Estimate time on the wire of API calls at configured baud rate
+  * @param  scheduler: scheduler
+  * @param  calls: number of API calls
+  * @retval us, 0 if baud rate unknown
+  */
+static uint64_t MMScript_SchedulerWireTime(const MMSCRIPT_SCHEDULER *scheduler, uint16_t calls);
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint64_t MMScript_SchedulerWireTime(const MMSCRIPT_SCHEDULER *scheduler, uint16_t calls)
+{
+    if (scheduler->config.baud_rate == 0)
+        return 0;
+
+    return (uint64_t)calls * MMSCRIPT_SCHEDULER_FRAME_BYTES * BITS_PER_BYTE * 1000000 / scheduler->config.baud_rate;
+}
+
+
+/* Public functions ---------------------------------------------------------*/
+
+void MMScript_SchedulerInit(MMSCRIPT_SCHEDULER *scheduler, const MMSCRIPT_SCHEDULER_CONFIG *config)
+{
+    memset(scheduler, 0, sizeof(MMSCRIPT_SCHEDULER));
+
+    if (config)
+        scheduler->config = *config;
+    else
+        scheduler->config.poll_share_percent = MMSCRIPT_SCHEDULER_DEFAULT_POLL_SHARE;
+
+    scheduler->running_priority = MMSCRIPT_PRIORITY_COUNT;
+}
+
+
+uint8_t MMScript_SchedulerPush(MMSCRIPT_SCHEDULER *scheduler, MMSCRIPT_TRANSACTION *transaction, MMSCRIPT_PRIORITY priority, uint16_t calls, uint64_t now_us)
+{
+    MMSCRIPT_SCHEDULER_ENTRY *entry;
+
+    if (priority >= MMSCRIPT_PRIORITY_COUNT || scheduler->count[priority] == MMSCRIPT_SCHEDULER_QUEUE_SIZE)
+        return 0;
+
+    entry = &scheduler->queues[priority][(scheduler->head[priority] + scheduler->count[priority]) % MMSCRIPT_SCHEDULER_QUEUE_SIZE];
+    entry->transaction = transaction;
+    entry->calls = calls;
+    entry->queued_us = now_us;
+
+    scheduler->count[priority]++;
+    return 1;
+}
+
+
+MMSCRIPT_TRANSACTION *MMScript_SchedulerPop(MMSCRIPT_SCHEDULER *scheduler, uint64_t now_us, uint64_t *wake_us)
+{
+    *wake_us = UINT64_MAX;
+
+    for (int priority=0; priority<MMSCRIPT_PRIORITY_COUNT; priority++)
+    {
+        if (scheduler->count[priority] == 0)
+            continue;
+
+        if (priority == MMSCRIPT_PRIORITY_POLL && now_us < scheduler->next_poll_us)
+        {
+            *wake_us = scheduler->next_poll_us;
+            return NULL;
+        }
+
+        scheduler->running = scheduler->queues[priority][scheduler->head[priority]];
+        scheduler->running_priority = (MMSCRIPT_PRIORITY)priority;
+
+        scheduler->head[priority] = (scheduler->head[priority] + 1) % MMSCRIPT_SCHEDULER_QUEUE_SIZE;
+        scheduler->count[priority]--;
+
+        return scheduler->running.transaction;
+    }
+
+    return NULL;
+}
+
+
+void MMScript_SchedulerDone(MMSCRIPT_SCHEDULER *scheduler, uint64_t start_us, uint64_t end_us)
+{
+    MMSCRIPT_PRIORITY priority = scheduler->running_priority;
+    MMSCRIPT_SCHEDULER_STATS *stats;
+    uint64_t busy_us, wire_us, latency_us;
+    uint8_t share = scheduler->config.poll_share_percent;
+
+    if (priority >= MMSCRIPT_PRIORITY_COUNT)
+        return;
+
+    stats = &scheduler->stats[priority];
+    busy_us = end_us - start_us;
+    wire_us = MMScript_SchedulerWireTime(scheduler, scheduler->running.calls);
+    latency_us = (start_us > scheduler->running.queued_us) ? start_us - scheduler->running.queued_us : 0;
+
+    stats->transactions++;
+    stats->busy_us += busy_us;
+    stats->wire_us += wire_us;
+    stats->total_latency_us += latency_us;
+
+    if (latency_us > stats->max_latency_us)
+        stats->max_latency_us = (uint32_t)latency_us;
+
+    if (priority == MMSCRIPT_PRIORITY_POLL && share > 0 && share < 100)
+        scheduler->next_poll_us = end_us + ((wire_us != 0) ? wire_us : busy_us) * (100 - share) / share;
+
+    scheduler->running_priority = MMSCRIPT_PRIORITY_COUNT;
+}
+
+
+void MMScript_GetSchedulerStats(const MMSCRIPT_SCHEDULER *scheduler, MMSCRIPT_PRIORITY priority, MMSCRIPT_SCHEDULER_STATS *stats)
+{
+    if (stats && priority < MMSCRIPT_PRIORITY_COUNT)
+        *stats = scheduler->stats[priority];
+}
@@ -0,0 +1,119 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BUS_SCHEDULER_H__
+#define __BUS_SCHEDULER_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_SCHEDULER_QUEUE_SIZE       16      /* Per priority class */
+#define MMSCRIPT_SCHEDULER_FRAME_BYTES      24      /* Estimated request + response bytes of one API call */
+#define MMSCRIPT_SCHEDULER_DEFAULT_POLL_SHARE 25    /* % of bus time polls may take */
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t baud_rate;             /* For wire time & poll share accounting, 0 if unknown: measured time */
+    uint8_t poll_share_percent;     /* Max share of bus time for polls, 0 or 100: unlimited */
+}   MMSCRIPT_SCHEDULER_CONFIG;
+
+typedef struct
+{
+    uint32_t transactions;          /* Completed */
+    uint64_t busy_us;               /* Measured bus time, request to last response */
+    uint64_t wire_us;               /* Estimated time on the wire at baud rate */
+    uint64_t total_latency_us;      /* Queued to started */
+    uint32_t max_latency_us;
+}   MMSCRIPT_SCHEDULER_STATS;
+
+typedef struct
+{
+    MMSCRIPT_TRANSACTION *transaction;
+    uint16_t calls;
+    uint64_t queued_us;
+}   MMSCRIPT_SCHEDULER_ENTRY;
+
+/* State of one bus, not thread safe, guard with the queue lock of the executor */
+typedef struct
+{
+    MMSCRIPT_SCHEDULER_CONFIG config;
+    MMSCRIPT_SCHEDULER_ENTRY queues[MMSCRIPT_PRIORITY_COUNT][MMSCRIPT_SCHEDULER_QUEUE_SIZE];
+    uint8_t head[MMSCRIPT_PRIORITY_COUNT];
+    uint8_t count[MMSCRIPT_PRIORITY_COUNT];
+    uint64_t next_poll_us;          /* Polls not started before */
+    MMSCRIPT_SCHEDULER_ENTRY running;
+    MMSCRIPT_PRIORITY running_priority;
+    MMSCRIPT_SCHEDULER_STATS stats[MMSCRIPT_PRIORITY_COUNT];
+}   MMSCRIPT_SCHEDULER;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Initialize scheduler, queues empty & statistics cleared
+  * @param  scheduler: scheduler to initialize
+  * @param  config: NULL for unknown baud rate & default poll share
+  * @retval None
+  */
+void MMScript_SchedulerInit(MMSCRIPT_SCHEDULER *scheduler, const MMSCRIPT_SCHEDULER_CONFIG *config);
+
+
+/**
+  * @brief  Queue a transaction
+  * @param  scheduler: scheduler
+  * @param  transaction: transaction to queue
+  * @param  priority: class, see MMScript_TransactionPriority()
+  * @param  calls: API calls of transaction, see MMScript_TransactionCalls()
+  * @param  now_us: monotonic us clock
+  * @retval 1: queued
+  *         0: queue of class full
+  */
+uint8_t MMScript_SchedulerPush(MMSCRIPT_SCHEDULER *scheduler, MMSCRIPT_TRANSACTION *transaction, MMSCRIPT_PRIORITY priority, uint16_t calls, uint64_t now_us);
+
+
+/**
+  * @brief  Take the next transaction to run
+  * @note   Call MMScript_SchedulerDone() when it completed, before the next call.
+  * @param  scheduler: scheduler
+  * @param  now_us: monotonic us clock
+  * @param  wake_us: when nothing can run, time a rate limited poll becomes eligible, UINT64_MAX if none
+  * @retval transaction, NULL if nothing can run now
+  */
+MMSCRIPT_TRANSACTION *MMScript_SchedulerPop(MMSCRIPT_SCHEDULER *scheduler, uint64_t now_us, uint64_t *wake_us);
+
+
+/**
+  * @brief  Account the transaction taken by the last MMScript_SchedulerPop()
+  * @param  scheduler: scheduler
+  * @param  start_us: time it started running
+  * @param  end_us: time it completed
+  * @retval None
+  */
+void MMScript_SchedulerDone(MMSCRIPT_SCHEDULER *scheduler, uint64_t start_us, uint64_t end_us);
+
+
+/**
+  * @brief  Get statistics of a priority class
+  * @param  scheduler: scheduler
+  * @param  priority: class
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetSchedulerStats(const MMSCRIPT_SCHEDULER *scheduler, MMSCRIPT_PRIORITY priority, MMSCRIPT_SCHEDULER_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __BUS_SCHEDULER_H__ */
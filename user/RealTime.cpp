@@ -0,0 +1,153 @@
+
+#include "RealTime.h"
+
+#include <QObject>
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+
+#define STACK_PREFAULT_SIZE (64 * 1024)
+
+
+const int64_t JitterStats::_bucketLimits[JitterStats::BUCKETS - 1] = { 10, 50, 100, 500, 1000 };
+
+
+#ifdef Q_OS_LINUX
+// Touch stack pages now, so that page faults don't hit the real-time loop
+static void prefaultStack()
+{
+    volatile unsigned char stack[STACK_PREFAULT_SIZE];
+
+    for (int i = 0; i < STACK_PREFAULT_SIZE; i += 4096)
+        stack[i] = 0;
+
+    (void)stack[0];
+}
+#endif
+
+
+bool RealTime::applyToCurrentThread(const RealTimeConfig &config, QString *error)
+{
+    if (!config.enabled)
+        return true;
+
+#ifdef Q_OS_LINUX
+    if (config.lockMemory)
+    {
+        int flags = MCL_CURRENT | MCL_FUTURE;
+
+#ifdef MCL_ONFAULT
+        // Later mappings, e.g. trajectory files of STREAM, locked page by page as they are read, not all at once
+        flags |= MCL_ONFAULT;
+#endif
+
+        // Kernels before 4.4 refuse MCL_ONFAULT
+        if (mlockall(flags) != 0 && (errno != EINVAL || flags == (MCL_CURRENT | MCL_FUTURE) || mlockall(MCL_CURRENT | MCL_FUTURE) != 0))
+        {
+            *error = QObject::tr("mlockall failed: %1").arg(strerror(errno));
+            return false;
+        }
+
+        prefaultStack();
+    }
+
+    if (config.cpu >= 0)
+    {
+        cpu_set_t cpuSet;
+
+        CPU_ZERO(&cpuSet);
+        CPU_SET(config.cpu, &cpuSet);
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+
+        if (ret != 0)
+        {
+            *error = QObject::tr("Pinning to CPU %1 failed: %2").arg(config.cpu).arg(strerror(ret));
+            return false;
+        }
+    }
+
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.priority;
+
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    if (ret != 0)
+    {
+        *error = QObject::tr("SCHED_FIFO priority %1 failed: %2").arg(config.priority).arg(strerror(ret));
+        return false;
+    }
+
+    return true;
+#else
+    *error = QObject::tr("Real-time mode is only supported on Linux");
+    return false;
+#endif
+}
+
+
+JitterStats::JitterStats()
+{
+    reset();
+}
+
+
+void JitterStats::reset()
+{
+    _count = 0;
+    _min = 0;
+    _max = 0;
+    _sum = 0;
+
+    for (int i = 0; i < BUCKETS; i++)
+        _buckets[i] = 0;
+}
+
+
+void JitterStats::record(int64_t lateness_us)
+{
+    if (_count == 0 || lateness_us < _min)
+        _min = lateness_us;
+
+    if (_count == 0 || lateness_us > _max)
+        _max = lateness_us;
+
+    _count++;
+    _sum += lateness_us;
+
+    int bucket = 0;
+
+    while (bucket < BUCKETS - 1 && lateness_us >= _bucketLimits[bucket])
+        bucket++;
+
+    _buckets[bucket]++;
+}
+
+
+QString JitterStats::report() const
+{
+    if (_count == 0)
+        return QObject::tr("Wake-up jitter: no samples");
+
+    QString msg = QObject::tr("Wake-up jitter over %1 waits, min/avg/max: %2/%3/%4us, histogram:")
+            .arg(_count).arg(_min).arg(_sum / (int64_t)_count).arg(_max);
+
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        if (i < BUCKETS - 1)
+            msg += QObject::tr(" <%1us: %2").arg(_bucketLimits[i]).arg(_buckets[i]);
+        else
+            msg += QObject::tr(" >=%1us: %2").arg(_bucketLimits[i - 1]).arg(_buckets[i]);
+    }
+
+    return msg;
+}
@@ -0,0 +1,55 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <QString>
+
+#include <stdint.h>
+
+
+struct RealTimeConfig
+{
+    bool enabled;
+    int priority;       // SCHED_FIFO priority, 1 to 99
+    int cpu;            // CPU to pin the thread to, -1 for no affinity
+    bool lockMemory;    // mlockall(), later mappings on fault where supported, & prefault stack
+
+    RealTimeConfig() : enabled(false), priority(80), cpu(-1), lockMemory(true) {}
+};
+
+
+class RealTime
+{
+public:
+    // Apply config to the calling thread, false with reason in error on failure
+    static bool applyToCurrentThread(const RealTimeConfig &config, QString *error);
+};
+
+
+// Lateness of wake-ups against their deadlines, fixed storage so that
+// recording doesn't allocate
+class JitterStats
+{
+public:
+    JitterStats();
+
+    void reset();
+    void record(int64_t lateness_us);
+    QString report() const;
+
+    uint64_t count() const { return _count; }
+    int64_t min() const { return _min; }
+    int64_t max() const { return _max; }
+    int64_t average() const { return _count ? _sum / (int64_t)_count : 0; }
+
+private:
+    enum { BUCKETS = 6 };
+    static const int64_t _bucketLimits[BUCKETS - 1];
+
+    uint64_t _count;
+    int64_t _min;
+    int64_t _max;
+    int64_t _sum;
+    uint64_t _buckets[BUCKETS];
+};
+
+#endif // REALTIME_H
@@ -0,0 +1,189 @@
+
+/**
+  * Per node round-trip time estimation, see RFC 6298:
+  *   RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|
+  *   SRTT   = 7/8 * SRTT + 1/8 * R
+  *   RTO    = SRTT + max(G, 4 * RTTVAR)
+  * A timed out command doubles RTO until the next valid sample.
+  * Clock, limits & statistics are kept per bus, the bus of the context selected by the calling thread.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "RttEstimator.h"
+
+#include <string.h>
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define NODE_COUNT  256
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Estimator state of a bus, commands of one bus are sequential */
+typedef struct
+{
+    MMSCRIPT_GET_MICRO_SECONDS get_us;
+    MMSCRIPT_SET_COMMAND_TIMEOUT set_timeout;
+    MMSCRIPT_RTT_CONFIG config;
+    uint64_t start_us;              /* Of the command in progress */
+    uint32_t current_timeout_ms;    /* Last given to set_timeout */
+    MMSCRIPT_RTT_STATS stats[NODE_COUNT];
+}   RTT_BUS;
+
+
+/* Private macro -------------------------------------------------------------*/
+
+
+/* Private variables ---------------------------------------------------------*/
+
+static const MMSCRIPT_RTT_CONFIG _default_config =
+{
+    MMSCRIPT_RTT_DEFAULT_FLOOR_MS,
+    MMSCRIPT_RTT_DEFAULT_CEILING_MS,
+    MMSCRIPT_RTT_DEFAULT_GRANULARITY_US
+};
+
+static RTT_BUS _buses[MMSCRIPT_MAX_BUSES];
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Clamp timeout to configured limits
+  * @param  config: limits of the bus
+  * @param  timeout_ms: timeout to clamp
+  * @retval clamped timeout
+  */
+static uint32_t MMScript_RttClamp(const MMSCRIPT_RTT_CONFIG *config, uint32_t timeout_ms);
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t MMScript_RttClamp(const MMSCRIPT_RTT_CONFIG *config, uint32_t timeout_ms)
+{
+    if (timeout_ms < config->floor_ms)
+        return config->floor_ms;
+
+    if (timeout_ms > config->ceiling_ms)
+        return config->ceiling_ms;
+
+    return timeout_ms;
+}
+
+
+/* Public functions ---------------------------------------------------------*/
+
+void MMScript_RttInit(MMSCRIPT_GET_MICRO_SECONDS GetMicroSecondsImpl, MMSCRIPT_SET_COMMAND_TIMEOUT SetCommandTimeOutImpl, const MMSCRIPT_RTT_CONFIG *config)
+{
+    RTT_BUS *rb = &_buses[MMScript_CurrentBus()];
+
+    memset(rb, 0, sizeof(RTT_BUS));
+    rb->get_us = GetMicroSecondsImpl;
+    rb->set_timeout = SetCommandTimeOutImpl ? SetCommandTimeOutImpl : MMS_SetCommandTimeOut;
+    rb->config = config ? *config : _default_config;
+
+    if (rb->config.floor_ms > rb->config.ceiling_ms)
+        rb->config.floor_ms = rb->config.ceiling_ms;
+
+    for (int i=0; i<NODE_COUNT; i++)
+        rb->stats[i].timeout_ms = rb->config.ceiling_ms;
+
+    rb->current_timeout_ms = rb->config.ceiling_ms;
+    rb->set_timeout(rb->current_timeout_ms);
+}
+
+
+void MMScript_RttBegin(uint8_t node_addr)
+{
+    RTT_BUS *rb = &_buses[MMScript_CurrentBus()];
+    const MMSCRIPT_RTT_STATS *stats = &rb->stats[node_addr];
+
+    if (rb->get_us == NULL)
+        return;
+
+    if (stats->timeout_ms != rb->current_timeout_ms)
+    {
+        rb->current_timeout_ms = stats->timeout_ms;
+        rb->set_timeout(rb->current_timeout_ms);
+    }
+
+    rb->start_us = rb->get_us();
+}
+
+
+uint8_t MMScript_RttEnd(uint8_t node_addr, uint8_t ret, uint8_t retransmitted)
+{
+    RTT_BUS *rb = &_buses[MMScript_CurrentBus()];
+    MMSCRIPT_RTT_STATS *stats = &rb->stats[node_addr];
+    uint32_t rtt_us, margin_us;
+
+    if (rb->get_us == NULL)
+        return ret;
+
+    rtt_us = (uint32_t)(rb->get_us() - rb->start_us);
+
+    if (ret != MMS_RESP_SUCCESS)
+    {
+        /* No response within timeout, back off until a valid sample */
+        if (ret == MMS_RESP_TIMEOUT || rtt_us >= stats->timeout_ms * 1000)
+        {
+            stats->timeouts++;
+            stats->timeout_ms = MMScript_RttClamp(&rb->config, stats->timeout_ms * 2);
+        }
+
+        return ret;
+    }
+
+    /* Karn's algorithm: response to a retransmitted command can't be matched to an attempt */
+    if (retransmitted)
+        return ret;
+
+    if (stats->samples == 0)
+    {
+        stats->srtt_us = rtt_us;
+        stats->rttvar_us = rtt_us / 2;
+        stats->min_rtt_us = rtt_us;
+        stats->max_rtt_us = rtt_us;
+    }
+    else
+    {
+        uint32_t delta = (stats->srtt_us > rtt_us) ? (stats->srtt_us - rtt_us) : (rtt_us - stats->srtt_us);
+
+        stats->rttvar_us = stats->rttvar_us - stats->rttvar_us / 4 + delta / 4;
+        stats->srtt_us = stats->srtt_us - stats->srtt_us / 8 + rtt_us / 8;
+
+        if (rtt_us < stats->min_rtt_us)
+            stats->min_rtt_us = rtt_us;
+
+        if (rtt_us > stats->max_rtt_us)
+            stats->max_rtt_us = rtt_us;
+    }
+
+    stats->samples++;
+    stats->last_rtt_us = rtt_us;
+
+    margin_us = 4 * stats->rttvar_us;
+
+    if (margin_us < rb->config.granularity_us)
+        margin_us = rb->config.granularity_us;
+
+    stats->timeout_ms = MMScript_RttClamp(&rb->config, (stats->srtt_us + margin_us + 999) / 1000);
+
+    return ret;
+}
+
+
+void MMScript_GetRttStats(uint8_t node_addr, MMSCRIPT_RTT_STATS *stats)
+{
+    MMScript_GetBusRttStats(MMScript_CurrentBus(), node_addr, stats);
+}
+
+
+void MMScript_GetBusRttStats(uint8_t bus, uint8_t node_addr, MMSCRIPT_RTT_STATS *stats)
+{
+    if (stats && bus < MMSCRIPT_MAX_BUSES)
+        *stats = _buses[bus].stats[node_addr];
+}
@@ -0,0 +1,101 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RTT_ESTIMATOR_H__
+#define __RTT_ESTIMATOR_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef void (*MMSCRIPT_SET_COMMAND_TIMEOUT)(uint16_t ms);
+
+typedef struct
+{
+    uint32_t floor_ms;          /* Lower limit of command timeout */
+    uint32_t ceiling_ms;        /* Upper limit of command timeout, also used before the first sample */
+    uint32_t granularity_us;    /* Minimum margin added over smoothed RTT */
+}   MMSCRIPT_RTT_CONFIG;
+
+typedef struct
+{
+    uint32_t samples;           /* Valid RTT samples, retransmitted commands excluded */
+    uint32_t timeouts;          /* Commands which ran into the timeout */
+    uint32_t last_rtt_us;
+    uint32_t min_rtt_us;
+    uint32_t max_rtt_us;
+    uint32_t srtt_us;           /* Smoothed RTT */
+    uint32_t rttvar_us;         /* Smoothed mean deviation of RTT */
+    uint32_t timeout_ms;        /* Command timeout currently used for the node */
+}   MMSCRIPT_RTT_STATS;
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_RTT_DEFAULT_FLOOR_MS       5
+#define MMSCRIPT_RTT_DEFAULT_CEILING_MS     100
+#define MMSCRIPT_RTT_DEFAULT_GRANULARITY_US 1000
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Enable adaptive command timeout
+  * @note   Timeout of each node is derived from its measured round-trip times
+  *         the way TCP derives its RTO (RFC 6298), clamped to [floor_ms, ceiling_ms].
+  *         Clock, limits & statistics of the current bus only are set.
+  * @param  GetMicroSecondsImpl: monotonic us clock, NULL disables the estimator of the bus
+  * @param  SetCommandTimeOutImpl: timeout of the API instance of the bus, NULL for MMS_SetCommandTimeOut()
+  * @param  config: limits, NULL for defaults
+  * @retval None
+  */
+void MMScript_RttInit(MMSCRIPT_GET_MICRO_SECONDS GetMicroSecondsImpl, MMSCRIPT_SET_COMMAND_TIMEOUT SetCommandTimeOutImpl, const MMSCRIPT_RTT_CONFIG *config);
+
+
+/**
+  * @brief  Prepare a command to node: set its command timeout & start timing
+  * @param  node_addr: node the command is sent to
+  * @retval None
+  */
+void MMScript_RttBegin(uint8_t node_addr);
+
+
+/**
+  * @brief  Finish timing of a command to node & update its estimation
+  * @param  node_addr: node the command was sent to
+  * @param  ret: response code of the command
+  * @param  retransmitted: non-zero if the command is a retry, its RTT is ambiguous then & not sampled
+  * @retval ret, so that it can wrap the command call in an expression
+  */
+uint8_t MMScript_RttEnd(uint8_t node_addr, uint8_t ret, uint8_t retransmitted);
+
+
+/**
+  * @brief  Get RTT statistics of node
+  * @param  node_addr: node address
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetRttStats(uint8_t node_addr, MMSCRIPT_RTT_STATS *stats);
+
+
+/**
+  * @brief  Get RTT statistics of node on given bus, from any thread
+  * @param  bus: bus index
+  * @param  node_addr: node address
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetBusRttStats(uint8_t bus, uint8_t node_addr, MMSCRIPT_RTT_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __RTT_ESTIMATOR_H__ */
@@ -0,0 +1,160 @@
+
+/**
+  * Recognizers of keywords & commands, from the tables of ScriptCommands.h.
+  * Each name hashes to its own slot of 64, KEYWORD_HASH() being perfect on both tables (checked by
+  * the tests). A prefix is recognized by hashing the letters it starts with, longest first, then
+  * comparing the name of the slot: 'PVM' is never taken as 'VM', nor 'FORK' as 'FOR'.
+  * C having no constexpr, the slots are filled from the tables on first use.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ScriptCommands.h"
+
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct
+{
+    const char *name;
+    uint8_t length;
+    uint8_t operands;
+}   COMMAND_NAME;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define SLOT_COUNT      64
+
+#if defined(_MSC_VER)
+#define ATOMIC_LOAD(p)      (*(volatile uint8_t*)(p))
+#define ATOMIC_STORE(p, v)  (*(volatile uint8_t*)(p) = (v))
+#else
+#define ATOMIC_LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+
+/* Private macro -------------------------------------------------------------*/
+
+/* First two letters, last letter & length, no collision in 64 slots for either table */
+#define KEYWORD_HASH(p, n)  (((uint8_t)(p)[0] + 5 * (uint8_t)(p)[1] + (uint8_t)(p)[(n) - 1] + 17 * (n)) & (SLOT_COUNT - 1))
+
+#define KEYWORD_ENTRY(name)                     { #name, sizeof(#name) - 1, 0 },
+#define COMMAND_ENTRY(name, operands, error)    { #name, sizeof(#name) - 1, operands },
+
+
+/* Private variables ---------------------------------------------------------*/
+
+static const COMMAND_NAME _keywords[MMSCRIPT_KEYWORD_COUNT] = { MMSCRIPT_KEYWORDS(KEYWORD_ENTRY) };
+static const COMMAND_NAME _commands[MMSCRIPT_OP_COUNT] = { MMSCRIPT_NODE_COMMANDS(COMMAND_ENTRY) };
+
+/* Index + 1 in the tables above by hash, 0 if free */
+static uint8_t _keyword_slots[SLOT_COUNT];
+static uint8_t _command_slots[SLOT_COUNT];
+static uint8_t _slots_ready = 0;
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+static void MMScript_FillSlots(void);
+static int8_t MMScript_Recognize(const char *p, uint8_t *length, const COMMAND_NAME *names, const uint8_t *slots, uint8_t maxLength);
+
+
+/* Exported functions --------------------------------------------------------*/
+
+int8_t MMScript_Keyword(const char *p, uint8_t *length)
+{
+    if (!ATOMIC_LOAD(&_slots_ready))
+        MMScript_FillSlots();
+
+    return MMScript_Recognize(p, length, _keywords, _keyword_slots, MMSCRIPT_MAX_KEYWORD_LENGTH);
+}
+
+
+int8_t MMScript_NodeCommand(const char *p, uint8_t *length)
+{
+    if (!ATOMIC_LOAD(&_slots_ready))
+        MMScript_FillSlots();
+
+    return MMScript_Recognize(p, length, _commands, _command_slots, MMSCRIPT_MAX_KEYWORD_LENGTH);
+}
+
+
+const char *MMScript_KeywordName(int8_t keyword)
+{
+    if (keyword < 0 || keyword >= MMSCRIPT_KEYWORD_COUNT)
+        return NULL;
+
+    return _keywords[keyword].name;
+}
+
+
+const char *MMScript_NodeCommandName(int8_t op, uint8_t *operands)
+{
+    if (op < 0 || op >= MMSCRIPT_OP_COUNT)
+        return NULL;
+
+    if (operands)
+        *operands = _commands[op].operands;
+
+    return _commands[op].name;
+}
+
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Fill the slots from the tables
+  * @note   Idempotent, threads racing on first use write the same values.
+  * @retval None
+  */
+static void MMScript_FillSlots(void)
+{
+    uint8_t i;
+
+    /* Filled in reverse, a collision would keep the first name of the table & fail the tests */
+    for (i=MMSCRIPT_KEYWORD_COUNT; i>0; i--)
+        ATOMIC_STORE(&_keyword_slots[KEYWORD_HASH(_keywords[i - 1].name, _keywords[i - 1].length)], i);
+
+    for (i=MMSCRIPT_OP_COUNT; i>0; i--)
+        ATOMIC_STORE(&_command_slots[KEYWORD_HASH(_commands[i - 1].name, _commands[i - 1].length)], i);
+
+    ATOMIC_STORE(&_slots_ready, 1);
+}
+
+
+/**
+  * @brief  Recognize the longest name p starts with
+  * @param  p: text
+  * @param  length: output of length of name
+  * @param  names: table of names
+  * @param  slots: index + 1 in names by hash
+  * @param  maxLength: length of the longest name
+  * @retval index in names, -1 if none
+  */
+static int8_t MMScript_Recognize(const char *p, uint8_t *length, const COMMAND_NAME *names, const uint8_t *slots, uint8_t maxLength)
+{
+    uint8_t n = 0;
+
+    /* Letters the name may span */
+    while (n < maxLength && p[n] >= 'A' && p[n] <= 'Z')
+        n++;
+
+    /* Names are 2 letters at least */
+    for (; n>=2; n--)
+    {
+        uint8_t i = slots[KEYWORD_HASH(p, n)];
+
+        if (i > 0 && names[i - 1].length == n && memcmp(names[i - 1].name, p, n) == 0)
+        {
+            *length = n;
+            return (int8_t)(i - 1);
+        }
+    }
+
+    *length = 0;
+    return -1;
+}
@@ -0,0 +1,127 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCRIPT_COMMANDS_H__
+#define __SCRIPT_COMMANDS_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include <stdint.h>
+
+
+/**
+  * Keywords of script lines & commands of node lines, declared once. The recognizers below, the
+  * dispatch of MMScript_ProcessLine() & MMScript_ParseCommands() and the compiler of mms2c are
+  * generated from these tables: adding a command is adding its line here & its case there.
+  * A keyword is recognized as the longest one the line starts with, whatever the order of the table.
+  */
+
+/* X(NAME): line starting with keyword NAME */
+#define MMSCRIPT_KEYWORDS(X)                                                        \
+    X(CALL)                                                                         \
+    X(FORK)                                                                         \
+    X(JOIN)                                                                         \
+    X(RETRY)                                                                        \
+    X(FOR)                                                                          \
+    X(NEXT)                                                                         \
+    X(RET)                                                                          \
+    X(LET)                                                                          \
+    X(IF)                                                                           \
+    X(GOTO)                                                                         \
+    X(END)                                                                          \
+    X(DELAY)                                                                        \
+    X(UDELAY)                                                                       \
+    X(PERIOD)                                                                       \
+    X(STREAM)                                                                       \
+    X(SCURVE)                                                                       \
+    X(SPLINE)                                                                       \
+    X(TABLE)                                                                        \
+    X(GEAR)                                                                         \
+    X(CAM)                                                                          \
+    X(BLEND)                                                                        \
+    X(UNTIL)                                                                        \
+    X(WAIT)
+
+/* X(NAME, OPERANDS, ERROR): command of a node line "NODE,NAME OPERAND{,OPERAND}", ERROR if operands are missing */
+#define MMSCRIPT_NODE_COMMANDS(X)                                                   \
+    X(START, 1, MMS_ERR_ERROR_START_PARAM)  /* MMS_ResetError, MMS_StartServo */    \
+    X(STOP,  0, 0)                          /* MMS_StopServo */                     \
+    X(HALT,  0, 0)                          /* MMS_HaltServo */                     \
+    X(VM,    1, MMS_ERR_MISSING_VM_PARAM)   /* MMS_ProfiledVelocityMove */          \
+    X(PVM,   2, MMS_ERR_MISSING_PVM_PARAM)  /* + MMS_SetProfileAcceleration */      \
+    X(AP,    1, MMS_ERR_MISSING_AP_PARAM)   /* MMS_AbsolutePositionMove */          \
+    X(PAP,   3, MMS_ERR_MISSING_PAP_PARAM)  /* MMS_ProfiledAbsolutePositionMove */  \
+    X(RP,    1, MMS_ERR_MISSING_RP_PARAM)   /* MMS_RelativePositionMove */          \
+    X(PRP,   3, MMS_ERR_MISSING_PRP_PARAM)  /* MMS_ProfiledRelativePositionMove */
+
+
+/* Exported types ------------------------------------------------------------*/
+
+#define MMSCRIPT_KEYWORD_ENUM(name)             MMSCRIPT_KEYWORD_##name,
+#define MMSCRIPT_OP_ENUM(name, operands, error) MMSCRIPT_OP_##name,
+
+typedef enum
+{
+    MMSCRIPT_KEYWORDS(MMSCRIPT_KEYWORD_ENUM)
+    MMSCRIPT_KEYWORD_COUNT
+}   MMSCRIPT_KEYWORD;
+
+/* Bus commands of node lines, as compiled by mms2c */
+typedef enum
+{
+    MMSCRIPT_NODE_COMMANDS(MMSCRIPT_OP_ENUM)
+    MMSCRIPT_OP_COUNT
+}   MMSCRIPT_OP;
+
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_MAX_KEYWORD_LENGTH     6
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Recognize the keyword a script line starts with
+  * @note   Perfect hash of the first two, the last letter & the length of each candidate prefix.
+  * @param  p: line, label removed
+  * @param  length: output of length of keyword
+  * @retval MMSCRIPT_KEYWORD, -1 if none
+  */
+int8_t MMScript_Keyword(const char *p, uint8_t *length);
+
+
+/**
+  * @brief  Recognize the command of a node line
+  * @param  p: command, node id removed
+  * @param  length: output of length of command
+  * @retval MMSCRIPT_OP, -1 if none
+  */
+int8_t MMScript_NodeCommand(const char *p, uint8_t *length);
+
+
+/**
+  * @brief  Get name of a keyword
+  * @param  keyword: MMSCRIPT_KEYWORD
+  * @retval name, NULL if invalid
+  */
+const char *MMScript_KeywordName(int8_t keyword);
+
+
+/**
+  * @brief  Get name & number of operands of a command of node lines
+  * @param  op: MMSCRIPT_OP
+  * @param  operands: output of number of operands, NULL if not needed
+  * @retval name, NULL if invalid
+  */
+const char *MMScript_NodeCommandName(int8_t op, uint8_t *operands);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SCRIPT_COMMANDS_H__ */
@@ -0,0 +1,556 @@
+
+/**
+  * Ahead of time compiler of scripts, used by mms2c. Each line is compiled to a C function mirroring
+  * what MMScript_ProcessLine() does with it, lines it can't mirror exactly are left to the interpreter.
+  * Bus commands are handed back to the interpreter as MMSCRIPT_NATIVE_OP, so that they are retried,
+  * queued by BLEND or submitted to the executor as those of interpreted lines.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ScriptCompiler.h"
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* C source of a line being compiled */
+typedef struct
+{
+    char *text;
+    size_t size;
+    size_t length;
+    uint8_t overflow;
+}   SOURCE;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define MAX_LINE_SOURCE     8192
+#define MAX_NATIVE_OPS      (sizeof(((MMSCRIPT_NATIVE_FRAME*)0)->ops) / sizeof(MMSCRIPT_NATIVE_OP))
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#define SKIP_SPACE(p)                              \
+    do {                                           \
+        while(*p == ' ' || *p == '\t' || *p == ';')\
+            p++;                                   \
+    }   while(0)
+
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Append formatted text to source
+  * @param  src: source
+  * @param  format: printf format
+  * @retval None
+  */
+static void MMScript_Emit(SOURCE *src, const char *format, ...);
+
+
+/**
+  * @brief  Compile an expression as MMScript_Eval() evaluates it, left to right in int16_t
+  * @param  src: source
+  * @param  result: C variable to assign
+  * @param  expr: expression, up to '\0'
+  * @retval 1: compiled
+  *         0: rejected by MMScript_Eval(), or reads a table
+  */
+static uint8_t MMScript_CompileExpr(SOURCE *src, const char *result, const char *expr);
+
+
+/**
+  * @brief  Compile the expression between start & end
+  * @retval 1: compiled
+  *         0: not compiled
+  */
+static uint8_t MMScript_CompileRange(SOURCE *src, const char *result, const char *start, const char *end);
+
+
+/**
+  * @brief  Compile a jump to label, resolving the line it goes to
+  * @param  src: source
+  * @param  indent: indentation
+  * @param  label: label
+  * @retval None
+  */
+static void MMScript_CompileJump(SOURCE *src, const char *indent, int16_t label);
+
+
+/**
+  * @brief  Compile LET, IF, GOTO or commands
+  * @retval 1: compiled
+  *         0: not compiled
+  */
+static uint8_t MMScript_CompileLet(SOURCE *src, const char *line);
+static uint8_t MMScript_CompileIf(SOURCE *src, const char *line);
+static uint8_t MMScript_CompileGoto(SOURCE *src, const char *line);
+static uint8_t MMScript_CompileCommands(SOURCE *src, const char *line);
+
+
+/**
+  * @brief  Compile operands as MMScript_Operands() reads them
+  * @param  src: source
+  * @param  p: operands
+  * @param  index: index of command in line
+  * @param  count: number of operands
+  * @retval 1: compiled
+  *         0: rejected by MMScript_Operands(), or table item
+  */
+static uint8_t MMScript_CompileOperands(SOURCE *src, const char *p, uint8_t index, uint8_t count);
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static void MMScript_Emit(SOURCE *src, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    if (src->overflow)
+        return;
+
+    va_start(args, format);
+    n = vsnprintf(src->text + src->length, src->size - src->length, format, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= src->size - src->length)
+    {
+        src->overflow = 1;
+        return;
+    }
+
+    src->length += (size_t)n;
+}
+
+
+static uint8_t MMScript_CompileExpr(SOURCE *src, const char *result, const char *expr)
+{
+    long number;
+    char *end;
+
+    SKIP_SPACE(expr);
+
+    if (*expr <= '9' && *expr >= '0')
+    {
+        number = strtol(expr, &end, 10);
+
+        if (number > INT16_MAX)
+            return 0;
+
+        MMScript_Emit(src, "    %s = %ld;\n", result, number);
+        expr = end;
+    }
+    else if (*expr <= 'Z' && *expr >= 'A')
+    {
+        if (expr[1] == '[')
+            return 0;
+
+        MMScript_Emit(src, "    %s = f->vars[%d];\n", result, *expr - 'A');
+        expr++;
+    }
+    else
+        return 0;
+
+    SKIP_SPACE(expr);
+
+    while (*expr)
+    {
+        char op = *expr;
+
+        if (op != '+' && op != '-' && op != '*' && op != '/')
+            return 0;
+
+        expr++;
+        SKIP_SPACE(expr);
+
+        if (*expr <= '9' && *expr >= '0')
+        {
+            number = strtol(expr, &end, 10);
+
+            /* Division by 0 is left to the interpreter, which reports it */
+            if (number > INT_MAX || (op == '/' && number == 0))
+                return 0;
+
+            MMScript_Emit(src, "    %s = (int16_t)(%s %c %ld);\n", result, result, op, number);
+            expr = end;
+        }
+        else if (*expr <= 'Z' && *expr >= 'A')
+        {
+            if (expr[1] == '[')
+                return 0;
+
+            if (op == '/')
+                MMScript_Emit(src, "    if (f->vars[%d] == 0)\n        return MMS_ERR_DIVISION_BY_ZERO;\n", *expr - 'A');
+
+            MMScript_Emit(src, "    %s = (int16_t)(%s %c f->vars[%d]);\n", result, result, op, *expr - 'A');
+            expr++;
+        }
+        else
+            return 0;
+
+        SKIP_SPACE(expr);
+    }
+
+    return 1;
+}
+
+
+static uint8_t MMScript_CompileRange(SOURCE *src, const char *result, const char *start, const char *end)
+{
+    char expr[256];
+
+    if (end < start || end - start >= (int)sizeof(expr))
+        return 0;
+
+    memcpy(expr, start, end - start);
+    expr[end - start] = '\0';
+
+    return MMScript_CompileExpr(src, result, expr);
+}
+
+
+static void MMScript_CompileJump(SOURCE *src, const char *indent, int16_t label)
+{
+    uint16_t count = MMScript_LineCount();
+
+    MMScript_Emit(src, "%sf->nextLabel = %d;\n", indent, label);
+
+    for (uint16_t i=0; label > 0 && i<count; i++)
+    {
+        int16_t line_label;
+
+        /* First line of label, as the interpreter's scan finds it */
+        if (MMScript_LineText(i, &line_label) != NULL && line_label == label)
+        {
+            MMScript_Emit(src, "%sf->nextLine = %u;\n", indent, i);
+            break;
+        }
+    }
+}
+
+
+static uint8_t MMScript_CompileLet(SOURCE *src, const char *line)
+{
+    const char *p;
+    char varname;
+
+    if (strchr(line, '=') == NULL)
+        return 0;
+
+    p = line + 3;
+    SKIP_SPACE(p);
+
+    if (*p < 'A' || *p > 'Z')
+        return 0;
+
+    varname = *p;
+
+    for (p++; *p != '='; p++)
+    {
+        if (*p != ' ')
+            return 0;
+    }
+
+    p++;
+
+    if ((*p < 'A' || *p > 'Z') && (*p < '0' || *p > '9') && *p != ' ')
+        return 0;
+
+    MMScript_Emit(src, "    int16_t r;\n\n");
+
+    if (!MMScript_CompileExpr(src, "r", p))
+        return 0;
+
+    MMScript_Emit(src, "    f->vars[%d] = r;\n", varname - 'A');
+    return 1;
+}
+
+
+static uint8_t MMScript_CompileIf(SOURCE *src, const char *line)
+{
+    static const char *OPERATORS[] = { "==", ">=", "<=", "!=", ">", "<" };
+    const char *left_bracket = strchr(line, '(');
+    const char *right_bracket = strchr(line, ')');
+    const char *p, *expr_start, *op, *then;
+    uint8_t i;
+    int label;
+
+    if (left_bracket == NULL || right_bracket == NULL)
+        return 0;
+
+    if (strchr(left_bracket + 1, '(') != NULL || strchr(right_bracket + 1, ')') != NULL)
+        return 0;
+
+    p = left_bracket + 1;
+    SKIP_SPACE(p);
+    expr_start = p;
+
+    op = strpbrk(p, "><=!");
+
+    if (op == NULL || op > right_bracket)
+        return 0;
+
+    for (p = op; *p == '>' || *p == '<' || *p == '=' || *p == '!'; p++)
+        ;
+
+    then = strstr(line, "THEN");
+
+    if (then == NULL || sscanf(then + 4, "%d", &label) != 1)
+        return 0;
+
+    for (i=0; i<sizeof(OPERATORS) / sizeof(OPERATORS[0]); i++)
+    {
+        if (strncmp(op, OPERATORS[i], strlen(OPERATORS[i])) == 0)
+            break;
+    }
+
+    if (i == sizeof(OPERATORS) / sizeof(OPERATORS[0]))
+        return 0;
+
+    MMScript_Emit(src, "    int16_t l, r;\n\n");
+
+    if (!MMScript_CompileRange(src, "l", expr_start, op) || !MMScript_CompileRange(src, "r", p, right_bracket))
+        return 0;
+
+    MMScript_Emit(src, "\n    if (l %s r)\n    {\n", OPERATORS[i]);
+    MMScript_CompileJump(src, "        ", (int16_t)label);
+    MMScript_Emit(src, "    }\n");
+
+    return 1;
+}
+
+
+static uint8_t MMScript_CompileGoto(SOURCE *src, const char *line)
+{
+    int label;
+
+    if (sscanf(line + 4, "%d", &label) != 1)
+        return 0;
+
+    MMScript_CompileJump(src, "    ", (int16_t)label);
+    return 1;
+}
+
+
+static uint8_t MMScript_CompileOperands(SOURCE *src, const char *p, uint8_t index, uint8_t count)
+{
+    for (uint8_t i=0; i<count; i++)
+    {
+        long number;
+        char *end;
+
+        SKIP_SPACE(p);
+
+        if (i > 0)
+        {
+            if (*p != ',')
+                return 0;
+
+            p++;
+            SKIP_SPACE(p);
+        }
+
+        if (*p <= 'Z' && *p >= 'A')
+        {
+            if (p[1] == '[')
+                return 0;
+
+            MMScript_Emit(src, "    f->ops[%u].args[%u] = f->vars[%d];\n", index, i, *p - 'A');
+            p++;
+            continue;
+        }
+
+        number = strtol(p, &end, 10);
+
+        if (end == p || number > INT32_MAX || number < INT32_MIN)
+            return 0;
+
+        MMScript_Emit(src, "    f->ops[%u].args[%u] = %ld;\n", index, i, number);
+        p = end;
+    }
+
+    return 1;
+}
+
+
+static uint8_t MMScript_CompileCommands(SOURCE *src, const char *line)
+{
+    const char *p = line;
+    uint8_t count = 0;
+
+    while (p != NULL)
+    {
+        const char *token = strchr(p, ',');
+        int node_id;
+        uint8_t length, operands;
+        int8_t command;
+
+        if (count == MAX_NATIVE_OPS || token == NULL || sscanf(p, "%x", &node_id) != 1)
+            return 0;
+
+        p = token + 1;
+        SKIP_SPACE(p);
+
+        command = MMScript_NodeCommand(p, &length);
+
+        if (command < 0)
+            return 0;
+
+        MMScript_Emit(src, "%s    f->ops[%u].type = MMSCRIPT_OP_%s;\n", (count > 0) ? "\n" : "", count, MMScript_NodeCommandName(command, &operands));
+        MMScript_Emit(src, "    f->ops[%u].node = 0x%02X;\n", count, (uint8_t)node_id);
+
+        if (command == MMSCRIPT_OP_START)
+        {
+            int mode;
+
+            if (sscanf(p + length, "%d", &mode) != 1 || (mode != MMS_MODE_KEEP && mode != MMS_MODE_ZERO && mode != MMS_MODE_RESET))
+                return 0;
+
+            MMScript_Emit(src, "    f->ops[%u].args[0] = %d;\n", count, mode);
+        }
+        else if (!MMScript_CompileOperands(src, p + length, count, operands))
+            return 0;
+
+        count++;
+
+        p = strchr(p, ';');
+
+        if (p)
+            p++;    /* Skip ';' */
+    }
+
+    MMScript_Emit(src, "\n    f->opCount = %u;\n", count);
+    return 1;
+}
+
+
+/* Public functions ---------------------------------------------------------*/
+
+uint8_t MMScript_CompileLine(uint16_t index, char *body, size_t size)
+{
+    SOURCE src;
+    const char *line;
+    int8_t keyword;
+    int16_t label;
+    uint8_t length, compiled;
+
+    line = MMScript_LineText(index, &label);
+
+    if (line == NULL)
+        return 0;
+
+    /* A line starting with no keyword is a command line */
+    keyword = MMScript_Keyword(line, &length);
+
+    src.text = body;
+    src.size = size;
+    src.length = 0;
+    src.overflow = 0;
+
+    switch (keyword)
+    {
+    case -1:
+        compiled = MMScript_CompileCommands(&src, line);
+        break;
+
+    case MMSCRIPT_KEYWORD_LET:
+        compiled = MMScript_CompileLet(&src, line);
+        break;
+
+    case MMSCRIPT_KEYWORD_IF:
+        compiled = MMScript_CompileIf(&src, line);
+        break;
+
+    case MMSCRIPT_KEYWORD_GOTO:
+        compiled = MMScript_CompileGoto(&src, line);
+        break;
+
+    case MMSCRIPT_KEYWORD_END:
+        MMScript_Emit(&src, "    f->nextLabel = 0;\n");
+        compiled = 1;
+        break;
+
+    default:
+        compiled = 0;   /* Tasks, delays, WAIT..., state of the interpreter */
+        break;
+    }
+
+    return compiled && !src.overflow;
+}
+
+
+int16_t MMScript_Compile(FILE *out, uint16_t *compiled)
+{
+    uint16_t count = MMScript_LineCount();
+    uint16_t lines = 0;
+    uint8_t *native;
+    char *body;
+
+    if (compiled)
+        *compiled = 0;
+
+    if (count == 0)
+        return MMS_PARSE_ERR_MISSING_LABEL;
+
+    native = (uint8_t*)calloc(count, 1);
+    body = (char*)malloc(MAX_LINE_SOURCE);
+
+    if (native == NULL || body == NULL)
+    {
+        free(native);
+        free(body);
+        return MMS_PARSE_ERR_MALLOC;
+    }
+
+    fprintf(out, "/* Generated by mms2c, do not edit */\n\n");
+    fprintf(out, "#include \"ScriptProcessor.h\"\n\n\n");
+
+    for (uint16_t i=0; i<count; i++)
+    {
+        int16_t label;
+        const char *line = MMScript_LineText(i, &label);
+
+        if (!MMScript_CompileLine(i, body, MAX_LINE_SOURCE))
+            continue;
+
+        native[i] = 1;
+        lines++;
+
+        /* Line as comment, unless it would end it */
+        if (strstr(line, "*/") == NULL)
+            fprintf(out, "/* %d: %s */\n", label, line);
+
+        fprintf(out, "static int16_t line_%u(MMSCRIPT_NATIVE_FRAME *f)\n{\n%s\n    return 0;\n}\n\n\n", i, body);
+    }
+
+    fprintf(out, "static const MMSCRIPT_NATIVE_LINE lines[%u] =\n{\n", count);
+
+    for (uint16_t i=0; i<count; i++)
+    {
+        if (native[i])
+            fprintf(out, "    line_%u,\n", i);
+        else
+            fprintf(out, "    NULL,\n");
+    }
+
+    fprintf(out, "};\n\n");
+    fprintf(out, "MMSCRIPT_NATIVE_EXPORT const MMSCRIPT_NATIVE_PROGRAM mmscript_native_program =\n{\n");
+    fprintf(out, "    MMSCRIPT_NATIVE_VERSION, %u, 0x%08lXu, lines\n};\n", count, (unsigned long)MMScript_ScriptHash());
+
+    free(native);
+    free(body);
+
+    if (compiled)
+        *compiled = lines;
+
+    return ferror(out) ? MMS_PARSE_ERR_FILE : 0;
+}
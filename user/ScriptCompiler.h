@@ -0,0 +1,54 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCRIPT_COMPILER_H__
+#define __SCRIPT_COMPILER_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+#include <stdio.h>
+
+
+/* Exported types ------------------------------------------------------------*/
+
+
+/* Exported constants --------------------------------------------------------*/
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Compile the script parsed in the selected context to C
+  * @note   The source defines MMSCRIPT_NATIVE_SYMBOL, to be built as a shared library & attached by
+  *         MMScript_AttachNative(). LET, IF, GOTO, END & lines of bus commands are compiled, other lines,
+  *         lines with TABLE items & lines the interpreter would reject are left to the interpreter.
+  * @param  out: output of C source
+  * @param  compiled: output of number of lines compiled, NULL if not needed
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_FILE: write error
+  *         MMS_PARSE_ERR_MISSING_LABEL: no script parsed
+  */
+int16_t MMScript_Compile(FILE *out, uint16_t *compiled);
+
+
+/**
+  * @brief  Compile one line of the script parsed to the body of a C function
+  * @param  index: line index, from 0
+  * @param  body: output of statements working on MMSCRIPT_NATIVE_FRAME *f
+  * @param  size: size of body
+  * @retval 1: compiled
+  *         0: left to the interpreter
+  */
+uint8_t MMScript_CompileLine(uint16_t index, char *body, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SCRIPT_COMPILER_H__ */
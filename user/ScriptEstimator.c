@@ -0,0 +1,1217 @@
+
+/**
+  * Static estimate of the cycle time of scripts, see ScriptEstimator.h. Lines are read back through
+  * MMScript_LineText() as mms2c compiles them, the walk keeps its own clock, variables & nodes: nothing
+  * is sent on the bus & nothing of the context parsed is changed.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ScriptEstimator.h"
+#include "ScriptCommands.h"
+#include "TrajectoryStream.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t id;
+    uint8_t known;              /* Position known */
+    int32_t from;               /* Start of the last move */
+    int32_t position;           /* Target of the last move */
+    uint32_t velocity;          /* Profile set by PAP/PRP, of the config until then */
+    uint32_t acceleration;
+    uint32_t move_velocity;     /* Profile of the last move */
+    uint32_t move_acceleration;
+    uint64_t start_us;          /* Of the last move */
+    uint64_t end_us;
+}   NODE_MODEL;
+
+typedef enum
+{
+    WALK_REACHED,               /* Line to stop at reached, or end of script */
+    WALK_RET,
+    WALK_END,                   /* END, or the script can't go on */
+    WALK_LOOP                   /* GOTO to a line above */
+}   WALK_RESULT;
+
+typedef struct
+{
+    const MMSCRIPT_ESTIMATE_CONFIG *config;
+    MMSCRIPT_ESTIMATE *estimate;    /* Totals & nodes added to, by index of nodes */
+    uint16_t count;                 /* Of lines */
+    uint64_t now_us;
+    int32_t vars[26];
+    uint32_t known_vars;            /* Bit per variable of known value */
+    NODE_MODEL nodes[MMSCRIPT_ESTIMATE_MAX_NODES];
+    uint64_t *deadlines;            /* Of PERIOD, by line */
+    uint8_t *unmodeled;             /* By line */
+    uint8_t depth;                  /* Of CALLs */
+}   WALK;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define MAX_CALL_DEPTH      16
+#define NO_STOP             0xFFFF
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#define SKIP_SPACE(p)                              \
+    do {                                           \
+        while(*p == ' ' || *p == '\t' || *p == ';')\
+            p++;                                   \
+    }   while(0)
+
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Walk lines as written
+  * @param  w: walk
+  * @param  index: line to start from, output of line the walk stopped at
+  * @param  stop: line to stop at, NO_STOP for none
+  * @retval WALK_RESULT
+  */
+static WALK_RESULT MMScript_Walk(WALK *w, uint16_t *index, uint16_t stop);
+
+
+/**
+  * @brief  Walk a FOR loop, body repeated as many passes as known
+  * @param  w: walk
+  * @param  index: line of FOR, output of line after NEXT, or the walk stopped at
+  * @param  p: FOR line, keyword removed
+  * @retval WALK_RESULT
+  */
+static WALK_RESULT MMScript_WalkFor(WALK *w, uint16_t *index, const char *p);
+
+
+/**
+  * @brief  Walk a line of bus commands, a WAIT, UNTIL, PERIOD or STREAM
+  * @param  w: walk
+  * @param  index: line index
+  * @param  p: line, keyword removed
+  * @retval None
+  */
+static void MMScript_WalkCommands(WALK *w, uint16_t index, const char *p);
+static void MMScript_WalkWait(WALK *w, const char *p);
+static void MMScript_WalkUntil(WALK *w, uint16_t index, const char *p);
+static void MMScript_WalkPeriod(WALK *w, uint16_t index, const char *p);
+static void MMScript_WalkStream(WALK *w, uint16_t index, const char *p);
+
+
+/**
+  * @brief  Walk a LET, the variable known if the expression is
+  * @param  w: walk
+  * @param  p: LET line, keyword removed
+  * @retval None
+  */
+static void MMScript_WalkLet(WALK *w, const char *p);
+
+
+/**
+  * @brief  Start a move of a node
+  * @param  w: walk
+  * @param  index: line index
+  * @param  node_id: node
+  * @param  target: position, or distance if relative
+  * @param  relative: 1 for RP/PRP
+  * @retval None
+  */
+static void MMScript_Move(WALK *w, uint16_t index, uint8_t node_id, int32_t target, uint8_t relative);
+
+
+/**
+  * @brief  Block the script until a node is done
+  * @param  w: walk
+  * @param  node: index of node
+  * @param  until_us: time the node is done at
+  * @retval None
+  */
+static void MMScript_Block(WALK *w, int8_t node, uint64_t until_us);
+
+
+/**
+  * @brief  Sleep in DELAY, UDELAY, PERIOD or STREAM
+  * @param  w: walk
+  * @param  us: time slept
+  * @retval None
+  */
+static void MMScript_Sleep(WALK *w, uint64_t us);
+
+
+/**
+  * @brief  Add the last pass of a loop times more
+  * @param  w: walk
+  * @param  before: estimate before the last pass
+  * @param  before_us: time before the last pass
+  * @param  times: passes to add
+  * @retval None
+  */
+static void MMScript_Repeat(WALK *w, const MMSCRIPT_ESTIMATE *before, uint64_t before_us, uint32_t times);
+
+
+/**
+  * @brief  Reset clock, variables & nodes of a walk
+  * @retval None
+  */
+static void MMScript_WalkInit(WALK *w, MMSCRIPT_ESTIMATE *estimate);
+
+
+/**
+  * @brief  Read the bounds of a FOR line
+  * @param  w: walk
+  * @param  p: FOR line, keyword removed
+  * @param  var: output of variable index
+  * @param  start: output of first value
+  * @param  step: output of step
+  * @param  passes: output of number of passes
+  * @retval 1 if bounds known
+  */
+static uint8_t MMScript_ForPasses(WALK *w, const char *p, uint8_t *var, int32_t *start, int32_t *step, uint32_t *passes);
+
+
+/**
+  * @brief  Evaluate an expression, left to right in int16_t as MMScript_Eval()
+  * @param  w: walk
+  * @param  p: expression
+  * @param  end: end of expression
+  * @param  value: output of value
+  * @retval 1 if known
+  */
+static uint8_t MMScript_EvalKnown(WALK *w, const char *p, const char *end, int32_t *value);
+
+
+/**
+  * @brief  Read the operands of a command, numbers or variables, as MMScript_Operands()
+  * @param  w: walk
+  * @param  p: operands
+  * @param  values: output of values
+  * @param  count: number of operands
+  * @retval 1 if all known
+  */
+static uint8_t MMScript_Operands(WALK *w, const char *p, int32_t *values, uint8_t count);
+
+
+/**
+  * @brief  Get index of a node model
+  * @param  w: walk
+  * @param  node_id: node
+  * @param  add: add the node if new
+  * @retval index, -1 if none or full
+  */
+static int8_t MMScript_Node(WALK *w, uint8_t node_id, uint8_t add);
+
+
+/**
+  * @brief  Get index of the first line of a label, as the interpreter's scan finds it
+  * @param  label: label
+  * @retval index, -1 if none
+  */
+static int32_t MMScript_LineOf(int label);
+
+
+/**
+  * @brief  Get index of the NEXT of a FOR, as MMScript_PairLoops() pairs them
+  * @param  index: line of FOR
+  * @retval index, -1 if none
+  */
+static int32_t MMScript_PairedNext(uint16_t index);
+
+
+/**
+  * @brief  Velocity along a trapezoidal profile
+  * @param  t_us: time since start of the move
+  * @param  distance, velocity, acceleration: of the move
+  * @retval counts/s
+  */
+static double MMScript_VelocityAt(uint64_t t_us, uint32_t distance, uint32_t velocity, uint32_t acceleration);
+
+
+/**
+  * @brief  Time a trapezoidal profile takes to cover part of its distance
+  * @param  covered: counts, up to distance
+  * @param  distance, velocity, acceleration: of the move
+  * @retval us since start of the move
+  */
+static uint64_t MMScript_TimeTo(uint32_t covered, uint32_t distance, uint32_t velocity, uint32_t acceleration);
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static WALK_RESULT MMScript_Walk(WALK *w, uint16_t *index, uint16_t stop)
+{
+    while (*index < w->count && *index != stop)
+    {
+        const char *line;
+        int16_t label;
+        uint8_t length;
+        int32_t target;
+        int value;
+
+        line = MMScript_LineText(*index, &label);
+
+        if (line == NULL)
+        {
+            (*index)++;
+            continue;
+        }
+
+        switch (MMScript_Keyword(line, &length))
+        {
+        case -1:
+            MMScript_WalkCommands(w, *index, line);
+            break;
+
+        case MMSCRIPT_KEYWORD_LET:
+            MMScript_WalkLet(w, line + length);
+            break;
+
+        case MMSCRIPT_KEYWORD_GOTO:
+            if (sscanf(line + length, "%d", &value) != 1 || (target = MMScript_LineOf(value)) < 0)
+                return WALK_END;
+
+            if (target <= *index)
+                return WALK_LOOP;
+
+            *index = (uint16_t)target;
+            continue;
+
+        case MMSCRIPT_KEYWORD_END:
+            return WALK_END;
+
+        case MMSCRIPT_KEYWORD_RET:
+            return WALK_RET;
+
+        case MMSCRIPT_KEYWORD_CALL:
+            if (sscanf(line + length, "%d", &value) != 1 || (target = MMScript_LineOf(value)) < 0 || w->depth == MAX_CALL_DEPTH)
+            {
+                w->unmodeled[*index] = 1;
+            }
+            else
+            {
+                uint16_t sub = (uint16_t)target;
+                WALK_RESULT result;
+
+                w->depth++;
+                result = MMScript_Walk(w, &sub, NO_STOP);
+                w->depth--;
+
+                if (result != WALK_RET)
+                {
+                    *index = sub;
+                    return result;
+                }
+            }
+            break;
+
+        case MMSCRIPT_KEYWORD_FOR:
+        {
+            WALK_RESULT result = MMScript_WalkFor(w, index, line + length);
+
+            if (result != WALK_REACHED)
+                return result;
+
+            continue;
+        }
+
+        case MMSCRIPT_KEYWORD_DELAY:
+            if (sscanf(line + length, "%d", &value) == 1 && value > 0)
+                MMScript_Sleep(w, (uint64_t)value * 1000);
+            break;
+
+        case MMSCRIPT_KEYWORD_UDELAY:
+            if (sscanf(line + length, "%d", &value) == 1 && value > 0)
+                MMScript_Sleep(w, (uint64_t)value);
+            break;
+
+        case MMSCRIPT_KEYWORD_PERIOD:
+            MMScript_WalkPeriod(w, *index, line + length);
+            break;
+
+        case MMSCRIPT_KEYWORD_WAIT:
+            MMScript_WalkWait(w, line + length);
+            break;
+
+        case MMSCRIPT_KEYWORD_UNTIL:
+            MMScript_WalkUntil(w, *index, line + length);
+            break;
+
+        case MMSCRIPT_KEYWORD_STREAM:
+            MMScript_WalkStream(w, *index, line + length);
+            break;
+
+        case MMSCRIPT_KEYWORD_IF:       /* Goes on with the next line */
+        case MMSCRIPT_KEYWORD_NEXT:
+        case MMSCRIPT_KEYWORD_TABLE:
+        case MMSCRIPT_KEYWORD_RETRY:
+        case MMSCRIPT_KEYWORD_JOIN:
+            break;
+
+        default:                        /* FORK, BLEND, SCURVE, SPLINE, GEAR, CAM */
+            w->unmodeled[*index] = 1;
+            break;
+        }
+
+        (*index)++;
+    }
+
+    return WALK_REACHED;
+}
+
+
+static WALK_RESULT MMScript_WalkFor(WALK *w, uint16_t *index, const char *p)
+{
+    int32_t next = MMScript_PairedNext(*index);
+    int32_t start, step;
+    uint32_t passes;
+    uint16_t body = *index + 1;
+    uint8_t var, known;
+    WALK_RESULT result;
+
+    if (next < 0)
+    {
+        w->unmodeled[(*index)++] = 1;
+        return WALK_REACHED;
+    }
+
+    known = MMScript_ForPasses(w, p, &var, &start, &step, &passes);
+
+    if (!known)
+        passes = 1;
+
+    /* Unknown in the body, last value of the loop after it */
+    w->known_vars &= ~(1u << var);
+
+    if (passes > 0)
+    {
+        *index = body;
+        result = MMScript_Walk(w, index, (uint16_t)next);
+
+        if (result != WALK_REACHED)
+            return result;
+    }
+
+    if (passes > 1)
+    {
+        MMSCRIPT_ESTIMATE before = *w->estimate;
+        uint64_t before_us = w->now_us;
+
+        *index = body;
+        result = MMScript_Walk(w, index, (uint16_t)next);
+
+        if (result != WALK_REACHED)
+            return result;
+
+        if (passes > 2)
+            MMScript_Repeat(w, &before, before_us, passes - 2);
+    }
+
+    if (known && passes > 0)
+    {
+        w->vars[var] = (int16_t)(start + (int32_t)(passes - 1) * step);
+        w->known_vars |= 1u << var;
+    }
+
+    *index = (uint16_t)next + 1;
+    return WALK_REACHED;
+}
+
+
+static void MMScript_WalkCommands(WALK *w, uint16_t index, const char *p)
+{
+    while (p != NULL)
+    {
+        const char *token = strchr(p, ',');
+        int32_t args[3];
+        uint8_t length, operands, known = 1, calls = 1;
+        int8_t command;
+        int node_id;
+
+        if (token == NULL || sscanf(p, "%x", &node_id) != 1)
+        {
+            w->unmodeled[index] = 1;
+            return;
+        }
+
+        p = token + 1;
+        SKIP_SPACE(p);
+
+        command = MMScript_NodeCommand(p, &length);
+
+        if (command < 0)
+        {
+            w->unmodeled[index] = 1;
+            return;
+        }
+
+        MMScript_NodeCommandName(command, &operands);
+
+        if (command != MMSCRIPT_OP_START && operands > 0)
+            known = MMScript_Operands(w, p + length, args, operands);
+
+        if (command == MMSCRIPT_OP_PVM)
+            calls = 2;
+        else if (command == MMSCRIPT_OP_PAP || command == MMSCRIPT_OP_PRP)
+            calls = 3;
+
+        w->now_us += (uint64_t)calls * w->config->command_us;
+        w->estimate->bus_us += (uint64_t)calls * w->config->command_us;
+
+        switch (command)
+        {
+        case MMSCRIPT_OP_STOP:
+        case MMSCRIPT_OP_HALT:
+        case MMSCRIPT_OP_VM:
+        case MMSCRIPT_OP_PVM:
+        {
+            int8_t node = MMScript_Node(w, (uint8_t)node_id, 1);
+
+            /* Stopped somewhere along the move, or moving until stopped */
+            if (node >= 0 && (w->nodes[node].end_us > w->now_us || command == MMSCRIPT_OP_VM || command == MMSCRIPT_OP_PVM))
+            {
+                w->nodes[node].known = 0;
+                w->nodes[node].end_us = w->now_us;
+            }
+
+            if (command == MMSCRIPT_OP_VM || command == MMSCRIPT_OP_PVM)
+                w->unmodeled[index] = 1;
+            break;
+        }
+
+        case MMSCRIPT_OP_AP:
+        case MMSCRIPT_OP_RP:
+        case MMSCRIPT_OP_PAP:
+        case MMSCRIPT_OP_PRP:
+        {
+            int8_t node = MMScript_Node(w, (uint8_t)node_id, 1);
+
+            if (node < 0 || !known)
+            {
+                if (node >= 0)
+                    w->nodes[node].known = 0;
+
+                w->unmodeled[index] = 1;
+                break;
+            }
+
+            if (command == MMSCRIPT_OP_PAP || command == MMSCRIPT_OP_PRP)
+            {
+                w->nodes[node].acceleration = (uint32_t)args[0];
+                w->nodes[node].velocity = (uint32_t)args[1];
+            }
+
+            MMScript_Move(w, index, (uint8_t)node_id, args[operands - 1], (command == MMSCRIPT_OP_RP || command == MMSCRIPT_OP_PRP));
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        p = strchr(p, ';');
+
+        if (p)
+            p++;    /* Skip ';' */
+    }
+}
+
+
+static void MMScript_WalkWait(WALK *w, const char *p)
+{
+    for (;;)
+    {
+        int node_id;
+        int8_t node;
+
+        SKIP_SPACE(p);
+
+        if (sscanf(p, "%x", &node_id) != 1)
+            break;
+
+        /* Polled once at least */
+        w->now_us += w->config->command_us;
+        w->estimate->bus_us += w->config->command_us;
+
+        node = MMScript_Node(w, (uint8_t)node_id, 0);
+
+        if (node >= 0)
+            MMScript_Block(w, node, w->nodes[node].end_us);
+
+        p = strchr(p, ',');
+
+        if (p == NULL)
+            break;
+
+        p++;
+    }
+}
+
+
+static void MMScript_WalkUntil(WALK *w, uint16_t index, const char *p)
+{
+    const NODE_MODEL *model;
+    int node_id, value;
+    char quantity[4], op;
+    int8_t node;
+    uint32_t distance;
+    uint64_t t_us, until_us;
+    double position, velocity;
+    int sign;
+
+    if (sscanf(p, "%x , %3[A-Z] %c %d", &node_id, quantity, &op, &value) != 4 || (node = MMScript_Node(w, (uint8_t)node_id, 0)) < 0)
+    {
+        w->unmodeled[index] = 1;
+        return;
+    }
+
+    model = &w->nodes[node];
+    distance = (uint32_t)llabs((long long)model->position - model->from);
+    sign = (model->position >= model->from) ? 1 : -1;
+    t_us = (w->now_us < model->end_us) ? w->now_us - model->start_us : model->end_us - model->start_us;
+
+    position = model->from + sign * MMScript_MoveDistance(t_us, distance, model->move_velocity, model->move_acceleration);
+    velocity = (w->now_us < model->end_us) ? MMScript_VelocityAt(t_us, distance, model->move_velocity, model->move_acceleration) : 0;
+
+    if (strcmp(quantity, "POS") == 0)
+    {
+        int64_t crossed = ((int64_t)value - model->from) * sign;
+
+        if (!model->known)
+        {
+            w->unmodeled[index] = 1;
+            return;
+        }
+
+        if ((op == '>') ? (position > value) : (position < value))
+            return;
+
+        /* Crossed along the move, or never once at rest */
+        if (w->now_us < model->end_us && crossed > 0 && crossed < distance)
+            until_us = model->start_us + MMScript_TimeTo((uint32_t)crossed, distance, model->move_velocity, model->move_acceleration);
+        else
+        {
+            until_us = model->end_us;
+            w->unmodeled[index] = 1;
+        }
+    }
+    else
+    {
+        double peak = MMScript_VelocityAt(MMScript_TimeTo(distance / 2, distance, model->move_velocity, model->move_acceleration),
+                                          distance, model->move_velocity, model->move_acceleration);
+
+        if ((op == '>') ? (velocity > value) : (velocity < value))
+            return;
+
+        if (op == '<')
+            until_us = model->end_us - (uint64_t)(1e6 * value / model->move_acceleration);    /* Slowing down */
+        else if (value < peak)
+            until_us = model->start_us + (uint64_t)(1e6 * value / model->move_acceleration);  /* Speeding up */
+        else
+        {
+            until_us = model->end_us;
+            w->unmodeled[index] = 1;
+        }
+    }
+
+    MMScript_Block(w, node, until_us);
+}
+
+
+static void MMScript_WalkPeriod(WALK *w, uint16_t index, const char *p)
+{
+    uint64_t period_us;
+    int period;
+
+    if (sscanf(p, "%d", &period) != 1 || period <= 0)
+        return;
+
+    /* As the interpreter, next multiple of period since the line was first reached */
+    period_us = (uint64_t)period * 1000;
+
+    if (w->deadlines[index] == 0 || w->now_us >= w->deadlines[index] + period_us)
+        w->deadlines[index] = w->now_us + period_us;
+    else
+        w->deadlines[index] += period_us;
+
+    if (w->deadlines[index] > w->now_us)
+        MMScript_Sleep(w, w->deadlines[index] - w->now_us);
+}
+
+
+static void MMScript_WalkStream(WALK *w, uint16_t index, const char *p)
+{
+    MMSCRIPT_STREAM stream;
+    char path[256];
+
+    if (MMScript_FilePath(p, path, sizeof(path)) != 0 || MMScript_StreamOpen(path, &stream) != 0)
+    {
+        w->unmodeled[index] = 1;
+        return;
+    }
+
+    MMScript_Sleep(w, (uint64_t)stream.frame_count * stream.period_us);
+
+    MMScript_StreamClose(&stream);
+}
+
+
+static void MMScript_WalkLet(WALK *w, const char *p)
+{
+    const char *equal = strchr(p, '=');
+    int32_t value;
+    uint8_t var;
+
+    SKIP_SPACE(p);
+
+    if (*p < 'A' || *p > 'Z' || equal == NULL)
+        return;
+
+    var = (uint8_t)(*p - 'A');
+
+    if (MMScript_EvalKnown(w, equal + 1, equal + strlen(equal), &value))
+    {
+        w->vars[var] = value;
+        w->known_vars |= 1u << var;
+    }
+    else
+    {
+        w->known_vars &= ~(1u << var);
+    }
+}
+
+
+static void MMScript_Move(WALK *w, uint16_t index, uint8_t node_id, int32_t target, uint8_t relative)
+{
+    int8_t node = MMScript_Node(w, node_id, 1);
+    NODE_MODEL *model = &w->nodes[node];
+    uint64_t duration;
+    uint32_t distance;
+
+    if (relative)
+    {
+        if (!model->known)
+        {
+            w->unmodeled[index] = 1;
+            return;
+        }
+
+        target = (int32_t)((int64_t)model->position + target);
+    }
+
+    if (!model->known || model->velocity == 0 || model->acceleration == 0)
+    {
+        model->known = 1;
+        model->from = target;
+        model->position = target;
+        model->end_us = w->now_us;
+        w->unmodeled[index] = 1;
+        return;
+    }
+
+    distance = (uint32_t)llabs((long long)target - model->position);
+    duration = MMScript_MoveTime(distance, model->velocity, model->acceleration);
+
+    model->from = model->position;
+    model->position = target;
+    model->move_velocity = model->velocity;
+    model->move_acceleration = model->acceleration;
+    model->start_us = w->now_us;
+    model->end_us = w->now_us + duration;
+
+    w->estimate->nodes[node].moves++;
+    w->estimate->nodes[node].motion_us += duration;
+}
+
+
+static void MMScript_Block(WALK *w, int8_t node, uint64_t until_us)
+{
+    if (until_us <= w->now_us)
+        return;
+
+    w->estimate->wait_us += until_us - w->now_us;
+    w->estimate->nodes[node].waited_us += until_us - w->now_us;
+    w->now_us = until_us;
+}
+
+
+static void MMScript_Sleep(WALK *w, uint64_t us)
+{
+    w->now_us += us;
+    w->estimate->delay_us += us;
+}
+
+
+static void MMScript_Repeat(WALK *w, const MMSCRIPT_ESTIMATE *before, uint64_t before_us, uint32_t times)
+{
+    MMSCRIPT_ESTIMATE *estimate = w->estimate;
+    uint64_t shift = (w->now_us - before_us) * times;
+
+    estimate->delay_us += (estimate->delay_us - before->delay_us) * times;
+    estimate->bus_us += (estimate->bus_us - before->bus_us) * times;
+    estimate->wait_us += (estimate->wait_us - before->wait_us) * times;
+
+    for (uint8_t i=0; i<estimate->node_count; i++)
+    {
+        MMSCRIPT_NODE_ESTIMATE *node = &estimate->nodes[i];
+        MMSCRIPT_NODE_ESTIMATE last = { 0, 0, 0, 0 };
+
+        if (i < before->node_count)
+            last = before->nodes[i];
+
+        node->moves += (node->moves - last.moves) * times;
+        node->motion_us += (node->motion_us - last.motion_us) * times;
+        node->waited_us += (node->waited_us - last.waited_us) * times;
+
+        /* Moves of the last pass end as many passes later */
+        if (w->nodes[i].start_us >= before_us)
+            w->nodes[i].start_us += shift;
+
+        if (w->nodes[i].end_us > before_us)
+            w->nodes[i].end_us += shift;
+    }
+
+    for (uint16_t i=0; i<w->count; i++)
+    {
+        if (w->deadlines[i] > before_us)
+            w->deadlines[i] += shift;
+    }
+
+    w->now_us += shift;
+}
+
+
+static void MMScript_WalkInit(WALK *w, MMSCRIPT_ESTIMATE *estimate)
+{
+    memset(estimate, 0, sizeof(MMSCRIPT_ESTIMATE));
+    memset(w->nodes, 0, sizeof(w->nodes));
+    memset(w->deadlines, 0, w->count * sizeof(uint64_t));
+
+    w->estimate = estimate;
+    w->now_us = 0;
+    w->known_vars = 0;
+    w->depth = 0;
+}
+
+
+static uint8_t MMScript_ForPasses(WALK *w, const char *p, uint8_t *var, int32_t *start, int32_t *step, uint32_t *passes)
+{
+    const char *equal = strchr(p, '=');
+    const char *to = strstr(p, "TO");
+    const char *by = strstr(p, "STEP");
+    int32_t end;
+
+    SKIP_SPACE(p);
+    *var = (*p >= 'A' && *p <= 'Z') ? (uint8_t)(*p - 'A') : 0;
+    *step = 1;
+
+    if (equal == NULL || to == NULL || to < equal || !MMScript_EvalKnown(w, equal + 1, to, start) ||
+        !MMScript_EvalKnown(w, to + 2, by ? by : to + strlen(to), &end) ||
+        (by && !MMScript_EvalKnown(w, by + 4, by + strlen(by), step)) || *step == 0)
+        return 0;
+
+    if ((*step > 0 && *start > end) || (*step < 0 && *start < end))
+        *passes = 0;
+    else
+        *passes = (uint32_t)((end - *start) / *step) + 1;
+
+    return 1;
+}
+
+
+static uint8_t MMScript_EvalKnown(WALK *w, const char *p, const char *end, int32_t *value)
+{
+    int16_t result = 0;
+    char op = '+';
+
+    for (;;)
+    {
+        int32_t operand;
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+
+        if (p >= end)
+            return 0;
+
+        if (*p >= 'A' && *p <= 'Z')
+        {
+            if (p[1] == '[' || !(w->known_vars & (1u << (*p - 'A'))))
+                return 0;
+
+            operand = w->vars[*p++ - 'A'];
+        }
+        else if (*p >= '0' && *p <= '9')
+        {
+            char *next;
+
+            operand = (int32_t)strtol(p, &next, 10);
+            p = next;
+        }
+        else
+        {
+            return 0;
+        }
+
+        if (op == '+')
+            result = (int16_t)(result + operand);
+        else if (op == '-')
+            result = (int16_t)(result - operand);
+        else if (op == '*')
+            result = (int16_t)(result * operand);
+        else if (operand != 0)
+            result = (int16_t)(result / operand);
+        else
+            return 0;
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+
+        if (p >= end)
+            break;
+
+        if (*p != '+' && *p != '-' && *p != '*' && *p != '/')
+            return 0;
+
+        op = *p++;
+    }
+
+    *value = result;
+    return 1;
+}
+
+
+static uint8_t MMScript_Operands(WALK *w, const char *p, int32_t *values, uint8_t count)
+{
+    for (uint8_t i=0; i<count; i++)
+    {
+        long number;
+        char *end;
+
+        SKIP_SPACE(p);
+
+        if (i > 0)
+        {
+            if (*p != ',')
+                return 0;
+
+            p++;
+            SKIP_SPACE(p);
+        }
+
+        if (*p <= 'Z' && *p >= 'A')
+        {
+            /* Table elements are read at run time */
+            if (p[1] == '[' || !(w->known_vars & (1u << (*p - 'A'))))
+                return 0;
+
+            values[i] = w->vars[*p++ - 'A'];
+            continue;
+        }
+
+        number = strtol(p, &end, 10);
+
+        if (end == p)
+            return 0;
+
+        values[i] = (int32_t)number;
+        p = end;
+    }
+
+    return 1;
+}
+
+
+static int8_t MMScript_Node(WALK *w, uint8_t node_id, uint8_t add)
+{
+    MMSCRIPT_ESTIMATE *estimate = w->estimate;
+    uint8_t i;
+
+    for (i=0; i<estimate->node_count; i++)
+    {
+        if (w->nodes[i].id == node_id)
+            return (int8_t)i;
+    }
+
+    if (!add || i == MMSCRIPT_ESTIMATE_MAX_NODES)
+        return -1;
+
+    /* At rest at 0, profile of AP & RP */
+    memset(&w->nodes[i], 0, sizeof(NODE_MODEL));
+    w->nodes[i].id = node_id;
+    w->nodes[i].known = 1;
+    w->nodes[i].velocity = w->config->velocity;
+    w->nodes[i].acceleration = w->config->acceleration;
+    w->nodes[i].end_us = w->now_us;
+
+    memset(&estimate->nodes[i], 0, sizeof(MMSCRIPT_NODE_ESTIMATE));
+    estimate->nodes[i].node = node_id;
+    estimate->node_count++;
+
+    return (int8_t)i;
+}
+
+
+static int32_t MMScript_LineOf(int label)
+{
+    uint16_t count = MMScript_LineCount();
+
+    for (uint16_t i=0; label > 0 && i<count; i++)
+    {
+        int16_t line_label;
+
+        if (MMScript_LineText(i, &line_label) != NULL && line_label == label)
+            return i;
+    }
+
+    return -1;
+}
+
+
+static int32_t MMScript_PairedNext(uint16_t index)
+{
+    uint16_t count = MMScript_LineCount();
+    int depth = 0;
+
+    for (uint16_t i=index; i<count; i++)
+    {
+        int16_t label;
+        const char *line = MMScript_LineText(i, &label);
+        uint8_t length;
+        int8_t keyword;
+
+        if (line == NULL)
+            continue;
+
+        keyword = MMScript_Keyword(line, &length);
+
+        if (keyword == MMSCRIPT_KEYWORD_FOR)
+            depth++;
+        else if (keyword == MMSCRIPT_KEYWORD_NEXT && --depth == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+static double MMScript_VelocityAt(uint64_t t_us, uint32_t distance, uint32_t velocity, uint32_t acceleration)
+{
+    double a = acceleration, d = distance, t = t_us / 1e6;
+    double peak, ramp_s, cruise_s, total_s;
+
+    if (velocity == 0 || acceleration == 0 || distance == 0)
+        return 0;
+
+    peak = fmin(velocity, sqrt(a * d));
+    ramp_s = peak / a;
+    cruise_s = (d - peak * ramp_s) / peak;
+    total_s = 2 * ramp_s + cruise_s;
+
+    if (t <= ramp_s)
+        return a * t;
+
+    if (t <= ramp_s + cruise_s)
+        return peak;
+
+    if (t < total_s)
+        return a * (total_s - t);
+
+    return 0;
+}
+
+
+static uint64_t MMScript_TimeTo(uint32_t covered, uint32_t distance, uint32_t velocity, uint32_t acceleration)
+{
+    double a = acceleration, d = distance, x = covered;
+    double peak, ramp_s, ramp, t;
+
+    if (velocity == 0 || acceleration == 0 || distance == 0)
+        return 0;
+
+    peak = fmin(velocity, sqrt(a * d));
+    ramp_s = peak / a;
+    ramp = 0.5 * peak * ramp_s;
+
+    if (x <= ramp)
+        t = sqrt(2 * x / a);
+    else if (x <= d - ramp)
+        t = ramp_s + (x - ramp) / peak;
+    else
+        t = MMScript_MoveTime(distance, velocity, acceleration) / 1e6 - sqrt(2 * (d - x) / a);
+
+    return (uint64_t)(t * 1e6 + 0.5);
+}
+
+
+/* Exported functions --------------------------------------------------------*/
+
+uint64_t MMScript_MoveTime(uint32_t distance, uint32_t velocity, uint32_t acceleration)
+{
+    double a = acceleration, d = distance;
+    double peak;
+
+    if (velocity == 0 || acceleration == 0)
+        return 0;
+
+    /* Up to velocity & back when the distance allows, triangular otherwise */
+    peak = fmin(velocity, sqrt(a * d));
+
+    if (peak <= 0)
+        return 0;
+
+    return (uint64_t)((d / peak + peak / a) * 1e6 + 0.5);
+}
+
+
+double MMScript_MoveDistance(uint64_t t_us, uint32_t distance, uint32_t velocity, uint32_t acceleration)
+{
+    double a = acceleration, d = distance, t = t_us / 1e6;
+    double peak, ramp_s, cruise_s, total_s;
+
+    if (velocity == 0 || acceleration == 0)
+        return d;
+
+    peak = fmin(velocity, sqrt(a * d));
+    ramp_s = peak / a;
+    cruise_s = (d - peak * ramp_s) / peak;
+    total_s = 2 * ramp_s + cruise_s;
+
+    if (t <= ramp_s)
+        return 0.5 * a * t * t;
+
+    if (t <= ramp_s + cruise_s)
+        return 0.5 * peak * ramp_s + peak * (t - ramp_s);
+
+    if (t < total_s)
+        return d - 0.5 * a * (total_s - t) * (total_s - t);
+
+    return d;
+}
+
+
+int16_t MMScript_Estimate(const MMSCRIPT_ESTIMATE_CONFIG *config, MMSCRIPT_ESTIMATE *estimate)
+{
+    MMSCRIPT_ESTIMATE *pass;
+    WALK w;
+    WALK_RESULT result;
+    uint16_t index = 0;
+
+    memset(estimate, 0, sizeof(MMSCRIPT_ESTIMATE));
+
+    w.config = config;
+    w.count = MMScript_LineCount();
+
+    if (w.count == 0)
+        return MMS_PARSE_ERR_MISSING_LABEL;
+
+    w.deadlines = (uint64_t*)calloc(w.count, sizeof(uint64_t));
+    w.unmodeled = (uint8_t*)calloc(w.count, 1);
+    pass = (MMSCRIPT_ESTIMATE*)malloc(sizeof(MMSCRIPT_ESTIMATE));
+
+    if (w.deadlines == NULL || w.unmodeled == NULL || pass == NULL)
+    {
+        free(w.deadlines);
+        free(w.unmodeled);
+        free(pass);
+        return MMS_PARSE_ERR_MALLOC;
+    }
+
+    //
+    // Whole script, from the first line
+
+    MMScript_WalkInit(&w, estimate);
+    result = MMScript_Walk(&w, &index, NO_STOP);
+
+    estimate->total_us = w.now_us;
+    estimate->endless = (result == WALK_LOOP);
+
+    //
+    // Loops on their own, second pass
+
+    for (uint16_t i=0; i<w.count && estimate->loop_count < MMSCRIPT_ESTIMATE_MAX_LOOPS; i++)
+    {
+        MMSCRIPT_LOOP_ESTIMATE *loop = &estimate->loops[estimate->loop_count];
+        int16_t label, start_label;
+        const char *line = MMScript_LineText(i, &label);
+        const char *then;
+        int32_t start = -1, stop = i + 1;
+        uint64_t before_us;
+        uint32_t passes = 0;
+        uint8_t length;
+        int value;
+
+        if (line == NULL)
+            continue;
+
+        switch (MMScript_Keyword(line, &length))
+        {
+        case MMSCRIPT_KEYWORD_GOTO:
+            if (sscanf(line + length, "%d", &value) == 1 && (start = MMScript_LineOf(value)) > i)
+                start = -1;
+            break;
+
+        case MMSCRIPT_KEYWORD_IF:
+            if ((then = strstr(line, "THEN")) != NULL && sscanf(then + 4, "%d", &value) == 1 && (start = MMScript_LineOf(value)) > i)
+                start = -1;
+            break;
+
+        case MMSCRIPT_KEYWORD_FOR:
+        {
+            int32_t first, step;
+            uint8_t var;
+
+            if ((stop = MMScript_PairedNext(i)) < 0)
+                break;
+
+            MMScript_WalkInit(&w, pass);
+
+            if (!MMScript_ForPasses(&w, line + length, &var, &first, &step, &passes))
+                passes = 0;
+
+            start = i + 1;
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        if (start < 0)
+            continue;
+
+        MMScript_WalkInit(&w, pass);
+        index = (uint16_t)start;
+        MMScript_Walk(&w, &index, (uint16_t)stop);
+
+        before_us = w.now_us;
+        index = (uint16_t)start;
+        MMScript_Walk(&w, &index, (uint16_t)stop);
+
+        /* FOR line to NEXT line, or line jumped to to the line jumping */
+        MMScript_LineText((uint16_t)((stop == i + 1) ? start : i), &start_label);
+        loop->start_label = start_label;
+        MMScript_LineText((uint16_t)((stop == i + 1) ? i : stop), &loop->end_label);
+        loop->passes = passes;
+        loop->pass_us = w.now_us - before_us;
+        estimate->loop_count++;
+    }
+
+    for (uint16_t i=0; i<w.count; i++)
+        estimate->unmodeled += w.unmodeled[i];
+
+    free(w.deadlines);
+    free(w.unmodeled);
+    free(pass);
+
+    return 0;
+}
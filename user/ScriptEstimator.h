@@ -0,0 +1,113 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCRIPT_ESTIMATOR_H__
+#define __SCRIPT_ESTIMATOR_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/**
+  * Static estimate of the cycle time of the script parsed, without bus nor clock (mms2c --estimate).
+  * Lines are walked as written: IF goes on with the next line, FOR repeats its body as many passes as
+  * its bounds give when they are known, once otherwise, & a GOTO to a line above ends the walk, the
+  * script looping there for ever. Each loop, GOTO or IF to a line above & FOR...NEXT, is walked on its
+  * own twice & the second pass reported, nodes being where the first pass left them.
+  * Nodes start at 0 & move along a trapezoidal profile from the target of their previous move: AP &
+  * RP at the profile of the config, PAP & PRP at theirs, in counts, counts/s & counts/s^2 as SCURVE.
+  * Each API call of a command line takes command_us, WAIT & UNTIL block until the node is in position
+  * or crosses the value, PERIOD until its next period, STREAM for its frames.
+  * Lines that can't be modeled, VM, PVM, FORK, BLEND, SCURVE, SPLINE, GEAR, CAM, moves to variables
+  * of unknown value..., take no time & are counted in unmodeled.
+  */
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_ESTIMATE_MAX_LOOPS     32
+#define MMSCRIPT_ESTIMATE_MAX_NODES     16
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t velocity;          /* Profile of AP & RP, counts/s, 0 if unknown */
+    uint32_t acceleration;      /* counts/s^2 */
+    uint32_t command_us;        /* Bus time of one API call, status polls included */
+}   MMSCRIPT_ESTIMATE_CONFIG;
+
+typedef struct
+{
+    int16_t start_label;        /* First line of the loop */
+    int16_t end_label;          /* Line branching back, NEXT of FOR */
+    uint32_t passes;            /* Of FOR, 0 if unknown */
+    uint64_t pass_us;           /* One pass, nodes being where the previous pass left them */
+}   MMSCRIPT_LOOP_ESTIMATE;
+
+typedef struct
+{
+    uint8_t node;
+    uint32_t moves;
+    uint64_t motion_us;         /* Moving */
+    uint64_t waited_us;         /* Script blocked by WAIT/UNTIL of the node, its part of the critical path */
+}   MMSCRIPT_NODE_ESTIMATE;
+
+typedef struct
+{
+    uint64_t total_us;          /* From the first line to END, or to the loop repeated for ever */
+    uint64_t delay_us;          /* DELAY, UDELAY, PERIOD & STREAM */
+    uint64_t bus_us;            /* Commands */
+    uint64_t wait_us;           /* WAIT & UNTIL */
+    uint8_t endless;            /* Walk ended in a loop repeated for ever */
+    uint16_t unmodeled;         /* Lines walked that take no time in the estimate */
+    uint8_t loop_count;
+    MMSCRIPT_LOOP_ESTIMATE loops[MMSCRIPT_ESTIMATE_MAX_LOOPS];
+    uint8_t node_count;
+    MMSCRIPT_NODE_ESTIMATE nodes[MMSCRIPT_ESTIMATE_MAX_NODES];
+}   MMSCRIPT_ESTIMATE;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Estimate the cycle time of the script parsed in the selected context
+  * @param  config: profile of the nodes & bus time
+  * @param  estimate: output of estimate
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_MISSING_LABEL: no script parsed
+  *         MMS_PARSE_ERR_MALLOC: malloc failed
+  */
+int16_t MMScript_Estimate(const MMSCRIPT_ESTIMATE_CONFIG *config, MMSCRIPT_ESTIMATE *estimate);
+
+
+/**
+  * @brief  Duration of a move along a trapezoidal profile, from rest to rest
+  * @param  distance: counts
+  * @param  velocity: counts/s
+  * @param  acceleration: counts/s^2, deceleration alike
+  * @retval us, 0 if velocity or acceleration is 0
+  */
+uint64_t MMScript_MoveTime(uint32_t distance, uint32_t velocity, uint32_t acceleration);
+
+
+/**
+  * @brief  Distance covered along a trapezoidal profile
+  * @param  t_us: time since start of the move
+  * @param  distance: of the move, counts
+  * @param  velocity: counts/s
+  * @param  acceleration: counts/s^2
+  * @retval counts, distance once the move is done or if velocity or acceleration is 0
+  */
+double MMScript_MoveDistance(uint64_t t_us, uint32_t distance, uint32_t velocity, uint32_t acceleration);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SCRIPT_ESTIMATOR_H__ */
@@ -0,0 +1,818 @@
+
+/**
+  * Directives of script files, see ScriptPreprocessor.h. Constants are kept as the text of their folded
+  * value & macros as their text, both replaced when lines are read: the interpreter, the optimizer & mms2c
+  * only ever see numbers, nothing of the directives is left to resolve when the script runs.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ScriptPreprocessor.h"
+#include "ScriptCommands.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct
+{
+    char *text;                 /* '\0' terminated, NULL while empty */
+    size_t size;
+    size_t used;
+}   TEXT;
+
+typedef struct
+{
+    char name[MMSCRIPT_PRE_MAX_NAME + 1];
+    uint8_t macro;
+    uint8_t param_count;
+    char params[MMSCRIPT_PRE_MAX_PARAMS][MMSCRIPT_PRE_MAX_NAME + 1];
+    char *text;                 /* Folded value of a constant, TEXT of a macro */
+}   DEFINE;
+
+typedef struct
+{
+    DEFINE defines[MMSCRIPT_PRE_MAX_DEFINES];
+    uint16_t define_count;
+    TEXT out;
+    MMSCRIPT_SOURCE_MAP *map;
+    uint16_t lines_size;        /* Entries allocated for map->lines */
+}   PREPROCESSOR;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define PATH_SIZE       1024
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#define IS_NAME_START(c)    (((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define IS_NAME_CHAR(c)     (IS_NAME_START(c) || ((c) >= '0' && (c) <= '9'))
+
+#define SKIP_BLANKS(p)                          \
+    do {                                        \
+        while (*(p) == ' ' || *(p) == '\t')     \
+            (p)++;                              \
+    } while (0)
+
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Words of the syntax other than keywords & commands */
+static const char *const _reserved[] = { "THEN", "TO", "STEP", "LINK", "SERVO", "POS", "VEL", "FILE", "I8", "I16", "I32" };
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Output the lines of a file
+  * @param  pre: preprocessor
+  * @param  path: file
+  * @param  depth: 0 for the script, of nested includes otherwise
+  * @retval 0 or parse error code
+  */
+static int16_t MMScript_PreprocessFile(PREPROCESSOR *pre, const char *path, uint8_t depth);
+
+
+/**
+  * @brief  Define a constant or a macro, or include a file
+  * @param  pre: preprocessor
+  * @param  p: directive, '#' & trailing spaces removed
+  * @param  path: file of the directive
+  * @param  depth: of the file
+  * @retval 0 or parse error code
+  */
+static int16_t MMScript_Directive(PREPROCESSOR *pre, char *p, const char *path, uint8_t depth);
+
+
+/**
+  * @brief  Replace constants & macro calls of a text
+  * @note   The rest of the text after STREAM or FILE is copied as written, being a path.
+  * @param  pre: preprocessor
+  * @param  p: text
+  * @param  out: output appended to
+  * @param  depth: of macros being expanded
+  * @retval 0 or parse error code
+  */
+static int16_t MMScript_Substitute(PREPROCESSOR *pre, const char *p, TEXT *out, uint8_t depth);
+
+
+/**
+  * @brief  Expand a macro call
+  * @param  pre: preprocessor
+  * @param  define: macro
+  * @param  p: '(' of the call, output of the end of the call
+  * @param  out: output appended to
+  * @param  depth: of macros being expanded
+  * @retval 0 or parse error code
+  */
+static int16_t MMScript_Expand(PREPROCESSOR *pre, const DEFINE *define, const char **p, TEXT *out, uint8_t depth);
+
+
+/**
+  * @brief  Output a line & its source
+  * @param  pre: preprocessor
+  * @param  text: line, new line removed
+  * @param  file: index of file
+  * @param  line: in file
+  * @retval 0 or parse error code
+  */
+static int16_t MMScript_OutputLine(PREPROCESSOR *pre, const char *text, uint16_t file, uint16_t line);
+
+
+/**
+  * @brief  Fold an expression of numbers, left to right as MMScript_Eval()
+  * @param  p: expression
+  * @param  value: output of value
+  * @retval 1 if constant & in range of int32_t
+  */
+static uint8_t MMScript_Fold(const char *p, int32_t *value);
+
+
+/**
+  * @brief  Check a name can be defined
+  * @param  pre: preprocessor
+  * @param  p: name
+  * @param  n: length of name
+  * @retval 1 if valid, neither reserved nor defined already
+  */
+static uint8_t MMScript_IsNewName(PREPROCESSOR *pre, const char *p, size_t n);
+
+
+/**
+  * @brief  Find a constant or macro
+  * @param  pre: preprocessor
+  * @param  p: name
+  * @param  n: length of name
+  * @retval define, NULL if not defined
+  */
+static DEFINE *MMScript_FindDefine(PREPROCESSOR *pre, const char *p, size_t n);
+
+
+/**
+  * @brief  Get length of the name a text starts with
+  * @param  p: text
+  * @retval length, 0 if p doesn't start with a name
+  */
+static size_t MMScript_NameLength(const char *p);
+
+
+/**
+  * @brief  Append to a text
+  * @param  t: text
+  * @param  p: characters
+  * @param  n: number of characters
+  * @retval 1 if succeeded, 0 if malloc failed
+  */
+static uint8_t MMScript_Append(TEXT *t, const char *p, size_t n);
+
+
+/**
+  * @brief  Read a whole file
+  * @param  path: file
+  * @retval malloced content, '\0' terminated, NULL if it can't be read
+  */
+static char *MMScript_ReadFile(const char *path);
+
+
+/* Exported functions --------------------------------------------------------*/
+
+int16_t MMScript_Preprocess(const char *path, char **script_buf, size_t *buf_len, MMSCRIPT_SOURCE_MAP *map)
+{
+    PREPROCESSOR *pre = (PREPROCESSOR*)calloc(1, sizeof(PREPROCESSOR));
+    int16_t ret;
+
+    memset(map, 0, sizeof(MMSCRIPT_SOURCE_MAP));
+    *script_buf = NULL;
+    *buf_len = 0;
+
+    if (pre == NULL)
+        return MMS_PARSE_ERR_MALLOC;
+
+    pre->map = map;
+    ret = MMScript_PreprocessFile(pre, path, 0);
+
+    /* As read, the last line has no new line */
+    if (ret == 0 && pre->out.used > 0)
+        pre->out.text[--pre->out.used] = '\0';
+    else if (ret == 0 && !MMScript_Append(&pre->out, "", 0))
+        ret = MMS_PARSE_ERR_MALLOC;
+
+    if (ret == 0)
+    {
+        *script_buf = pre->out.text;
+        *buf_len = pre->out.used + 1;
+        pre->out.text = NULL;
+    }
+
+    for (uint16_t i=0; i<pre->define_count; i++)
+        free(pre->defines[i].text);
+
+    free(pre->out.text);
+    free(pre);
+
+    return ret;
+}
+
+
+const char *MMScript_SourceLine(const MMSCRIPT_SOURCE_MAP *map, uint16_t index, uint16_t *line)
+{
+    if (map == NULL || map->lines == NULL || index >= map->line_count)
+        return NULL;
+
+    *line = map->lines[index].line;
+    return map->files[map->lines[index].file];
+}
+
+
+void MMScript_FreeSourceMap(MMSCRIPT_SOURCE_MAP *map)
+{
+    for (uint16_t i=0; i<map->file_count; i++)
+        free(map->files[i]);
+
+    free(map->files);
+    free(map->lines);
+    memset(map, 0, sizeof(MMSCRIPT_SOURCE_MAP));
+}
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static int16_t MMScript_PreprocessFile(PREPROCESSOR *pre, const char *path, uint8_t depth)
+{
+    MMSCRIPT_SOURCE_MAP *map = pre->map;
+    char **files;
+    char *buf, *line;
+    uint16_t file, number = 1;
+    int16_t ret = 0;
+
+    if (depth > MMSCRIPT_PRE_MAX_DEPTH)
+        return MMS_PARSE_ERR_INCLUDE;
+
+    buf = MMScript_ReadFile(path);
+
+    if (buf == NULL)
+        return (depth > 0) ? MMS_PARSE_ERR_INCLUDE : MMS_PARSE_ERR_FILE;
+
+    files = (char**)realloc(map->files, (map->file_count + 1) * sizeof(char*));
+
+    if (files == NULL || (files[map->file_count] = strdup(path)) == NULL)
+    {
+        if (files)
+            map->files = files;
+
+        free(buf);
+        return MMS_PARSE_ERR_MALLOC;
+    }
+
+    map->files = files;
+    file = map->file_count++;
+
+    for (line = buf; ret == 0; number++)
+    {
+        char *end = strchr(line, '\n');
+        char *p = line;
+
+        if (end)
+            *end = '\0';
+
+        /* An included file ending with a new line adds no empty line */
+        if (end == NULL && depth > 0 && *line == '\0')
+            break;
+
+        map->error.file = file;
+        map->error.line = number;
+
+        SKIP_BLANKS(p);
+
+        if (*p == '#')
+        {
+            char *q = p + strlen(p);
+
+            while (q > p && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r'))
+                *--q = '\0';
+
+            ret = MMScript_Directive(pre, p + 1, path, depth);
+        }
+        else
+        {
+            ret = MMScript_OutputLine(pre, line, file, number);
+        }
+
+        if (end == NULL)
+            break;
+
+        line = end + 1;
+    }
+
+    free(buf);
+    return ret;
+}
+
+
+static int16_t MMScript_Directive(PREPROCESSOR *pre, char *p, const char *path, uint8_t depth)
+{
+    DEFINE *define = &pre->defines[pre->define_count];
+    size_t n;
+
+    if (strncmp(p, "CONST", 5) == 0 && (p[5] == ' ' || p[5] == '\t'))
+    {
+        TEXT value = { NULL, 0, 0 };
+        char number[16];
+        int32_t folded;
+        int16_t ret;
+
+        p += 5;
+        SKIP_BLANKS(p);
+        n = MMScript_NameLength(p);
+
+        if (!MMScript_IsNewName(pre, p, n) || (p[n] != ' ' && p[n] != '\t'))
+            return MMS_PARSE_ERR_DIRECTIVE;
+
+        ret = MMScript_Substitute(pre, p + n, &value, 0);
+
+        if (ret == 0 && (value.text == NULL || !MMScript_Fold(value.text, &folded)))
+            ret = MMS_PARSE_ERR_DIRECTIVE;
+
+        free(value.text);
+
+        if (ret != 0)
+            return ret;
+
+        snprintf(number, sizeof(number), "%ld", (long)folded);
+
+        if ((define->text = strdup(number)) == NULL)
+            return MMS_PARSE_ERR_MALLOC;
+
+        memcpy(define->name, p, n);
+        define->name[n] = '\0';
+        define->macro = 0;
+        define->param_count = 0;
+        pre->define_count++;
+
+        return 0;
+    }
+
+    if (strncmp(p, "MACRO", 5) == 0 && (p[5] == ' ' || p[5] == '\t'))
+    {
+        const char *name;
+
+        p += 5;
+        SKIP_BLANKS(p);
+        n = MMScript_NameLength(p);
+
+        if (!MMScript_IsNewName(pre, p, n) || p[n] != '(')
+            return MMS_PARSE_ERR_DIRECTIVE;
+
+        name = p;
+        p += n + 1;
+        SKIP_BLANKS(p);
+        define->param_count = 0;
+
+        while (*p != ')')
+        {
+            uint8_t i;
+
+            n = MMScript_NameLength(p);
+
+            if (n < 2 || n > MMSCRIPT_PRE_MAX_NAME || define->param_count == MMSCRIPT_PRE_MAX_PARAMS)
+                return MMS_PARSE_ERR_DIRECTIVE;
+
+            for (i=0; i<define->param_count; i++)
+                if (strlen(define->params[i]) == n && memcmp(define->params[i], p, n) == 0)
+                    return MMS_PARSE_ERR_DIRECTIVE;
+
+            memcpy(define->params[define->param_count], p, n);
+            define->params[define->param_count++][n] = '\0';
+
+            p += n;
+            SKIP_BLANKS(p);
+
+            if (*p == ',')
+            {
+                p++;
+                SKIP_BLANKS(p);
+            }
+            else if (*p != ')')
+            {
+                return MMS_PARSE_ERR_DIRECTIVE;
+            }
+        }
+
+        p++;
+        SKIP_BLANKS(p);
+
+        if (*p == '\0')
+            return MMS_PARSE_ERR_DIRECTIVE;
+
+        if ((define->text = strdup(p)) == NULL)
+            return MMS_PARSE_ERR_MALLOC;
+
+        n = MMScript_NameLength(name);
+        memcpy(define->name, name, n);
+        define->name[n] = '\0';
+        define->macro = 1;
+        pre->define_count++;
+
+        return 0;
+    }
+
+    if (strncmp(p, "INCLUDE", 7) == 0 && (p[7] == ' ' || p[7] == '\t'))
+    {
+        char included[PATH_SIZE];
+        const char *dir = strrchr(path, '/');
+        const char *backslash = strrchr(path, '\\');
+
+        p += 7;
+        SKIP_BLANKS(p);
+
+        if (*p == '"')
+        {
+            char *quote = strchr(++p, '"');
+
+            if (quote == NULL || quote[1] != '\0')
+                return MMS_PARSE_ERR_DIRECTIVE;
+
+            *quote = '\0';
+        }
+
+        if (*p == '\0')
+            return MMS_PARSE_ERR_DIRECTIVE;
+
+        if (backslash > dir)
+            dir = backslash;
+
+        /* Relative to the directory of the including file */
+        if (p[0] == '/' || p[0] == '\\' || (p[0] != '\0' && p[1] == ':') || dir == NULL)
+            n = (size_t)snprintf(included, sizeof(included), "%s", p);
+        else
+            n = (size_t)snprintf(included, sizeof(included), "%.*s%s", (int)(dir - path + 1), path, p);
+
+        if (n >= sizeof(included))
+            return MMS_PARSE_ERR_INCLUDE;
+
+        return MMScript_PreprocessFile(pre, included, depth + 1);
+    }
+
+    return MMS_PARSE_ERR_DIRECTIVE;
+}
+
+
+static int16_t MMScript_Substitute(PREPROCESSOR *pre, const char *p, TEXT *out, uint8_t depth)
+{
+    const char *start = p;
+
+    if (depth > MMSCRIPT_PRE_MAX_DEPTH)
+        return MMS_PARSE_ERR_DIRECTIVE;
+
+    /* Nothing to replace, as read */
+    if (pre->define_count == 0)
+        return MMScript_Append(out, p, strlen(p)) ? 0 : MMS_PARSE_ERR_MALLOC;
+
+    while (*p != '\0')
+    {
+        const DEFINE *define;
+        size_t n;
+        uint8_t ok;
+
+        if (!IS_NAME_START(*p) || (p > start && IS_NAME_CHAR(p[-1])))
+        {
+            if (!MMScript_Append(out, p++, 1))
+                return MMS_PARSE_ERR_MALLOC;
+
+            continue;
+        }
+
+        n = MMScript_NameLength(p);
+
+        if ((n == 4 && memcmp(p, "FILE", 4) == 0) || (n == 6 && memcmp(p, "STREAM", 6) == 0))
+            return MMScript_Append(out, p, strlen(p)) ? 0 : MMS_PARSE_ERR_MALLOC;
+
+        define = MMScript_FindDefine(pre, p, n);
+
+        if (define && define->macro && p[n] == '(')
+        {
+            int16_t ret;
+
+            p += n;
+            ret = MMScript_Expand(pre, define, &p, out, depth);
+
+            if (ret != 0)
+                return ret;
+
+            continue;
+        }
+
+        if (define && !define->macro)
+            ok = MMScript_Append(out, define->text, strlen(define->text));
+        else
+            ok = MMScript_Append(out, p, n);
+
+        if (!ok)
+            return MMS_PARSE_ERR_MALLOC;
+
+        p += n;
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_Expand(PREPROCESSOR *pre, const DEFINE *define, const char **p, TEXT *out, uint8_t depth)
+{
+    TEXT args[MMSCRIPT_PRE_MAX_PARAMS];
+    TEXT body = { NULL, 0, 0 };
+    const char *q = *p + 1;
+    const char *t;
+    uint8_t count = 0;
+    int16_t ret = 0;
+    uint8_t i;
+
+    memset(args, 0, sizeof(args));
+    SKIP_BLANKS(q);
+
+    /* Arguments split at commas outside of brackets, replaced & folded */
+    if (*q == ')')
+        q++;
+
+    while (ret == 0 && q[-1] != ')')
+    {
+        TEXT arg = { NULL, 0, 0 };
+        const char *start = q;
+        const char *end;
+        int level = 0;
+        int32_t folded;
+
+        while (*q != '\0' && (level > 0 || (*q != ',' && *q != ')')))
+        {
+            if (*q == '(' || *q == '[')
+                level++;
+            else if (*q == ')' || *q == ']')
+                level--;
+
+            q++;
+        }
+
+        for (end = q; end > start && (end[-1] == ' ' || end[-1] == '\t'); end--);
+        SKIP_BLANKS(start);
+
+        if (*q == '\0' || end <= start || count == define->param_count)
+        {
+            ret = MMS_PARSE_ERR_DIRECTIVE;
+            break;
+        }
+
+        if (!MMScript_Append(&arg, start, end - start))
+            ret = MMS_PARSE_ERR_MALLOC;
+        else
+            ret = MMScript_Substitute(pre, arg.text, &args[count], depth + 1);
+
+        free(arg.text);
+
+        if (ret == 0 && args[count].text && MMScript_Fold(args[count].text, &folded))
+        {
+            char number[16];
+
+            args[count].used = 0;
+            snprintf(number, sizeof(number), "%ld", (long)folded);
+
+            if (!MMScript_Append(&args[count], number, strlen(number)))
+                ret = MMS_PARSE_ERR_MALLOC;
+        }
+
+        count++;
+
+        if (*q++ == ')')
+            break;
+    }
+
+    if (ret == 0 && count != define->param_count)
+        ret = MMS_PARSE_ERR_DIRECTIVE;
+
+    /* Parameters replaced by arguments, then constants & macros of the result */
+    for (t = define->text; ret == 0 && *t != '\0'; )
+    {
+        size_t n = (t == define->text || !IS_NAME_CHAR(t[-1])) ? MMScript_NameLength(t) : 0;
+
+        for (i=0; i<count; i++)
+            if (strlen(define->params[i]) == n && memcmp(define->params[i], t, n) == 0)
+                break;
+
+        if (n == 0)
+            n = 1;
+
+        if (!((i < count) ? MMScript_Append(&body, args[i].text, args[i].used) : MMScript_Append(&body, t, n)))
+            ret = MMS_PARSE_ERR_MALLOC;
+
+        t += n;
+    }
+
+    if (ret == 0)
+        ret = MMScript_Substitute(pre, body.text, out, depth + 1);
+
+    for (i=0; i<count; i++)
+        free(args[i].text);
+
+    free(body.text);
+    *p = q;
+
+    return ret;
+}
+
+
+static int16_t MMScript_OutputLine(PREPROCESSOR *pre, const char *text, uint16_t file, uint16_t line)
+{
+    MMSCRIPT_SOURCE_MAP *map = pre->map;
+    int16_t ret;
+
+    if (map->line_count == pre->lines_size)
+    {
+        uint16_t size = pre->lines_size ? pre->lines_size * 2 : 64;
+        MMSCRIPT_SOURCE_LINE *lines;
+
+        if (size <= pre->lines_size)
+            return MMS_PARSE_ERR_MALLOC;
+
+        lines = (MMSCRIPT_SOURCE_LINE*)realloc(map->lines, size * sizeof(MMSCRIPT_SOURCE_LINE));
+
+        if (lines == NULL)
+            return MMS_PARSE_ERR_MALLOC;
+
+        map->lines = lines;
+        pre->lines_size = size;
+    }
+
+    map->lines[map->line_count].file = file;
+    map->lines[map->line_count].line = line;
+    map->line_count++;
+
+    ret = MMScript_Substitute(pre, text, &pre->out, 0);
+
+    if (ret == 0 && !MMScript_Append(&pre->out, "\n", 1))
+        ret = MMS_PARSE_ERR_MALLOC;
+
+    return ret;
+}
+
+
+static uint8_t MMScript_Fold(const char *p, int32_t *value)
+{
+    int64_t result = 0;
+    char op = '+';
+
+    for (;;)
+    {
+        int64_t operand = 0;
+        uint8_t negative = 0;
+        const char *digits;
+
+        SKIP_BLANKS(p);
+
+        if (*p == '-')
+        {
+            negative = 1;
+            p++;
+        }
+
+        for (digits = p; *p >= '0' && *p <= '9' && operand <= INT32_MAX; p++)
+            operand = operand * 10 + (*p - '0');
+
+        if (p == digits || operand > INT32_MAX)
+            return 0;
+
+        if (negative)
+            operand = -operand;
+
+        if (op == '+')
+            result += operand;
+        else if (op == '-')
+            result -= operand;
+        else if (op == '*')
+            result *= operand;
+        else if (operand != 0)
+            result /= operand;
+        else
+            return 0;
+
+        if (result > INT32_MAX || result < INT32_MIN)
+            return 0;
+
+        SKIP_BLANKS(p);
+
+        if (*p == '\0')
+            break;
+
+        if (*p != '+' && *p != '-' && *p != '*' && *p != '/')
+            return 0;
+
+        op = *p++;
+    }
+
+    *value = (int32_t)result;
+    return 1;
+}
+
+
+static uint8_t MMScript_IsNewName(PREPROCESSOR *pre, const char *p, size_t n)
+{
+    uint8_t length;
+    size_t i;
+
+    if (n < 2 || n > MMSCRIPT_PRE_MAX_NAME || pre->define_count == MMSCRIPT_PRE_MAX_DEFINES)
+        return 0;
+
+    if ((MMScript_Keyword(p, &length) >= 0 && length == n) || (MMScript_NodeCommand(p, &length) >= 0 && length == n))
+        return 0;
+
+    for (i=0; i<sizeof(_reserved) / sizeof(_reserved[0]); i++)
+        if (strlen(_reserved[i]) == n && memcmp(_reserved[i], p, n) == 0)
+            return 0;
+
+    return MMScript_FindDefine(pre, p, n) == NULL;
+}
+
+
+static DEFINE *MMScript_FindDefine(PREPROCESSOR *pre, const char *p, size_t n)
+{
+    for (uint16_t i=0; i<pre->define_count; i++)
+        if (strlen(pre->defines[i].name) == n && memcmp(pre->defines[i].name, p, n) == 0)
+            return &pre->defines[i];
+
+    return NULL;
+}
+
+
+static size_t MMScript_NameLength(const char *p)
+{
+    size_t n = 0;
+
+    if (!IS_NAME_START(*p))
+        return 0;
+
+    while (IS_NAME_CHAR(p[n]))
+        n++;
+
+    return n;
+}
+
+
+static uint8_t MMScript_Append(TEXT *t, const char *p, size_t n)
+{
+    if (t->used + n + 1 > t->size)
+    {
+        size_t size = t->size ? t->size : 256;
+        char *text;
+
+        while (size < t->used + n + 1)
+            size *= 2;
+
+        text = (char*)realloc(t->text, size);
+
+        if (text == NULL)
+            return 0;
+
+        t->text = text;
+        t->size = size;
+    }
+
+    memcpy(t->text + t->used, p, n);
+    t->used += n;
+    t->text[t->used] = '\0';
+
+    return 1;
+}
+
+
+static char *MMScript_ReadFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char *buf;
+    long length;
+
+    if (file == NULL)
+        return NULL;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    buf = (char*)malloc((size_t)length + 1);
+
+    if (buf == NULL || fread(buf, 1, (size_t)length, file) != (size_t)length)
+    {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+
+    buf[length] = '\0';
+    fclose(file);
+
+    return buf;
+}
@@ -0,0 +1,97 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCRIPT_PREPROCESSOR_H__
+#define __SCRIPT_PREPROCESSOR_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+#include <stddef.h>
+
+
+/**
+  * Directives of script files, resolved once by MMScript_Preprocess() before MMScript_ParseScript():
+  *   "#CONST" NAME EXPR                                  named constant
+  *   "#MACRO" NAME "(" [PARAM {"," PARAM}] ")" TEXT      NAME(ARG,...) is replaced by TEXT, PARAMs by ARGs
+  *   "#INCLUDE" FILE                                     lines of FILE, relative to the including file
+  * NAME & PARAM are 2 to 31 of A-Z, 0-9 & '_', not starting with a digit, neither keywords nor command
+  * or other words of the script syntax; single letters stay variables. EXPR is folded left to right, as
+  * LET does, from numbers & constants defined above. Arguments of macros are folded too when constant,
+  * replaced as written otherwise. Paths after STREAM & FILE are never replaced.
+  * Directive lines are left out of the output, included lines take the place of "#INCLUDE"; the source map
+  * gives the file & line each line of the output comes from, for errors & GUI.
+  */
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_PRE_MAX_NAME       31
+#define MMSCRIPT_PRE_MAX_PARAMS     8
+#define MMSCRIPT_PRE_MAX_DEFINES    256
+#define MMSCRIPT_PRE_MAX_DEPTH      8       /* Of nested includes, & of macros expanding macros */
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    uint16_t file;              /* Index in files */
+    uint16_t line;              /* From 1 */
+}   MMSCRIPT_SOURCE_LINE;
+
+typedef struct
+{
+    char **files;               /* Paths of the files read, the script first */
+    uint16_t file_count;
+    MMSCRIPT_SOURCE_LINE *lines;    /* By index of line of the output */
+    uint16_t line_count;
+    MMSCRIPT_SOURCE_LINE error;     /* Line preprocessing failed at */
+}   MMSCRIPT_SOURCE_MAP;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Read a script file & resolve its directives
+  * @note   Lines without directive nor name defined are output as read, so that a script without
+  *         directive is parsed & hashed as before.
+  * @param  path: script file
+  * @param  script_buf: output of malloced script, to be handed over to MMScript_ParseScript()
+  * @param  buf_len: output of size of script_buf
+  * @param  map: output of source map, to be freed by MMScript_FreeSourceMap() even on failure
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_FILE: script can't be read
+  *         MMS_PARSE_ERR_MALLOC: malloc failed
+  *         MMS_PARSE_ERR_INCLUDE: included file can't be read, or included too deep
+  *         MMS_PARSE_ERR_DIRECTIVE: invalid directive or macro call, at map->error
+  */
+int16_t MMScript_Preprocess(const char *path, char **script_buf, size_t *buf_len, MMSCRIPT_SOURCE_MAP *map);
+
+
+/**
+  * @brief  Get the file & line a line of the output comes from
+  * @param  map: source map of MMScript_Preprocess()
+  * @param  index: line index, as MMScript_LineText()
+  * @param  line: output of line in file, from 1
+  * @retval file path, NULL if out of range
+  */
+const char *MMScript_SourceLine(const MMSCRIPT_SOURCE_MAP *map, uint16_t index, uint16_t *line);
+
+
+/**
+  * @brief  Free a source map
+  * @param  map: source map of MMScript_Preprocess()
+  * @retval None
+  */
+void MMScript_FreeSourceMap(MMSCRIPT_SOURCE_MAP *map);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SCRIPT_PREPROCESSOR_H__ */
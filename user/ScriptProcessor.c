@@ -2,25 +2,87 @@
 /**
   * Script definition:
   * SCRIPT ::= {LINE}
-  * LINE ::= {LABEL ":" (ASSIGN_EXPR | IF_EXPR | ("GOTO" NUMBER) | ("DELAY" NUMBER) | ("CALL" NUMBER) | "RET" | "END" | ACTION)} "\r\n"
+  * LINE ::= {LABEL ":" (ASSIGN_EXPR | IF_EXPR | ("GOTO" NUMBER) | ("DELAY" NUMBER) | ("UDELAY" NUMBER) | ("PERIOD" NUMBER) | ("CALL" NUMBER) | "RET" | "END" | FOR_EXPR | ("NEXT" [VAR]) | ("FORK" LABEL) | "JOIN" | RETRY_EXPR | UNTIL_EXPR | ("BLEND" NODE_ID "," NUMBER) | ("STREAM" FILE) | SCURVE_EXPR | SPLINE_EXPR | GEAR_EXPR | CAM_EXPR | TABLE_EXPR | ACTION)} "\r\n"
   * LABEL ::= NUMBER
-  * EXPR ::= (NUMBER | VAR) {("+" | "-" | "*" | "/") (NUMBER | VAR)}
+  * EXPR ::= (NUMBER | VAR | ITEM) {("+" | "-" | "*" | "/") (NUMBER | VAR | ITEM)}
+  * ITEM ::= VAR "[" (NUMBER | VAR) "]"
+  * TABLE_EXPR ::= "TABLE" VAR "," ("I8" | "I16" | "I32") "," (("FILE" FILE) | (NUMBER {"," NUMBER}))
   * ASSIGN_EXPR := "LET" VAR "=" EXPR
+  * FOR_EXPR := "FOR" VAR "=" EXPR "TO" EXPR ["STEP" EXPR]
   * IF_EXPR := "IF" "(" EXPR (">" | "<" | ">=" | "<=" | "==" | "!=") EXPR ")" "THEN" LABEL
+  * UNTIL_EXPR ::= "UNTIL" NODE_ID "," ("POS" | "VEL") (">" | "<") NUMBER
+  * SCURVE_EXPR ::= "SCURVE" VMAX "," AMAX "," JMAX "," PERIOD_US ";" NODE_ID "," NUMBER {";" NODE_ID "," NUMBER}
+  * SPLINE_EXPR ::= "SPLINE" SEGMENT_MS "," PERIOD_US ";" NODE_ID "," NUMBER {"," NUMBER} {";" NODE_ID "," NUMBER {"," NUMBER}}
+  * GEAR_EXPR ::= "GEAR" NODE_ID "," (("0") | (NODE_ID "," NUMBER "," NUMBER))
+  * CAM_EXPR ::= "CAM" NODE_ID "," NODE_ID "," NUMBER "," NUMBER {"," NUMBER}
+  * RETRY_EXPR ::= "RETRY" ("LINK" | "SERVO") "," MAX_ATTEMPTS "," INITIAL_DELAY_MS "," MAX_DELAY_MS ["," ERROR_LABEL]
   * VAR ::= ("A" | "B" | "C" | "D" | "E" | "F" | "G" | "H" | "I" | "J" | "K" | "L" | "M" | "N" | "O" | "P" | "Q" | "R" | "S" | "T" | "U" | "V" | "W" | "X" | "Y" | "Z")
   * ACTION ::= ("WAIT", NODE_ID{"," NODE_ID}) | COMMANDS
   * COMMANDS ::= NODE_ID "," COMMAND{";" NODE_ID "," COMMAND}
-  * COMMAND ::= ("START" NUMBER) | "STOP" | "HALT" | ("VM" NUMBER) | ("PVM" NUMBER "," NUMBER) | ("AP" NUMBER) | ("PAP" NUMBER "," NUMBER "," NUMBER) | ("RP" NUMBER) | ("PRP" NUMBER "," NUMBER "," NUMBER)
+  * COMMAND ::= ("START" NUMBER) | "STOP" | "HALT" | ("VM" OPERAND) | ("PVM" OPERAND "," OPERAND) | ("AP" OPERAND) | ("PAP" OPERAND "," OPERAND "," OPERAND) | ("RP" OPERAND) | ("PRP" OPERAND "," OPERAND "," OPERAND)
+  * OPERAND ::= NUMBER | VAR | ITEM
   *
   * Note: ASSIGN_EXPR uses left precedence
+  *       FOR & NEXT are paired when the script is parsed. FOR evaluates its bounds once, NEXT adds STEP (1 by
+  *       default) to VAR & branches back to the line after FOR by line index while VAR has not passed the end,
+  *       without going through labels or expressions. FOR skips the loop if the start is already past the end.
+  *       After the loop VAR keeps the value of the last pass.
+  *       DELAY & UDELAY wait from the time they are reached, so the time the other lines of a GOTO loop take adds
+  *       to its period. PERIOD waits for the next multiple of its period since the task first reached the line,
+  *       at the top of a loop that must repeat at a fixed rate, e.g. "1: PERIOD 5000" ... "9: GOTO 1".
+ *
+ * Tasks: "FORK" starts a task at LABEL with its own call stack, the forking task goes on with the next line.
+ *        Tasks are switched after every line & variables are shared. With a time base set, DELAY, UDELAY,
+ *        PERIOD & WAIT yield to other tasks instead of blocking. "JOIN" waits for the tasks forked by the
+ *        current task, END of a forked task ends it, END of the main task ends the script.
+ *        With an executor set, command lines & WAIT polls are submitted as transactions & their task is parked
+ *        until completion, so that tasks go on while commands of another task are on the bus.
+ *
+ * Telemetry: with a poller publishing node status (see MMScript_SetTelemetry()), WAIT reads it instead of
+ *        polling the bus. "UNTIL" goes on as soon as the position, or absolute velocity, of a node crosses
+ *        a value, so that the next moves overlap the end of the current one instead of waiting in-position.
+ *        "BLEND" NODE_ID "," RADIUS queues the AP/PAP/RP/PRP of the node (up to 8) instead of sending them,
+ *        the poller sends the next one once the node is within RADIUS of the current target, so that
+ *        it goes on without coming to rest. RADIUS should cover the deceleration distance plus the distance
+ *        moved in one poll cycle. WAIT of the node waits for the queue to drain. "BLEND" NODE_ID ",0" ends.
+ *
+ * Streaming: "STREAM" FILE sends the setpoints of a binary trajectory file (see TrajectoryStream.h) as AP,
+ *        one frame every period of the file, timed by the time base. FILE is quoted & relative as a TABLE's.
+ *        Frames already overdue when the next one is due are dropped. The line ends once the last frame was
+ *        sent; with tasks forked, the task yields until each frame is due so that the others go on meanwhile.
+ *        "SCURVE" moves up to 8 nodes from their polled positions to absolute targets along a straight line,
+ *        jerk limited in counts/s, counts/s^2 & counts/s^3 on the longest axis. "SPLINE" moves them through
+ *        the same number of waypoints per node (up to 15), SEGMENT_MS apart, along a cubic spline at rest at
+ *        both ends. Both generate their setpoints up front (see TrajectoryGen.h) & send them as STREAM does.
+ *
+ * Gearing: "GEAR" FOLLOWER "," LEADER "," NUM "," DEN makes the follower move NUM/DEN times as much as the
+ *        leader from their positions when engaged. "CAM" FOLLOWER "," LEADER "," CYCLE "," OFFSET {"," OFFSET}
+ *        moves it by the offsets (up to 16) equally spaced over CYCLE counts of the leader, interpolated &
+ *        repeated every cycle. The poller reads the leader position & sends the follower setpoint every
+ *        poll interval, up to 4 followers. "GEAR" FOLLOWER ",0" disengages & logs the update latency, from
+ *        the leader sampling its position, taken halfway through the read, to the follower setpoint accepted.
+ *
+ * Tables: "TABLE" VAR declares a table of 8, 16 or 32 bit integers, separate from the variable of the same
+ *        name, with the values listed or read from a binary file of little endian integers. TABLE lines are
+ *        read once by MMScript_ParseScript() & skipped when executed, more TABLE lines of the same VAR append.
+ *        A relative FILE is read from the directory of the script, see MMScript_SetScriptPath(), quoted if
+ *        it has spaces. VAR "[" INDEX "]" reads element INDEX, from 0, in expressions & as operand of
+ *        commands; I32 tables read in expressions must fit int16_t variables.
+ *
+ * Directives: "#CONST", "#MACRO" & "#INCLUDE" lines are resolved by MMScript_Preprocess() when the file is
+ *        read, see ScriptPreprocessor.h. MMScript_ParseScript() only sees their result.
   */
 
 /* Includes ------------------------------------------------------------------*/
 
 #include "ScriptProcessor.h"
+#include "RttEstimator.h"
+#include "Telemetry.h"
+#include "TrajectoryGen.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 
 
@@ -29,8 +91,177 @@ typedef struct
 {
     int16_t label;
     const char *startOfLine;
+    int16_t loop_line;          /* FOR: line of its NEXT, NEXT: line of its FOR, -1 otherwise */
+    uint8_t loop_var;           /* FOR: index of VAR */
+    int16_t loop_end;           /* FOR: bounds evaluated when the loop was entered */
+    int16_t loop_step;
 }   LINE_ENTRY;
 
+#define MAX_STACK_SIZE 10
+#define MAX_TASK_COUNT 8
+#define MAX_TRANSACTION_OPS 16
+#define MAX_BLEND_NODES 4
+#define MAX_BLEND_SEGMENTS 8       /* Power of 2, queue indexes wrap at 256 */
+#define MAX_GEAR_FOLLOWERS 4
+#define MAX_CAM_POINTS 16
+#define MAX_TABLE_LENGTH 32768     /* Indexes are int16_t variables */
+#define MAX_LOOP_DEPTH 8
+#define MAX_TASK_PERIODS 4         /* PERIOD lines a task keeps anchored at once */
+
+/* Bus command of a script line, see MMScript_RunOps() */
+typedef enum
+{
+    OP_START = MMSCRIPT_OP_START,
+    OP_STOP = MMSCRIPT_OP_STOP,
+    OP_HALT = MMSCRIPT_OP_HALT,
+    OP_VM = MMSCRIPT_OP_VM,
+    OP_PVM = MMSCRIPT_OP_PVM,
+    OP_AP = MMSCRIPT_OP_AP,
+    OP_PAP = MMSCRIPT_OP_PAP,
+    OP_RP = MMSCRIPT_OP_RP,
+    OP_PRP = MMSCRIPT_OP_PRP,
+    OP_STATUS = MMSCRIPT_OP_COUNT,  /* Control status for WAIT, restart servo if not under control */
+    OP_SETPOINT,                    /* AP of a stream frame, not retried */
+    OP_TELEMETRY,                   /* MMScript_PollTelemetry() of the poller */
+    OP_GEAR                         /* MMScript_PollGear() of the poller */
+}   OP_TYPE;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t node;
+    int32_t args[3];
+    uint8_t status;             /* Output of OP_STATUS, MMS_RESP_xxx of OP_SETPOINT */
+    uint8_t in_position;
+}   TRANSACTION_OP;
+
+/* Bus commands of one script line, run by the executor while their task is parked */
+struct MMSCRIPT_TRANSACTION
+{
+    MMSCRIPT_CONTEXT *ctx;
+    uint8_t opCount;
+    TRANSACTION_OP ops[MAX_TRANSACTION_OPS];
+    int16_t result;             /* <0: error aborting the script */
+    int16_t nextLabel;          /* Error label of retry policy, -1 if none */
+    uint8_t done;               /* Set by the executor thread, see ATOMIC_STORE() */
+    MMSCRIPT_RETRY_POLICY retry_policies[MMSCRIPT_RETRY_CLASS_COUNT];   /* As submitted, RETRY lines change the context's meanwhile */
+};
+
+/* Move queued for a node in BLEND mode, target made absolute */
+typedef struct
+{
+    uint8_t profiled;           /* PAP, else AP */
+    int32_t acceleration;
+    int32_t velocity;
+    int32_t target;
+}   BLEND_SEGMENT;
+
+/* Lookahead queue of a node, filled by the script & sent by the telemetry poller */
+typedef struct
+{
+    uint8_t node;               /* 0 if free, see ATOMIC_STORE() */
+    int32_t radius;             /* Next segment sent once within radius of the current target */
+    BLEND_SEGMENT segments[MAX_BLEND_SEGMENTS];
+    uint8_t head;               /* Next to send, written by the poller */
+    uint8_t tail;               /* Next free, written by the script */
+    int32_t last_target;        /* Target of the last segment queued, base of RP/PRP */
+    uint8_t has_last_target;
+    uint8_t active;             /* A segment was sent, poller only */
+    int32_t active_target;      /* poller only */
+    uint64_t sent_us;           /* Time the last segment was sent */
+}   BLEND_SLOT;
+
+/* Follower of GEAR/CAM, set up by the script & stepped by the telemetry poller */
+typedef struct
+{
+    uint8_t follower;           /* 0 if free, see ATOMIC_STORE() */
+    uint8_t leader;
+    int32_t numerator;          /* GEAR */
+    int32_t denominator;
+    int32_t cycle;              /* CAM: leader counts per cycle, 0 for GEAR */
+    uint8_t cam_points;
+    int32_t cam[MAX_CAM_POINTS];    /* Follower offsets at 0, cycle / cam_points, ... */
+    int32_t leader_origin;      /* Positions when engaged */
+    int32_t follower_origin;
+    uint64_t updated_us;        /* Last setpoint accepted, poller only */
+}   GEAR_SLOT;
+
+/* Table declared by TABLE, elements in native byte order */
+typedef struct
+{
+    uint8_t size;               /* Bytes per element: 1, 2 or 4, 0 if not declared */
+    uint16_t length;
+    void *data;
+}   SCRIPT_TABLE;
+
+/* Anchor of a PERIOD line in a task */
+typedef struct
+{
+    uint16_t line;
+    uint64_t deadline_us;       /* Of the last pass, 0 if not anchored */
+}   PERIOD_SLOT;
+
+/* Script task started by FORK, task 0 is the main task */
+typedef struct
+{
+    uint8_t alive;
+    uint8_t joining;            /* Blocked in JOIN until its children ended */
+    uint8_t polling;            /* Yielded in WAIT, poll on next execution */
+    int8_t parent;              /* Index of forking task, -1 for main task */
+    int8_t stack_pointer;
+    int16_t nextLabel;
+    uint16_t run_stack[MAX_STACK_SIZE];
+    uint64_t wake_us;           /* Yielded in DELAY/UDELAY/PERIOD/WAIT until, 0 if ready */
+    uint8_t parked;             /* Transaction submitted, line executed again on completion */
+    MMSCRIPT_TRANSACTION transaction;
+    uint64_t wait_since_us;     /* WAIT on telemetry trusts status sampled after this only */
+    uint16_t nextLine;          /* Line of nextLabel if known, saves the label scan */
+    PERIOD_SLOT periods[MAX_TASK_PERIODS];  /* Tasks running the same PERIOD line keep their own period */
+    uint8_t next_period;        /* Slot taken over when all are anchored */
+    uint8_t streaming;          /* STREAM, SCURVE or SPLINE line in progress, executed again for the next frame */
+    MMSCRIPT_STREAM stream;
+    uint8_t *trajectory;        /* Setpoints of SCURVE/SPLINE, freed with the stream */
+    uint32_t frame;             /* Next frame of stream */
+    uint64_t stream_start_us;
+    MMSCRIPT_STREAM_STATS stream_stats;
+}   SCRIPT_TASK;
+
+/* Interpreter state, one per bus */
+struct MMSCRIPT_CONTEXT
+{
+    uint8_t bus;
+    uint8_t stop;               /* Set from any thread, ATOMIC_LOAD/ATOMIC_STORE only */
+    MMSCRIPT_GET_MICRO_SECONDS get_us;
+    MMSCRIPT_DELAY_UNTIL_MICRO_SECONDS delay_until_us;
+    int16_t vars[26];           /* 'A' to 'Z', shared by tasks */
+    char *scriptBuf;
+    LINE_ENTRY *lineEntries;
+    int lineCount;
+    SCRIPT_TASK tasks[MAX_TASK_COUNT];
+    uint8_t current;            /* Index of task executing */
+    uint8_t liveTasks;
+    MMSCRIPT_RETRY_POLICY retry_policies[MMSCRIPT_RETRY_CLASS_COUNT];     /* In effect, RETRY lines included */
+    MMSCRIPT_RETRY_POLICY host_retry_policies[MMSCRIPT_RETRY_CLASS_COUNT];  /* Of MMScript_SetRetryPolicy(), restored by rewind */
+    MMSCRIPT_SUBMIT submit;     /* NULL: bus commands run on the calling thread */
+    MMSCRIPT_WAIT_COMPLETION wait_completion;
+    uint8_t telemetry;          /* Status polled in the background, see MMScript_SetTelemetry() */
+    BLEND_SLOT blend[MAX_BLEND_NODES];
+    MMSCRIPT_STREAM_STATS stream_stats;     /* Of the last STREAM, SCURVE or SPLINE */
+    GEAR_SLOT gear[MAX_GEAR_FOLLOWERS];
+    MMSCRIPT_GEAR_STATS gear_stats;         /* Since rewound, written by the poller */
+    SCRIPT_TABLE tables[26];                /* By VAR, set up by MMScript_ParseScript() */
+    uint32_t hash;                          /* Of the script parsed */
+    const MMSCRIPT_NATIVE_PROGRAM *native;  /* Compiled lines, NULL to interpret all */
+    uint8_t optimize;                       /* See MMScript_SetOptimize() */
+    MMSCRIPT_OPTIMIZE_REPORT optimize_report;
+    char *rewrites;                         /* Lines rewritten by the optimizer */
+    size_t rewrites_size;
+    size_t rewrites_used;
+    const MMSCRIPT_BUS *api;                /* Node calls, the API unless MMScript_SetBus() */
+    MMSCRIPT_TRANSACTION polls[2];          /* Of the poller in async mode: GEAR/CAM followers, node in turn */
+    char *script_path;                      /* See MMScript_SetScriptPath(), NULL: working directory */
+};
+
 
 /* Private define ------------------------------------------------------------*/
 
@@ -38,6 +269,14 @@ typedef struct
     DelayMilliSecondsImpl(ms)
 
 
+#define CURRENT_TASK        \
+    (&_ctx->tasks[_ctx->current])
+
+
+#define WAIT_SETTLE_US      100000  /* Let motion start before the first status is trusted */
+#define TELEMETRY_CHECK_MS  10      /* WAIT re-reads the status table, cheap */
+
+
 #define SAFE_FREE(p)        \
     do {                    \
         free(p);            \
@@ -52,78 +291,149 @@ typedef struct
     }   while(0)
 
 
-#define FORCE_EXEC(func, node_id, local_error_callback, node_error_callback, log_func)       \
+/* Number item of an expression, negative ones as folded by the preprocessor */
+#define IS_NUMBER(p)                               \
+    ((*(p) <= '9' && *(p) >= '0') ||               \
+     (*(p) == '-' && (p)[1] <= '9' && (p)[1] >= '0'))
+
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL        __declspec(thread)
+#define ATOMIC_LOAD(p)      (*(volatile uint8_t*)(p))
+#define ATOMIC_STORE(p, v)  (*(volatile uint8_t*)(p) = (v))
+#define ATOMIC_LOAD64(p)    (*(volatile uint64_t*)(p))
+#define ATOMIC_STORE64(p, v) (*(volatile uint64_t*)(p) = (v))
+#else
+#define THREAD_LOCAL        __thread
+#define ATOMIC_LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_LOAD64(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE64(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+
+/* The API is shared by all buses, hold it for the whole transaction */
+#define TIMED_CALL(func, node_id, attempt)                                                   \
+    (MMScript_ApiAcquire(node_id),                                                           \
+     MMScript_ApiRelease(MMScript_RttEnd(node_id, func, (attempt) > 0)))
+
+
+#define RETRY_EXEC(func, node_id)                                                            \
     do {                                                                                     \
-        uint8_t ret;                                                                         \
-        if (log_func)                                                                        \
-            log_func(node_id, #func);                                                        \
-        while ((ret = func) != MMS_RESP_SUCCESS)                                             \
+        uint8_t ret_;                                                                        \
+        uint16_t attempt_ = 0;                                                               \
+        while ((ret_ = TIMED_CALL(func, node_id, attempt_)) != MMS_RESP_SUCCESS)             \
         {                                                                                    \
-            local_error_callback(node_id, ret);                                              \
-            if (_stop)                                                                       \
+            if (ATOMIC_LOAD(&_ctx->stop))                                                    \
                 return 0;                                                                    \
-            DELAY_MS(100);                                                                   \
+            if (!MMScript_RetryBackoff(node_id, ret_, ++attempt_, local_error_callback,      \
+                                       DelayMilliSecondsImpl, log_func))                     \
+                return MMScript_RetryEscalate(ret_, nextLabel);                              \
         }                                                                                    \
     }   while(0)
 
 
+#define FORCE_EXEC(func, node_id, local_error_callback, node_error_callback, log_func)       \
+    do {                                                                                     \
+        if (log_func)                                                                        \
+            log_func(node_id, #func);                                                        \
+        RETRY_EXEC(func, node_id);                                                           \
+    }   while(0)
+
+
 #define FORCE_MOVE(func, node_id, local_error_callback, node_error_callback, log_func)       \
     do {                                                                                     \
         uint8_t ret;                                                                         \
+        uint16_t attempt = 0;                                                                \
+        uint64_t sent_us;                                                                    \
         if (log_func)                                                                        \
             log_func(node_id, #func);                                                        \
-        while ((ret = func) != MMS_RESP_SUCCESS)                                             \
+        while ((sent_us = _ctx->get_us ? _ctx->get_us() : 0,                                 \
+                ret = TIMED_CALL(func, node_id, attempt)) != MMS_RESP_SUCCESS)               \
         {                                                                                    \
-            local_error_callback(node_id, ret);                                              \
-            if (_stop)                                                                       \
+            if (ATOMIC_LOAD(&_ctx->stop))                                                    \
                 return 0;                                                                    \
+            if (!MMScript_RetryBackoff(node_id, ret, ++attempt, local_error_callback,        \
+                                       DelayMilliSecondsImpl, log_func))                     \
+                return MMScript_RetryEscalate(ret, nextLabel);                               \
             if (ret == MMS_RESP_SERVO_ERROR)                                                 \
             {                                                                                \
                 uint8_t status, in_position;                                                 \
-                log_func(node_id, "Check control status.");                                  \
-                while ((ret = MMS_GetControlStatus(node_id, &status, &in_position,           \
-                                                   node_error_callback)) != MMS_RESP_SUCCESS)\
-                {                                                                            \
-                    local_error_callback(node_id, ret);                                      \
-                    if (_stop)                                                               \
-                        return 0;                                                            \
-                    DELAY_MS(100);                                                           \
-                }                                                                            \
+                if (log_func)                                                                \
+                    log_func(node_id, "Check control status.");                              \
+                if (!MMScript_TelemetryStatus(node_id, sent_us, &status, &in_position))      \
+                    RETRY_EXEC(_ctx->api->GetControlStatus(node_id, &status, &in_position,   \
+                                                    node_error_callback), node_id);          \
                 if (status == MMS_CTRL_STATUS_NO_CONTROL)                                    \
                 {                                                                            \
-                    log_func(node_id, "Restart servo.");                                     \
-                    while ((ret = MMS_StartServo(node_id, MMS_MODE_KEEP,                     \
-                                                 node_error_callback)) != MMS_RESP_SUCCESS)  \
-                    {                                                                        \
-                        local_error_callback(node_id, ret);                                  \
-                        if (_stop)                                                           \
-                            return 0;                                                        \
-                        DELAY_MS(100);                                                       \
-                    }                                                                        \
+                    if (log_func)                                                            \
+                        log_func(node_id, "Restart servo.");                                 \
+                    RETRY_EXEC(_ctx->api->StartServo(node_id, MMS_MODE_KEEP,                        \
+                                              node_error_callback), node_id);                \
                 }                                                                            \
             }                                                                                \
-            DELAY_MS(100);                                                                   \
         }                                                                                    \
     }   while(0)
 
 
 /* Private macro -------------------------------------------------------------*/
 
-#define MAX_STACK_SIZE 10
+#define MISSING_PARAM_ERROR(name, operands, error)  error,
 
+/* LINK: lost/corrupted frame, retry almost immediately. SERVO: servo error/busy, back off up to 100ms */
+#define DEFAULT_RETRY_POLICIES      { { 0, 2, 2, 0 }, { 0, 10, 100, 0 } }
 
-/* Private variables ---------------------------------------------------------*/
 
-static uint8_t _stop = 0;
-static int16_t vars[26] = {0};  /* 'A' to 'Z' */
-static int16_t _nextLabel = 0;  /*      */
-static char *_scriptBuf = NULL; /*      */
-static LINE_ENTRY *_lineEntries = NULL;
-static int _lineCount = -1;
+/* Private variables ---------------------------------------------------------*/
 
+/* By MMSCRIPT_OP, error of a command missing operands */
+static const int16_t _missing_param_errors[MMSCRIPT_OP_COUNT] = { MMSCRIPT_NODE_COMMANDS(MISSING_PARAM_ERROR) };
 
-static uint16_t _run_stack[MAX_STACK_SIZE];
-static int8_t _stack_pointer = -1;
+/* Node calls of contexts MMScript_SetBus() gave no other bus */
+static const MMSCRIPT_BUS _api_bus =
+{
+    MMS_GetControlStatus,
+    MMS_GetAbsolutePosition,
+    MMS_StartServo,
+    MMS_ResetError,
+    MMS_StopServo,
+    MMS_HaltServo,
+    MMS_SetProfileAcceleration,
+    MMS_SetProfileVelocity,
+    MMS_ProfiledVelocityMove,
+    MMS_AbsolutePositionMove,
+    MMS_ProfiledAbsolutePositionMove,
+    MMS_RelativePositionMove,
+    MMS_ProfiledRelativePositionMove
+};
+
+static MMSCRIPT_CONTEXT _default_context =
+{
+    0, 0, NULL, NULL, {0}, NULL, NULL, -1,
+    {
+        { 1, 0, 0, -1, -1, 0, {0}, 0, 0, {0}, 0, 0, { { 0 } }, 0, 0, { 0 }, NULL, 0, 0, { 0 } }
+    },
+    0, 1,
+    DEFAULT_RETRY_POLICIES,
+    DEFAULT_RETRY_POLICIES,
+    NULL, NULL, 0,
+    { { 0 } },
+    { 0 },
+    { { 0 } },
+    { 0 },
+    { { 0 } },
+    0, NULL,
+    0, { 0 }, NULL, 0, 0,
+    &_api_bus,
+    { { 0 } },
+    NULL
+};
+
+static THREAD_LOCAL MMSCRIPT_CONTEXT *_ctx = &_default_context;    /* Selected by the calling thread */
+static THREAD_LOCAL const MMSCRIPT_RETRY_POLICY *_policies = NULL; /* Of the transaction run by the executor, NULL: of _ctx */
+
+static MMSCRIPT_API_LOCK _api_acquire = NULL;
+static MMSCRIPT_API_LOCK _api_release = NULL;
 
 
 /* Private function prototypes -----------------------------------------------*/
@@ -153,6 +463,167 @@ static int16_t MMScript_ProcessLine(uint16_t *lineNum, int16_t *nextLabel, MMSCR
 static int16_t MMScript_Eval(const char *expr, int16_t *eval_out);
 
 
+/**
+  * @brief  Evaluate VAR or VAR "[" INDEX "]" & move past it
+  * @param  expr: points to VAR, moved past the item
+  * @param  value: output of value
+  * @retval 0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_EvalVar(const char **expr, int32_t *value);
+
+
+/**
+  * @brief  Evaluate operands of a command, NUMBER, VAR or VAR "[" INDEX "]" separated by ","
+  * @param  p: first operand
+  * @param  values: output of values
+  * @param  count: number of operands
+  * @retval 0: succeeded
+  *         MMS_ERR_TABLE_INDEX: table not declared or index out of range
+  *         MMS_ERR_INVALID_EXPR_ITEM: missing or invalid operand
+  */
+static int16_t MMScript_Operands(const char *p, int32_t *values, uint8_t count);
+
+
+/**
+  * @brief  Declare a table or append to it, from a TABLE line
+  * @param  params: parameters after the keyword
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_TABLE: invalid
+  */
+static int16_t MMScript_ParseTable(const char *params);
+
+
+/**
+  * @brief  Check that the tables read in expressions fit the int16_t variables
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_TABLE: I32 table with elements out of range read by LET, IF or FOR
+  */
+static int16_t MMScript_CheckTableReads(void);
+
+
+/**
+  * @brief  Free the tables of a context
+  * @param  ctx: context
+  * @retval None
+  */
+static void MMScript_FreeTables(MMSCRIPT_CONTEXT *ctx);
+
+
+/**
+  * @brief  Execute a compiled line
+  * @param  line: compiled line
+  * @param  lineNum: index of line
+  * @param  nextLabel: output of next label
+  * @retval 0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_ExecNative(MMSCRIPT_NATIVE_LINE line, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
+
+
+/**
+  * @brief  Hash labels & lines of the script parsed
+  * @retval FNV-1a hash
+  */
+static uint32_t MMScript_HashLines();
+
+
+/**
+  * @brief  Pair FOR & NEXT lines
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_LOOP: unpaired or nested too deep
+  */
+static int16_t MMScript_PairLoops();
+
+
+/**
+  * @brief  Optimize the lines of the script parsed, see MMScript_SetOptimize()
+  * @note   Lines removed are left NULL like empty lines, so that line indexes don't change.
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_MALLOC: malloc failed
+  */
+static int16_t MMScript_Optimize();
+
+
+/**
+  * @brief  Check the expression between start & end is made of numbers, dividing by none that is 0
+  * @param  start: expression
+  * @param  end: end of expression
+  * @retval 1 if constant
+  */
+static uint8_t MMScript_IsConstant(const char *start, const char *end);
+
+
+/**
+  * @brief  Get index of the first line with label
+  * @param  label: label, a line if >0
+  * @retval line index, -1 if none
+  */
+static int MMScript_FindLabel(int label);
+
+
+/**
+  * @brief  Get index of the next line that isn't empty or removed
+  * @param  index: line index
+  * @retval line index, -1 if none
+  */
+static int MMScript_NextLine(int index);
+
+
+/**
+  * @brief  Get the label a GOTO, IF, CALL or FORK line jumps to, as written
+  * @param  line: text of line
+  * @param  number: output of label in the text
+  * @param  end: output of text after label
+  * @retval label, -1 if none
+  */
+static int MMScript_JumpTarget(const char *line, const char **number, const char **end);
+
+
+/**
+  * @brief  Get index of the line a line may jump to, error label of RETRY included
+  * @param  index: line index
+  * @retval line index, -1 if none
+  */
+static int MMScript_JumpLine(int index);
+
+
+/**
+  * @brief  Replace the text of a line by head, middle & tail concatenated
+  * @param  index: line index
+  * @param  head: start of text
+  * @param  headLength: length of head
+  * @param  middle: text
+  * @param  tail: end of text
+  * @retval 1: replaced
+  *         0: same text, or no room left
+  */
+static uint8_t MMScript_RewriteLine(int index, const char *head, size_t headLength, const char *middle, const char *tail);
+
+
+/**
+  * @brief  Evaluate the condition of an IF line
+  * @param  scriptLine: IF line, restored once evaluated
+  * @param  taken: output of 1 if the condition holds
+  * @param  label: output of label after THEN
+  * @retval 0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_EvalIf(const char *scriptLine, uint8_t *taken, int *label);
+
+
+/**
+  * @brief  Evaluate the expression of FOR between start & the first of the keywords that follow
+  * @param  start: expression
+  * @param  keyword1: keyword ending the expression, NULL if none
+  * @param  keyword2: keyword ending the expression, NULL if none
+  * @param  result: output of value
+  * @retval 0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_EvalUntil(const char *start, const char *keyword1, const char *keyword2, int16_t *result);
+
+
 /**
   * @brief  Push into the Stack
   * @note   Stack operation
@@ -173,795 +644,3990 @@ static int16_t MMScript_PushStack(uint16_t val);
 static int16_t MMScript_PopStack(uint16_t *val);
 
 
-/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Get the retry policy of a failed bus command
+  * @param  ret: response code of the failed attempt
+  * @retval policy of the transaction run by the calling executor, of the selected context otherwise
+  */
+static const MMSCRIPT_RETRY_POLICY *MMScript_RetryPolicy(uint8_t ret);
 
-static int16_t MMScript_ProcessLine(uint16_t *lineNum, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
-{
-    const char *scriptLine = _lineEntries[*lineNum].startOfLine;
-    const char *p = scriptLine;
 
-    *nextLabel = -1;    /* Default to next line */
+/**
+  * @brief  Report a failed bus command & wait before the next attempt
+  * @note   Delay grows exponentially from initial_delay_ms up to max_delay_ms,
+  *         local_error_callback is invoked for the first failure & when giving up only.
+  * @param  node_id: node the command was sent to
+  * @param  ret: response code of the failed attempt
+  * @param  attempt: number of failed attempts so far, starting from 1
+  * @retval 1: retry the command
+  *         0: attempts exhausted, give up
+  */
+static uint8_t MMScript_RetryBackoff(uint8_t node_id, uint8_t ret, uint16_t attempt, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
 
-    if (scriptLine== NULL)
-        return MMS_PARSE_ERR_MALLOC;
 
-    if (strncmp(scriptLine, "CALL", 4) == 0)
-    {
-        //
-        // CALL
+/**
+  * @brief  Escalate a bus command whose attempts are exhausted
+  * @param  ret: response code of the last attempt
+  * @param  nextLabel: set to the error label of the policy if there is one
+  * @retval 0: jump to error label
+  *         MMS_ERR_RETRY_EXHAUSTED: no error label, abort execution
+  */
+static int16_t MMScript_RetryEscalate(uint8_t ret, int16_t *nextLabel);
 
-        int label;
 
-        if (sscanf(scriptLine + 4, "%d", &label) != 1)
-            return MMS_ERR_MISSING_CALL_PARAM;
+/**
+  * @brief  Take the API for a command to node & prepare its timing
+  * @param  node_addr: node the command is sent to
+  * @retval None
+  */
+static void MMScript_ApiAcquire(uint8_t node_addr);
 
-        if (!MMScript_PushStack(*lineNum))
-            return MMS_ERR_FULL_STACK;
 
-        *nextLabel = label;
-    }
-    else if (strncmp(scriptLine, "RET", 3) == 0)
-    {
-        //
-        // RET
+/**
+  * @brief  Give the API back after a command
+  * @param  ret: response code of the command
+  * @retval ret, so that it can wrap the command call in an expression
+  */
+static uint8_t MMScript_ApiRelease(uint8_t ret);
 
-        if (!MMScript_PopStack(lineNum))
-          return MMS_ERR_EMPTY_STACK;
-    }
-    else if (strncmp(scriptLine, "LET", 3) == 0)
-    {
-        //
-        // LET
 
-        int16_t ret;
-        int16_t result = 0;
+/**
+  * @brief  Parse commands of a line into a transaction
+  * @param  scriptLine: line to parse
+  * @param  transaction: output
+  * @retval =0: succeeded
+  *         <0: something error, see exec error codes for detailed info
+  */
+static int16_t MMScript_ParseCommands(const char *scriptLine, MMSCRIPT_TRANSACTION *transaction);
 
-        char varname;
 
-        p = strstr(scriptLine, "=");                             /*Find '=' and return the point to p*/
-        if (p == NULL)
-            return MMS_ERR_MISSING_LET_EQUAL;
+/**
+  * @brief  Run bus commands of a transaction, blocking
+  * @note   Called by MMScript_ProcessLine() without executor, by MMScript_RunTransaction() otherwise.
+  * @param  transaction: commands to run
+  * @param  nextLabel: set to error label of retry policy if attempts exhausted
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_RunOps(MMSCRIPT_TRANSACTION *transaction, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
 
-        p = scriptLine;
-        p += 3;
-        SKIP_SPACE(p);
 
-        if (*p < 'A' || *p > 'Z')
-            return MMS_ERR_MISSING_LET_VARNAME;
+/**
+  * @brief  Hand the transaction of current task to the executor & park the task
+  * @param  lineNum: line to execute again on completion
+  * @param  nextLabel: set to the label of lineNum
+  * @retval 0
+  */
+static int16_t MMScript_SubmitTransaction(uint16_t lineNum, int16_t *nextLabel);
 
-        varname = *p;
 
-        p++;
-        while (*p != '=')
-        {
-            if (*p != ' ')
-                return MMS_ERR_INVALID_LET_VARNAME;
+/**
+  * @brief  Unpark current task & take over the result of its transaction
+  * @param  nextLabel: set to error label of retry policy if attempts exhausted
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_ResumeTransaction(int16_t *nextLabel);
 
-            p++;
-        }
 
-        p++;
-        if ((*p < 'A' || *p > 'Z') && (*p < '0' || *p > '9') && *p != ' ')
-            return MMS_ERR_INVALID_LET_EQUAL;
+/**
+  * @brief  WAIT on status published by the telemetry poller
+  * @note   The bus is only used to restart a servo which lost control.
+  * @param  nodes: node list of WAIT
+  * @param  lineNum: line of WAIT
+  * @param  nextLabel: set to the line itself while waiting
+  * @param  yield: return to the scheduler instead of sleeping
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_WaitTelemetry(const char *nodes, uint16_t lineNum, int16_t *nextLabel, uint8_t yield, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
 
-        SKIP_SPACE(p);
 
-        ret = MMScript_Eval(p, &result);
+/**
+  * @brief  Control status of node from the telemetry table
+  * @param  node_id: node address
+  * @param  since_us: time the status must have been polled after, as WAIT does
+  * @param  status: output of control status
+  * @param  in_position: output of in position
+  * @retval 1: status read
+  *         0: telemetry disabled or status older than since_us, ask the node
+  */
+static uint8_t MMScript_TelemetryStatus(uint8_t node_id, uint64_t since_us, uint8_t *status, uint8_t *in_position);
 
-        if(ret < 0)
-            return ret;
 
-        vars[varname - 'A'] = result;
-    }
-    else if (strncmp(scriptLine, "IF", 2) == 0)
-    {
-        //
-        // IF
+/**
+  * @brief  Lookahead queue of node
+  * @param  node_id: node address
+  * @retval slot, NULL if node not in BLEND mode
+  */
+static BLEND_SLOT *MMScript_BlendSlot(uint8_t node_id);
 
-        int16_t ret;
 
-        int16_t left_val = 0;
-        int16_t right_val = 0;
-        const char *expr_start;
-        char *expr_end;
-        char orig_char;
-        char *op = NULL;
-        char *left_bracket, *right_bracket;
+/**
+  * @brief  Queue a move of a node in BLEND mode, wait while the queue is full
+  * @param  op: AP/PAP/RP/PRP
+  * @param  DelayMilliSecondsImpl: delay while full
+  * @retval 1: queued or stopped
+  *         0: node not in BLEND mode, send the move
+  *         <0 : something error
+  */
+static int16_t MMScript_BlendQueue(const TRANSACTION_OP *op, void (*DelayMilliSecondsImpl)(uint32_t ms));
 
-        int label;
 
-        left_bracket = strstr(scriptLine, "(");
-        right_bracket = strstr(scriptLine, ")");
+/**
+  * @brief  Send the next queued move of node if close enough to the current target, poller only
+  * @param  node_id: node address
+  * @param  status: status just polled
+  * @param  node_error_callback: node error callback
+  * @retval None
+  */
+static void MMScript_BlendStep(uint8_t node_id, const MMSCRIPT_NODE_STATUS *status, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback);
 
-        if (left_bracket == NULL || right_bracket == NULL)   /*Find '(' ')' and check*/
-            return MMS_ERR_MISSING_IF_BRACKETS;
 
-        if (strstr(left_bracket + 1, "(") != NULL || strstr(right_bracket + 1, ")") != NULL)
-            return MMS_ERR_INVALID_IF_BRACKETS;
+/**
+  * @brief  Check whether moves of node are still queued, or status predates the last one sent
+  * @param  node_id: node address
+  * @param  sampled_us: time status was polled
+  * @retval 1: busy
+  *         0: idle or not in BLEND mode
+  */
+static uint8_t MMScript_BlendBusy(uint8_t node_id, uint64_t sampled_us);
 
-        p = left_bracket + 1;
-        SKIP_SPACE(p);
 
-        expr_start = p;
+/**
+  * @brief  Send the setpoints of a trajectory file at its period
+  * @param  path: trajectory file, mapped when the line is reached
+  * @param  lineNum: index of the STREAM line
+  * @param  nextLabel: output of the line itself while frames are left
+  * @param  node_error_callback: node error callback
+  * @param  log_func: log function
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_RunStream(const char *path, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_LOG log_func);
 
-        /* Locate end of expression */
-        while (*p)
-        {
-            if (*p == '>' || *p == '<' || *p == '=' || *p == '!')
-            {
-                op = (char *)p;
-                orig_char = *op;
-                expr_end = (char *)p;
-                *expr_end = '\0';
 
-                break;
-            }
+/**
+  * @brief  Start sending the stream of the current task from its first frame
+  * @param  None
+  * @retval None
+  */
+static void MMScript_StartStream(void);
 
-            p++;
-        }
 
-        if (op == NULL)
-        {
-            return MMS_ERR_INVALID_IF_SYNTAX;
-        }
+/**
+  * @brief  Send the frames of the stream of the current task that are due, timed by the time base
+  * @note   With tasks forked, yields until the next frame is due instead of blocking. With an executor,
+  *         each frame is a transaction, the task parked until it was sent.
+  * @param  lineNum: index of the streaming line
+  * @param  nextLabel: output of the line itself while frames are left
+  * @param  node_error_callback: node error callback
+  * @param  log_func: log function
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_SendStream(uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_LOG log_func);
 
-        /* Eval */
-        ret = MMScript_Eval(expr_start, &right_val);
 
-        /* Recover */
-        *op = orig_char;
+/**
+  * @brief  Release the stream of a task, sent or not
+  * @param  task: task
+  * @retval None
+  */
+static void MMScript_EndStream(SCRIPT_TASK *task);
 
-        if (ret < 0)
-            return ret;
 
-        /* Parse right expr */
-        while (*p == '>' || *p == '<' || *p == '=' || *p == '!')
-            p++;
+/**
+  * @brief  Generate the setpoints of SCURVE or SPLINE from polled positions & send them
+  * @param  params: parameters after the keyword
+  * @param  spline: 1 for SPLINE, 0 for SCURVE
+  * @param  lineNum: index of the line
+  * @param  nextLabel: output of the line itself while frames are left
+  * @param  node_error_callback: node error callback
+  * @param  DelayMilliSecondsImpl: delay function
+  * @param  log_func: log function
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_RunPath(const char *params, uint8_t spline, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
 
-        expr_start = p;
-        expr_end = strstr(scriptLine, ")");
-        *expr_end = '\0';
 
-        ret = MMScript_Eval(expr_start, &left_val);
+/**
+  * @brief  Wait for positions of nodes polled by the telemetry poller after the call
+  * @param  nodes: nodes, watched if not yet
+  * @param  count: number of nodes
+  * @param  positions: output of positions
+  * @param  DelayMilliSecondsImpl: delay function
+  * @retval 0: positions read
+  *         1: stopped
+  *         MMS_ERR_NO_TELEMETRY: position not polled
+  */
+static int16_t MMScript_PolledPositions(const uint8_t *nodes, uint8_t count, int32_t *positions, void (*DelayMilliSecondsImpl)(uint32_t ms));
 
-        /* Recover */
-        *expr_end = ')';
 
-        if (ret < 0)
-            return ret;
+/**
+  * @brief  Engage or disengage a follower of GEAR/CAM
+  * @param  params: parameters after the keyword
+  * @param  cam: 1 for CAM, 0 for GEAR
+  * @param  DelayMilliSecondsImpl: delay function
+  * @param  log_func: log function
+  * @retval >=0: succeeded
+  *         <0 : something error
+  */
+static int16_t MMScript_RunGear(const char *params, uint8_t cam, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func);
 
-        p = strstr(scriptLine, "THEN");          /* THEN LABEL*/
 
-        if(p == NULL)
-            return MMS_ERR_INVALID_IF_SYNTAX;
+/**
+  * @brief  Follower offset from its origin
+  * @param  slot: follower
+  * @param  travel: leader position from its origin
+  * @retval offset
+  */
+static int64_t MMScript_GearOffset(const GEAR_SLOT *slot, int64_t travel);
 
-        p += 4;
 
-        if (sscanf(p, "%d", &label) != 1)
-            return MMS_ERR_MISSING_THEN_PARAM;    /**/
+/**
+  * @brief  Reset tasks to the main task only
+  * @param  ctx: context to reset
+  * @param  label: next label of main task
+  * @retval None
+  */
+static void MMScript_ResetTasks(MMSCRIPT_CONTEXT *ctx, int16_t label);
+
+
+/**
+  * @brief  Check whether a task has forked tasks still alive, or tasks forked by them
+  * @param  index: task index
+  * @retval 1: has children
+  *         0: no children
+  */
+static uint8_t MMScript_HasChildren(uint8_t index);
+
+
+/**
+  * @brief  Wait for the transactions of parked tasks, so that none is dropped when the script ends
+  * @param  None
+  * @retval 0 or error of the first transaction which failed
+  */
+static int16_t MMScript_DrainTransactions(void);
+
+
+/**
+  * @brief  Check whether the current task may yield instead of blocking
+  * @note   Requires other tasks alive & a time base to sleep until the first one is due.
+  * @param  None
+  * @retval 1: yield
+  *         0: block
+  */
+static uint8_t MMScript_CanYield();
+
+
+/**
+  * @brief  Select the next task to execute, sleep if all of them yielded
+  * @param  None
+  * @retval 1: task selected
+  *         0: stopped
+  */
+static int16_t MMScript_Schedule();
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static void MMScript_ApiAcquire(uint8_t node_addr)
+{
+    if (_api_acquire)
+        _api_acquire();
+
+    MMScript_RttBegin(node_addr);
+}
+
+
+static uint8_t MMScript_ApiRelease(uint8_t ret)
+{
+    if (_api_release)
+        _api_release();
+
+    return ret;
+}
+
+
+static MMSCRIPT_RETRY_CLASS MMScript_RetryClass(uint8_t ret)
+{
+    return (ret == MMS_RESP_SERVO_ERROR) ? MMSCRIPT_RETRY_CLASS_SERVO : MMSCRIPT_RETRY_CLASS_LINK;
+}
+
+
+static const MMSCRIPT_RETRY_POLICY *MMScript_RetryPolicy(uint8_t ret)
+{
+    return (_policies ? _policies : _ctx->retry_policies) + MMScript_RetryClass(ret);
+}
+
+
+static uint8_t MMScript_RetryBackoff(uint8_t node_id, uint8_t ret, uint16_t attempt, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    const MMSCRIPT_RETRY_POLICY *policy = MMScript_RetryPolicy(ret);
+    uint32_t delay;
+
+    if (policy->max_attempts != 0 && attempt >= policy->max_attempts)
+    {
+        if (local_error_callback)
+            local_error_callback(node_id, ret);
+
+        if (log_func)
+            log_func(node_id, "Retry attempts exhausted.");
+
+        return 0;
+    }
+
+    if (attempt == 1 && local_error_callback)
+        local_error_callback(node_id, ret);
+
+    delay = policy->initial_delay_ms;
+
+    /* Clamped before shifting, max_delay_ms may be over UINT32_MAX / 2 */
+    while (--attempt > 0 && delay < policy->max_delay_ms)
+        delay = (delay > policy->max_delay_ms / 2) ? policy->max_delay_ms : delay << 1;
+
+    if (delay > policy->max_delay_ms)
+        delay = policy->max_delay_ms;
+
+    if (delay > 0 && DelayMilliSecondsImpl)
+        DELAY_MS(delay);
+
+    return 1;
+}
+
+
+static int16_t MMScript_RetryEscalate(uint8_t ret, int16_t *nextLabel)
+{
+    const MMSCRIPT_RETRY_POLICY *policy = MMScript_RetryPolicy(ret);
+
+    if (policy->error_label <= 0)
+        return MMS_ERR_RETRY_EXHAUSTED;
+
+    *nextLabel = policy->error_label;
+    return 0;
+}
+
+
+static int16_t MMScript_ProcessLine(uint16_t *lineNum, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    const char *scriptLine = _ctx->lineEntries[*lineNum].startOfLine;
+    const char *p = scriptLine;
+    uint8_t length;
+
+    *nextLabel = -1;    /* Default to next line */
+
+    if (scriptLine== NULL)
+        return MMS_PARSE_ERR_MALLOC;
+
+    switch (MMScript_Keyword(scriptLine, &length))
+    {
+    case MMSCRIPT_KEYWORD_CALL:
+    {
+        //
+        // CALL
+
+        int label;
+
+        if (sscanf(scriptLine + length, "%d", &label) != 1)
+            return MMS_ERR_MISSING_CALL_PARAM;
+
+        if (!MMScript_PushStack(*lineNum))
+            return MMS_ERR_FULL_STACK;
+
+        *nextLabel = label;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_FORK:
+    {
+        //
+        // FORK
+
+        int label, i;
+        SCRIPT_TASK *task;
+
+        if (sscanf(scriptLine + length, "%d", &label) != 1 || label <= 0)
+            return MMS_ERR_MISSING_FORK_PARAM;
+
+        for (i=0; i<MAX_TASK_COUNT; i++)
+        {
+            if (!_ctx->tasks[i].alive)
+                break;
+        }
+
+        if (i == MAX_TASK_COUNT)
+            return MMS_ERR_FULL_TASKS;
+
+        task = &_ctx->tasks[i];
+        memset(task, 0, sizeof(SCRIPT_TASK));
+        task->alive = 1;
+        task->parent = (int8_t)_ctx->current;
+        task->stack_pointer = -1;
+        task->nextLabel = label;
+
+        _ctx->liveTasks++;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_JOIN:
+    {
+        //
+        // JOIN: wait for tasks forked by current task, the scheduler skips it meanwhile
+
+        SCRIPT_TASK *task = CURRENT_TASK;
+
+        task->joining = MMScript_HasChildren(_ctx->current);
+
+        if (task->joining)
+            *nextLabel = _ctx->lineEntries[*lineNum].label;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_RETRY:
+    {
+        //
+        // RETRY
+
+        MMSCRIPT_RETRY_POLICY policy;
+        MMSCRIPT_RETRY_CLASS retry_class;
+        unsigned int max_attempts, initial_delay, max_delay;
+        int label = 0;
+
+        p = scriptLine + length;
+        SKIP_SPACE(p);
+
+        if (strncmp(p, "LINK", 4) == 0)
+        {
+            retry_class = MMSCRIPT_RETRY_CLASS_LINK;
+            p += 4;
+        }
+        else if (strncmp(p, "SERVO", 5) == 0)
+        {
+            retry_class = MMSCRIPT_RETRY_CLASS_SERVO;
+            p += 5;
+        }
+        else
+            return MMS_ERR_MISSING_RETRY_PARAM;
+
+        if (sscanf(p, " ,%u,%u,%u,%d", &max_attempts, &initial_delay, &max_delay, &label) < 3)
+            return MMS_ERR_MISSING_RETRY_PARAM;
+
+        if (max_attempts > UINT16_MAX || initial_delay > max_delay || label < 0)
+            return MMS_ERR_MISSING_RETRY_PARAM;
+
+        policy.max_attempts = (uint16_t)max_attempts;
+        policy.initial_delay_ms = initial_delay;
+        policy.max_delay_ms = max_delay;
+        policy.error_label = (int16_t)label;
+
+        /* Until the script is rewound */
+        _ctx->retry_policies[retry_class] = policy;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_FOR:
+    {
+        //
+        // FOR
+
+        LINE_ENTRY *entry = &_ctx->lineEntries[*lineNum];
+        int16_t ret, start, end, step = 1;
+        const char *to = strstr(scriptLine, "TO");
+        const char *by = strstr(scriptLine, "STEP");
+
+        p = strchr(scriptLine, '=');
+
+        if (p == NULL || to == NULL || to < p)
+            return MMS_ERR_INVALID_FOR_PARAM;
+
+        if ((ret = MMScript_EvalUntil(p + 1, "TO", NULL, &start)) < 0 ||
+            (ret = MMScript_EvalUntil(to + 2, "STEP", NULL, &end)) < 0 ||
+            (by && (ret = MMScript_EvalUntil(by + 4, NULL, NULL, &step)) < 0))
+            return ret;
+
+        if (step == 0)
+            return MMS_ERR_INVALID_FOR_PARAM;
+
+        entry->loop_end = end;
+        entry->loop_step = step;
+        _ctx->vars[entry->loop_var] = start;
+
+        /* Already past the end, go on after NEXT */
+        if ((step > 0 && start > end) || (step < 0 && start < end))
+            *lineNum = (uint16_t)entry->loop_line;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_NEXT:
+    {
+        //
+        // NEXT
+
+        const LINE_ENTRY *loop = &_ctx->lineEntries[_ctx->lineEntries[*lineNum].loop_line];
+        int16_t *var = &_ctx->vars[loop->loop_var];
+        int32_t value = (int32_t)*var + loop->loop_step;
+
+        if ((loop->loop_step > 0 && value <= loop->loop_end) || (loop->loop_step < 0 && value >= loop->loop_end))
+        {
+            *var = (int16_t)value;
+            *lineNum = (uint16_t)_ctx->lineEntries[*lineNum].loop_line;     /* Line after FOR is next */
+        }
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_RET:
+    {
+        //
+        // RET
+
+        if (!MMScript_PopStack(lineNum))
+          return MMS_ERR_EMPTY_STACK;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_LET:
+    {
+        //
+        // LET
+
+        int16_t ret;
+        int16_t result = 0;
+
+        char varname;
+
+        p = strstr(scriptLine, "=");                             /*Find '=' and return the point to p*/
+        if (p == NULL)
+            return MMS_ERR_MISSING_LET_EQUAL;
+
+        p = scriptLine;
+        p += 3;
+        SKIP_SPACE(p);
+
+        if (*p < 'A' || *p > 'Z')
+            return MMS_ERR_MISSING_LET_VARNAME;
+
+        varname = *p;
+
+        p++;
+        while (*p != '=')
+        {
+            if (*p != ' ')
+                return MMS_ERR_INVALID_LET_VARNAME;
+
+            p++;
+        }
+
+        p++;
+        if ((*p < 'A' || *p > 'Z') && (*p < '0' || *p > '9') && *p != ' ' && *p != '-')
+            return MMS_ERR_INVALID_LET_EQUAL;
+
+        SKIP_SPACE(p);
+
+        ret = MMScript_Eval(p, &result);
+
+        if(ret < 0)
+            return ret;
+
+        _ctx->vars[varname - 'A'] = result;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_IF:
+    {
+        //
+        // IF
+
+        uint8_t taken;
+        int label;
+        int16_t ret = MMScript_EvalIf(scriptLine, &taken, &label);
+
+        if (ret < 0)
+            return ret;
+
+        if (taken)
+            *nextLabel = label;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_GOTO:
+    {
+        //
+        // PARAMETERS
+        int label;
+
+        if (sscanf(scriptLine + length, "%d", &label) != 1)
+            return MMS_ERR_MISSING_GOTO_PARAM;
+
+        *nextLabel = label;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_END:
+    {
+        *nextLabel = 0;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_DELAY:
+    {
+        //
+        // PARAMETERS
+        int delay;
+
+        if (sscanf(scriptLine + length, "%d", &delay) != 1)
+            return MMS_ERR_MISSING_DELAY_PARAM;
+
+        // Delay
+        if (MMScript_CanYield())
+            CURRENT_TASK->wake_us = _ctx->get_us() + (uint64_t)delay * 1000;
+        else if (_ctx->get_us && _ctx->delay_until_us)
+            _ctx->delay_until_us(_ctx->get_us() + (uint64_t)delay * 1000);
+        else
+            DELAY_MS(delay);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_UDELAY:
+    {
+        //
+        // PARAMETERS
+        unsigned long delay;
+
+        if (sscanf(scriptLine + length, "%lu", &delay) != 1)
+            return MMS_ERR_MISSING_UDELAY_PARAM;
+
+        if (MMScript_CanYield())
+            CURRENT_TASK->wake_us = _ctx->get_us() + delay;
+        else if (_ctx->get_us && _ctx->delay_until_us)
+            _ctx->delay_until_us(_ctx->get_us() + delay);
+        else
+            DELAY_MS((delay + 999) / 1000);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_PERIOD:
+    {
+        //
+        // PARAMETERS
+        int period, i;
+        uint64_t now, period_us;
+        SCRIPT_TASK *task = CURRENT_TASK;
+        PERIOD_SLOT *slot;
+
+        if (sscanf(scriptLine + length, "%d", &period) != 1 || period <= 0)
+            return MMS_ERR_MISSING_PERIOD_PARAM;
+
+        if (!_ctx->get_us || !_ctx->delay_until_us)
+        {
+            DELAY_MS(period);
+            return 0;
+        }
+
+        //
+        // Wait for the next multiple of period since the line was first reached,
+        // so that execution time of the loop body doesn't add to the period
+
+        for (i=0; i<MAX_TASK_PERIODS; i++)
+        {
+            if (task->periods[i].deadline_us != 0 && task->periods[i].line == *lineNum)
+                break;
+        }
+
+        if (i == MAX_TASK_PERIODS)
+        {
+            i = task->next_period;
+            task->next_period = (uint8_t)((i + 1) % MAX_TASK_PERIODS);
+            task->periods[i].line = *lineNum;
+            task->periods[i].deadline_us = 0;
+        }
+
+        slot = &task->periods[i];
+        now = _ctx->get_us();
+        period_us = (uint64_t)period * 1000;
+
+        if (slot->deadline_us == 0 || now >= slot->deadline_us + period_us)
+            slot->deadline_us = now + period_us;     /* First pass or overrun by a whole period, re-anchor */
+        else
+            slot->deadline_us += period_us;
+
+        if (MMScript_CanYield())
+            task->wake_us = slot->deadline_us;
+        else
+            _ctx->delay_until_us(slot->deadline_us);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_STREAM:
+    {
+        //
+        // PARAMETERS
+        char path[256];
+
+        if (MMScript_FilePath(scriptLine + length, path, sizeof(path)) != 0 || !_ctx->get_us || !_ctx->delay_until_us)
+            return MMS_ERR_MISSING_STREAM_PARAM;
+
+        return MMScript_RunStream(path, *lineNum, nextLabel, node_error_callback, log_func);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_SCURVE:
+    {
+        return MMScript_RunPath(scriptLine + length, 0, *lineNum, nextLabel, node_error_callback, DelayMilliSecondsImpl, log_func);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_SPLINE:
+    {
+        return MMScript_RunPath(scriptLine + length, 1, *lineNum, nextLabel, node_error_callback, DelayMilliSecondsImpl, log_func);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_TABLE:
+    {
+        /* Declared by MMScript_ParseScript() */
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_GEAR:
+    {
+        return MMScript_RunGear(scriptLine + length, 0, DelayMilliSecondsImpl, log_func);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_CAM:
+    {
+        return MMScript_RunGear(scriptLine + length, 1, DelayMilliSecondsImpl, log_func);
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_BLEND:
+    {
+        //
+        // PARAMETERS
+        int node_id, radius;
+        BLEND_SLOT *slot;
+
+        if (sscanf(scriptLine + length, "%x , %d", &node_id, &radius) != 2 || node_id <= 0 || node_id > 0xFF || radius < 0)
+            return MMS_ERR_MISSING_BLEND_PARAM;
+
+        if (!_ctx->telemetry || !_ctx->get_us)
+            return MMS_ERR_NO_TELEMETRY;
+
+        slot = MMScript_BlendSlot((uint8_t)node_id);
+
+        if (radius > 0)
+        {
+            for (uint8_t i=0; slot == NULL && i<MAX_BLEND_NODES; i++)
+            {
+                if (_ctx->blend[i].node != 0)
+                    continue;
+
+                slot = &_ctx->blend[i];
+                memset(slot, 0, sizeof(BLEND_SLOT));
+                ATOMIC_STORE(&slot->node, (uint8_t)node_id);   /* Seen by the poller once initialized */
+            }
+
+            if (slot == NULL)
+                return MMS_ERR_FULL_BLEND;
+
+            slot->radius = radius;
+            MMScript_TelemetryWatch(_ctx->bus, (uint8_t)node_id);
+        }
+        else if (slot)
+        {
+            /* Let the queue drain before moves are sent directly again */
+            while (ATOMIC_LOAD(&slot->head) != slot->tail)
+            {
+                if (ATOMIC_LOAD(&_ctx->stop))
+                    return 0;
+
+                if ((_ctx->submit && _ctx->get_us) || MMScript_CanYield())
+                {
+                    CURRENT_TASK->wake_us = _ctx->get_us() + TELEMETRY_CHECK_MS * 1000;
+                    *nextLabel = _ctx->lineEntries[*lineNum].label;
+                    return 0;
+                }
+
+                DELAY_MS(TELEMETRY_CHECK_MS);
+            }
+
+            ATOMIC_STORE(&slot->node, 0);
+        }
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_UNTIL:
+    {
+        //
+        // PARAMETERS
+        int node_id, value;
+        char quantity[4], op;
+        SCRIPT_TASK *task = CURRENT_TASK;
+        uint8_t yield = (_ctx->submit && _ctx->get_us) || MMScript_CanYield();
+
+        if (sscanf(scriptLine + length, "%x , %3[A-Z] %c %d", &node_id, quantity, &op, &value) != 4)
+            return MMS_ERR_MISSING_UNTIL_PARAM;
+
+        if ((strcmp(quantity, "POS") != 0 && strcmp(quantity, "VEL") != 0) || (op != '>' && op != '<'))
+            return MMS_ERR_MISSING_UNTIL_PARAM;
+
+        if (!_ctx->telemetry || !_ctx->get_us)
+            return MMS_ERR_NO_TELEMETRY;
+
+        if (!task->polling)
+        {
+            /* Status polled before the previous commands completed doesn't count */
+            task->polling = 1;
+            task->wait_since_us = _ctx->get_us();
+            MMScript_TelemetryWatch(_ctx->bus, (uint8_t)node_id);
+        }
+
+        for (;;)
+        {
+            MMSCRIPT_NODE_STATUS status;
+
+            if (MMScript_TelemetryRead(_ctx->bus, (uint8_t)node_id, &status) && status.sampled_us >= task->wait_since_us)
+            {
+                int32_t actual;
+
+                if (!status.has_position)
+                {
+                    task->polling = 0;
+                    return MMS_ERR_NO_TELEMETRY;
+                }
+
+                if (quantity[0] == 'P')
+                    actual = status.position;
+                else
+                    actual = (status.velocity < 0) ? -status.velocity : status.velocity;
+
+                if ((quantity[0] == 'P' || status.has_velocity) &&
+                    ((op == '>' && actual > value) || (op == '<' && actual < value)))
+                    break;
+            }
+
+            if (ATOMIC_LOAD(&_ctx->stop))
+                return 0;
+
+            if (yield)
+            {
+                task->wake_us = _ctx->get_us() + TELEMETRY_CHECK_MS * 1000;
+                *nextLabel = _ctx->lineEntries[*lineNum].label;
+                return 0;
+            }
+
+            DELAY_MS(TELEMETRY_CHECK_MS);
+        }
+
+        task->polling = 0;
+        break;
+    }
+
+    case MMSCRIPT_KEYWORD_WAIT:
+    {
+        SCRIPT_TASK *task = CURRENT_TASK;
+        uint8_t async = _ctx->submit && _ctx->get_us;
+        uint8_t yield = async || MMScript_CanYield();
+
+        if (_ctx->telemetry && _ctx->get_us)
+            return MMScript_WaitTelemetry(scriptLine + length, *lineNum, nextLabel, yield, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+
+        if (task->parked)
+        {
+            //
+            // Status polled by the executor
+
+            int16_t ret = MMScript_ResumeTransaction(nextLabel);
+
+            if (ret < 0 || *nextLabel != -1)
+            {
+                task->polling = 0;
+                return ret;
+            }
+
+            for (uint8_t i=0; i<task->transaction.opCount; i++)
+            {
+                const TRANSACTION_OP *op = &task->transaction.ops[i];
+
+                if (op->status != MMS_CTRL_STATUS_POSITION_CONTROL || op->in_position == 0)
+                {
+                    /* Poll the line again in 100ms */
+                    task->wake_us = _ctx->get_us() + 100000;
+                    *nextLabel = _ctx->lineEntries[*lineNum].label;
+                    return 0;
+                }
+            }
+
+            task->polling = 0;
+            return 0;
+        }
+
+        if (yield && !task->polling)
+        {
+            /* Let motion start before the first poll, other tasks run meanwhile */
+            task->polling = 1;
+            task->wake_us = _ctx->get_us() + 100000;
+            *nextLabel = _ctx->lineEntries[*lineNum].label;
+            return 0;
+        }
+
+        if (async)
+        {
+            MMSCRIPT_TRANSACTION *transaction = &task->transaction;
+
+            p = scriptLine + length;
+            transaction->opCount = 0;
+
+            while (p)
+            {
+                int node_id;
+
+                if (sscanf(p, "%x", &node_id) != 1)
+                    return MMS_ERR_MISSING_WAIT_PARAM;
+
+                if (transaction->opCount == MAX_TRANSACTION_OPS)
+                    return MMS_ERR_TOO_MANY_COMMANDS;
+
+                transaction->ops[transaction->opCount].type = OP_STATUS;
+                transaction->ops[transaction->opCount].node = (uint8_t)node_id;
+                transaction->opCount++;
+
+                p = strchr(p, ',');
+                if (p)
+                    p += 1; /* Skip ',' */
+            }
+
+            return MMScript_SubmitTransaction(*lineNum, nextLabel);
+        }
+
+        scriptLine += length;
+        p = scriptLine;   //strtok(line, ",");
+
+        while (p)
+        {
+            int node_id;
+            uint8_t status, in_position;
+
+            if (sscanf(p, "%x", &node_id) != 1)
+                return MMS_ERR_MISSING_WAIT_PARAM;
+
+            //
+            // Wait specified servo to finish command
+
+            status = MMS_CTRL_STATUS_NO_CONTROL;
+            in_position = 0;
+
+            while (status != MMS_CTRL_STATUS_POSITION_CONTROL || in_position == 0)
+            {
+                if (ATOMIC_LOAD(&_ctx->stop))
+                    return 0;
+
+                if (!yield)
+                    DELAY_MS(100);
+
+                FORCE_EXEC(_ctx->api->GetControlStatus((uint8_t)node_id, &status, &in_position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+
+                if (status == MMS_CTRL_STATUS_NO_CONTROL)
+                {
+                    if (log_func)
+                        log_func(node_id, "Restart servo.");
+
+                    RETRY_EXEC(_ctx->api->StartServo(node_id, MMS_MODE_KEEP, node_error_callback), node_id);
+                }
+
+                if (yield && (status != MMS_CTRL_STATUS_POSITION_CONTROL || in_position == 0))
+                {
+                    /* Poll the line again in 100ms */
+                    task->wake_us = _ctx->get_us() + 100000;
+                    *nextLabel = _ctx->lineEntries[*lineNum].label;
+                    return 0;
+                }
+            }
+
+            //p = strtok(NULL, ",");
+            p = strchr(p, ',');
+            if (p)
+            {
+                p += 1; /* Skip ',' */
+            }
+        }
+
+        task->polling = 0;
+        break;
+    }
+
+    default:
+    {
+        //
+        // COMMANDS, parsed into a transaction run here or by the executor
+
+        SCRIPT_TASK *task = CURRENT_TASK;
+        int16_t ret;
+
+        if (task->parked)
+            return MMScript_ResumeTransaction(nextLabel);
+
+        ret = MMScript_ParseCommands(scriptLine, &task->transaction);
+
+        if (ret < 0)
+            return ret;
+
+        if (_ctx->submit)
+            return MMScript_SubmitTransaction(*lineNum, nextLabel);
+
+        return MMScript_RunOps(&task->transaction, nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+    }
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_ParseCommands(const char *scriptLine, MMSCRIPT_TRANSACTION *transaction)
+{
+    const char *p = scriptLine;
+    uint8_t length;
+    int8_t command;
+
+    transaction->opCount = 0;
+
+    while (p != NULL)
+    {
+        int node_id;
+        char *token;
+        TRANSACTION_OP *op;
+
+        if (transaction->opCount == MAX_TRANSACTION_OPS)
+            return MMS_ERR_TOO_MANY_COMMANDS;
+
+        op = &transaction->ops[transaction->opCount];
+
+        //
+        // NODE_ID
+
+        token = strchr(p, ',');
+
+        if (!token)
+            return MMS_ERR_MISSING_NODE_ID;
+
+        if (sscanf(p, "%x", &node_id) != 1)
+            return MMS_ERR_MISSING_NODE_ID;
+
+        op->node = (uint8_t)node_id;
+
+        if (_ctx->telemetry)
+            MMScript_TelemetryWatch(_ctx->bus, op->node);
+
+        p = token + 1;
+        SKIP_SPACE(p);
+
+        //
+        // COMMAND_ID
+
+        command = MMScript_NodeCommand(p, &length);
+
+        if (command < 0)
+        {
+            // Unknown command
+            return MMS_ERR_UNKNOWN_COMMAND;
+        }
+
+        op->type = (uint8_t)command;
+
+        //
+        // PARAMETERS
+
+        if (op->type == OP_START)
+        {
+            int mode;
+
+            if (sscanf(p + length, "%d", &mode) != 1)
+                return MMS_ERR_ERROR_START_PARAM;
+
+            if (mode != MMS_MODE_KEEP && mode != MMS_MODE_ZERO && mode != MMS_MODE_RESET)
+                return MMS_ERR_ERROR_START_PARAM;
+
+            op->args[0] = mode;
+        }
+        else
+        {
+            uint8_t operands;
+            int16_t ret;
+
+            MMScript_NodeCommandName(command, &operands);
+
+            if (operands > 0 && (ret = MMScript_Operands(p + length, op->args, operands)) != 0)
+                return (ret == MMS_ERR_TABLE_INDEX) ? ret : _missing_param_errors[command];
+        }
+
+        transaction->opCount++;
+
+        // next COMMAND
+        p = strchr(p, ';');
+
+        if (p)
+            p++;    /* Skip ';' */
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_RunOps(MMSCRIPT_TRANSACTION *transaction, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    for (uint8_t i=0; i<transaction->opCount; i++)
+    {
+        TRANSACTION_OP *op = &transaction->ops[i];
+        uint8_t node_id = op->node;
+
+        if (op->type == OP_AP || op->type == OP_PAP || op->type == OP_RP || op->type == OP_PRP)
+        {
+            int16_t queued = MMScript_BlendQueue(op, DelayMilliSecondsImpl);
+
+            if (queued < 0)
+                return queued;
+
+            if (queued)
+                continue;
+        }
+
+        switch (op->type)
+        {
+        case OP_START:
+            FORCE_EXEC(_ctx->api->ResetError(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_EXEC(_ctx->api->StartServo(node_id, (uint8_t)op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_STOP:
+            FORCE_EXEC(_ctx->api->StopServo(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_HALT:
+            FORCE_EXEC(_ctx->api->HaltServo(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_VM:
+            FORCE_MOVE(_ctx->api->ProfiledVelocityMove(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_PVM:
+            FORCE_EXEC(_ctx->api->SetProfileAcceleration(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_MOVE(_ctx->api->ProfiledVelocityMove(node_id, op->args[1], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_AP:
+            FORCE_MOVE(_ctx->api->AbsolutePositionMove(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_PAP:
+            FORCE_EXEC(_ctx->api->SetProfileAcceleration(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_EXEC(_ctx->api->SetProfileVelocity(node_id, op->args[1], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_MOVE(_ctx->api->ProfiledAbsolutePositionMove(node_id, op->args[2], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_RP:
+            FORCE_MOVE(_ctx->api->RelativePositionMove(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_PRP:
+            FORCE_EXEC(_ctx->api->SetProfileAcceleration(node_id, op->args[0], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_EXEC(_ctx->api->SetProfileVelocity(node_id, op->args[1], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            FORCE_MOVE(_ctx->api->ProfiledRelativePositionMove(node_id, op->args[2], node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+            break;
+
+        case OP_STATUS:
+            op->status = MMS_CTRL_STATUS_NO_CONTROL;
+            op->in_position = 0;
+
+            FORCE_EXEC(_ctx->api->GetControlStatus(node_id, &op->status, &op->in_position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+
+            if (op->status == MMS_CTRL_STATUS_NO_CONTROL)
+            {
+                if (log_func)
+                    log_func(node_id, "Restart servo.");
+
+                RETRY_EXEC(_ctx->api->StartServo(node_id, MMS_MODE_KEEP, node_error_callback), node_id);
+            }
+            break;
+
+        case OP_SETPOINT:
+            op->status = TIMED_CALL(_ctx->api->AbsolutePositionMove(node_id, op->args[0], node_error_callback), node_id, 0);
+            break;
+
+        case OP_TELEMETRY:
+            MMScript_PollTelemetry(node_id, (uint8_t)op->args[0], node_error_callback);
+            break;
+
+        case OP_GEAR:
+            MMScript_PollGear(node_error_callback);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_SubmitTransaction(uint16_t lineNum, int16_t *nextLabel)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+    MMSCRIPT_TRANSACTION *transaction = &task->transaction;
+
+    transaction->ctx = _ctx;
+    transaction->result = 0;
+    transaction->nextLabel = -1;
+    transaction->done = 0;
+    memcpy(transaction->retry_policies, _ctx->retry_policies, sizeof(transaction->retry_policies));
+
+    task->parked = 1;
+    *nextLabel = _ctx->lineEntries[lineNum].label;   /* Execute the line again on completion */
+
+    _ctx->submit(transaction);
+    return 0;
+}
+
+
+static int16_t MMScript_ResumeTransaction(int16_t *nextLabel)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+    MMSCRIPT_TRANSACTION *transaction = &task->transaction;
+
+    task->parked = 0;
+
+    if (transaction->result < 0)
+        return transaction->result;
+
+    if (transaction->nextLabel != -1)
+        *nextLabel = transaction->nextLabel;    /* Error label of retry policy */
+
+    return 0;
+}
+
+
+static int16_t MMScript_WaitTelemetry(const char *nodes, uint16_t lineNum, int16_t *nextLabel, uint8_t yield, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+
+    if (task->parked)
+    {
+        //
+        // Servo restarted by the executor, wait for a status polled afterwards
+
+        int16_t ret = MMScript_ResumeTransaction(nextLabel);
+
+        if (ret < 0 || *nextLabel != -1)
+        {
+            task->polling = 0;
+            return ret;
+        }
+
+        task->wait_since_us = _ctx->get_us();
+    }
+    else if (!task->polling)
+    {
+        task->polling = 1;
+        task->wait_since_us = _ctx->get_us();
+    }
+
+    for (;;)
+    {
+        const char *p = nodes;
+        uint8_t pending = 0;
+
+        while (p)
+        {
+            int node_id;
+            MMSCRIPT_NODE_STATUS status;
+
+            if (sscanf(p, "%x", &node_id) != 1)
+                return MMS_ERR_MISSING_WAIT_PARAM;
+
+            MMScript_TelemetryWatch(_ctx->bus, (uint8_t)node_id);
+
+            if (!MMScript_TelemetryRead(_ctx->bus, (uint8_t)node_id, &status) ||
+                status.sampled_us < task->wait_since_us + WAIT_SETTLE_US ||
+                MMScript_BlendBusy((uint8_t)node_id, status.sampled_us))
+            {
+                pending = 1;
+            }
+            else if (status.status == MMS_CTRL_STATUS_NO_CONTROL)
+            {
+                if (_ctx->submit)
+                {
+                    /* Polled once more by the executor, restarted if still not under control */
+                    task->transaction.opCount = 1;
+                    task->transaction.ops[0].type = OP_STATUS;
+                    task->transaction.ops[0].node = (uint8_t)node_id;
+
+                    return MMScript_SubmitTransaction(lineNum, nextLabel);
+                }
+
+                if (log_func)
+                    log_func(node_id, "Restart servo.");
+
+                RETRY_EXEC(_ctx->api->StartServo((uint8_t)node_id, MMS_MODE_KEEP, node_error_callback), node_id);
+
+                task->wait_since_us = _ctx->get_us();
+                pending = 1;
+            }
+            else if (status.status != MMS_CTRL_STATUS_POSITION_CONTROL || status.in_position == 0)
+            {
+                pending = 1;
+            }
+
+            p = strchr(p, ',');
+            if (p)
+                p += 1; /* Skip ',' */
+        }
+
+        if (!pending)
+            break;
+
+        if (ATOMIC_LOAD(&_ctx->stop))
+            return 0;
+
+        if (yield)
+        {
+            task->wake_us = _ctx->get_us() + TELEMETRY_CHECK_MS * 1000;
+            *nextLabel = _ctx->lineEntries[lineNum].label;
+            return 0;
+        }
+
+        DELAY_MS(TELEMETRY_CHECK_MS);
+    }
+
+    task->polling = 0;
+    return 0;
+}
+
+
+static uint8_t MMScript_TelemetryStatus(uint8_t node_id, uint64_t since_us, uint8_t *status, uint8_t *in_position)
+{
+    MMSCRIPT_NODE_STATUS snapshot;
+
+    if (!_ctx->telemetry || !MMScript_TelemetryRead(_ctx->bus, node_id, &snapshot) || snapshot.sampled_us < since_us)
+        return 0;
+
+    *status = snapshot.status;
+    *in_position = snapshot.in_position;
+    return 1;
+}
+
+
+static BLEND_SLOT *MMScript_BlendSlot(uint8_t node_id)
+{
+    for (uint8_t i=0; i<MAX_BLEND_NODES; i++)
+    {
+        if (node_id != 0 && ATOMIC_LOAD(&_ctx->blend[i].node) == node_id)
+            return &_ctx->blend[i];
+    }
+
+    return NULL;
+}
+
+
+static int16_t MMScript_BlendQueue(const TRANSACTION_OP *op, void (*DelayMilliSecondsImpl)(uint32_t ms))
+{
+    BLEND_SLOT *slot = MMScript_BlendSlot(op->node);
+    BLEND_SEGMENT *segment;
+    int32_t base = 0;
+
+    if (slot == NULL)
+        return 0;
+
+    if (op->type == OP_RP || op->type == OP_PRP)
+    {
+        MMSCRIPT_NODE_STATUS status;
+
+        if (slot->has_last_target)
+            base = slot->last_target;
+        else if (MMScript_TelemetryRead(_ctx->bus, op->node, &status) && status.has_position)
+            base = status.position;
+        else
+            return MMS_ERR_NO_TELEMETRY;
+    }
+
+    while ((uint8_t)(slot->tail - ATOMIC_LOAD(&slot->head)) == MAX_BLEND_SEGMENTS)
+    {
+        if (ATOMIC_LOAD(&_ctx->stop))
+            return 1;
+
+        DELAY_MS(TELEMETRY_CHECK_MS);
+    }
+
+    segment = &slot->segments[slot->tail % MAX_BLEND_SEGMENTS];
+    segment->profiled = (op->type == OP_PAP || op->type == OP_PRP);
+
+    if (segment->profiled)
+    {
+        segment->acceleration = op->args[0];
+        segment->velocity = op->args[1];
+        segment->target = base + op->args[2];
+    }
+    else
+    {
+        segment->target = base + op->args[0];
+    }
+
+    slot->last_target = segment->target;
+    slot->has_last_target = 1;
+
+    ATOMIC_STORE(&slot->tail, (uint8_t)(slot->tail + 1));
+    return 1;
+}
+
+
+static void MMScript_BlendStep(uint8_t node_id, const MMSCRIPT_NODE_STATUS *status, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback)
+{
+    BLEND_SLOT *slot = MMScript_BlendSlot(node_id);
+    const BLEND_SEGMENT *segment;
+    int64_t distance;
+    uint8_t head;
+
+    if (slot == NULL || ATOMIC_LOAD(&_ctx->stop) || !status->has_position)
+        return;
+
+    head = slot->head;
+
+    if (head == ATOMIC_LOAD(&slot->tail))
+        return;
+
+    distance = (int64_t)status->position - slot->active_target;
+
+    if (slot->active && (distance > slot->radius || distance < -slot->radius))
+        return;
+
+    segment = &slot->segments[head % MAX_BLEND_SEGMENTS];
+
+    /* Sent again on next poll if any call fails */
+    if (segment->profiled)
+    {
+        if (TIMED_CALL(_ctx->api->SetProfileAcceleration(node_id, segment->acceleration, node_error_callback), node_id, 0) != MMS_RESP_SUCCESS ||
+            TIMED_CALL(_ctx->api->SetProfileVelocity(node_id, segment->velocity, node_error_callback), node_id, 0) != MMS_RESP_SUCCESS ||
+            TIMED_CALL(_ctx->api->ProfiledAbsolutePositionMove(node_id, segment->target, node_error_callback), node_id, 0) != MMS_RESP_SUCCESS)
+            return;
+    }
+    else if (TIMED_CALL(_ctx->api->AbsolutePositionMove(node_id, segment->target, node_error_callback), node_id, 0) != MMS_RESP_SUCCESS)
+    {
+        return;
+    }
+
+    slot->active = 1;
+    slot->active_target = segment->target;
+
+    ATOMIC_STORE64(&slot->sent_us, _ctx->get_us ? _ctx->get_us() : 0);
+    ATOMIC_STORE(&slot->head, (uint8_t)(head + 1));
+}
+
+
+static uint8_t MMScript_BlendBusy(uint8_t node_id, uint64_t sampled_us)
+{
+    BLEND_SLOT *slot = MMScript_BlendSlot(node_id);
+
+    if (slot == NULL)
+        return 0;
+
+    if (ATOMIC_LOAD(&slot->head) != slot->tail)
+        return 1;
+
+    return sampled_us < ATOMIC_LOAD64(&slot->sent_us) + WAIT_SETTLE_US;
+}
+
+
+static int16_t MMScript_RunStream(const char *path, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_LOG log_func)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+
+    if (!task->streaming)
+    {
+        memset(&_ctx->stream_stats, 0, sizeof(MMSCRIPT_STREAM_STATS));
+
+        if (MMScript_StreamOpen(path, &task->stream) != 0)
+            return MMS_ERR_STREAM_FILE;
+
+        MMScript_StartStream();
+    }
+
+    return MMScript_SendStream(lineNum, nextLabel, node_error_callback, log_func);
+}
+
+
+static void MMScript_StartStream(void)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+
+    task->streaming = 1;
+    task->frame = 0;
+    task->stream_start_us = _ctx->get_us();
+
+    memset(&task->stream_stats, 0, sizeof(MMSCRIPT_STREAM_STATS));
+    task->stream_stats.frames = task->stream.frame_count;
+}
+
+
+static int16_t MMScript_SendStream(uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_LOG log_func)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+    const MMSCRIPT_STREAM *stream = &task->stream;
+    MMSCRIPT_STREAM_STATS *stats = &task->stream_stats;
+
+    /* Frame sent by the executor, or dropped if it couldn't queue it */
+    if (task->parked)
+    {
+        task->parked = 0;
+
+        if (task->transaction.result < 0)
+        {
+            stats->underruns++;
+        }
+        else
+        {
+            for (uint8_t i=0; i<task->transaction.opCount; i++)
+            {
+                if (task->transaction.ops[i].status != MMS_RESP_SUCCESS)
+                    stats->errors++;
+            }
+
+            stats->sent++;
+        }
+
+        task->frame++;
+    }
+
+    for (; task->frame<stream->frame_count && !ATOMIC_LOAD(&_ctx->stop); task->frame++)
+    {
+        uint32_t frame = task->frame;
+        uint64_t deadline_us = task->stream_start_us + (uint64_t)frame * stream->period_us;
+        uint64_t now = _ctx->get_us();
+        uint64_t late_us;
+
+        if (now < deadline_us)
+        {
+            /* Line executed again when the frame is due, the other tasks go on meanwhile */
+            if (MMScript_CanYield())
+            {
+                _ctx->stream_stats = *stats;
+                task->wake_us = deadline_us;
+                *nextLabel = _ctx->lineEntries[lineNum].label;
+                return 0;
+            }
+
+            _ctx->delay_until_us(deadline_us);
+            now = _ctx->get_us();
+        }
+        else if (frame + 1 < stream->frame_count && now >= deadline_us + stream->period_us)
+        {
+            /* Bus can't keep up, the last frame is always sent */
+            stats->underruns++;
+            continue;
+        }
+
+        late_us = (now > deadline_us) ? now - deadline_us : 0;
+
+        if (late_us > stats->max_late_us)
+            stats->max_late_us = (uint32_t)late_us;
+
+        if (late_us > stream->period_us / 10)
+            stats->late++;
+
+        /* Ordered with the commands of the other tasks, line executed again once sent */
+        if (_ctx->submit && stream->node_count <= MAX_TRANSACTION_OPS)
+        {
+            task->transaction.opCount = (uint8_t)stream->node_count;
+
+            for (uint16_t i=0; i<stream->node_count; i++)
+            {
+                task->transaction.ops[i].type = OP_SETPOINT;
+                task->transaction.ops[i].node = stream->nodes[i];
+                task->transaction.ops[i].args[0] = MMScript_StreamSetpoint(stream, frame, i);
+            }
+
+            _ctx->stream_stats = *stats;
+            return MMScript_SubmitTransaction(lineNum, nextLabel);
+        }
+
+        for (uint16_t i=0; i<stream->node_count; i++)
+        {
+            uint8_t node_id = stream->nodes[i];
+
+            /* Not retried, the next setpoint supersedes it */
+            if (TIMED_CALL(_ctx->api->AbsolutePositionMove(node_id, MMScript_StreamSetpoint(stream, frame, i), node_error_callback), node_id, 0) != MMS_RESP_SUCCESS)
+                stats->errors++;
+        }
+
+        stats->sent++;
+    }
+
+    if (log_func)
+    {
+        char msg[128];
+
+        snprintf(msg, sizeof(msg), "Stream: %u/%u frames sent, %u late, %u underruns, %u errors, max late %uus",
+                 (unsigned)stats->sent, (unsigned)stats->frames, (unsigned)stats->late,
+                 (unsigned)stats->underruns, (unsigned)stats->errors, (unsigned)stats->max_late_us);
+        log_func(0, msg);
+    }
+
+    _ctx->stream_stats = *stats;
+    MMScript_EndStream(task);
+
+    return 0;
+}
+
+
+static void MMScript_EndStream(SCRIPT_TASK *task)
+{
+    if (task->streaming)
+        MMScript_StreamClose(&task->stream);
+
+    SAFE_FREE(task->trajectory);
+    task->streaming = 0;
+}
+
+
+static int16_t MMScript_RunPath(const char *params, uint8_t spline, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    uint8_t nodes[MMSCRIPT_GEN_MAX_AXES];
+    int32_t points[MMSCRIPT_GEN_MAX_AXES * MMSCRIPT_GEN_MAX_POINTS];   /* Start position first */
+    int32_t start[MMSCRIPT_GEN_MAX_AXES];
+    uint8_t axes = 0, count = 0;
+    double limits[3] = { 0 };
+    unsigned int segment_ms = 0, period_us = 0;
+    SCRIPT_TASK *task = CURRENT_TASK;
+    uint8_t *trajectory;
+    size_t size;
+    int16_t ret;
+    int n = 0;
+
+    /* Generated when the line was reached, frames left */
+    if (task->streaming)
+        return MMScript_SendStream(lineNum, nextLabel, node_error_callback, log_func);
+
+    memset(&_ctx->stream_stats, 0, sizeof(MMSCRIPT_STREAM_STATS));
+
+    //
+    // PARAMETERS
+    if (spline)
+    {
+        if (sscanf(params, " %u , %u ;%n", &segment_ms, &period_us, &n) != 2 || n == 0 || segment_ms == 0)
+            return MMS_ERR_MISSING_PATH_PARAM;
+    }
+    else if (sscanf(params, " %lf , %lf , %lf , %u ;%n", &limits[0], &limits[1], &limits[2], &period_us, &n) != 4 || n == 0 ||
+             !(limits[0] > 0) || !(limits[1] > 0) || !(limits[2] > 0))
+    {
+        return MMS_ERR_MISSING_PATH_PARAM;
+    }
+
+    if (period_us == 0 || !_ctx->get_us || !_ctx->delay_until_us)
+        return MMS_ERR_MISSING_PATH_PARAM;
+
+    params += n;
+
+    for (;;)
+    {
+        int node_id, value;
+        uint8_t values = 0;
+
+        if (axes == MMSCRIPT_GEN_MAX_AXES || sscanf(params, " %x ,%n", &node_id, &n) != 1 || n == 0 || node_id <= 0 || node_id > 0xFF)
+            return MMS_ERR_MISSING_PATH_PARAM;
+
+        params += n;
+
+        while (sscanf(params, " %d%n", &value, &n) == 1)
+        {
+            if (values + 1 == ((spline) ? MMSCRIPT_GEN_MAX_POINTS : 2))
+                return MMS_ERR_MISSING_PATH_PARAM;
+
+            points[axes * MMSCRIPT_GEN_MAX_POINTS + 1 + values++] = value;
+            params += n;
+            SKIP_SPACE(params);
+
+            if (*params != ',')
+                break;
+
+            params++;
+        }
+
+        /* Same number of waypoints for all nodes */
+        if (values == 0 || (axes > 0 && values != count - 1))
+            return MMS_ERR_MISSING_PATH_PARAM;
+
+        nodes[axes++] = (uint8_t)node_id;
+        count = values + 1;
+        SKIP_SPACE(params);
+
+        if (*params == '\0')
+            break;
+
+        if (*params != ';')
+            return MMS_ERR_MISSING_PATH_PARAM;
+
+        params++;
+    }
+
+    if (!_ctx->telemetry)
+        return MMS_ERR_NO_TELEMETRY;
+
+    //
+    // START POSITIONS
+    ret = MMScript_PolledPositions(nodes, axes, start, DelayMilliSecondsImpl);
+
+    if (ret != 0)
+        return (ret > 0) ? 0 : ret;
+
+    for (uint8_t axis=0; axis<axes; axis++)
+        points[axis * MMSCRIPT_GEN_MAX_POINTS] = start[axis];
+
+    //
+    // SETPOINTS
+    if (spline)
+    {
+        /* Knots packed axis by axis */
+        for (uint8_t axis=1; axis<axes; axis++)
+            memmove(points + axis * count, points + axis * MMSCRIPT_GEN_MAX_POINTS, count * sizeof(int32_t));
+
+        trajectory = MMScript_GenerateSpline(nodes, points, axes, count, segment_ms * 1000, period_us, &size);
+    }
+    else
+    {
+        int32_t target[MMSCRIPT_GEN_MAX_AXES];
+
+        for (uint8_t axis=0; axis<axes; axis++)
+            target[axis] = points[axis * MMSCRIPT_GEN_MAX_POINTS + 1];
+
+        trajectory = MMScript_GenerateSCurve(nodes, start, target, axes, limits[0], limits[1], limits[2], period_us, &size);
+    }
+
+    if (trajectory == NULL)
+        return MMS_ERR_PATH_TOO_LONG;
+
+    if (MMScript_StreamAttach(trajectory, size, &task->stream) != 0)
+    {
+        free(trajectory);
+        return MMS_ERR_STREAM_FILE;
+    }
+
+    task->trajectory = trajectory;
+    MMScript_StartStream();
+
+    return MMScript_SendStream(lineNum, nextLabel, node_error_callback, log_func);
+}
+
+
+static int16_t MMScript_PolledPositions(const uint8_t *nodes, uint8_t count, int32_t *positions, void (*DelayMilliSecondsImpl)(uint32_t ms))
+{
+    /* Polled after the line was reached, so that moves of the previous lines are accounted for */
+    uint64_t since_us = _ctx->get_us();
+
+    for (uint8_t i=0; i<count; i++)
+        MMScript_TelemetryWatch(_ctx->bus, nodes[i]);
+
+    for (uint8_t i=0; i<count; i++)
+    {
+        MMSCRIPT_NODE_STATUS status;
+
+        while (!MMScript_TelemetryRead(_ctx->bus, nodes[i], &status) || status.sampled_us < since_us)
+        {
+            if (ATOMIC_LOAD(&_ctx->stop))
+                return 1;
+
+            DELAY_MS(TELEMETRY_CHECK_MS);
+        }
+
+        if (!status.has_position)
+            return MMS_ERR_NO_TELEMETRY;
+
+        positions[i] = status.position;
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_RunGear(const char *params, uint8_t cam, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    GEAR_SLOT setup, *slot = NULL;
+    int follower_id, leader_id, value, n = 0;
+    uint8_t nodes[2];
+    int32_t positions[2];
+    int16_t ret;
+
+    //
+    // PARAMETERS
+    if (sscanf(params, " %x , %x%n", &follower_id, &leader_id, &n) != 2 || n == 0 ||
+        follower_id <= 0 || follower_id > 0xFF || leader_id < 0 || leader_id > 0xFF || leader_id == follower_id)
+        return MMS_ERR_MISSING_GEAR_PARAM;
+
+    params += n;
+
+    for (uint8_t i=0; i<MAX_GEAR_FOLLOWERS; i++)
+    {
+        if (ATOMIC_LOAD(&_ctx->gear[i].follower) == follower_id)
+            slot = &_ctx->gear[i];
+    }
+
+    if (leader_id == 0)
+    {
+        if (cam || *params != '\0')
+            return MMS_ERR_MISSING_GEAR_PARAM;
+
+        if (slot)
+            ATOMIC_STORE(&slot->follower, 0);
+
+        if (log_func)
+        {
+            MMSCRIPT_GEAR_STATS *stats = &_ctx->gear_stats;
+            char msg[128];
+
+            snprintf(msg, sizeof(msg), "Gear: %u updates, %u errors, latency avg %uus max %uus, max interval %uus",
+                     (unsigned)stats->updates, (unsigned)stats->errors,
+                     (unsigned)(stats->updates ? stats->total_latency_us / stats->updates : 0),
+                     (unsigned)stats->max_latency_us, (unsigned)stats->max_interval_us);
+            log_func((uint8_t)follower_id, msg);
+        }
+
+        return 0;
+    }
+
+    memset(&setup, 0, sizeof(GEAR_SLOT));
+    setup.leader = (uint8_t)leader_id;
+
+    if (cam)
+    {
+        if (sscanf(params, " , %d%n", &value, &n) != 1 || value <= 0)
+            return MMS_ERR_MISSING_GEAR_PARAM;
+
+        setup.cycle = value;
+        params += n;
+
+        while (sscanf(params, " , %d%n", &value, &n) == 1)
+        {
+            if (setup.cam_points == MAX_CAM_POINTS)
+                return MMS_ERR_MISSING_GEAR_PARAM;
+
+            setup.cam[setup.cam_points++] = value;
+            params += n;
+        }
+
+        /* At least one count of the leader between two offsets */
+        if (setup.cam_points == 0 || setup.cycle < setup.cam_points)
+            return MMS_ERR_MISSING_GEAR_PARAM;
+    }
+    else
+    {
+        int numerator, denominator;
+
+        if (sscanf(params, " , %d , %d%n", &numerator, &denominator, &n) != 2 || denominator == 0)
+            return MMS_ERR_MISSING_GEAR_PARAM;
+
+        setup.numerator = numerator;
+        setup.denominator = denominator;
+        params += n;
+    }
+
+    SKIP_SPACE(params);
+
+    if (*params != '\0')
+        return MMS_ERR_MISSING_GEAR_PARAM;
+
+    if (!_ctx->telemetry || !_ctx->get_us)
+        return MMS_ERR_NO_TELEMETRY;
+
+    for (uint8_t i=0; slot == NULL && i<MAX_GEAR_FOLLOWERS; i++)
+    {
+        if (_ctx->gear[i].follower == 0)
+            slot = &_ctx->gear[i];
+    }
+
+    if (slot == NULL)
+        return MMS_ERR_FULL_GEAR;
+
+    /* Engaged again from the current positions */
+    ATOMIC_STORE(&slot->follower, 0);
+
+    nodes[0] = (uint8_t)leader_id;
+    nodes[1] = (uint8_t)follower_id;
+    ret = MMScript_PolledPositions(nodes, 2, positions, DelayMilliSecondsImpl);
+
+    if (ret != 0)
+        return (ret > 0) ? 0 : ret;
+
+    setup.leader_origin = positions[0];
+    setup.follower_origin = positions[1];
+    *slot = setup;
+    ATOMIC_STORE(&slot->follower, (uint8_t)follower_id);    /* Seen by the poller once initialized */
+
+    return 0;
+}
+
+
+static int64_t MMScript_GearOffset(const GEAR_SLOT *slot, int64_t travel)
+{
+    int64_t phase, x0, x1, y0, y1;
+    uint8_t index;
+
+    if (slot->cycle == 0)
+        return travel * slot->numerator / slot->denominator;
+
+    phase = travel % slot->cycle;
+
+    if (phase < 0)
+        phase += slot->cycle;
+
+    index = (uint8_t)(phase * slot->cam_points / slot->cycle);
+    x0 = (int64_t)index * slot->cycle / slot->cam_points;
+    x1 = (int64_t)(index + 1) * slot->cycle / slot->cam_points;
+    y0 = slot->cam[index];
+    y1 = slot->cam[(index + 1) % slot->cam_points];
+
+    return y0 + (y1 - y0) * (phase - x0) / (x1 - x0);
+}
+
+
+static int16_t MMScript_Eval(const char *expr, int16_t *result)
+{
+    int number = 0;
+    int n = 0;
+    int32_t item;
+    int16_t ret;
+
+    SKIP_SPACE(expr);
+
+    if (IS_NUMBER(expr))
+    {
+        sscanf(expr,"%d%n", &number, &n);
+
+        if (number > INT16_MAX || number < INT16_MIN)
+            return MMS_ERR_INVALID_EXPR_ITEM;
+
+        *result = (int16_t)number;
+        expr += n;
+    }
+    else if (*expr <= 'Z' && *expr >= 'A')
+    {
+        if ((ret = MMScript_EvalVar(&expr, &item)) != 0)
+            return ret;
+
+        *result = (int16_t)item;
+    }
+    else
+        return MMS_ERR_INVALID_EXPR_ITEM;
+
+    SKIP_SPACE(expr);
+
+    while (*expr)
+    {
+        if (*expr == '+')
+        {
+            expr++;
+            SKIP_SPACE(expr);
+            if (IS_NUMBER(expr))
+            {
+                sscanf(expr,"%d%n", &number, &n);
+                *result += number;
+                expr += n;
+            }
+            else if (*expr <= 'Z' && *expr >= 'A')
+            {
+                if ((ret = MMScript_EvalVar(&expr, &item)) != 0)
+                    return ret;
+
+                *result += (int16_t)item;
+            }
+            else
+                return MMS_ERR_INVALID_EXPR_ITEM;
+        }
+        else if (*expr == '-')
+        {
+            expr++;
+            SKIP_SPACE(expr);
+            if (IS_NUMBER(expr))
+            {
+                sscanf(expr,"%d%n", &number, &n);
+                *result -= number;
+                expr += n;
+            }
+            else if (*expr <= 'Z' && *expr >= 'A')
+            {
+                if ((ret = MMScript_EvalVar(&expr, &item)) != 0)
+                    return ret;
+
+                *result -= (int16_t)item;
+            }
+            else
+                return MMS_ERR_INVALID_EXPR_ITEM;
+        }
+        else if (*expr == '*')
+        {
+            expr++;
+            SKIP_SPACE(expr);
+            if (IS_NUMBER(expr))
+            {
+                sscanf(expr,"%d%n", &number, &n);
+                *result *= number;
+                expr += n;
+            }
+            else if (*expr <= 'Z' && *expr >= 'A')
+            {
+                if ((ret = MMScript_EvalVar(&expr, &item)) != 0)
+                    return ret;
+
+                *result *= (int16_t)item;
+            }
+            else
+                return MMS_ERR_INVALID_EXPR_ITEM;
+        }
+        else if (*expr == '/')
+        {
+            expr++;
+            SKIP_SPACE(expr);
+            if (IS_NUMBER(expr))
+            {
+                sscanf(expr,"%d%n", &number, &n);
+                if (number == 0)
+                    return MMS_ERR_DIVISION_BY_ZERO;
+
+                *result /= number;
+                expr += n;
+            }
+            else if (*expr <= 'Z' && *expr >= 'A')
+            {
+                if ((ret = MMScript_EvalVar(&expr, &item)) != 0)
+                    return ret;
+
+                if ((int16_t)item == 0)
+                    return MMS_ERR_DIVISION_BY_ZERO;
+
+                *result /= (int16_t)item;
+            }
+            else
+                return MMS_ERR_INVALID_EXPR_ITEM;
+        }
+        else if (*expr >= 'A' && *expr <= 'Z')
+            return MMS_ERR_INVALID_EXPR_ITEM;
+        else if (*expr == ' ')
+            SKIP_SPACE(expr);
+        else
+            return MMS_ERR_INVALID_EXPR_OPERATOR;
+
+        SKIP_SPACE(expr);
+    }
+    return 0;
+}
+
+
+static int16_t MMScript_EvalVar(const char **expr, int32_t *value)
+{
+    const char *p = *expr;
+    const SCRIPT_TABLE *table = &_ctx->tables[*p - 'A'];
+    int32_t index;
+    int n = 0;
+
+    p++;
+
+    if (*p != '[')
+    {
+        *value = _ctx->vars[**expr - 'A'];
+        *expr = p;
+        return 0;
+    }
+
+    p++;
+    SKIP_SPACE(p);
+
+    if (*p <= 'Z' && *p >= 'A')
+    {
+        index = _ctx->vars[*p - 'A'];
+        p++;
+    }
+    else if (sscanf(p, "%d%n", &index, &n) == 1)
+        p += n;
+    else
+        return MMS_ERR_INVALID_EXPR_ITEM;
+
+    SKIP_SPACE(p);
+
+    if (*p != ']')
+        return MMS_ERR_INVALID_EXPR_ITEM;
+
+    if (table->size == 0 || index < 0 || index >= table->length)
+        return MMS_ERR_TABLE_INDEX;
+
+    if (table->size == 1)
+        *value = ((const int8_t*)table->data)[index];
+    else if (table->size == 2)
+        *value = ((const int16_t*)table->data)[index];
+    else
+        *value = ((const int32_t*)table->data)[index];
+
+    *expr = p + 1;
+    return 0;
+}
+
+
+static int16_t MMScript_Operands(const char *p, int32_t *values, uint8_t count)
+{
+    for (uint8_t i=0; i<count; i++)
+    {
+        int16_t ret;
+        long number;
+        char *end;
+
+        SKIP_SPACE(p);
+
+        if (i > 0)
+        {
+            if (*p != ',')
+                return MMS_ERR_INVALID_EXPR_ITEM;
+
+            p++;
+            SKIP_SPACE(p);
+        }
+
+        if (*p <= 'Z' && *p >= 'A')
+        {
+            if ((ret = MMScript_EvalVar(&p, &values[i])) != 0)
+                return ret;
+
+            continue;
+        }
+
+        number = strtol(p, &end, 10);
+
+        if (end == p)
+            return MMS_ERR_INVALID_EXPR_ITEM;
+
+        values[i] = (int32_t)number;
+        p = end;
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_ParseTable(const char *params)
+{
+    SCRIPT_TABLE *table;
+    char name, type[4];
+    uint8_t size;
+    uint32_t count;
+    uint8_t *data;
+    int n = 0;
+
+    if (sscanf(params, " %c , %3[I0-9] ,%n", &name, type, &n) != 2 || n == 0 || name < 'A' || name > 'Z')
+        return MMS_PARSE_ERR_TABLE;
+
+    if (strcmp(type, "I8") == 0)
+        size = 1;
+    else if (strcmp(type, "I16") == 0)
+        size = 2;
+    else if (strcmp(type, "I32") == 0)
+        size = 4;
+    else
+        return MMS_PARSE_ERR_TABLE;
+
+    table = &_ctx->tables[name - 'A'];
+
+    /* Appended to with the same type only */
+    if (table->size != 0 && table->size != size)
+        return MMS_PARSE_ERR_TABLE;
+
+    params += n;
+    SKIP_SPACE(params);
+
+    if (strncmp(params, "FILE", 4) == 0)
+    {
+        char path[256];
+        FILE *file;
+        long file_size;
+        uint8_t raw[4];
+
+        if (MMScript_FilePath(params + 4, path, sizeof(path)) != 0 || (file = fopen(path, "rb")) == NULL)
+            return MMS_PARSE_ERR_TABLE;
+
+        if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) <= 0 || file_size % size != 0 ||
+            table->length + (uint32_t)(file_size / size) > MAX_TABLE_LENGTH || fseek(file, 0, SEEK_SET) != 0)
+        {
+            fclose(file);
+            return MMS_PARSE_ERR_TABLE;
+        }
+
+        count = (uint32_t)(file_size / size);
+        data = (uint8_t*)realloc(table->data, (size_t)(table->length + count) * size);
+
+        if (data == NULL)
+        {
+            fclose(file);
+            return MMS_PARSE_ERR_TABLE;
+        }
+
+        table->data = data;
+        table->size = size;
+
+        for (uint32_t i=0; i<count; i++)
+        {
+            uint32_t value;
+
+            if (fread(raw, 1, size, file) != size)
+            {
+                fclose(file);
+                return MMS_PARSE_ERR_TABLE;
+            }
+
+            value = (uint32_t)raw[0] | ((size > 1) ? ((uint32_t)raw[1] << 8) : 0) |
+                    ((size > 2) ? ((uint32_t)raw[2] << 16 | (uint32_t)raw[3] << 24) : 0);
+
+            if (size == 1)
+                ((int8_t*)data)[table->length++] = (int8_t)value;
+            else if (size == 2)
+                ((int16_t*)data)[table->length++] = (int16_t)value;
+            else
+                ((int32_t*)data)[table->length++] = (int32_t)value;
+        }
+
+        fclose(file);
+        return 0;
+    }
+
+    count = 1;
+
+    for (const char *p = params; *p; p++)
+    {
+        if (*p == ',')
+            count++;
+    }
+
+    if (table->length + count > MAX_TABLE_LENGTH)
+        return MMS_PARSE_ERR_TABLE;
+
+    data = (uint8_t*)realloc(table->data, (size_t)(table->length + count) * size);
+
+    if (data == NULL)
+        return MMS_PARSE_ERR_TABLE;
+
+    table->data = data;
+    table->size = size;
+
+    for (uint32_t i=0; i<count; i++)
+    {
+        long long value;        /* long is 32 bit on Windows, out of range I32 would saturate */
+        char *end;
+
+        SKIP_SPACE(params);
+
+        if (i > 0)
+        {
+            if (*params != ',')
+                return MMS_PARSE_ERR_TABLE;
+
+            params++;
+        }
+
+        value = strtoll(params, &end, 10);
+
+        if (end == params)
+            return MMS_PARSE_ERR_TABLE;
+
+        params = end;
+
+        if (size == 1 && value >= INT8_MIN && value <= INT8_MAX)
+            ((int8_t*)data)[table->length++] = (int8_t)value;
+        else if (size == 2 && value >= INT16_MIN && value <= INT16_MAX)
+            ((int16_t*)data)[table->length++] = (int16_t)value;
+        else if (size == 4 && value >= INT32_MIN && value <= INT32_MAX)
+            ((int32_t*)data)[table->length++] = (int32_t)value;
+        else
+            return MMS_PARSE_ERR_TABLE;
+    }
+
+    SKIP_SPACE(params);
+
+    return (*params == '\0') ? 0 : MMS_PARSE_ERR_TABLE;
+}
+
+
+static int16_t MMScript_CheckTableReads(void)
+{
+    uint8_t wide[26] = { 0 };
+
+    for (int i=0; i<26; i++)
+    {
+        const SCRIPT_TABLE *table = &_ctx->tables[i];
+
+        for (uint16_t j=0; table->size == 4 && j<table->length && !wide[i]; j++)
+        {
+            int32_t value = ((const int32_t*)table->data)[j];
+
+            wide[i] = (value < INT16_MIN || value > INT16_MAX);
+        }
+    }
+
+    /* Commands take 32 bit operands, only expressions are evaluated to int16_t */
+    for (int i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        int8_t keyword;
+        uint8_t length;
+
+        if (line == NULL)
+            continue;
+
+        keyword = MMScript_Keyword(line, &length);
+
+        if (keyword != MMSCRIPT_KEYWORD_LET && keyword != MMSCRIPT_KEYWORD_IF && keyword != MMSCRIPT_KEYWORD_FOR)
+            continue;
+
+        for (const char *p = line + length; *p; p++)
+        {
+            if (p[0] >= 'A' && p[0] <= 'Z' && p[1] == '[' && wide[p[0] - 'A'])
+                return MMS_PARSE_ERR_TABLE;
+        }
+    }
+
+    return 0;
+}
+
+
+static void MMScript_FreeTables(MMSCRIPT_CONTEXT *ctx)
+{
+    for (int i=0; i<26; i++)
+        SAFE_FREE(ctx->tables[i].data);
+
+    memset(ctx->tables, 0, sizeof(ctx->tables));
+}
+
+
+static int16_t MMScript_ExecNative(MMSCRIPT_NATIVE_LINE line, uint16_t lineNum, int16_t *nextLabel, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, void (*DelayMilliSecondsImpl)(uint32_t ms), MMSCRIPT_LOG log_func)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+    MMSCRIPT_TRANSACTION *transaction = &task->transaction;
+    MMSCRIPT_NATIVE_FRAME frame;
+    int16_t ret;
+
+    frame.vars = _ctx->vars;
+    frame.nextLabel = -1;
+    frame.nextLine = UINT16_MAX;
+    frame.opCount = 0;
+
+    ret = line(&frame);
+    *nextLabel = frame.nextLabel;
+
+    if (ret < 0)
+        return ret;
+
+    if (frame.nextLine < _ctx->lineCount)
+        task->nextLine = frame.nextLine;    /* Jump resolved by the compiler, no label scan */
+
+    if (frame.opCount == 0)
+        return 0;
+
+    //
+    // COMMANDS, run as if parsed by MMScript_ParseCommands()
+
+    if (frame.opCount > MAX_TRANSACTION_OPS)
+        return MMS_ERR_TOO_MANY_COMMANDS;
+
+    transaction->opCount = frame.opCount;
+
+    for (uint8_t i=0; i<frame.opCount; i++)
+    {
+        TRANSACTION_OP *op = &transaction->ops[i];
+
+        op->type = frame.ops[i].type;
+        op->node = frame.ops[i].node;
+        memcpy(op->args, frame.ops[i].args, sizeof(op->args));
+
+        if (_ctx->telemetry)
+            MMScript_TelemetryWatch(_ctx->bus, op->node);
+    }
+
+    if (_ctx->submit)
+        return MMScript_SubmitTransaction(lineNum, nextLabel);
+
+    return MMScript_RunOps(transaction, nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+}
+
+
+static uint32_t MMScript_HashLines()
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i=0; i<_ctx->lineCount; i++)
+    {
+        const char *p = _ctx->lineEntries[i].startOfLine;
+        uint16_t label = (uint16_t)_ctx->lineEntries[i].label;
+
+        hash = (hash ^ (label & 0xFF)) * 16777619u;
+        hash = (hash ^ (label >> 8)) * 16777619u;
+
+        while (p && *p)
+            hash = (hash ^ (uint8_t)*p++) * 16777619u;
+
+        hash = (hash ^ '\n') * 16777619u;
+    }
+
+    return hash;
+}
+
+
+static int16_t MMScript_PairLoops()
+{
+    int16_t open[MAX_LOOP_DEPTH];
+    int depth = 0;
+
+    for (int i=0; i<_ctx->lineCount; i++)
+    {
+        LINE_ENTRY *entry = &_ctx->lineEntries[i];
+        uint8_t length;
+        int8_t keyword;
+        char var;
+
+        entry->loop_line = -1;
+
+        if (entry->startOfLine == NULL)
+            continue;
+
+        keyword = MMScript_Keyword(entry->startOfLine, &length);
+
+        if (keyword == MMSCRIPT_KEYWORD_FOR)
+        {
+            if (depth == MAX_LOOP_DEPTH || sscanf(entry->startOfLine + length, " %c =", &var) != 1 || var < 'A' || var > 'Z')
+                return MMS_PARSE_ERR_LOOP;
+
+            entry->loop_var = (uint8_t)(var - 'A');
+            open[depth++] = (int16_t)i;
+        }
+        else if (keyword == MMSCRIPT_KEYWORD_NEXT)
+        {
+            if (depth == 0)
+                return MMS_PARSE_ERR_LOOP;
+
+            depth--;
+
+            /* VAR of NEXT is optional, must be the one of FOR if given */
+            if (sscanf(entry->startOfLine + length, " %c", &var) == 1 && var != 'A' + _ctx->lineEntries[open[depth]].loop_var)
+                return MMS_PARSE_ERR_LOOP;
+
+            entry->loop_line = open[depth];
+            _ctx->lineEntries[open[depth]].loop_line = (int16_t)i;
+        }
+    }
+
+    return (depth == 0) ? 0 : MMS_PARSE_ERR_LOOP;
+}
+
+
+static int16_t MMScript_Optimize()
+{
+    MMSCRIPT_OPTIMIZE_REPORT *report = &_ctx->optimize_report;
+    uint8_t *marks;
+    size_t size = 0;
+    uint8_t changed;
+    int i, j;
+
+    /* Each line rewritten twice at most, with longer labels or values */
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        if (_ctx->lineEntries[i].startOfLine)
+            size += 2 * (strlen(_ctx->lineEntries[i].startOfLine) + 24);
+    }
+
+    _ctx->rewrites = (char*)malloc(size + 1);
+    _ctx->rewrites_size = size + 1;
+    _ctx->rewrites_used = 0;
+    marks = (uint8_t*)malloc(_ctx->lineCount);
+
+    if (_ctx->rewrites == NULL || marks == NULL)
+    {
+        SAFE_FREE(_ctx->rewrites);
+        free(marks);
+        return MMS_PARSE_ERR_MALLOC;
+    }
+
+    //
+    // Lines jumped to, not to be merged or removed
+
+    memset(marks, 0, _ctx->lineCount);
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        if (_ctx->lineEntries[i].startOfLine && (j = MMScript_JumpLine(i)) >= 0)
+            marks[j] = 1;
+    }
+
+    for (i=0; i<MMSCRIPT_RETRY_CLASS_COUNT; i++)
+    {
+        if ((j = MMScript_FindLabel(_ctx->retry_policies[i].error_label)) >= 0)
+            marks[j] = 1;
+    }
+
+    //
+    // Fold LET & IF of constant expressions
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        const char *p, *end;
+        char number[16];
+        uint8_t length, taken;
+        int16_t value;
+        int label;
+
+        if (line == NULL)
+            continue;
+
+        switch (MMScript_Keyword(line, &length))
+        {
+        case MMSCRIPT_KEYWORD_LET:
+            /* As MMScript_ProcessLine() accepts it */
+            p = line + length;
+            SKIP_SPACE(p);
+
+            if (*p < 'A' || *p > 'Z')
+                break;
+
+            p++;
+            while (*p == ' ')
+                p++;
+
+            if (*p != '=' || (*++p != ' ' && *p != '-' && (*p < '0' || *p > '9')))
+                break;
+
+            SKIP_SPACE(p);
+            end = p + strlen(p);
+
+            if (!MMScript_IsConstant(p, end) || strpbrk(p + 1, "+-*/") == NULL || MMScript_Eval(p, &value) != 0)
+                break;
+
+            /* As 0-n, mms2c & the estimator take no unary minus */
+            snprintf(number, sizeof(number), (value < 0) ? "0-%d" : "%d", (value < 0) ? -(int)value : value);
+
+            if (MMScript_RewriteLine(i, line, p - line, number, ""))
+                report->folded++;
+            break;
+
+        case MMSCRIPT_KEYWORD_IF:
+            p = strchr(line, '(');
+            end = strchr(line, ')');
+
+            if (p == NULL || end == NULL || !MMScript_IsConstant(p, end) || MMScript_EvalIf(line, &taken, &label) != 0)
+                break;
+
+            if (taken)
+            {
+                snprintf(number, sizeof(number), "%d", label);
+
+                if (MMScript_RewriteLine(i, "GOTO ", 5, number, ""))
+                    report->folded++;
+            }
+            else if (!marks[i])
+            {
+                _ctx->lineEntries[i].startOfLine = NULL;
+                _ctx->lineEntries[i].label = -1;
+                report->folded++;
+                report->removed_lines++;
+            }
+            break;
+        }
+    }
+
+    //
+    // Thread jumps to GOTO, GOTO to END is END
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        const char *number, *end;
+        char text[16];
+        uint8_t length;
+        int label, target, hops = 0;
+
+        if (line == NULL || (label = MMScript_JumpTarget(line, &number, &end)) < 0)
+            continue;
+
+        target = label;
+        j = MMScript_FindLabel(target);
+
+        while (j >= 0 && hops++ < _ctx->lineCount && MMScript_Keyword(_ctx->lineEntries[j].startOfLine, &length) == MMSCRIPT_KEYWORD_GOTO)
+        {
+            const char *n, *e;
+            int next = MMScript_JumpTarget(_ctx->lineEntries[j].startOfLine, &n, &e);
+
+            /* GOTO 0 ends, CALL & FORK can't */
+            if (next <= 0 || next == target)
+                break;
+
+            target = next;
+            j = MMScript_FindLabel(target);
+        }
+
+        if (target != label)
+        {
+            snprintf(text, sizeof(text), "%d", target);
+
+            if (MMScript_RewriteLine(i, line, number - line, text, end))
+                report->threaded_jumps++;
+        }
+        else if (j >= 0 && MMScript_Keyword(line, &length) == MMSCRIPT_KEYWORD_GOTO &&
+                 MMScript_Keyword(_ctx->lineEntries[j].startOfLine, &length) == MMSCRIPT_KEYWORD_END)
+        {
+            if (MMScript_RewriteLine(i, "END", 3, "", ""))
+                report->threaded_jumps++;
+        }
+    }
+
+    //
+    // Inline CALL of a subroutine of one line & RET
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        const char *number, *end;
+        uint8_t length;
+        int8_t keyword;
+        int k;
+
+        if (line == NULL || MMScript_Keyword(line, &length) != MMSCRIPT_KEYWORD_CALL)
+            continue;
+
+        j = MMScript_FindLabel(MMScript_JumpTarget(line, &number, &end));
+
+        if (j < 0 || j == i || (k = MMScript_NextLine(j)) < 0 || MMScript_Keyword(_ctx->lineEntries[k].startOfLine, &length) != MMSCRIPT_KEYWORD_RET)
+            continue;
+
+        /* Lines keeping no state & not jumping */
+        keyword = MMScript_Keyword(_ctx->lineEntries[j].startOfLine, &length);
+
+        if (keyword == -1 || keyword == MMSCRIPT_KEYWORD_LET || keyword == MMSCRIPT_KEYWORD_DELAY || keyword == MMSCRIPT_KEYWORD_UDELAY)
+        {
+            _ctx->lineEntries[i].startOfLine = _ctx->lineEntries[j].startOfLine;
+            report->inlined_calls++;
+        }
+    }
+
+    //
+    // Merge consecutive DELAYs, but those jumped to
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        uint8_t length;
+        char number[16];
+        long total;
+        int delay, last;
+
+        if (line == NULL || MMScript_Keyword(line, &length) != MMSCRIPT_KEYWORD_DELAY ||
+            sscanf(line + length, "%d", &delay) != 1 || delay < 0)
+            continue;
+
+        total = delay;
+        last = i;
+
+        while ((j = MMScript_NextLine(last)) >= 0 && !marks[j])
+        {
+            line = _ctx->lineEntries[j].startOfLine;
+
+            if (MMScript_Keyword(line, &length) != MMSCRIPT_KEYWORD_DELAY || sscanf(line + length, "%d", &delay) != 1 ||
+                delay < 0 || total + delay > INT32_MAX)
+                break;
+
+            total += delay;
+            last = j;
+        }
+
+        snprintf(number, sizeof(number), "%ld", total);
+
+        if (last == i || !MMScript_RewriteLine(i, "DELAY ", 6, number, ""))
+            continue;
+
+        for (j=i + 1; j<=last; j++)
+        {
+            if (_ctx->lineEntries[j].startOfLine)
+            {
+                _ctx->lineEntries[j].startOfLine = NULL;
+                _ctx->lineEntries[j].label = -1;
+                report->merged_delays++;
+            }
+        }
+    }
+
+    //
+    // Remove unreachable lines, from the first line, loops, tables & error labels
+
+    memset(marks, 0, _ctx->lineCount);
+
+    if ((i = _ctx->lineEntries[0].startOfLine ? 0 : MMScript_NextLine(0)) >= 0)
+        marks[i] = 1;
+
+    for (i=0; i<MMSCRIPT_RETRY_CLASS_COUNT; i++)
+    {
+        if ((j = MMScript_FindLabel(_ctx->retry_policies[i].error_label)) >= 0)
+            marks[j] = 1;
+    }
+
+    do
+    {
+        changed = 0;
+
+        for (i=0; i<_ctx->lineCount; i++)
+        {
+            const char *line = _ctx->lineEntries[i].startOfLine;
+            uint8_t length;
+            int8_t keyword;
+            int next;
+
+            if (line == NULL)
+                continue;
+
+            keyword = MMScript_Keyword(line, &length);
+
+            if (keyword == MMSCRIPT_KEYWORD_FOR || keyword == MMSCRIPT_KEYWORD_NEXT || keyword == MMSCRIPT_KEYWORD_TABLE)
+                marks[i] = 1;
+
+            if (!marks[i])
+                continue;
+
+            if (keyword != MMSCRIPT_KEYWORD_END && keyword != MMSCRIPT_KEYWORD_GOTO && keyword != MMSCRIPT_KEYWORD_RET &&
+                (next = MMScript_NextLine(i)) >= 0 && !marks[next])
+                changed = marks[next] = 1;
+
+            if ((next = MMScript_JumpLine(i)) >= 0 && !marks[next])
+                changed = marks[next] = 1;
+        }
+    }   while (changed);
+
+    for (i=0; i<_ctx->lineCount; i++)
+    {
+        if (_ctx->lineEntries[i].startOfLine && !marks[i])
+        {
+            _ctx->lineEntries[i].startOfLine = NULL;
+            _ctx->lineEntries[i].label = -1;
+            report->removed_lines++;
+        }
+    }
+
+    free(marks);
+    return 0;
+}
+
+
+static uint8_t MMScript_IsConstant(const char *start, const char *end)
+{
+    for (const char *p=start; p<end; p++)
+    {
+        if (*p >= 'A' && *p <= 'Z')
+            return 0;
+
+        /* Not folded, MMScript_Eval() reports division by 0 when the line runs */
+        if (*p == '/' && strtol(p + 1, NULL, 10) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+
+static int MMScript_FindLabel(int label)
+{
+    if (label <= 0)
+        return -1;
+
+    for (int i=0; i<_ctx->lineCount; i++)
+    {
+        if (_ctx->lineEntries[i].startOfLine && _ctx->lineEntries[i].label == label)
+            return i;
+    }
+
+    return -1;
+}
+
+
+static int MMScript_NextLine(int index)
+{
+    for (int i=index + 1; i<_ctx->lineCount; i++)
+    {
+        if (_ctx->lineEntries[i].startOfLine)
+            return i;
+    }
+
+    return -1;
+}
+
+
+static int MMScript_JumpTarget(const char *line, const char **number, const char **end)
+{
+    uint8_t length;
+    long label;
+    char *e;
+
+    switch (MMScript_Keyword(line, &length))
+    {
+    case MMSCRIPT_KEYWORD_GOTO:
+    case MMSCRIPT_KEYWORD_CALL:
+    case MMSCRIPT_KEYWORD_FORK:
+        *number = line + length;
+        break;
+
+    case MMSCRIPT_KEYWORD_IF:
+        if ((*number = strstr(line, "THEN")) == NULL)
+            return -1;
+
+        *number += 4;
+        break;
+
+    default:
+        return -1;
+    }
+
+    while (**number == ' ' || **number == '\t')
+        (*number)++;
+
+    label = strtol(*number, &e, 10);
+
+    if (e == *number || label < 0 || label > INT16_MAX)
+        return -1;
+
+    *end = e;
+    return (int)label;
+}
+
+
+static int MMScript_JumpLine(int index)
+{
+    const char *line = _ctx->lineEntries[index].startOfLine;
+    const char *number, *end;
+    unsigned int max_attempts, initial_delay, max_delay;
+    uint8_t length;
+    int label = -1;
+
+    if (MMScript_Keyword(line, &length) == MMSCRIPT_KEYWORD_RETRY)
+    {
+        /* As MMScript_ProcessLine() parses it */
+        line += length;
+        SKIP_SPACE(line);
+
+        if (strncmp(line, "LINK", 4) == 0)
+            line += 4;
+        else if (strncmp(line, "SERVO", 5) == 0)
+            line += 5;
+
+        if (sscanf(line, " ,%u,%u,%u,%d", &max_attempts, &initial_delay, &max_delay, &label) != 4)
+            return -1;
+    }
+    else
+        label = MMScript_JumpTarget(line, &number, &end);
+
+    return MMScript_FindLabel(label);
+}
+
+
+static uint8_t MMScript_RewriteLine(int index, const char *head, size_t headLength, const char *middle, const char *tail)
+{
+    size_t length = headLength + strlen(middle) + strlen(tail);
+    const char *line = _ctx->lineEntries[index].startOfLine;
+    char *text = _ctx->rewrites + _ctx->rewrites_used;
+
+    if (_ctx->rewrites_used + length + 1 > _ctx->rewrites_size)
+        return 0;
+
+    memcpy(text, head, headLength);
+    strcpy(text + headLength, middle);
+    strcat(text, tail);
+
+    if (strcmp(text, line) == 0)
+        return 0;
+
+    _ctx->lineEntries[index].startOfLine = text;
+    _ctx->rewrites_used += length + 1;
+
+    return 1;
+}
+
+
+static int16_t MMScript_EvalIf(const char *scriptLine, uint8_t *taken, int *label)
+{
+    const char *p;
+    int16_t ret;
+
+    int16_t left_val = 0;
+    int16_t right_val = 0;
+    const char *expr_start;
+    char *expr_end;
+    char orig_char;
+    char *op = NULL;
+    char *left_bracket, *right_bracket;
+
+    *taken = 0;
+
+    left_bracket = strstr(scriptLine, "(");
+    right_bracket = strstr(scriptLine, ")");
+
+    if (left_bracket == NULL || right_bracket == NULL)   /*Find '(' ')' and check*/
+        return MMS_ERR_MISSING_IF_BRACKETS;
+
+    if (strstr(left_bracket + 1, "(") != NULL || strstr(right_bracket + 1, ")") != NULL)
+        return MMS_ERR_INVALID_IF_BRACKETS;
+
+    p = left_bracket + 1;
+    SKIP_SPACE(p);
+
+    expr_start = p;
+
+    /* Locate end of expression */
+    while (*p)
+    {
+        if (*p == '>' || *p == '<' || *p == '=' || *p == '!')
+        {
+            op = (char *)p;
+            orig_char = *op;
+            expr_end = (char *)p;
+            *expr_end = '\0';
+
+            break;
+        }
+
+        p++;
+    }
+
+    if (op == NULL)
+    {
+        return MMS_ERR_INVALID_IF_SYNTAX;
+    }
+
+    /* Eval */
+    ret = MMScript_Eval(expr_start, &right_val);
+
+    /* Recover */
+    *op = orig_char;
+
+    if (ret < 0)
+        return ret;
+
+    /* Parse right expr */
+    while (*p == '>' || *p == '<' || *p == '=' || *p == '!')
+        p++;
+
+    expr_start = p;
+    expr_end = strstr(scriptLine, ")");
+    *expr_end = '\0';
+
+    ret = MMScript_Eval(expr_start, &left_val);
+
+    /* Recover */
+    *expr_end = ')';
+
+    if (ret < 0)
+        return ret;
+
+    p = strstr(scriptLine, "THEN");          /* THEN LABEL*/
+
+    if(p == NULL)
+        return MMS_ERR_INVALID_IF_SYNTAX;
+
+    p += 4;
+
+    if (sscanf(p, "%d", label) != 1)
+        return MMS_ERR_MISSING_THEN_PARAM;    /**/
+
+
+    if (strncmp(op, "==", 2) == 0)
+    {
+        if (right_val == left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else if (strncmp(op, ">=", 2) == 0)
+    {
+        if (right_val >= left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else if (strncmp(op, "<=", 2) == 0)
+    {
+        if (right_val <= left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else if (strncmp(op, "!=", 2) == 0)
+    {
+        if (right_val != left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else if (strncmp(op, ">", 1) == 0)
+    {
+        if (right_val > left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else if (strncmp(op, "<", 1) == 0)
+    {
+        if (right_val < left_val)
+        {
+            *taken = 1;
+        }
+    }
+    else
+        return MMS_ERR_INVALID_IF_OPERATOR;
+
+    return 0;
+}
+
+
+static int16_t MMScript_EvalUntil(const char *start, const char *keyword1, const char *keyword2, int16_t *result)
+{
+    char expr[64];
+    const char *end = start + strlen(start);
+    const char *found;
+
+    if (keyword1 && (found = strstr(start, keyword1)) != NULL && found < end)
+        end = found;
+
+    if (keyword2 && (found = strstr(start, keyword2)) != NULL && found < end)
+        end = found;
+
+    if (end - start >= (int)sizeof(expr))
+        return MMS_ERR_INVALID_FOR_PARAM;
+
+    memcpy(expr, start, end - start);
+    expr[end - start] = '\0';
+
+    return MMScript_Eval(expr, result);
+}
+
+
+static int16_t MMScript_PushStack(uint16_t val)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+
+    if (task->stack_pointer >= (MAX_STACK_SIZE - 1))
+    {
+        return 0;
+    }
+    else
+    {
+        task->run_stack[++task->stack_pointer] = val;
+        return 1;
+    }
+}
+
+
+static int16_t MMScript_PopStack(uint16_t *val)
+{
+    SCRIPT_TASK *task = CURRENT_TASK;
+
+    if (task->stack_pointer == -1)
+        return 0;
+    else
+    {
+        *val = task->run_stack[task->stack_pointer--];
+        return 1;
+    }
+}
+
+
+static void MMScript_ResetTasks(MMSCRIPT_CONTEXT *ctx, int16_t label)
+{
+    /* Streams left by a stop or an error */
+    for (int i=0; i<MAX_TASK_COUNT; i++)
+        MMScript_EndStream(&ctx->tasks[i]);
+
+    memset(ctx->tasks, 0, sizeof(ctx->tasks));
+
+    ctx->tasks[0].alive = 1;
+    ctx->tasks[0].parent = -1;
+    ctx->tasks[0].stack_pointer = -1;
+    ctx->tasks[0].nextLabel = label;
+
+    ctx->current = 0;
+    ctx->liveTasks = 1;
+}
+
+
+static uint8_t MMScript_HasChildren(uint8_t index)
+{
+    for (int i=0; i<MAX_TASK_COUNT; i++)
+    {
+        int8_t parent = _ctx->tasks[i].alive ? _ctx->tasks[i].parent : -1;
+
+        /* Up the forking tasks, all alive as ended ones hand their children over */
+        for (int n=0; parent >= 0 && n<MAX_TASK_COUNT; n++)
+        {
+            if (parent == index)
+                return 1;
+
+            parent = _ctx->tasks[parent].parent;
+        }
+    }
+
+    return 0;
+}
+
+
+static int16_t MMScript_DrainTransactions(void)
+{
+    int16_t ret = 0;
+
+    for (int i=0; i<MAX_TASK_COUNT; i++)
+    {
+        SCRIPT_TASK *task = &_ctx->tasks[i];
+
+        if (!task->alive || !task->parked)
+            continue;
+
+        while (!ATOMIC_LOAD(&task->transaction.done))
+        {
+            if (ATOMIC_LOAD(&_ctx->stop))
+                return 0;
+
+            _ctx->wait_completion(UINT64_MAX);
+        }
+
+        if (ret == 0 && task->transaction.result < 0)
+            ret = task->transaction.result;
+    }
+
+    return ret;
+}
+
+
+static uint8_t MMScript_CanYield()
+{
+    return _ctx->liveTasks > 1 && _ctx->get_us && _ctx->delay_until_us;
+}
+
+
+static int16_t MMScript_Schedule()
+{
+    for (;;)
+    {
+        uint64_t now = _ctx->get_us ? _ctx->get_us() : 0;
+        uint64_t earliest = UINT64_MAX;
+        uint8_t parked = 0;
+
+        /* Round robin, from the task after the last one executed */
+        for (int n=1; n<=MAX_TASK_COUNT; n++)
+        {
+            uint8_t i = (_ctx->current + n) % MAX_TASK_COUNT;
+            SCRIPT_TASK *task = &_ctx->tasks[i];
+
+            if (!task->alive)
+                continue;
+
+            if (task->joining && MMScript_HasChildren(i))
+                continue;
+
+            if (task->parked && !ATOMIC_LOAD(&task->transaction.done))
+            {
+                parked = 1;
+                continue;
+            }
+
+            if (task->wake_us > now)
+            {
+                if (task->wake_us < earliest)
+                    earliest = task->wake_us;
+
+                continue;
+            }
+
+            task->wake_us = 0;
+            _ctx->current = i;
+            return 1;
+        }
+
+        if (ATOMIC_LOAD(&_ctx->stop))
+            return 0;
+
+        /* All tasks yielded or parked, sleep until the first one is due or a transaction completes */
+        if (parked)
+            _ctx->wait_completion(earliest);
+        else if (earliest != UINT64_MAX)
+            _ctx->delay_until_us(earliest);
+        else
+            return 0;
+    }
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+int16_t MMScript_ParseScript(char *scriptBuf, size_t bufLen)
+{
+    _ctx->scriptBuf = scriptBuf;
+    _ctx->native = NULL;
+    MMScript_FreeTables(_ctx);
+    SAFE_FREE(_ctx->rewrites);
+    memset(&_ctx->optimize_report, 0, sizeof(MMSCRIPT_OPTIMIZE_REPORT));
+
+    /**
+      * Count lines
+      */
+
+    _ctx->lineCount = 1;
+
+    for (size_t i=0; i<bufLen; i++)
+    {
+        if (*(_ctx->scriptBuf + i) == '\n')
+        {
+            _ctx->lineCount++;
+        }
+    }
+
+    if (_ctx->lineEntries != NULL)
+        SAFE_FREE(_ctx->lineEntries);
+
+    _ctx->lineEntries = (LINE_ENTRY*)malloc(_ctx->lineCount * sizeof(LINE_ENTRY));
+
+    if (_ctx->lineEntries == NULL)
+    {
+        SAFE_FREE(_ctx->scriptBuf);
+        return MMS_PARSE_ERR_MALLOC;
+    }
+
+
+    /**
+      * Locate lines
+      */
 
+    memset(_ctx->lineEntries, 0, _ctx->lineCount * sizeof(LINE_ENTRY));
+    _ctx->lineEntries[0].startOfLine = _ctx->scriptBuf;
+    int currLine = 1;
 
-        if (strncmp(op, "==", 2) == 0)
+    for (size_t i=0; i<bufLen; i++)
+    {
+        if (*(_ctx->scriptBuf + i) == '\n')
         {
-            if (right_val == left_val)
-            {
-                *nextLabel = label;
-            }
+            *(_ctx->scriptBuf + i) = '\0';
+            _ctx->lineEntries[currLine].startOfLine = _ctx->scriptBuf + i + 1;
+            SKIP_SPACE(_ctx->lineEntries[currLine].startOfLine);
+            currLine++;
         }
-        else if (strncmp(op, ">=", 2) == 0)
+    }
+
+
+    /**
+      * Save label for each line
+      */
+
+    for (int i=0; i<_ctx->lineCount; i++)
+    {
+        const char *line = _ctx->lineEntries[i].startOfLine;
+
+        //
+        // Trim
+
+        SKIP_SPACE(line);
+
+        char *p = (char*)line + strlen(line) - 1;
+
+        while (*p == '\r' || *p == ';')
         {
-            if (right_val >= left_val)
-            {
-                *nextLabel = label;
-            }
+            *p = '\0';
+            p--;
         }
-        else if (strncmp(op, "<=", 2) == 0)
+
+        if (*line == '\0')
         {
-            if (right_val <= left_val)
-            {
-                *nextLabel = label;
-            }
+            _ctx->lineEntries[i].label = -1;
+            _ctx->lineEntries[i].startOfLine = NULL;
+            continue;
         }
-        else if (strncmp(op, "!=", 2) == 0)
+
+        //
+        // Get LABEL
+        p = strchr(line, ':');
+
+        if (p)
         {
-            if (right_val != left_val)
+            int label;
+
+            *p = '\0';
+
+            if (sscanf(line, "%d", &label) != 1)
             {
-                *nextLabel = label;
+                SAFE_FREE(_ctx->scriptBuf);
+                SAFE_FREE(_ctx->lineEntries);
+                return MMS_PARSE_ERR_MISSING_LABEL;
             }
-        }
-        else if (strncmp(op, ">", 1) == 0)
-        {
-            if (right_val > left_val)
+
+            _ctx->lineEntries[i].label = label;
+            _ctx->lineEntries[i].startOfLine = p + 1;
+            SKIP_SPACE(_ctx->lineEntries[i].startOfLine);
+
+            if (_ctx->lineEntries[i].startOfLine == '\0')
             {
-                *nextLabel = label;
+                SAFE_FREE(_ctx->scriptBuf);
+                SAFE_FREE(_ctx->lineEntries);
+                return MMS_PARSE_ERR_MISSING_COMMAND;
             }
         }
-        else if (strncmp(op, "<", 1) == 0)
+        else
         {
-            if (right_val < left_val)
-            {
-                *nextLabel = label;
-            }
+            SAFE_FREE(_ctx->scriptBuf);
+            SAFE_FREE(_ctx->lineEntries);
+            return MMS_PARSE_ERR_MISSING_LABEL;
         }
-        else
-            return MMS_ERR_INVALID_IF_OPERATOR;
     }
-    else if (strncmp(scriptLine, "GOTO", 4) == 0)
+
+
+    /**
+      * Declare tables
+      */
+
+    for (int i=0; i<_ctx->lineCount; i++)
     {
-        //
-        // PARAMETERS
-        int label;
+        const char *line = _ctx->lineEntries[i].startOfLine;
+        uint8_t length;
 
-        if (sscanf(scriptLine + 4, "%d", &label) != 1)
-            return MMS_ERR_MISSING_GOTO_PARAM;
+        if (line && MMScript_Keyword(line, &length) == MMSCRIPT_KEYWORD_TABLE && MMScript_ParseTable(line + length) != 0)
+        {
+            SAFE_FREE(_ctx->scriptBuf);
+            SAFE_FREE(_ctx->lineEntries);
+            MMScript_FreeTables(_ctx);
+            return MMS_PARSE_ERR_TABLE;
+        }
+    }
 
-        *nextLabel = label;
+    if (MMScript_CheckTableReads() != 0)
+    {
+        SAFE_FREE(_ctx->scriptBuf);
+        SAFE_FREE(_ctx->lineEntries);
+        MMScript_FreeTables(_ctx);
+        return MMS_PARSE_ERR_TABLE;
     }
-    else if (strncmp(scriptLine, "END", 3) == 0)
+
+
+    /**
+      * Optimize
+      */
+
+    if (_ctx->optimize && MMScript_Optimize() != 0)
     {
-        *nextLabel = 0;
+        SAFE_FREE(_ctx->scriptBuf);
+        SAFE_FREE(_ctx->lineEntries);
+        MMScript_FreeTables(_ctx);
+        return MMS_PARSE_ERR_MALLOC;
     }
-    else if (strncmp(scriptLine, "DELAY", 5) == 0)
+
+
+    /**
+      * Pair loops
+      */
+
+    if (MMScript_PairLoops() != 0)
     {
-        //
-        // PARAMETERS
-        int delay;
+        SAFE_FREE(_ctx->scriptBuf);
+        SAFE_FREE(_ctx->lineEntries);
+        SAFE_FREE(_ctx->rewrites);
+        MMScript_FreeTables(_ctx);
+        return MMS_PARSE_ERR_LOOP;
+    }
+    
+    _ctx->hash = MMScript_HashLines();
+    ATOMIC_STORE(&_ctx->stop, 0);
+    MMScript_ResetTasks(_ctx, _ctx->lineEntries[0].label); /* Label of first line */
 
-        if (sscanf(scriptLine + 5, "%d", &delay) != 1)
-            return MMS_ERR_MISSING_DELAY_PARAM;
+    return CURRENT_TASK->nextLabel;
+}
 
-        // Delay
-        DELAY_MS(delay);
+
+void MMScript_SetLabelToExec(int16_t label)
+{
+    CURRENT_TASK->nextLabel = label;
+}
+
+
+int16_t MMScript_ExecOneStep(MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_DELAY_MILLI_SECONDS DelayMilliSecondsImpl, MMSCRIPT_LOG log_func)
+{
+    uint16_t currLine;
+    SCRIPT_TASK *task;
+
+    if (_ctx->lineCount == 0 || _ctx->lineEntries == NULL)
+        return 0;
+
+    /* Pick the task to execute */
+    if ((_ctx->liveTasks > 1 || CURRENT_TASK->wake_us != 0 || CURRENT_TASK->parked) && !MMScript_Schedule())
+        return 0;
+
+    task = CURRENT_TASK;
+
+    /* Find line with label nextLabel of task */
+
+    if (task->nextLabel == -1)
+    {
+        currLine = 0;
+        task->nextLabel = _ctx->lineEntries[0].label;
     }
-    else if (strncmp(scriptLine, "WAIT", 4) == 0)
+    else if (task->nextLine < _ctx->lineCount && _ctx->lineEntries[task->nextLine].label == task->nextLabel)
     {
-        scriptLine += 4;
-        p = scriptLine;   //strtok(line, ",");
+        currLine = task->nextLine;
+    }
+    else
+    {
+        for (currLine=0; currLine<_ctx->lineCount; currLine++)
+        {
+            if (_ctx->lineEntries[currLine].label == task->nextLabel)
+                break;
+        }
 
-        while (p)
+        if (currLine == _ctx->lineCount)
         {
-            int node_id;
-            uint8_t status, in_position;
+            /* NOT found */
+            return MMS_ERR_INVALID_LABEL;
+        }
+    }
 
-            if (sscanf(p, "%x", &node_id) != 1)
-                return MMS_ERR_MISSING_WAIT_PARAM;
+    int16_t ret;
 
-            //
-            // Wait specified servo to finish command
+    /* Compiled line, unless resuming a transaction it submitted */
+    if (_ctx->native && _ctx->native->lines[currLine] && !task->parked)
+        ret = MMScript_ExecNative(_ctx->native->lines[currLine], currLine, &task->nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+    else
+        ret = MMScript_ProcessLine(&currLine, &task->nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
 
-            status = MMS_CTRL_STATUS_NO_CONTROL;
-            in_position = 0;
+    /* If negtive, indicates something error, return */
+    if (ret < 0)
+        return ret;
 
-            while (status != MMS_CTRL_STATUS_POSITION_CONTROL || in_position == 0)
-            {
-                if (_stop)
-                    return 0;
+    /* NON negtive nextLabel means next label or ended, while -1 for next line */
+    if (task->nextLabel == -1)
+    {
+        currLine++;
 
-                DELAY_MS(100);
-                FORCE_EXEC(MMS_GetControlStatus((uint8_t)node_id, &status, &in_position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
+        while (currLine < _ctx->lineCount && _ctx->lineEntries[currLine].startOfLine == NULL)
+        {
+            currLine++;
+        }
 
-                if (status == MMS_CTRL_STATUS_NO_CONTROL)
-                {
-                    uint8_t ret;
+        if (currLine == _ctx->lineCount)
+        {
+            /* NO found */
+            task->nextLabel = MMS_ERR_END;
+        }
+        else
+        {
+            /* Return the label */
+            task->nextLabel = _ctx->lineEntries[currLine].label;
+            task->nextLine = currLine;
+        }
+    }
+    else if (task->nextLabel == _ctx->lineEntries[currLine].label)
+    {
+        task->nextLine = currLine;      /* Same line again */
+    }
 
-                    log_func(node_id, "Restart servo.");
+    if (_ctx->current == 0 && task->nextLabel == 0 && (ret = MMScript_DrainTransactions()) < 0)
+        return ret;
 
-                    while ((ret = MMS_StartServo(node_id, MMS_MODE_KEEP,
-                                                 node_error_callback)) != MMS_RESP_SUCCESS)
-                    {
-                        local_error_callback(node_id, ret);
-                        if (_stop)
-                            return 0;
-                        DELAY_MS(100);
-                    }
-                }
-            }
+    if (_ctx->current == 0 || task->nextLabel < 0)
+        return task->nextLabel;     /* END of main task ends the script, forked tasks included */
 
-            //p = strtok(NULL, ",");
-            p = strchr(p, ',');
-            if (p)
-            {
-                p += 1; /* Skip ',' */
-            }
+    if (task->nextLabel == 0)
+    {
+        /* Forked task ended, its children are handed over to its parent so that JOIN still waits for them */
+        for (int i=0; i<MAX_TASK_COUNT; i++)
+        {
+            if (_ctx->tasks[i].alive && _ctx->tasks[i].parent == (int8_t)_ctx->current)
+                _ctx->tasks[i].parent = task->parent;
         }
+
+        task->alive = 0;
+        _ctx->liveTasks--;
+        _ctx->current = 0;
+    }
+
+    /* Label of the main task, whichever task ran */
+    return _ctx->tasks[0].nextLabel;
+}
+
+
+void MMScript_Rewind()
+{
+    ATOMIC_STORE(&_ctx->stop, 0);
+    memcpy(_ctx->retry_policies, _ctx->host_retry_policies, sizeof(_ctx->retry_policies));
+    MMScript_ResetTasks(_ctx, -1);
+    memset(_ctx->blend, 0, sizeof(_ctx->blend));
+    memset(_ctx->gear, 0, sizeof(_ctx->gear));
+    memset(&_ctx->gear_stats, 0, sizeof(MMSCRIPT_GEAR_STATS));
+}
+
+
+void MMScript_Stop()
+{
+    ATOMIC_STORE(&_ctx->stop, 1);
+}
+
+
+void MMScript_SetTimeBase(MMSCRIPT_GET_MICRO_SECONDS GetMicroSecondsImpl, MMSCRIPT_DELAY_UNTIL_MICRO_SECONDS DelayUntilMicroSecondsImpl)
+{
+    _ctx->get_us = GetMicroSecondsImpl;
+    _ctx->delay_until_us = DelayUntilMicroSecondsImpl;
+}
+
+
+void MMScript_SetRetryPolicy(MMSCRIPT_RETRY_CLASS retry_class, const MMSCRIPT_RETRY_POLICY *policy)
+{
+    if (retry_class >= MMSCRIPT_RETRY_CLASS_COUNT || policy == NULL)
+        return;
+
+    _ctx->retry_policies[retry_class] = *policy;
+    _ctx->host_retry_policies[retry_class] = *policy;
+}
+
+
+void MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS retry_class, MMSCRIPT_RETRY_POLICY *policy)
+{
+    if (retry_class >= MMSCRIPT_RETRY_CLASS_COUNT || policy == NULL)
+        return;
+
+    *policy = _ctx->retry_policies[retry_class];
+}
+
+
+void MMScript_Clean()
+{
+    _ctx->native = NULL;
+    SAFE_FREE(_ctx->scriptBuf);
+    SAFE_FREE(_ctx->lineEntries);
+    SAFE_FREE(_ctx->rewrites);
+    MMScript_FreeTables(_ctx);
+
+    MMScript_ResetTasks(_ctx, 0);
+    _ctx->lineCount = 0;
+}
+
+
+void MMScript_SetScriptPath(const char *path)
+{
+    SAFE_FREE(_ctx->script_path);
+
+    if (path)
+        _ctx->script_path = strdup(path);
+}
+
+
+int16_t MMScript_FilePath(const char *params, char *path, size_t size)
+{
+    const char *dir = _ctx->script_path ? strrchr(_ctx->script_path, '/') : NULL;
+    const char *backslash = _ctx->script_path ? strrchr(_ctx->script_path, '\\') : NULL;
+    const char *start, *end;
+    size_t n;
+
+    SKIP_SPACE(params);
+
+    if (*params == '"')
+    {
+        start = params + 1;
+
+        if ((end = strchr(start, '"')) == NULL)
+            return -1;
+
+        params = end + 1;
     }
     else
     {
-        //
-        // Get COMMAND
+        start = params;
 
-        p = scriptLine;
+        for (end = start; *end && *end != ' ' && *end != '\t'; end++)
+            ;
 
-        while (p != NULL)
-        {
-            int node_id;
-            char *token;
+        params = end;
+    }
 
-            //
-            // NODE_ID
+    SKIP_SPACE(params);
 
-            token = strchr(p, ',');
+    if (end == start || *params != '\0')
+        return -1;
 
-            if (!token)
-                return MMS_ERR_MISSING_NODE_ID;
+    if (backslash > dir)
+        dir = backslash;
 
-            if (sscanf(p, "%x", &node_id) != 1)
-                return MMS_ERR_MISSING_NODE_ID;
+    /* Relative to the directory of the script */
+    if (start[0] == '/' || start[0] == '\\' || start[1] == ':' || dir == NULL)
+        n = (size_t)snprintf(path, size, "%.*s", (int)(end - start), start);
+    else
+        n = (size_t)snprintf(path, size, "%.*s%.*s", (int)(dir - _ctx->script_path + 1), _ctx->script_path, (int)(end - start), start);
 
-            p = token + 1;
-            SKIP_SPACE(p);
+    return (n < size) ? 0 : -1;
+}
 
-            //
-            // COMMAND_ID
 
-            if (strncmp(p, "START", 5) == 0)
-            {
-                //
-                // PARAMETERS
-                int mode;
+void MMScript_SetOptimize(uint8_t enabled)
+{
+    _ctx->optimize = enabled;
+}
 
-                if (sscanf(p + 5, "%d", &mode) != 1)
-                    return MMS_ERR_ERROR_START_PARAM;
 
-                if (mode != MMS_MODE_KEEP && mode != MMS_MODE_ZERO && mode != MMS_MODE_RESET)
-                    return MMS_ERR_ERROR_START_PARAM;
+void MMScript_GetOptimizeReport(MMSCRIPT_OPTIMIZE_REPORT *report)
+{
+    if (report)
+        *report = _ctx->optimize_report;
+}
 
-                FORCE_EXEC(MMS_ResetError(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_EXEC(MMS_StartServo(node_id, mode, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "STOP", 4) == 0)
-            {
-                FORCE_EXEC(MMS_StopServo(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "HALT", 4) == 0)
-            {
-                FORCE_EXEC(MMS_HaltServo(node_id, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "VM", 2) == 0)
-            {
-                //
-                // PARAMETERS
-                int velocity;
 
-                if (sscanf(p + 2, "%d", &velocity) != 1)
-                    return MMS_ERR_MISSING_VM_PARAM;
+uint16_t MMScript_LineCount()
+{
+    return (_ctx->lineEntries) ? (uint16_t)_ctx->lineCount : 0;
+}
 
-                FORCE_MOVE(MMS_ProfiledVelocityMove(node_id, velocity, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "PVM", 3) == 0)
-            {
-                //
-                // PARAMETERS
-                int accel, velocity;
 
-                if (sscanf(p + 3, "%d,%d", &accel, &velocity) != 2)
-                    return MMS_ERR_MISSING_PVM_PARAM;
+const char *MMScript_LineText(uint16_t index, int16_t *label)
+{
+    if (_ctx->lineEntries == NULL || index >= _ctx->lineCount)
+    {
+        *label = -1;
+        return NULL;
+    }
 
-                FORCE_EXEC(MMS_SetProfileAcceleration(node_id, accel, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_MOVE(MMS_ProfiledVelocityMove(node_id, velocity, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "AP", 2) == 0)
-            {
-                //
-                // PARAMETERS
-                long position;
+    *label = _ctx->lineEntries[index].label;
+    return _ctx->lineEntries[index].startOfLine;
+}
 
-                if (sscanf(p + 2, "%ld", &position) != 1)
-                    return MMS_ERR_MISSING_AP_PARAM;
 
-                FORCE_MOVE(MMS_AbsolutePositionMove(node_id, position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "PAP", 3) == 0)
-            {
-                //
-                // PARAMETERS
-                int accel, velocity;
-                long position;
+uint32_t MMScript_ScriptHash()
+{
+    return _ctx->hash;
+}
 
-                if (sscanf(p + 3, "%d,%d,%ld", &accel, &velocity, &position) != 3)
-                    return MMS_ERR_MISSING_PAP_PARAM;
 
-                FORCE_EXEC(MMS_SetProfileAcceleration(node_id, accel, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_EXEC(MMS_SetProfileVelocity(node_id, velocity, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_MOVE(MMS_ProfiledAbsolutePositionMove(node_id, position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "RP", 2) == 0)
-            {
-                //
-                // PARAMETERS
-                long position;
+int16_t MMScript_AttachNative(const MMSCRIPT_NATIVE_PROGRAM *program)
+{
+    _ctx->native = NULL;
+
+    if (program == NULL)
+        return 0;
+
+    if (program->version != MMSCRIPT_NATIVE_VERSION || _ctx->lineEntries == NULL ||
+        program->line_count != _ctx->lineCount || program->hash != _ctx->hash)
+        return MMS_PARSE_ERR_NATIVE;
 
-                if (sscanf(p + 2, "%ld", &position) != 1)
-                    return MMS_ERR_MISSING_RP_PARAM;
+    _ctx->native = program;
+    return 0;
+}
 
-                FORCE_MOVE(MMS_RelativePositionMove(node_id, position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else if (strncmp(p, "PRP", 3) == 0)
-            {
-                //
-                // PARAMETERS
-                int accel, velocity;
-                long position;
 
-                if (sscanf(p + 3, "%d,%d,%ld", &accel, &velocity, &position) != 3)
-                    return MMS_ERR_MISSING_PRP_PARAM;
+MMSCRIPT_CONTEXT *MMScript_CreateContext(uint8_t bus)
+{
+    MMSCRIPT_CONTEXT *ctx;
 
-                FORCE_EXEC(MMS_SetProfileAcceleration(node_id, accel, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_EXEC(MMS_SetProfileVelocity(node_id, velocity, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-                FORCE_MOVE(MMS_ProfiledRelativePositionMove(node_id, position, node_error_callback), node_id, local_error_callback, node_error_callback, log_func);
-            }
-            else
-            {
-                // Unknown command
-                return MMS_ERR_UNKNOWN_COMMAND;
-            }
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return NULL;
 
-            // next COMMAND
-            p = strchr(p, ';');
+    ctx = (MMSCRIPT_CONTEXT*)malloc(sizeof(MMSCRIPT_CONTEXT));
 
-            if (p)
-                p++;    /* Skip ';' */
-        }
-    }
+    if (ctx == NULL)
+        return NULL;
 
-    return 0;
+    memset(ctx, 0, sizeof(MMSCRIPT_CONTEXT));
+    ctx->bus = bus;
+    ctx->lineCount = -1;
+    ctx->api = &_api_bus;
+    MMScript_ResetTasks(ctx, 0);
+    memcpy(ctx->retry_policies, _default_context.host_retry_policies, sizeof(ctx->retry_policies));
+    memcpy(ctx->host_retry_policies, _default_context.host_retry_policies, sizeof(ctx->host_retry_policies));
+
+    return ctx;
 }
 
 
-static int16_t MMScript_Eval(const char *expr, int16_t *result)
+void MMScript_DestroyContext(MMSCRIPT_CONTEXT *ctx)
 {
-    int number = 0;
-    int n = 0;
+    MMSCRIPT_CONTEXT *selected = _ctx;
 
-    SKIP_SPACE(expr);
+    if (ctx == NULL || ctx == &_default_context)
+        return;
 
-    if (*expr <= '9' && *expr >= '0')
-    {
-        sscanf(expr,"%d%n", &number, &n);
+    _ctx = ctx;
+    MMScript_Clean();
+    _ctx = (selected == ctx) ? &_default_context : selected;
 
-        if (number > INT16_MAX || number < INT16_MIN)
-            return MMS_ERR_INVALID_EXPR_ITEM;
+    free(ctx->script_path);
+    free(ctx);
+}
 
-        *result = (int16_t)number;
-        expr += n;
-    }
-    else if (*expr <= 'Z' && *expr >= 'A')
-    {
-        *result = vars[(*expr) - 'A'];
-        expr++;
-    }
-    else
-        return MMS_ERR_INVALID_EXPR_ITEM;
 
-    SKIP_SPACE(expr);
+void MMScript_SelectContext(MMSCRIPT_CONTEXT *ctx)
+{
+    _ctx = ctx ? ctx : &_default_context;
+}
 
-    while (*expr)
-    {
-        if (*expr == '+')
-        {
-            expr++;
-            SKIP_SPACE(expr);
-            if (*expr <= '9' && *expr >= '0')
-            {
-                sscanf(expr,"%d%n", &number, &n);
-                *result += number;
-                expr += n;
-            }
-            else if (*expr <= 'Z' && *expr >= 'A')
-            {
-                *result += vars[(*expr) - 'A'];
-                expr++;
-            }
-            else
-                return MMS_ERR_INVALID_EXPR_ITEM;
-        }
-        else if (*expr == '-')
-        {
-            expr++;
-            SKIP_SPACE(expr);
-            if (*expr <= '9' && *expr >= '0')
-            {
-                sscanf(expr,"%d%n", &number, &n);
-                *result -= number;
-                expr += n;
-            }
-            else if (*expr <= 'Z' && *expr >= 'A')
-            {
-                *result -= vars[(*expr) - 'A'];
-                expr++;
-            }
-            else
-                return MMS_ERR_INVALID_EXPR_ITEM;
-        }
-        else if (*expr == '*')
-        {
-            expr++;
-            SKIP_SPACE(expr);
-            if (*expr <= '9' && *expr >= '0')
-            {
-                sscanf(expr,"%d%n", &number, &n);
-                *result *= number;
-                expr += n;
-            }
-            else if (*expr <= 'Z' && *expr >= 'A')
-            {
-                *result *= vars[(*expr) - 'A'];
-                expr++;
-            }
-            else
-                return MMS_ERR_INVALID_EXPR_ITEM;
-        }
-        else if (*expr == '/')
-        {
-            expr++;
-            SKIP_SPACE(expr);
-            if (*expr <= '9' && *expr >= '0')
-            {
-                sscanf(expr,"%d%n", &number, &n);
-                *result /= number;
-                expr += n;
-            }
-            else if (*expr <= 'Z' && *expr >= 'A')
-            {
-                *result /= vars[(*expr) - 'A'];
-                expr++;
-            }
-            else
-                return MMS_ERR_INVALID_EXPR_ITEM;
-        }
-        else if (*expr >= 'A' && *expr <= 'Z')
-            return MMS_ERR_INVALID_EXPR_ITEM;
-        else if (*expr == ' ')
-            SKIP_SPACE(expr);
-        else
-            return MMS_ERR_INVALID_EXPR_OPERATOR;
 
-        SKIP_SPACE(expr);
-    }
-    return 0;
+uint8_t MMScript_CurrentBus()
+{
+    return _ctx->bus;
 }
 
 
-static int16_t MMScript_PushStack(uint16_t val)
+void MMScript_StopContext(MMSCRIPT_CONTEXT *ctx)
 {
-    if (_stack_pointer >= (MAX_STACK_SIZE - 1))
-    {
-        return 0;
-    }
-    else
-    {
-        _run_stack[++_stack_pointer] = val;
-        return 1;
-    }
+    ATOMIC_STORE(&(ctx ? ctx : &_default_context)->stop, 1);
 }
 
 
-static int16_t MMScript_PopStack(uint16_t *val)
+void MMScript_SetExecutor(MMSCRIPT_SUBMIT submit, MMSCRIPT_WAIT_COMPLETION wait_completion)
 {
-    if (_stack_pointer == -1)
-        return 0;
-    else
-    {
-        *val = _run_stack[_stack_pointer--];
-        return 1;
-    }
+    _ctx->submit = (submit && wait_completion) ? submit : NULL;
+    _ctx->wait_completion = wait_completion;
 }
 
-/* Public functions ---------------------------------------------------------*/
 
-int16_t MMScript_ParseScript(char *scriptBuf, size_t bufLen)
+void MMScript_RunTransaction(MMSCRIPT_TRANSACTION *transaction, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_DELAY_MILLI_SECONDS DelayMilliSecondsImpl, MMSCRIPT_LOG log_func)
 {
-    _scriptBuf = scriptBuf;
+    MMSCRIPT_CONTEXT *selected = _ctx;
 
-    /**
-      * Count lines
-      */
+    /* Stop flag & RTT statistics of the bus, retry policies as submitted */
+    _ctx = transaction->ctx;
+    _policies = transaction->retry_policies;
 
-    _lineCount = 1;
+    transaction->result = MMScript_RunOps(transaction, &transaction->nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+
+    _policies = NULL;
+    _ctx = selected;
+    ATOMIC_STORE(&transaction->done, 1);
+}
 
-    for (size_t i=0; i<bufLen; i++)
-    {
-        if (*(_scriptBuf + i) == '\n')
-        {
-            _lineCount++;
-        }
-    }
 
-    if (_lineEntries != NULL)
-        SAFE_FREE(_lineEntries);
+void MMScript_FailTransaction(MMSCRIPT_TRANSACTION *transaction, int16_t error)
+{
+    transaction->result = error;
+    ATOMIC_STORE(&transaction->done, 1);
+}
 
-    _lineEntries = (LINE_ENTRY*)malloc(_lineCount * sizeof(LINE_ENTRY));
 
-    if (_lineEntries == NULL)
+MMSCRIPT_PRIORITY MMScript_TransactionPriority(const MMSCRIPT_TRANSACTION *transaction)
+{
+    MMSCRIPT_PRIORITY priority = MMSCRIPT_PRIORITY_POLL;
+
+    for (uint8_t i=0; i<transaction->opCount; i++)
     {
-        SAFE_FREE(_scriptBuf);
-        return MMS_PARSE_ERR_MALLOC;
+        MMSCRIPT_PRIORITY op_priority;
+
+        switch (transaction->ops[i].type)
+        {
+        case OP_STOP:
+        case OP_HALT:
+            op_priority = MMSCRIPT_PRIORITY_STOP;
+            break;
+        case OP_START:
+            op_priority = MMSCRIPT_PRIORITY_CONFIG;
+            break;
+        case OP_STATUS:
+        case OP_TELEMETRY:
+            op_priority = MMSCRIPT_PRIORITY_POLL;
+            break;
+        default:
+            op_priority = MMSCRIPT_PRIORITY_MOTION;
+            break;
+        }
+
+        if (op_priority < priority)
+            priority = op_priority;
     }
 
+    return priority;
+}
 
-    /**
-      * Locate lines
-      */
 
-    _lineEntries[0].startOfLine = _scriptBuf;
-    int currLine = 1;
+uint16_t MMScript_TransactionCalls(const MMSCRIPT_TRANSACTION *transaction)
+{
+    uint16_t calls = 0;
 
-    for (size_t i=0; i<bufLen; i++)
+    for (uint8_t i=0; i<transaction->opCount; i++)
     {
-        if (*(_scriptBuf + i) == '\n')
+        switch (transaction->ops[i].type)
         {
-            *(_scriptBuf + i) = '\0';
-            _lineEntries[currLine].startOfLine = _scriptBuf + i + 1;
-            SKIP_SPACE(_lineEntries[currLine].startOfLine);
-            currLine++;
+        case OP_PAP:
+        case OP_PRP:
+            calls += 3;     /* Acceleration, velocity, move */
+            break;
+        case OP_START:
+        case OP_PVM:
+            calls += 2;
+            break;
+        case OP_TELEMETRY:
+            calls += 1 + (uint16_t)transaction->ops[i].args[0];
+            break;
+        case OP_GEAR:
+            calls += 2 * (uint16_t)transaction->ops[i].args[0];     /* Leader read, follower move */
+            break;
+        default:
+            calls += 1;
+            break;
         }
     }
 
+    return calls;
+}
 
-    /**
-      * Save label for each line
-      */
 
-    for (int i=0; i<_lineCount; i++)
-    {
-        const char *line = _lineEntries[i].startOfLine;
+MMSCRIPT_TRANSACTION *MMScript_PollTransaction(uint8_t node_id, uint8_t with_position)
+{
+    MMSCRIPT_TRANSACTION *transaction = &_ctx->polls[node_id != 0];
+    uint8_t followers = 0;
 
-        //
-        // Trim
+    for (uint8_t i=0; i<MAX_GEAR_FOLLOWERS; i++)
+    {
+        if (ATOMIC_LOAD(&_ctx->gear[i].follower) != 0)
+            followers++;
+    }
 
-        SKIP_SPACE(line);
+    if (node_id == 0 && followers == 0)
+        return NULL;
 
-        char *p = (char*)line + strlen(line) - 1;
+    memset(transaction, 0, sizeof(MMSCRIPT_TRANSACTION));
+    transaction->ctx = _ctx;
+    transaction->nextLabel = -1;
+    transaction->opCount = 1;
+    transaction->ops[0].type = (node_id != 0) ? OP_TELEMETRY : OP_GEAR;
+    transaction->ops[0].node = node_id;
+    transaction->ops[0].args[0] = (node_id != 0) ? (with_position != 0) : followers;
 
-        while (*p == '\r' || *p == ';')
-        {
-            *p = '\0';
-            p--;
-        }
+    /* Polls aren't retried, RETRY lines of the script don't apply */
+    memcpy(transaction->retry_policies, _ctx->host_retry_policies, sizeof(transaction->retry_policies));
 
-        if (*line == '\0')
-        {
-            _lineEntries[i].label = -1;
-            _lineEntries[i].startOfLine = NULL;
-            continue;
-        }
+    return transaction;
+}
 
-        //
-        // Get LABEL
-        p = strchr(line, ':');
 
-        if (p)
-        {
-            int label;
+uint8_t MMScript_TransactionDone(const MMSCRIPT_TRANSACTION *transaction)
+{
+    return ATOMIC_LOAD(&transaction->done);
+}
 
-            *p = '\0';
 
-            if (sscanf(line, "%d", &label) != 1)
-            {
-                SAFE_FREE(_scriptBuf);
-                SAFE_FREE(_lineEntries);
-                return MMS_PARSE_ERR_MISSING_LABEL;
-            }
+void MMScript_SetBus(const MMSCRIPT_BUS *bus)
+{
+    _ctx->api = bus ? bus : &_api_bus;
+}
 
-            _lineEntries[i].label = label;
-            _lineEntries[i].startOfLine = p + 1;
-            SKIP_SPACE(_lineEntries[i].startOfLine);
 
-            if (_lineEntries[i].startOfLine == '\0')
-            {
-                SAFE_FREE(_scriptBuf);
-                SAFE_FREE(_lineEntries);
-                return MMS_PARSE_ERR_MISSING_COMMAND;
-            }
-        }
-        else
-        {
-            SAFE_FREE(_scriptBuf);
-            SAFE_FREE(_lineEntries);
-            return MMS_PARSE_ERR_MISSING_LABEL;
-        }
-    }
-    
-    _stack_pointer = -1;
+void MMScript_GetVariables(int16_t vars[26])
+{
+    memcpy(vars, _ctx->vars, sizeof(_ctx->vars));
+}
 
-    _stop = 0;
-    _nextLabel = _lineEntries[0].label; /* Label of first line */
 
-    return _nextLabel;
+void MMScript_SetApiLock(MMSCRIPT_API_LOCK acquire, MMSCRIPT_API_LOCK release)
+{
+    _api_acquire = acquire;
+    _api_release = release;
 }
 
 
-void MMScript_SetLabelToExec(int16_t label)
+void MMScript_GetStreamStats(MMSCRIPT_STREAM_STATS *stats)
 {
-    _nextLabel = label;
+    if (stats)
+        *stats = _ctx->stream_stats;
 }
 
 
-int16_t MMScript_ExecOneStep(MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_DELAY_MILLI_SECONDS DelayMilliSecondsImpl, MMSCRIPT_LOG log_func)
+void MMScript_GetGearStats(MMSCRIPT_GEAR_STATS *stats)
 {
-    uint16_t currLine;
-
-    if (_lineCount == 0 || _lineEntries == NULL)
-        return 0;
+    if (stats)
+        *stats = _ctx->gear_stats;
+}
 
-    /* Find line with label _nextLabel */
 
-    if (_nextLabel == -1)
-    {
-        currLine = 0;
-        _nextLabel = _lineEntries[0].label;
-    }
-    else
-    {
-        for (currLine=0; currLine<_lineCount; currLine++)
-        {
-            if (_lineEntries[currLine].label == _nextLabel)
-                break;
-        }
+void MMScript_SetTelemetry(uint8_t enabled)
+{
+    _ctx->telemetry = enabled;
+}
 
-        if (currLine == _lineCount)
-        {
-            /* NOT found */
-            return MMS_ERR_INVALID_LABEL;
-        }
-    }
 
-    int16_t ret = MMScript_ProcessLine(&currLine, &_nextLabel, local_error_callback, node_error_callback, DelayMilliSecondsImpl, log_func);
+uint8_t MMScript_PollTelemetry(uint8_t node_id, uint8_t with_position, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback)
+{
+    MMSCRIPT_NODE_STATUS status, previous;
+    uint8_t ret;
 
-    /* If negtive, indicates something error, return */
-    if (ret < 0)
-        return ret;
+    memset(&status, 0, sizeof(status));
 
-    /* NON negtive _nextLabel means next label or ended, while -1 for next line */
-    if (_nextLabel == -1)
-    {
-        currLine++;
+    ret = TIMED_CALL(_ctx->api->GetControlStatus(node_id, &status.status, &status.in_position, node_error_callback), node_id, 0);
 
-        while (currLine < _lineCount && _lineEntries[currLine].startOfLine == NULL)
-        {
-            currLine++;
-        }
+    if (ret != MMS_RESP_SUCCESS)
+        return ret;
 
-        if (currLine == _lineCount)
-        {
-            /* NO found */
-            return MMS_ERR_END;
-        }
+    if (with_position &&
+        TIMED_CALL(_ctx->api->GetAbsolutePosition(node_id, &status.position, node_error_callback), node_id, 0) == MMS_RESP_SUCCESS)
+        status.has_position = 1;
 
-        /* Return the label */
-        _nextLabel = _lineEntries[currLine].label;
+    status.sampled_us = _ctx->get_us ? _ctx->get_us() : 0;
 
+    if (status.has_position && MMScript_TelemetryRead(_ctx->bus, node_id, &previous) &&
+        previous.has_position && status.sampled_us > previous.sampled_us)
+    {
+        status.velocity = (int32_t)((int64_t)(status.position - previous.position) * 1000000 /
+                                    (int64_t)(status.sampled_us - previous.sampled_us));
+        status.has_velocity = 1;
     }
 
-    return _nextLabel;
+    MMScript_TelemetryPublish(_ctx->bus, node_id, &status);
+    MMScript_BlendStep(node_id, &status, node_error_callback);
+
+    return ret;
 }
 
 
-void MMScript_Rewind()
+void MMScript_PollGear(MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback)
 {
-    _stop = 0;
-    _nextLabel = -1;
-}
+    MMSCRIPT_GEAR_STATS *stats = &_ctx->gear_stats;
 
+    if (!_ctx->get_us)
+        return;
 
-void MMScript_Stop()
-{
-    _stop = 1;
-}
+    for (uint8_t i=0; i<MAX_GEAR_FOLLOWERS && !ATOMIC_LOAD(&_ctx->stop); i++)
+    {
+        GEAR_SLOT *slot = &_ctx->gear[i];
+        uint8_t follower = ATOMIC_LOAD(&slot->follower);
+        int32_t position;
+        int64_t setpoint;
+        uint64_t read_us, now, latency_us;
 
+        if (follower == 0)
+            continue;
 
-void MMScript_Clean()
-{
-    if (_scriptBuf)
-        free(_scriptBuf);
+        read_us = _ctx->get_us();
 
-    if (_lineEntries)
-        free(_lineEntries);
+        /* Not retried, the next poll supersedes it */
+        if (TIMED_CALL(_ctx->api->GetAbsolutePosition(slot->leader, &position, node_error_callback), slot->leader, 0) != MMS_RESP_SUCCESS)
+        {
+            stats->errors++;
+            continue;
+        }
 
-    _nextLabel = 0;
-    _lineCount = 0;
-}
+        /* The leader sampled its position about halfway through the round trip */
+        read_us += (_ctx->get_us() - read_us) / 2;
+        setpoint = slot->follower_origin + MMScript_GearOffset(slot, (int64_t)position - slot->leader_origin);
 
+        if (setpoint > INT32_MAX)
+            setpoint = INT32_MAX;
+        else if (setpoint < INT32_MIN)
+            setpoint = INT32_MIN;
 
+        if (TIMED_CALL(_ctx->api->AbsolutePositionMove(follower, (int32_t)setpoint, node_error_callback), follower, 0) != MMS_RESP_SUCCESS)
+        {
+            stats->errors++;
+            continue;
+        }
+
+        now = _ctx->get_us();
+        latency_us = now - read_us;
 
+        stats->updates++;
+        stats->total_latency_us += latency_us;
 
+        if (latency_us > stats->max_latency_us)
+            stats->max_latency_us = (uint32_t)latency_us;
+
+        if (slot->updated_us != 0 && now - slot->updated_us > stats->max_interval_us)
+            stats->max_interval_us = (uint32_t)(now - slot->updated_us);
+
+        slot->updated_us = now;
+    }
+}
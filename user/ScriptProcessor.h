@@ -9,6 +9,7 @@
 /* Includes ----------------------------------------------------------------*/
 
 #include "MemeServoAPI/MemeServoAPI.h"
+#include "ScriptCommands.h"
 
 
 /* Exported types ------------------------------------------------------------*/
@@ -16,9 +17,133 @@ typedef void (*MMSCRIPT_LOCAL_ERROR_CALLBACK)(uint8_t node_addr, uint8_t err);
 typedef void (*MMSCRIPT_NODE_ERROR_CALLBACK)(uint8_t node_addr, uint8_t err);
 typedef void (*MMSCRIPT_LOG)(uint8_t node_addr, const char *msg);
 typedef void (*MMSCRIPT_DELAY_MILLI_SECONDS)(uint32_t ms);
+typedef uint64_t (*MMSCRIPT_GET_MICRO_SECONDS)(void);
+typedef void (*MMSCRIPT_DELAY_UNTIL_MICRO_SECONDS)(uint64_t deadline_us);
+typedef void (*MMSCRIPT_API_LOCK)(void);
+
+/* Interpreter state of one bus, opaque */
+typedef struct MMSCRIPT_CONTEXT MMSCRIPT_CONTEXT;
+
+/* Bus commands of one script line, opaque */
+typedef struct MMSCRIPT_TRANSACTION MMSCRIPT_TRANSACTION;
+typedef void (*MMSCRIPT_SUBMIT)(MMSCRIPT_TRANSACTION *transaction);
+typedef void (*MMSCRIPT_WAIT_COMPLETION)(uint64_t deadline_us);
+
+/* Priority classes of transactions, served strictly in this order, see BusScheduler.h */
+typedef enum
+{
+    MMSCRIPT_PRIORITY_STOP = 0,     /* STOP, HALT */
+    MMSCRIPT_PRIORITY_MOTION,       /* VM, PVM, AP, PAP, RP, PRP */
+    MMSCRIPT_PRIORITY_CONFIG,       /* START */
+    MMSCRIPT_PRIORITY_POLL,         /* Status polls of WAIT, rate limited */
+    MMSCRIPT_PRIORITY_COUNT
+}   MMSCRIPT_PRIORITY;
+
+/* Retry classes, selected by the response code of a failed bus command */
+typedef enum
+{
+    MMSCRIPT_RETRY_CLASS_LINK = 0,      /* Timeout/checksum errors, i.e. frame lost on the bus */
+    MMSCRIPT_RETRY_CLASS_SERVO,         /* MMS_RESP_SERVO_ERROR, servo busy or in error state */
+    MMSCRIPT_RETRY_CLASS_COUNT
+}   MMSCRIPT_RETRY_CLASS;
+
+typedef struct
+{
+    uint16_t max_attempts;      /* 0: retry forever */
+    uint32_t initial_delay_ms;  /* Delay after the first failure, 0 for immediate retry */
+    uint32_t max_delay_ms;      /* Delay doubles on every failure up to this cap */
+    int16_t error_label;        /* >0: GOTO this label when attempts exhausted, otherwise abort */
+}   MMSCRIPT_RETRY_POLICY;
+
+typedef struct
+{
+    uint32_t frames;            /* In the file, or generated */
+    uint32_t sent;
+    uint32_t late;              /* Sent later than 10% of the period after their time */
+    uint32_t underruns;         /* Dropped, the next frame was already due */
+    uint32_t errors;            /* Setpoints the node didn't accept, not retried */
+    uint32_t max_late_us;
+}   MMSCRIPT_STREAM_STATS;
+
+typedef struct
+{
+    uint32_t updates;           /* Follower setpoints accepted */
+    uint32_t errors;            /* Leader position not read, or setpoint not accepted */
+    uint64_t total_latency_us;  /* From leader position sampled, mid-read, to follower setpoint accepted */
+    uint32_t max_latency_us;
+    uint32_t max_interval_us;   /* Between two setpoints of a follower */
+}   MMSCRIPT_GEAR_STATS;
+
+typedef struct
+{
+    uint8_t type;               /* MMSCRIPT_OP, see ScriptCommands.h */
+    uint8_t node;
+    int32_t args[3];
+}   MMSCRIPT_NATIVE_OP;
+
+/* State a compiled line works on, see MMScript_AttachNative() */
+typedef struct
+{
+    int16_t *vars;              /* 'A' to 'Z' */
+    int16_t nextLabel;          /* -1: next line, 0: END, >0: jump */
+    uint16_t nextLine;          /* Line of nextLabel if known, UINT16_MAX otherwise */
+    uint8_t opCount;            /* Bus commands for the interpreter to run, retried as its own */
+    MMSCRIPT_NATIVE_OP ops[16];     /* As many as the commands of one line */
+}   MMSCRIPT_NATIVE_FRAME;
+
+/* Compiled line, returns 0 or an exec error */
+typedef int16_t (*MMSCRIPT_NATIVE_LINE)(MMSCRIPT_NATIVE_FRAME *frame);
+
+/* Script compiled to C by mms2c, exported by its shared library as MMSCRIPT_NATIVE_SYMBOL */
+typedef struct
+{
+    uint16_t version;           /* MMSCRIPT_NATIVE_VERSION */
+    uint16_t line_count;        /* Lines of the script, as counted by MMScript_ParseScript() */
+    uint32_t hash;              /* MMScript_ScriptHash() of the script compiled */
+    const MMSCRIPT_NATIVE_LINE *lines;      /* By line, NULL for lines left to the interpreter */
+}   MMSCRIPT_NATIVE_PROGRAM;
+
+/* What MMScript_ParseScript() optimized, see MMScript_SetOptimize() */
+typedef struct
+{
+    uint16_t folded;            /* LET & IF of constant expressions evaluated once */
+    uint16_t merged_delays;     /* DELAY lines added to the DELAY before */
+    uint16_t threaded_jumps;    /* GOTO, IF, CALL & FORK to a GOTO retargeted, GOTO to END made END */
+    uint16_t inlined_calls;     /* CALL of a one line subroutine replaced by the line */
+    uint16_t removed_lines;     /* Unreachable, or folded IF never taken */
+}   MMSCRIPT_OPTIMIZE_REPORT;
+
+/* Node calls of the API as the interpreter makes them, see MMScript_SetBus(), return MMS_RESP_xxx */
+typedef struct
+{
+    uint8_t (*GetControlStatus)(uint8_t node_addr, uint8_t *status, uint8_t *in_position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*GetAbsolutePosition)(uint8_t node_addr, int32_t *position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*StartServo)(uint8_t node_addr, uint8_t mode, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*ResetError)(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*StopServo)(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*HaltServo)(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*SetProfileAcceleration)(uint8_t node_addr, uint32_t acceleration, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*SetProfileVelocity)(uint8_t node_addr, uint32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*ProfiledVelocityMove)(uint8_t node_addr, int32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*AbsolutePositionMove)(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*ProfiledAbsolutePositionMove)(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*RelativePositionMove)(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+    uint8_t (*ProfiledRelativePositionMove)(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+}   MMSCRIPT_BUS;
 
 /* Exported constants --------------------------------------------------------*/
 
+#define MMSCRIPT_MAX_BUSES  16
+
+#define MMSCRIPT_NATIVE_VERSION     1
+#define MMSCRIPT_NATIVE_SYMBOL      "mmscript_native_program"
+
+#if defined(_WIN32)
+#define MMSCRIPT_NATIVE_EXPORT      __declspec(dllexport)
+#else
+#define MMSCRIPT_NATIVE_EXPORT      __attribute__((visibility("default")))
+#endif
+
 
 /* Exported macro ------------------------------------------------------------*/
 
@@ -53,12 +178,38 @@ typedef void (*MMSCRIPT_DELAY_MILLI_SECONDS)(uint32_t ms);
 #define MMS_ERR_FULL_STACK            (int16_t)-26  /* Full Stack */
 #define MMS_ERR_EMPTY_STACK           (int16_t)-27  /* Empty Stack */
 #define MMS_ERR_MISSING_CALL_PARAM    (int16_t)-28  /* Missing Call Parm*/
+#define MMS_ERR_MISSING_RETRY_PARAM   (int16_t)-29  /* Missing/error parameters for RETRY */
+#define MMS_ERR_RETRY_EXHAUSTED       (int16_t)-30  /* Bus command failed after max attempts, no error label */
+#define MMS_ERR_MISSING_UDELAY_PARAM  (int16_t)-31  /* Missing parameter for UDELAY */
+#define MMS_ERR_MISSING_PERIOD_PARAM  (int16_t)-32  /* Missing parameter for PERIOD */
+#define MMS_ERR_MISSING_FORK_PARAM    (int16_t)-33  /* Missing/error parameter for FORK */
+#define MMS_ERR_FULL_TASKS            (int16_t)-34  /* Too many tasks alive for FORK */
+#define MMS_ERR_TOO_MANY_COMMANDS     (int16_t)-35  /* Too many commands in one line */
+#define MMS_ERR_MISSING_UNTIL_PARAM   (int16_t)-36  /* Missing/error parameters for UNTIL */
+#define MMS_ERR_NO_TELEMETRY          (int16_t)-37  /* UNTIL/BLEND without telemetry poller, or position not polled */
+#define MMS_ERR_MISSING_BLEND_PARAM   (int16_t)-38  /* Missing/error parameters for BLEND */
+#define MMS_ERR_FULL_BLEND            (int16_t)-39  /* Too many nodes in BLEND mode */
+#define MMS_ERR_MISSING_STREAM_PARAM  (int16_t)-40  /* Missing file of STREAM, or no time base */
+#define MMS_ERR_STREAM_FILE           (int16_t)-41  /* Trajectory file can't be mapped or invalid */
+#define MMS_ERR_MISSING_PATH_PARAM    (int16_t)-42  /* Missing/error parameters for SCURVE/SPLINE, or no time base */
+#define MMS_ERR_PATH_TOO_LONG         (int16_t)-43  /* Setpoints of SCURVE/SPLINE exceed MMSCRIPT_GEN_MAX_FRAMES or memory */
+#define MMS_ERR_MISSING_GEAR_PARAM    (int16_t)-44  /* Missing/error parameters for GEAR/CAM */
+#define MMS_ERR_FULL_GEAR             (int16_t)-45  /* Too many followers of GEAR/CAM */
+#define MMS_ERR_TABLE_INDEX           (int16_t)-46  /* Table not declared or index out of range */
+#define MMS_ERR_INVALID_FOR_PARAM     (int16_t)-47  /* Missing/error expressions of FOR, or STEP 0 */
+#define MMS_ERR_BUS_QUEUE_FULL        (int16_t)-48  /* Transaction refused by the executor, its queue is full */
+#define MMS_ERR_DIVISION_BY_ZERO      (int16_t)-49  /* Expression divided by 0 */
 
 /* Parse errors */
 #define MMS_PARSE_ERR_FILE            (int16_t)-101 /* File open error */
 #define MMS_PARSE_ERR_MALLOC          (int16_t)-102 /* Malloc failed */
 #define MMS_PARSE_ERR_MISSING_LABEL   (int16_t)-103 /* Missing label */
 #define MMS_PARSE_ERR_MISSING_COMMAND (int16_t)-104 /* Missing command */
+#define MMS_PARSE_ERR_TABLE           (int16_t)-105 /* Invalid TABLE, or its file can't be read */
+#define MMS_PARSE_ERR_LOOP            (int16_t)-106 /* FOR without NEXT, NEXT without FOR, or nested too deep */
+#define MMS_PARSE_ERR_NATIVE          (int16_t)-107 /* Native program of another script or version */
+#define MMS_PARSE_ERR_INCLUDE         (int16_t)-108 /* Included file can't be read, or included too deep */
+#define MMS_PARSE_ERR_DIRECTIVE       (int16_t)-109 /* Invalid #CONST/#MACRO/#INCLUDE, or macro called with other arguments */
 
 /* Exported functions ------------------------------------------------------- */
 
@@ -73,6 +224,29 @@ typedef void (*MMSCRIPT_DELAY_MILLI_SECONDS)(uint32_t ms);
 int16_t MMScript_ParseScript(char *script_buf, size_t buf_len);
 
 
+/**
+  * @brief  Set the file the scripts parsed next in the selected context are read from
+  * @note   Relative paths of TABLE ... FILE & STREAM are read from its directory, as #INCLUDE, instead of
+  *         the working directory.
+  * @param  path: script file, copied, NULL for the working directory
+  * @retval None
+  */
+void MMScript_SetScriptPath(const char *path);
+
+
+/**
+  * @brief  Get the path of the file named by a TABLE ... FILE or STREAM line of the selected context
+  * @note   The path is quoted if it has spaces, a relative one is joined to the directory of the script
+  *         set by MMScript_SetScriptPath().
+  * @param  params: parameters after FILE or STREAM
+  * @param  path: output of path
+  * @param  size: size of path
+  * @retval 0: succeeded
+  *         -1: missing, too long or followed by more parameters
+  */
+int16_t MMScript_FilePath(const char *params, char *path, size_t size);
+
+
 /**
   * @brief  Set the label to execute
   * @note
@@ -85,6 +259,8 @@ void MMScript_SetLabelToExec(int16_t label);
 /**
   * @brief  Execute oneline & return the next script line label
   * @note   This function should called to execute script step by step.
+  *         With tasks forked, one line of the next task due is executed, sleeping until one is due if needed,
+  *         & the label returned is the next one of the main task whichever task ran.
   * @param  local_error_callback: call back function for local error
   * @param  node_error_callback: call back function for servo error
   * @param  DelayMilliSecondsImpl: ms delay function pointer
@@ -111,6 +287,52 @@ void MMScript_Rewind();
 void MMScript_Stop();
 
 
+/**
+  * @brief  Set monotonic time base used by DELAY, UDELAY & PERIOD
+  * @note   Without a time base these fall back to the ms delay function of MMScript_ExecOneStep().
+  *         DELAY & UDELAY wait relative to now, only PERIOD compensates the time taken by the rest of a loop.
+  * @param  GetMicroSecondsImpl: monotonic us clock
+  * @param  DelayUntilMicroSecondsImpl: wait until the clock reaches deadline_us
+  * @retval None
+  */
+void MMScript_SetTimeBase(MMSCRIPT_GET_MICRO_SECONDS GetMicroSecondsImpl, MMSCRIPT_DELAY_UNTIL_MICRO_SECONDS DelayUntilMicroSecondsImpl);
+
+
+/**
+  * @brief  Set retry policy for failed bus commands
+  * @note   Scripts may override it with "RETRY" lines until rewound.
+  * @param  retry_class: class of errors the policy applies to
+  * @param  policy: policy to copy
+  * @retval None
+  */
+void MMScript_SetRetryPolicy(MMSCRIPT_RETRY_CLASS retry_class, const MMSCRIPT_RETRY_POLICY *policy);
+
+
+/**
+  * @brief  Get retry policy for failed bus commands
+  * @param  retry_class: class of errors the policy applies to
+  * @param  policy: output of current policy
+  * @retval None
+  */
+void MMScript_GetRetryPolicy(MMSCRIPT_RETRY_CLASS retry_class, MMSCRIPT_RETRY_POLICY *policy);
+
+
+/**
+  * @brief  Get statistics of the last STREAM, SCURVE or SPLINE of the selected context
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetStreamStats(MMSCRIPT_STREAM_STATS *stats);
+
+
+/**
+  * @brief  Get statistics of GEAR/CAM followers of the selected context since rewound
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetGearStats(MMSCRIPT_GEAR_STATS *stats);
+
+
 /**
   * @brief  Clean allocated space for script parser
   * @param  None
@@ -118,6 +340,239 @@ void MMScript_Stop();
   */
 void MMScript_Clean();
 
+
+/**
+  * @brief  Get number of lines of the script parsed, empty lines included
+  * @param  None
+  * @retval number of lines
+  */
+uint16_t MMScript_LineCount();
+
+
+/**
+  * @brief  Get a line of the script parsed, label & trailing ';' removed
+  * @param  index: line index, from 0
+  * @param  label: output of label, -1 for empty lines
+  * @retval text of line, NULL for empty lines or index out of range
+  */
+const char *MMScript_LineText(uint16_t index, int16_t *label);
+
+
+/**
+  * @brief  Get hash of the labels & lines of the script parsed
+  * @note   Identifies the script a native program was compiled from.
+  * @param  None
+  * @retval FNV-1a hash
+  */
+uint32_t MMScript_ScriptHash();
+
+
+/**
+  * @brief  Execute the compiled lines of a native program instead of interpreting them
+  * @note   Call this after MMScript_ParseScript(), which detaches it. Lines the program leaves NULL,
+  *         as well as tasks, delays, WAIT & retries of bus commands, are still run by the interpreter.
+  * @param  program: program compiled from the script parsed, NULL to detach
+  * @retval 0: succeeded
+  *         MMS_PARSE_ERR_NATIVE: compiled from another script or by another version
+  */
+int16_t MMScript_AttachNative(const MMSCRIPT_NATIVE_PROGRAM *program);
+
+
+/**
+  * @brief  Optimize the scripts parsed by MMScript_ParseScript() in the selected context, disabled by default
+  * @note   Constant LET & IF are folded, consecutive DELAYs merged, jump chains threaded, CALLs of one line
+  *         subroutines inlined & unreachable lines removed. Bus commands & their timing are unchanged but
+  *         lines merged or removed can't be jumped to by MMScript_SetLabelToExec(), nor by error labels set
+  *         by MMScript_SetRetryPolicy() after parsing. mms2c must optimize alike for MMScript_AttachNative().
+  * @param  enabled: non-zero to optimize
+  * @retval None
+  */
+void MMScript_SetOptimize(uint8_t enabled);
+
+
+/**
+  * @brief  Get what the last MMScript_ParseScript() of the selected context optimized
+  * @param  report: output of report, all 0 if not optimized
+  * @retval None
+  */
+void MMScript_GetOptimizeReport(MMSCRIPT_OPTIMIZE_REPORT *report);
+
+
+/**
+  * @brief  Create interpreter context for a bus
+  * @note   All other functions work on the context selected by the calling thread,
+  *         a default context (bus 0) is selected until MMScript_SelectContext() is called.
+  * @param  bus: bus index, less than MMSCRIPT_MAX_BUSES
+  * @retval context, NULL if bus invalid or malloc failed
+  */
+MMSCRIPT_CONTEXT *MMScript_CreateContext(uint8_t bus);
+
+
+/**
+  * @brief  Clean & free context created by MMScript_CreateContext()
+  * @param  ctx: context to destroy, must not be executing
+  * @retval None
+  */
+void MMScript_DestroyContext(MMSCRIPT_CONTEXT *ctx);
+
+
+/**
+  * @brief  Select context for the calling thread
+  * @param  ctx: context, NULL for the default context
+  * @retval None
+  */
+void MMScript_SelectContext(MMSCRIPT_CONTEXT *ctx);
+
+
+/**
+  * @brief  Get bus index of the context selected by the calling thread
+  * @param  None
+  * @retval bus index
+  */
+uint8_t MMScript_CurrentBus();
+
+
+/**
+  * @brief  Stop execution of context from any thread
+  * @param  ctx: context, NULL for the default context
+  * @retval None
+  */
+void MMScript_StopContext(MMSCRIPT_CONTEXT *ctx);
+
+
+/**
+  * @brief  Send node calls of the selected context to another bus than the API
+  * @note   For dry runs against simulated nodes, see VirtualBus.h. Frames of the API, e.g. the
+  *         global stop, are left alone.
+  * @param  bus: calls, NULL for the API
+  * @retval None
+  */
+void MMScript_SetBus(const MMSCRIPT_BUS *bus);
+
+
+/**
+  * @brief  Get variables of the selected context
+  * @param  vars: output of 'A' to 'Z'
+  * @retval None
+  */
+void MMScript_GetVariables(int16_t vars[26]);
+
+
+/**
+  * @brief  Set lock serializing bus commands of contexts sharing an API
+  * @note   The API has a single protocol state, so a command & its response must not
+  *         interleave with another bus using it. Buses given their own API instance with
+  *         MMScript_SetBus() (see ApiInstance.h) only need a lock per instance.
+  *         Delays, WAIT polling intervals & PERIOD run unlocked.
+  * @param  acquire: called before each command, NULL for single bus
+  * @param  release: called after its response or timeout
+  * @retval None
+  */
+void MMScript_SetApiLock(MMSCRIPT_API_LOCK acquire, MMSCRIPT_API_LOCK release);
+
+
+/**
+  * @brief  Run bus commands of the selected context asynchronously
+  * @note   A task executing a command line, a frame of a stream or WAIT hands its commands to submit()
+  *         & is parked, other tasks go on meanwhile. submit() must queue the transaction for a thread
+  *         which calls MMScript_RunTransaction(), then wakes up wait_completion(). Requires a time base.
+  *         The script ends once the transactions of all tasks completed, the main task's END included.
+  * @param  submit: queue transaction, called by the script thread, NULL to run commands in place
+  * @param  wait_completion: wait until deadline_us, a transaction completes or stop
+  * @retval None
+  */
+void MMScript_SetExecutor(MMSCRIPT_SUBMIT submit, MMSCRIPT_WAIT_COMPLETION wait_completion);
+
+
+/**
+  * @brief  Run a submitted transaction, blocking until its commands are done
+  * @note   Called by the executor thread, the parked task resumes once it returns.
+  * @param  transaction: transaction passed to submit()
+  * @retval None
+  */
+void MMScript_RunTransaction(MMSCRIPT_TRANSACTION *transaction, MMSCRIPT_LOCAL_ERROR_CALLBACK local_error_callback, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback, MMSCRIPT_DELAY_MILLI_SECONDS DelayMilliSecondsImpl, MMSCRIPT_LOG log_func);
+
+
+/**
+  * @brief  Complete a transaction without running it
+  * @note   For an executor which can't queue a transaction submitted, wake up wait_completion() next.
+  *         The task parked on it aborts the script with error, a frame of a stream is dropped.
+  * @param  transaction: transaction passed to submit() or of MMScript_PollTransaction()
+  * @param  error: MMS_ERR_xxx, e.g. MMS_ERR_BUS_QUEUE_FULL
+  * @retval None
+  */
+void MMScript_FailTransaction(MMSCRIPT_TRANSACTION *transaction, int16_t error);
+
+
+/**
+  * @brief  Get priority class of a transaction, the most urgent of its commands
+  * @param  transaction: transaction passed to submit()
+  * @retval priority class
+  */
+MMSCRIPT_PRIORITY MMScript_TransactionPriority(const MMSCRIPT_TRANSACTION *transaction);
+
+
+/**
+  * @brief  Get number of API calls of a transaction without retries, for bus time accounting
+  * @param  transaction: transaction passed to submit()
+  * @retval number of calls
+  */
+uint16_t MMScript_TransactionCalls(const MMSCRIPT_TRANSACTION *transaction);
+
+
+/**
+  * @brief  Get a transaction of the telemetry poller of the selected context
+  * @note   With an executor, the poller submits these instead of calling MMScript_PollGear() &
+  *         MMScript_PollTelemetry(), so that its polls & the moves of BLEND & GEAR are ordered with
+  *         the commands of the script. One of each per context, submit it again once done only.
+  * @param  node_id: node polled in turn, 0 for the GEAR/CAM followers
+  * @param  with_position: also read the absolute position
+  * @retval transaction, NULL if no follower is engaged
+  */
+MMSCRIPT_TRANSACTION *MMScript_PollTransaction(uint8_t node_id, uint8_t with_position);
+
+
+/**
+  * @brief  Check whether a transaction submitted completed
+  * @param  transaction: transaction passed to submit() or of MMScript_PollTransaction()
+  * @retval 1: completed, 0: queued or running
+  */
+uint8_t MMScript_TransactionDone(const MMSCRIPT_TRANSACTION *transaction);
+
+
+/**
+  * @brief  Let WAIT of the selected context read status from the telemetry table
+  * @note   A poller must then call MMScript_PollTelemetry() for the nodes watched
+  *         (see Telemetry.h), WAIT & servo error recovery don't poll the bus themselves.
+  *         Requires a time base.
+  * @param  enabled: non-zero if a poller runs for the bus
+  * @retval None
+  */
+void MMScript_SetTelemetry(uint8_t enabled);
+
+
+/**
+  * @brief  Poll status of node on the bus of the selected context & publish it
+  * @note   Called by the telemetry poller, serialized with other commands by the API lock.
+  *         Velocity is derived from the position polled last time.
+  *         Sends the next move queued for node in BLEND mode once it is close enough to its target.
+  * @param  node_id: node address
+  * @param  with_position: also read the absolute position
+  * @param  node_error_callback: node error callback
+  * @retval MMS_RESP_xxx of the control status command
+  */
+uint8_t MMScript_PollTelemetry(uint8_t node_id, uint8_t with_position, MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback);
+
+
+/**
+  * @brief  Read the position of each GEAR/CAM leader & send the setpoint of its follower
+  * @note   Called by the telemetry poller once per poll interval, before the node polled in turn,
+  *         so that followers are updated at the poll interval whatever the number of nodes watched.
+  * @param  node_error_callback: node error callback
+  * @retval None
+  */
+void MMScript_PollGear(MMSCRIPT_NODE_ERROR_CALLBACK node_error_callback);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,26 +2,98 @@
 #include "ScriptThread.h"
 
 #include <QTimer>
-#include <QDateTime>
-#include <QFile>
+#include <QElapsedTimer>
+
+#include <limits.h>
+#include <string.h>
 
 #include "ScriptProcessor.h"
+#include "RttEstimator.h"
 #include "MemeServoAPI/MemeServoAPI.h"
 
 
-ScriptThread* ScriptThread::_me = NULL;
+#define SPIN_THRESHOLD_US       300
+#define DISPATCH_INTERVAL_MS    1       // Latency of callbacks deferred in real-time mode
+
+
+QMutex ScriptThread::_apiMutex[MMSCRIPT_API_INSTANCES];
+std::atomic<ScriptThread*> ScriptThread::_apiOwner[MMSCRIPT_API_INSTANCES];
+thread_local ScriptThread* ScriptThread::_current = NULL;
+thread_local int ScriptThread::_producer = -1;
 
 
-ScriptThread::ScriptThread()
+ScriptThread::ScriptThread(uint8_t bus) :
+    _dispatcher(this),
+    _executor(this),
+    _poller(this)
 {
-    _me = this;
+    _bus = bus;
+    _api = MMScript_ApiInstance(bus);
+    _apiIndex = MMScript_ApiInstanceIndex(bus);
+    _context = MMScript_CreateContext(bus);
     _status = ScriptThread::NEW;
+    _result = 0;
+    _pause = false;
+    _stop = false;
+    _captureSend = false;
+    _deferCallbacks = false;
+    _deferredDropped = 0;
+    _async = false;
+    _completed = false;
+    _executorQuit = false;
+    _telemetryIntervalMs = 0;
+    _telemetryPosition = false;
+    _optimize = true;
+    _pollerQuit = false;
+    _dryRun = false;
+    memset(&_virtualConfig, 0, sizeof(_virtualConfig));
+    memset(&_sourceMap, 0, sizeof(_sourceMap));
+
+    _schedulerConfig.baud_rate = 0;
+    _schedulerConfig.poll_share_percent = MMSCRIPT_SCHEDULER_DEFAULT_POLL_SHARE;
+    MMScript_SchedulerInit(&_scheduler, &_schedulerConfig);
 }
 
 
 ScriptThread::~ScriptThread()
 {
-    MMScript_Clean();
+    MMScript_DestroyContext(_context);
+    MMScript_FreeSourceMap(&_sourceMap);
+
+    if (_native.isLoaded())
+        _native.unload();
+}
+
+
+uint8_t ScriptThread::bus() const
+{
+    return _bus;
+}
+
+
+// Instance whose script is executing on the calling thread
+ScriptThread* ScriptThread::current()
+{
+    return _current;
+}
+
+
+// Only the threads of one bus wait for each other, each bus has its API instance
+void ScriptThread::ApiAcquire()
+{
+    ScriptThread *self = current();
+
+    _apiMutex[self->_apiIndex].lock();
+    _apiOwner[self->_apiIndex] = self;
+}
+
+
+void ScriptThread::ApiRelease()
+{
+    ScriptThread *self = current();
+
+    _apiOwner[self->_apiIndex] = NULL;
+    _apiMutex[self->_apiIndex].unlock();
 }
 
 
@@ -31,41 +103,585 @@ void ScriptThread::DelayMilisecondImpl(uint32_t ms)
 }
 
 
+// Delay of script (DELAY, WAIT polling, retry backoff), returns at once on stop,
+// time spent paused doesn't count
+void ScriptThread::InterruptibleDelayImpl(uint32_t ms)
+{
+    DelayUntilMicroSecondsImpl(GetMicroSecondsImpl() + (uint64_t)ms * 1000);
+}
+
+
+// Sleep on the wait condition until SPIN_THRESHOLD_US before deadline, then spin,
+// since the scheduler can't be relied on to wake us up more precisely
+void ScriptThread::DelayUntilMicroSecondsImpl(uint64_t deadline_us)
+{
+    ScriptThread *self = current();
+    QMutexLocker locker(&self->_waitMutex);
+
+    while (!self->_stop)
+    {
+        if (self->_pause)
+        {
+            uint64_t pausedAt = GetMicroSecondsImpl();
+            locker.unlock();
+
+            if (!self->waitWhilePaused())
+                return;
+
+            locker.relock();
+            deadline_us += GetMicroSecondsImpl() - pausedAt;
+        }
+
+        uint64_t now = GetMicroSecondsImpl();
+
+        if (now >= deadline_us)
+        {
+            self->_jitter.record((int64_t)(now - deadline_us));
+            break;
+        }
+
+        uint64_t left = deadline_us - now;
+
+        if (left >= SPIN_THRESHOLD_US + 1000)
+        {
+            self->_waitCondition.wait(&self->_waitMutex, (unsigned long)((left - SPIN_THRESHOLD_US) / 1000));
+        }
+        else if (left > SPIN_THRESHOLD_US)
+        {
+            locker.unlock();
+            QThread::usleep((unsigned long)(left - SPIN_THRESHOLD_US));
+            locker.relock();
+        }
+        else
+        {
+            locker.unlock();
+
+            while (GetMicroSecondsImpl() < deadline_us && !self->_stop && !self->_pause)
+                ;
+
+            locker.relock();
+        }
+    }
+}
+
+
+// Submitted by the script thread, see MMScript_SetExecutor()
+void ScriptThread::SubmitImpl(MMSCRIPT_TRANSACTION *transaction)
+{
+    ScriptThread *self = current();
+    QMutexLocker locker(&self->_queueMutex);
+
+    if (MMScript_SchedulerPush(&self->_scheduler, transaction, MMScript_TransactionPriority(transaction),
+                               MMScript_TransactionCalls(transaction), GetMicroSecondsImpl()))
+    {
+        self->_queueCondition.wakeOne();
+        return;
+    }
+
+    locker.unlock();
+
+    // Class full, completed as failed for the task or poller waiting on it
+    Log(0, QObject::tr("Bus queue full, transaction dropped").toStdString().c_str());
+    MMScript_FailTransaction(transaction, MMS_ERR_BUS_QUEUE_FULL);
+
+    QMutexLocker wait(&self->_waitMutex);
+
+    self->_completed = true;
+    self->_waitCondition.wakeAll();
+    self->_pollerCondition.wakeAll();
+}
+
+
+// All tasks parked or sleeping, wait for the first due or a completed transaction
+void ScriptThread::WaitCompletionImpl(uint64_t deadline_us)
+{
+    ScriptThread *self = current();
+    QMutexLocker locker(&self->_waitMutex);
+
+    while (!self->_completed && !self->_stop)
+    {
+        uint64_t now = GetMicroSecondsImpl();
+
+        if (now >= deadline_us)
+            break;
+
+        uint64_t left_ms = (deadline_us - now + 999) / 1000;
+        self->_waitCondition.wait(&self->_waitMutex, (deadline_us == UINT64_MAX || left_ms > ULONG_MAX) ? ULONG_MAX : (unsigned long)left_ms);
+    }
+
+    self->_completed = false;
+}
+
+
+// Timeline of a dry run, on the script thread
+void ScriptThread::TraceImpl(const MMSCRIPT_VIRTUAL_EVENT *event)
+{
+    current()->_trace(*event);
+}
+
+
+// Retry backoff of the executor, returns at once on stop
+void ScriptThread::ExecutorDelayImpl(uint32_t ms)
+{
+    ScriptThread *self = current();
+    uint64_t deadline_us = GetMicroSecondsImpl() + (uint64_t)ms * 1000;
+    QMutexLocker locker(&self->_waitMutex);
+
+    while (!self->_stop)
+    {
+        uint64_t now = GetMicroSecondsImpl();
+
+        if (now >= deadline_us)
+            break;
+
+        self->_waitCondition.wait(&self->_waitMutex, (unsigned long)((deadline_us - now + 999) / 1000));
+    }
+}
+
+
+void ScriptThread::Executor::run()
+{
+    MMSCRIPT_TRANSACTION *transaction;
+
+    _current = _owner;
+    _producer = PRODUCER_EXECUTOR;
+
+    if (_owner->_rtConfig.enabled)
+    {
+        QString error;
+
+        if (!RealTime::applyToCurrentThread(_owner->_rtConfig, &error))
+            Log(0, QObject::tr("Real-time mode of executor: %1").arg(error).toStdString().c_str());
+    }
+
+    for (;;)
+    {
+        {
+            QMutexLocker queue(&_owner->_queueMutex);
+
+            for (;;)
+            {
+                uint64_t wake_us;
+
+                // Transactions left over belong to tasks of an ended script
+                if (_owner->_executorQuit)
+                    return;
+
+                transaction = MMScript_SchedulerPop(&_owner->_scheduler, GetMicroSecondsImpl(), &wake_us);
+
+                if (transaction)
+                    break;
+
+                if (wake_us == UINT64_MAX)
+                {
+                    _owner->_queueCondition.wait(&_owner->_queueMutex);
+                }
+                else
+                {
+                    uint64_t now = GetMicroSecondsImpl();
+
+                    if (wake_us > now)
+                        _owner->_queueCondition.wait(&_owner->_queueMutex, (unsigned long)((wake_us - now + 999) / 1000));
+                }
+            }
+        }
+
+        uint64_t start_us = GetMicroSecondsImpl();
+        MMScript_RunTransaction(transaction, OnLocalError, OnNodeError, ExecutorDelayImpl, Log);
+        uint64_t end_us = GetMicroSecondsImpl();
+
+        {
+            QMutexLocker queue(&_owner->_queueMutex);
+            MMScript_SchedulerDone(&_owner->_scheduler, start_us, end_us);
+        }
+
+        QMutexLocker locker(&_owner->_waitMutex);
+
+        _owner->_completed = true;
+        _owner->_waitCondition.wakeAll();
+        _owner->_pollerCondition.wakeAll();
+    }
+}
+
+
+// Keeps polling while the script is paused, so that status stays live
+void ScriptThread::Poller::run()
+{
+    uint8_t node = 0;
+
+    _current = _owner;
+    _producer = PRODUCER_POLLER;
+    MMScript_SelectContext(_owner->_context);
+
+    if (_owner->_rtConfig.enabled)
+    {
+        QString error;
+
+        // Same priority as the script thread, which waits for the API while we poll
+        if (!RealTime::applyToCurrentThread(_owner->_rtConfig, &error))
+            Log(0, QObject::tr("Real-time mode of poller: %1").arg(error).toStdString().c_str());
+    }
+
+    QMutexLocker locker(&_owner->_waitMutex);
+
+    while (!_owner->_pollerQuit)
+    {
+        locker.unlock();
+
+        // Followers of GEAR/CAM every interval, then one node in turn
+        node = MMScript_TelemetryNextNode(_owner->_bus, node);
+
+        if (_owner->_async)
+        {
+            // Run by the executor, ordered with the commands of the script
+            MMSCRIPT_TRANSACTION *gear = MMScript_PollTransaction(0, 0);
+            MMSCRIPT_TRANSACTION *poll = (node != 0) ? MMScript_PollTransaction(node, _owner->_telemetryPosition) : NULL;
+
+            if (gear)
+                SubmitImpl(gear);
+
+            if (poll)
+                SubmitImpl(poll);
+
+            locker.relock();
+
+            while (!_owner->_pollerQuit && ((gear && !MMScript_TransactionDone(gear)) || (poll && !MMScript_TransactionDone(poll))))
+                _owner->_pollerCondition.wait(&_owner->_waitMutex);
+
+            locker.unlock();
+        }
+        else
+        {
+            MMScript_PollGear(OnNodeError);
+
+            if (node != 0)
+                MMScript_PollTelemetry(node, _owner->_telemetryPosition, OnNodeError);
+        }
+
+        uint64_t deadline_us = GetMicroSecondsImpl() + (uint64_t)_owner->_telemetryIntervalMs * 1000;
+
+        locker.relock();
+
+        // Own condition, only quit wakes it up: the interval holds whatever the script does
+        for (uint64_t now = GetMicroSecondsImpl(); !_owner->_pollerQuit && now < deadline_us; now = GetMicroSecondsImpl())
+            _owner->_pollerCondition.wait(&_owner->_waitMutex, (unsigned long)((deadline_us - now + 999) / 1000));
+    }
+}
+
+
+// Block while paused, returns false if stopped
+bool ScriptThread::waitWhilePaused()
+{
+    QMutexLocker locker(&_waitMutex);
+
+    if (_pause && !_stop)
+    {
+        _status = ScriptThread::PAUSED;
+
+        while (_pause && !_stop)
+            _waitCondition.wait(&_waitMutex);
+
+        _status = ScriptThread::RUNNING;
+    }
+
+    return !_stop;
+}
+
+
 uint32_t ScriptThread::GetMilliSecondsImpl()
 {
-    static uint64_t startTime = QDateTime::currentMSecsSinceEpoch();
+    return (uint32_t)(GetMicroSecondsImpl() / 1000);
+}
+
+
+// Monotonic, unaffected by wall clock adjustments
+uint64_t ScriptThread::GetMicroSecondsImpl()
+{
+    static struct StartedTimer
+    {
+        QElapsedTimer timer;
+        StartedTimer() { timer.start(); }
+    }   clock;
 
-    return (uint32_t)(QDateTime::currentMSecsSinceEpoch() - startTime);
+    return (uint64_t)(clock.timer.nsecsElapsed() / 1000);
 }
 
 
 void ScriptThread::onSerialData(uint8_t data)
 {
-    MMS_OnData(data);
+    if (_apiOwner[_apiIndex] == this)
+        _api->OnData(data);
 }
 
 
+// Shared by the API instances, called by the thread holding the instance
 void ScriptThread::SendDataImpl(uint8_t addr, uint8_t *data, uint8_t size)
 {
-    _me->_sendDataCallback(addr, data, size);
+    ScriptThread *self = current();
+
+    if (self->_captureSend)
+    {
+        self->_globalStopFrame.assign(data, data + size);
+        return;
+    }
+
+    // Frame not sent, e.g. transmit queue full: reported, the command then times out
+    if (!self->_sendDataCallback(addr, data, size))
+    {
+        if (self->_deferCallbacks)
+            self->defer(DeferredEvent::LOCAL_ERROR, addr, MMS_RESP_FAIL, NULL);
+        else
+            self->_localErrorCallback(addr, MMS_RESP_FAIL);
+    }
 }
 
 
 void ScriptThread::OnLocalError(uint8_t addr, uint8_t err)
 {
-    _me->_localErrorCallback(addr, err);
+    ScriptThread *self = current();
+
+    if (self->_deferCallbacks)
+        self->defer(DeferredEvent::LOCAL_ERROR, addr, err, NULL);
+    else
+        self->_localErrorCallback(addr, err);
 }
 
 
 void ScriptThread::OnNodeError(uint8_t addr, uint8_t err)
 {
-    _me->_nodeErrorCallback(addr, err);
+    ScriptThread *self = current();
+
+    if (self->_deferCallbacks)
+        self->defer(DeferredEvent::NODE_ERROR, addr, err, NULL);
+    else
+        self->_nodeErrorCallback(addr, err);
 }
 
 
 void ScriptThread::Log(unsigned char node_addr, const char* msg)
 {
-    _me->_log(node_addr, msg);
+    ScriptThread *self = current();
+
+    if (self->_deferCallbacks)
+        self->defer(DeferredEvent::LOG, node_addr, 0, msg);
+    else
+        self->_log(node_addr, msg);
+}
+
+
+void ScriptThread::notifyLabel(int16_t label)
+{
+    if (_deferCallbacks)
+        defer(DeferredEvent::LABEL, 0, label, NULL);
+    else
+        _labelUpdateCallback(label);
+}
+
+
+// Queue a callback for the dispatcher in the ring of the calling thread, without lock
+void ScriptThread::defer(DeferredEvent::TYPE type, uint8_t node, int16_t value, const char *msg)
+{
+    DeferredEvent event;
+
+    event.type = type;
+    event.node = node;
+    event.value = value;
+    event.msg[0] = '\0';
+
+    if (msg)
+    {
+        strncpy(event.msg, msg, sizeof(event.msg) - 1);
+        event.msg[sizeof(event.msg) - 1] = '\0';
+    }
+
+    // Other threads have no ring, sharing one would break its single producer
+    if (_producer < 0 || !_deferredEvents[_producer].push(event))
+        _deferredDropped++;
+}
+
+
+// Polls the rings rather than being woken, so that producers never take a lock. Events
+// of a thread keep their order, those of different threads only roughly.
+void ScriptThread::Dispatcher::run()
+{
+    DeferredEvent event;
+    bool quit = false;
+
+    for (;;)
+    {
+        bool idle = true;
+
+        for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+        {
+            while (_owner->_deferredEvents[producer].pop(event))
+            {
+                idle = false;
+
+                switch (event.type)
+                {
+                case DeferredEvent::LABEL:
+                    _owner->_labelUpdateCallback(event.value);
+                    break;
+                case DeferredEvent::LOCAL_ERROR:
+                    _owner->_localErrorCallback(event.node, (uint8_t)event.value);
+                    break;
+                case DeferredEvent::NODE_ERROR:
+                    _owner->_nodeErrorCallback(event.node, (uint8_t)event.value);
+                    break;
+                case DeferredEvent::LOG:
+                    _owner->_log(event.node, event.msg);
+                    break;
+                case DeferredEvent::QUIT:
+                    quit = true;
+                    break;
+                }
+            }
+        }
+
+        // Pushed once the other producers have ended, their rings are drained by now
+        if (quit)
+            return;
+
+        if (idle)
+            QThread::msleep(DISPATCH_INTERVAL_MS);
+    }
+}
+
+
+void ScriptThread::setRealTimeConfig(const RealTimeConfig &config)
+{
+    _rtConfig = config;
+}
+
+
+void ScriptThread::setAsyncExecution(bool enabled)
+{
+    _async = enabled;
+}
+
+
+void ScriptThread::setBusScheduling(uint32_t baudRate, uint8_t pollSharePercent)
+{
+    _schedulerConfig.baud_rate = baudRate;
+    _schedulerConfig.poll_share_percent = pollSharePercent;
+}
+
+
+MMSCRIPT_SCHEDULER_STATS ScriptThread::schedulerStats(MMSCRIPT_PRIORITY priority) const
+{
+    MMSCRIPT_SCHEDULER_STATS stats;
+
+    memset(&stats, 0, sizeof(stats));
+    MMScript_GetSchedulerStats(&_scheduler, priority, &stats);
+
+    return stats;
+}
+
+
+void ScriptThread::setTelemetryPolling(uint32_t intervalMs, bool withPosition)
+{
+    _telemetryIntervalMs = intervalMs;
+    _telemetryPosition = withPosition;
+}
+
+
+void ScriptThread::setOptimization(bool enabled)
+{
+    _optimize = enabled;
+}
+
+
+MMSCRIPT_OPTIMIZE_REPORT ScriptThread::optimizeReport() const
+{
+    MMSCRIPT_OPTIMIZE_REPORT report;
+
+    MMScript_SelectContext(_context);
+    MMScript_GetOptimizeReport(&report);
+    MMScript_SelectContext(NULL);
+
+    return report;
+}
+
+
+void ScriptThread::setDryRun(bool enabled, const MMSCRIPT_VIRTUAL_CONFIG &config, TRACE_CB trace)
+{
+    _dryRun = enabled;
+    _virtualConfig = config;
+    _trace = trace;
+}
+
+
+MMSCRIPT_VIRTUAL_STATS ScriptThread::virtualStats() const
+{
+    MMSCRIPT_VIRTUAL_STATS stats;
+
+    MMScript_GetVirtualStats(_bus, &stats);
+
+    return stats;
+}
+
+
+bool ScriptThread::virtualNode(uint8_t node, int32_t *position, uint8_t *status) const
+{
+    return _dryRun && MMScript_VirtualNode(_bus, node, position, status) != 0;
+}
+
+
+std::vector<int16_t> ScriptThread::variables() const
+{
+    std::vector<int16_t> vars(26);
+
+    MMScript_SelectContext(_context);
+    MMScript_GetVariables(vars.data());
+    MMScript_SelectContext(NULL);
+
+    return vars;
+}
+
+
+QString ScriptThread::source(int16_t label) const
+{
+    QString where;
+
+    MMScript_SelectContext(_context);
+
+    for (uint16_t i = 0; i < MMScript_LineCount(); i++)
+    {
+        int16_t lineLabel;
+        uint16_t line;
+        const char *file;
+
+        if (MMScript_LineText(i, &lineLabel) != NULL && lineLabel == label &&
+            (file = MMScript_SourceLine(&_sourceMap, i, &line)) != NULL)
+        {
+            where = QString("%1:%2").arg(QString::fromLocal8Bit(file)).arg(line);
+            break;
+        }
+    }
+
+    MMScript_SelectContext(NULL);
+    return where;
+}
+
+
+QString ScriptThread::errorSource() const
+{
+    if (_sourceMap.file_count == 0 || _sourceMap.error.line == 0)
+        return QString();
+
+    return QString("%1:%2").arg(QString::fromLocal8Bit(_sourceMap.files[_sourceMap.error.file])).arg(_sourceMap.error.line);
+}
+
+
+void ScriptThread::watchNode(uint8_t node)
+{
+    MMScript_TelemetryWatch(_bus, node);
+}
+
+
+bool ScriptThread::nodeStatus(uint8_t node, MMSCRIPT_NODE_STATUS *status) const
+{
+    return MMScript_TelemetryRead(_bus, node, status) != 0;
 }
 
 
@@ -75,13 +691,49 @@ ScriptThread::STATUS ScriptThread::status() const
 }
 
 
+int16_t ScriptThread::result() const
+{
+    return _result;
+}
+
+
 int16_t ScriptThread::init(QString scriptFileName, LABEL_UPDATE_CB labelUpdateCallback, SEND_DATA_CB sendDataCallback, LOCAL_ERROR_CB localErrorCallback, NODE_ERROR_CB nodeErrorCallback, LOG_FUNC log)
 {
     _status = ScriptThread::INIT;
 
-    MMS_SetProtocol(MMS_PROTOCOL_UART, 0x01, SendDataImpl, NULL);
-    MMS_SetTimerFunction(GetMilliSecondsImpl, DelayMilisecondImpl);
-    MMS_SetCommandTimeOut(100);
+    MMScript_SelectContext(_context);
+    MMScript_SetApiLock(ApiAcquire, ApiRelease);
+
+    // Dry run: node calls answered by simulated nodes, on a virtual clock
+    if (_dryRun)
+        MMScript_SetTimeBase(MMScript_VirtualMicroSeconds, MMScript_VirtualDelayUntil);
+    else
+        MMScript_SetTimeBase(GetMicroSecondsImpl, DelayUntilMicroSecondsImpl);
+
+    MMScript_SetBus(_dryRun ? MMScript_VirtualBus() : &_api->calls);
+
+    {
+        // Calls of the API come back to SendDataImpl() on the calling thread
+        ScriptThread *previous = _current;
+        _current = this;
+
+        ApiAcquire();
+
+        _api->SetProtocol(0x01, SendDataImpl);
+        _api->SetTimerFunction(GetMilliSecondsImpl, DelayMilisecondImpl);
+        MMScript_RttInit(_dryRun ? MMScript_VirtualMicroSeconds : GetMicroSecondsImpl, _api->SetCommandTimeOut, NULL);
+        MMScript_TelemetryReset(_bus);
+
+        // Capture the global stop frame while the API is idle, so that an emergency
+        // stop can be put on the wire from another thread without re-entering the API
+        _globalStopFrame.clear();
+        _captureSend = true;
+        _api->GlobalStop();
+        _captureSend = false;
+
+        ApiRelease();
+        _current = previous;
+    }
 
     _labelUpdateCallback = labelUpdateCallback;
     _sendDataCallback = sendDataCallback;
@@ -90,56 +742,172 @@ int16_t ScriptThread::init(QString scriptFileName, LABEL_UPDATE_CB labelUpdateCa
     _log = log;
 
 
-    QFile inFile(scriptFileName);
+    // Constants, macros & includes resolved before parsing, see errorSource() on failure
+    MMScript_FreeSourceMap(&_sourceMap);
 
-    if (!inFile.open(QIODevice::ReadOnly))
-        QThread::exit(-1);
+    char *rawData;
+    size_t size;
+    _startLabel = MMScript_Preprocess(scriptFileName.toLocal8Bit().constData(), &rawData, &size, &_sourceMap);
 
-    int fileSize = inFile.size();
-    char *rawData = (char *)malloc(fileSize + 1);
-    inFile.read(rawData, fileSize);
-    rawData[fileSize] = '\0';
+    if (_startLabel == 0)
+    {
+        _sourceMap.error.line = 0;
+        MMScript_SetOptimize(_optimize);
+        MMScript_SetScriptPath(scriptFileName.toLocal8Bit().constData());
+        _startLabel = MMScript_ParseScript(rawData, size);
+    }
 
-    _startLabel = MMScript_ParseScript(rawData, fileSize + 1);
+    MMScript_SelectContext(NULL);
     return _startLabel;
 }
 
 
-void ScriptThread::run()
+int16_t ScriptThread::loadNative(QString libraryFileName)
 {
-    _status = ScriptThread::RUNNING;
+    MMScript_SelectContext(_context);
+    MMScript_AttachNative(NULL);
+
+    if (_native.isLoaded())
+        _native.unload();
 
+    _native.setFileName(libraryFileName);
+
+    const MMSCRIPT_NATIVE_PROGRAM *program = (const MMSCRIPT_NATIVE_PROGRAM *)_native.resolve(MMSCRIPT_NATIVE_SYMBOL);
+    int16_t ret = program ? MMScript_AttachNative(program) : MMS_PARSE_ERR_FILE;
+
+    if (ret != 0 && _native.isLoaded())
+        _native.unload();
+
+    MMScript_SelectContext(NULL);
+    return ret;
+}
+
+
+void ScriptThread::run()
+{
     _stop = false;
     _pause = false;
+    _status = ScriptThread::RUNNING;
+
+    _jitter.reset();
+    _deferredDropped = 0;
+
+    MMScript_SelectContext(_context);
+    _current = this;
+    _producer = PRODUCER_SCRIPT;
+
+    if (_rtConfig.enabled)
+    {
+        QString error;
+
+        if (!RealTime::applyToCurrentThread(_rtConfig, &error))
+            Log(0, QObject::tr("Real-time mode: %1").arg(error).toStdString().c_str());
+
+        // Everything allocating from here on goes through the dispatcher
+        for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+            _deferredEvents[producer].clear();
+
+        _dispatcher.start();
+        _deferCallbacks = true;
+    }
+
+    // Transactions & polls of threads would take real time
+    bool async = _async && !_dryRun;
+    bool poller = _telemetryIntervalMs > 0 && !_dryRun;
 
-    while (_semResume.available())
+    if (_dryRun)
     {
-        _semResume.acquire();
+        _virtualConfig.telemetry = _telemetryIntervalMs > 0;
+        _virtualConfig.with_position = _telemetryPosition;
+        MMScript_VirtualInit(_bus, &_virtualConfig, _trace ? TraceImpl : NULL);
     }
 
+    if (async)
+    {
+        MMScript_SchedulerInit(&_scheduler, &_schedulerConfig);
+        _executorQuit = false;
+        _completed = false;
+        _executor.start();
+    }
+
+    MMScript_SetExecutor(async ? SubmitImpl : NULL, WaitCompletionImpl);
+    MMScript_SetTelemetry(_telemetryIntervalMs > 0);
     MMScript_Rewind();
 
+    // After the rewind, the poller sends moves queued by BLEND
+    if (poller)
+    {
+        _pollerQuit = false;
+        _poller.start();
+    }
+
     int16_t nextLabel = _startLabel;
+    bool stopped = false;
 
     while (nextLabel > 0)
     {
-        if (_pause)
+        if (!waitWhilePaused())
         {
-            _pause = false;
-            _status = ScriptThread::PAUSED;
-            _semResume.acquire();
-            _status = ScriptThread::RUNNING;
+            stopped = true;
+            break;
         }
 
-        if (_stop)
+        // Virtual time given to the dry run is over, as if the script had ended there
+        if (_dryRun && !MMScript_VirtualLine(nextLabel))
         {
-            _status = ScriptThread::STOPPED;
-            QThread::exit(0);
-            return;
+            nextLabel = 0;
+            break;
+        }
+
+        notifyLabel(nextLabel);
+        nextLabel = MMScript_ExecOneStep(OnLocalError, OnNodeError, _dryRun ? MMScript_VirtualDelay : InterruptibleDelayImpl, Log);
+    }
+
+    _result = nextLabel;
+
+    if (async)
+    {
+        // Parked tasks are gone, let the transaction in progress finish
+        {
+            QMutexLocker queue(&_queueMutex);
+
+            _executorQuit = true;
+            _queueCondition.wakeAll();
+        }
+
+        _executor.wait();
+    }
+
+    if (poller)
+    {
+        {
+            QMutexLocker locker(&_waitMutex);
+
+            _pollerQuit = true;
+            _pollerCondition.wakeAll();
         }
 
-        _labelUpdateCallback(nextLabel);
-        nextLabel = MMScript_ExecOneStep(OnLocalError, OnNodeError, DelayMilisecondImpl, Log);
+        _poller.wait();
+    }
+
+    if (_deferCallbacks)
+    {
+        // Executor & poller are done, let the dispatcher drain, then go on invoking callbacks directly
+        DeferredEvent quit;
+        quit.type = DeferredEvent::QUIT;
+
+        while (!_deferredEvents[PRODUCER_SCRIPT].push(quit))
+            QThread::msleep(1);
+
+        _dispatcher.wait();
+        _deferCallbacks = false;
+    }
+
+    if (stopped)
+    {
+        _status = ScriptThread::STOPPED;
+        QThread::exit(0);
+        return;
     }
 
     _status = ScriptThread::STOPPED;
@@ -148,6 +916,42 @@ void ScriptThread::run()
     QString msg = QObject::tr("MMScript_ExecOneStep returned: %1").arg(nextLabel);
     Log(0, msg.toStdString().c_str());
 
+    Log(0, _jitter.report().toStdString().c_str());
+
+    if (_deferredDropped > 0)
+        Log(0, QObject::tr("Callbacks dropped in real-time mode: %1").arg(_deferredDropped.load()).toStdString().c_str());
+
+    for (int node = 1; node < 256; node++)
+    {
+        MMSCRIPT_RTT_STATS stats;
+        MMScript_GetRttStats((uint8_t)node, &stats);
+
+        if (stats.samples == 0 && stats.timeouts == 0)
+            continue;
+
+        msg = QObject::tr("RTT samples: %1, timeouts: %2, min/avg/max: %3/%4/%5us, var: %6us, timeout: %7ms")
+                .arg(stats.samples).arg(stats.timeouts)
+                .arg(stats.min_rtt_us).arg(stats.srtt_us).arg(stats.max_rtt_us)
+                .arg(stats.rttvar_us).arg(stats.timeout_ms);
+        Log((uint8_t)node, msg.toStdString().c_str());
+    }
+
+    static const char *PRIORITY_NAMES[MMSCRIPT_PRIORITY_COUNT] = { "Stop", "Motion", "Config", "Poll" };
+
+    for (int priority = 0; async && priority < MMSCRIPT_PRIORITY_COUNT; priority++)
+    {
+        MMSCRIPT_SCHEDULER_STATS stats = schedulerStats((MMSCRIPT_PRIORITY)priority);
+
+        if (stats.transactions == 0)
+            continue;
+
+        msg = QObject::tr("%1 transactions: %2, latency avg/max: %3/%4us, bus time: %5us, wire time: %6us")
+                .arg(PRIORITY_NAMES[priority]).arg(stats.transactions)
+                .arg((quint64)(stats.total_latency_us / stats.transactions)).arg(stats.max_latency_us)
+                .arg((quint64)stats.busy_us).arg((quint64)stats.wire_us);
+        Log(0, msg.toStdString().c_str());
+    }
+
     // Notify main thread
     _labelUpdateCallback(0);
 }
@@ -155,35 +959,79 @@ void ScriptThread::run()
 
 void ScriptThread::pause()
 {
-    while (_semResume.available())
-    {
-        _semResume.acquire();
-    }
+    QMutexLocker locker(&_waitMutex);
 
     _pause = true;
+    _waitCondition.wakeAll();
 }
 
 
 void ScriptThread::resume()
 {
-   if (_semResume.available() == 0)
-       _semResume.release();
+    QMutexLocker locker(&_waitMutex);
+
+    _pause = false;
+    _waitCondition.wakeAll();
 }
 
 
-void ScriptThread::stop()
+const std::vector<uint8_t>& ScriptThread::globalStopFrame() const
 {
-    if (_status == ScriptThread::NEW || _status == ScriptThread::INIT || _status == ScriptThread::STOPPED)
-        return; // NOT running or paused, just return
+    return _globalStopFrame;
+}
 
-    MMScript_Stop();
 
-    // Soft stop
+// Valid once the run has ended
+const JitterStats& ScriptThread::jitterStats() const
+{
+    return _jitter;
+}
+
+
+MMSCRIPT_STREAM_STATS ScriptThread::streamStats() const
+{
+    MMSCRIPT_STREAM_STATS stats;
+
+    MMScript_SelectContext(_context);
+    MMScript_GetStreamStats(&stats);
+    MMScript_SelectContext(NULL);
+
+    return stats;
+}
+
+
+MMSCRIPT_GEAR_STATS ScriptThread::gearStats() const
+{
+    MMSCRIPT_GEAR_STATS stats;
+
+    MMScript_SelectContext(_context);
+    MMScript_GetGearStats(&stats);
+    MMScript_SelectContext(NULL);
+
+    return stats;
+}
+
+
+// Ask the script to stop without waiting for it to unwind
+void ScriptThread::requestStop()
+{
+    MMScript_StopContext(_context);
+
+    // Soft stop, wakes up any delay or pause at once
+    QMutexLocker locker(&_waitMutex);
+
     _stop = true;
-    _semResume.release();
+    _waitCondition.wakeAll();
+}
+
+
+void ScriptThread::stop()
+{
+    if (_status == ScriptThread::NEW || _status == ScriptThread::INIT || _status == ScriptThread::STOPPED)
+        return; // NOT running or paused, just return
 
-    while (status() != ScriptThread::STOPPED)
-        QThread::msleep(100);
+    requestStop();
+    QThread::wait();
 
     /*
     // Hard stop
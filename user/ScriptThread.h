@@ -2,12 +2,28 @@
 #define SCRIPTTHREAD_H
 
 #include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 #include <QSemaphore>
-#include <QSerialPort>
+#include <QLibrary>
 
+#include <atomic>
 #include <functional>
+#include <vector>
 
+#include "RealTime.h"
+#include "SpscRing.h"
+#include "ScriptProcessor.h"
+#include "ScriptPreprocessor.h"
+#include "BusScheduler.h"
+#include "Telemetry.h"
+#include "VirtualBus.h"
+#include "ApiInstance.h"
 
+
+// Runs a script on one bus. Several instances may run in parallel, one per bus,
+// each bus has its own API instance (see ApiInstance.h), bus commands are only
+// serialized between the threads of one bus.
 class ScriptThread : public QThread
 {
     Q_OBJECT
@@ -22,39 +38,195 @@ public:
         STOPPED
     };
     typedef std::function<void (int16_t)> LABEL_UPDATE_CB;
-    typedef std::function<void (uint8_t, uint8_t*, uint8_t)> SEND_DATA_CB;
+    typedef std::function<bool (uint8_t, uint8_t*, uint8_t)> SEND_DATA_CB;     // false if the frame couldn't be sent
     typedef std::function<void (uint8_t, uint8_t)> LOCAL_ERROR_CB;
     typedef std::function<void (uint8_t, uint8_t)> NODE_ERROR_CB;
     typedef std::function<void (uint8_t, const char*)> LOG_FUNC;
+    typedef std::function<void (const MMSCRIPT_VIRTUAL_EVENT&)> TRACE_CB;
 
-    ScriptThread();
+    explicit ScriptThread(uint8_t bus = 0);
     virtual ~ScriptThread();
 
+    uint8_t bus() const;
+
     int16_t init(QString scriptFileName, LABEL_UPDATE_CB labelUpdateCallback, SEND_DATA_CB sendDataCallback, LOCAL_ERROR_CB localErrorCallback, NODE_ERROR_CB nodeErrorCallback, LOG_FUNC log);
+
+    // After init(), run the lines mms2c compiled into the shared library instead of interpreting them.
+    // Returns 0, MMS_PARSE_ERR_FILE if the library can't be loaded or MMS_PARSE_ERR_NATIVE.
+    int16_t loadNative(QString libraryFileName);
     void pause();
     void resume();
+    void requestStop();
     void stop();
 
+    // Takes effect on next start(). In real-time mode, label/error/log callbacks are
+    // queued without allocating nor locking & invoked from a normal priority thread, while
+    // the send callback is still invoked from the thread sending & must neither block nor
+    // allocate, e.g. queue the frame in a ring like SerialLink::send().
+    void setRealTimeConfig(const RealTimeConfig &config);
+
+    // Takes effect on next start(). Bus commands are run by an executor thread while the
+    // task issuing them is parked, so that FORKed tasks go on meanwhile.
+    void setAsyncExecution(bool enabled);
+
+    // Takes effect on next start(). Transactions of the executor are served by priority
+    // (stop > motion > config > status poll) & polls limited to pollSharePercent of bus time.
+    void setBusScheduling(uint32_t baudRate, uint8_t pollSharePercent);
+    MMSCRIPT_SCHEDULER_STATS schedulerStats(MMSCRIPT_PRIORITY priority) const;    // Valid once the run has ended
+
+    // Takes effect on next start(). A poller thread polls the nodes addressed by the script one
+    // after the other, one every intervalMs, WAIT reads their status from a table instead of
+    // polling the bus itself. 0 disables.
+    void setTelemetryPolling(uint32_t intervalMs, bool withPosition = false);
+    void watchNode(uint8_t node);                                       // Poll node even if the script doesn't address it, after init()
+    bool nodeStatus(uint8_t node, MMSCRIPT_NODE_STATUS *status) const;  // Last status polled, lock free
+
+    // Takes effect on next init(), enabled by default. See MMScript_SetOptimize(), the libraries of
+    // loadNative() must be compiled by mms2c with the same setting.
+    void setOptimization(bool enabled);
+    MMSCRIPT_OPTIMIZE_REPORT optimizeReport() const;    // What init() optimized
+
+    // Takes effect on next init(). Nodes are simulated & time is virtual (see VirtualBus.h), a script
+    // looping for hours runs in seconds. Nothing is sent on the bus, asynchronous execution is ignored
+    // & telemetry is polled by the delays of the script instead of a poller thread. trace gets each line
+    // & call of the run with its virtual time, on the script thread.
+    void setDryRun(bool enabled, const MMSCRIPT_VIRTUAL_CONFIG &config, TRACE_CB trace = TRACE_CB());
+    MMSCRIPT_VIRTUAL_STATS virtualStats() const;                            // Valid once the run has ended
+    bool virtualNode(uint8_t node, int32_t *position, uint8_t *status) const;   // Simulated node at the end of the run
+    std::vector<int16_t> variables() const;                                 // 'A' to 'Z', valid once the run has ended
+
+    // Where a label of the script comes from once #INCLUDEs & #MACROs are resolved, "file:line", empty if unknown
+    QString source(int16_t label) const;
+    QString errorSource() const;    // "file:line" of the directive init() failed at, empty if it failed elsewhere
+
+    const std::vector<uint8_t>& globalStopFrame() const;
+    const JitterStats& jitterStats() const;
+    MMSCRIPT_STREAM_STATS streamStats() const;      // Last STREAM of the script, valid once the run has ended
+    MMSCRIPT_GEAR_STATS gearStats() const;          // GEAR/CAM followers of the run, valid once the run has ended
+
+    // Data received from the bus, dropped unless a command of this bus is in progress
     void onSerialData(uint8_t data);
 
     STATUS status() const;
+    int16_t result() const;     // Return value of the last MMScript_ExecOneStep() of a run
 
 private:
     static void DelayMilisecondImpl(uint32_t ms);
+    static void InterruptibleDelayImpl(uint32_t ms);
+    static void DelayUntilMicroSecondsImpl(uint64_t deadline_us);
     static uint32_t GetMilliSecondsImpl();
+    static uint64_t GetMicroSecondsImpl();
     static void Log(unsigned char node_addr, const char* msg);
+    static void ApiAcquire();
+    static void ApiRelease();
+    static void SubmitImpl(MMSCRIPT_TRANSACTION *transaction);
+    static void WaitCompletionImpl(uint64_t deadline_us);
+    static void TraceImpl(const MMSCRIPT_VIRTUAL_EVENT *event);
+    static void ExecutorDelayImpl(uint32_t ms);
+    static ScriptThread *current();
 
     static void SendDataImpl(uint8_t addr, uint8_t *data, uint8_t size);
     static void OnLocalError(uint8_t addr, uint8_t err);
     static void OnNodeError(uint8_t addr, uint8_t err);
 
-    static ScriptThread *_me;
+    bool waitWhilePaused();
+
+    struct DeferredEvent
+    {
+        enum TYPE { LABEL, LOCAL_ERROR, NODE_ERROR, LOG, QUIT } type;
+        uint8_t node;
+        int16_t value;
+        char msg[96];
+    };
+
+    // Threads which queue callbacks in real-time mode, one ring each
+    enum PRODUCER { PRODUCER_SCRIPT, PRODUCER_EXECUTOR, PRODUCER_POLLER, PRODUCER_COUNT };
 
-    volatile STATUS _status;
+    // Invokes callbacks queued by the script, executor & poller threads in real-time mode
+    class Dispatcher : public QThread
+    {
+    public:
+        explicit Dispatcher(ScriptThread *owner) : _owner(owner) {}
+    protected:
+        void run() Q_DECL_OVERRIDE;
+    private:
+        ScriptThread *_owner;
+    };
+
+    // Runs transactions submitted by the script thread
+    class Executor : public QThread
+    {
+    public:
+        explicit Executor(ScriptThread *owner) : _owner(owner) {}
+    protected:
+        void run() Q_DECL_OVERRIDE;
+    private:
+        ScriptThread *_owner;
+    };
+
+    // Polls status of watched nodes in the background, through the executor in async mode
+    class Poller : public QThread
+    {
+    public:
+        explicit Poller(ScriptThread *owner) : _owner(owner) {}
+    protected:
+        void run() Q_DECL_OVERRIDE;
+    private:
+        ScriptThread *_owner;
+    };
+
+    void defer(DeferredEvent::TYPE type, uint8_t node, int16_t value, const char *msg);
+    void notifyLabel(int16_t label);
+
+    static QMutex _apiMutex[MMSCRIPT_API_INSTANCES];    // Held by the bus which owns the API instance
+    static std::atomic<ScriptThread*> _apiOwner[MMSCRIPT_API_INSTANCES];
+    static thread_local ScriptThread *_current;     // Set by script, executor & poller threads
+    static thread_local int _producer;              // PRODUCER of the thread, -1 for others
+
+    uint8_t _bus;
+    const MMSCRIPT_API_INSTANCE *_api;      // Of the bus, see MMScript_ApiInstance()
+    uint8_t _apiIndex;
+    MMSCRIPT_CONTEXT *_context;
+    std::atomic<STATUS> _status;
     int16_t _startLabel;
-    QSemaphore _semResume;
-    volatile bool _pause;
-    volatile bool _stop;
+    std::atomic<int16_t> _result;
+    QMutex _waitMutex;
+    QWaitCondition _waitCondition;  // Woken by pause(), resume() & stop()
+    std::atomic<bool> _pause;
+    std::atomic<bool> _stop;
+
+    RealTimeConfig _rtConfig;
+    std::atomic<bool> _deferCallbacks;
+    SpscRing<DeferredEvent, 256> _deferredEvents[PRODUCER_COUNT];  // Polled by the dispatcher, no lock nor wake-up
+    std::atomic<uint32_t> _deferredDropped;
+    Dispatcher _dispatcher;
+    JitterStats _jitter;                    // Written by the script thread only
+
+    bool _async;
+    MMSCRIPT_SCHEDULER_CONFIG _schedulerConfig;
+    MMSCRIPT_SCHEDULER _scheduler;          // Guarded by _queueMutex
+    QMutex _queueMutex;
+    QWaitCondition _queueCondition;         // Woken by submissions & quit
+    bool _executorQuit;
+    Executor _executor;
+    bool _completed;                        // Guarded by _waitMutex
+
+    uint32_t _telemetryIntervalMs;
+    bool _telemetryPosition;
+    bool _optimize;
+    bool _pollerQuit;                       // Guarded by _waitMutex
+    QWaitCondition _pollerCondition;        // Woken by quit only
+    Poller _poller;
+
+    bool _dryRun;
+    MMSCRIPT_VIRTUAL_CONFIG _virtualConfig;
+    TRACE_CB _trace;
+
+    QLibrary _native;                       // Script compiled by mms2c, attached to _context
+    MMSCRIPT_SOURCE_MAP _sourceMap;         // Of the script of init()
+
+    bool _captureSend;                      // Store frames instead of sending them
+    std::vector<uint8_t> _globalStopFrame;  // MMS_GlobalStop() frame captured by init()
 
     LABEL_UPDATE_CB _labelUpdateCallback;
     SEND_DATA_CB _sendDataCallback;
@@ -0,0 +1,433 @@
+
+#include "SerialLink.h"
+
+#include <QObject>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+
+static bool baudToSpeed(int baudRate, speed_t *speed)
+{
+    switch (baudRate)
+    {
+    case 4800:   *speed = B4800;   return true;
+    case 9600:   *speed = B9600;   return true;
+    case 19200:  *speed = B19200;  return true;
+    case 38400:  *speed = B38400;  return true;
+    case 57600:  *speed = B57600;  return true;
+    case 115200: *speed = B115200; return true;
+    case 230400: *speed = B230400; return true;
+    default:     return false;
+    }
+}
+
+
+SerialLink::SerialLink()
+{
+    _fd = -1;
+    _wakePipe[0] = _wakePipe[1] = -1;
+    _urgentDonePipe[0] = _urgentDonePipe[1] = -1;
+    _quit = false;
+    _down = false;
+    _txChunkSize = 0;
+    _txChunkOffset = 0;
+    _urgentSize = 0;
+    _urgentPending = false;
+}
+
+
+SerialLink::~SerialLink()
+{
+    close();
+}
+
+
+bool SerialLink::open(const QString &device, int baudRate, RECEIVE_CB receiveCallback, QString *error)
+{
+    speed_t speed;
+    struct termios tio;
+
+    if (!baudToSpeed(baudRate, &speed))
+    {
+        *error = QObject::tr("Unsupported baud rate %1").arg(baudRate);
+        return false;
+    }
+
+    _fd = ::open(device.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (_fd < 0)
+    {
+        *error = QObject::tr("Open '%1' failed: %2").arg(device).arg(strerror(errno));
+        return false;
+    }
+
+    if (tcgetattr(_fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+
+        if (tcsetattr(_fd, TCSANOW, &tio) != 0)
+        {
+            *error = QObject::tr("Configure '%1' failed: %2").arg(device).arg(strerror(errno));
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+    }
+
+    if (pipe(_wakePipe) != 0)
+    {
+        *error = QObject::tr("pipe failed: %1").arg(strerror(errno));
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    if (pipe(_urgentDonePipe) != 0)
+    {
+        *error = QObject::tr("pipe failed: %1").arg(strerror(errno));
+        ::close(_wakePipe[0]);
+        ::close(_wakePipe[1]);
+        ::close(_fd);
+        _wakePipe[0] = _wakePipe[1] = -1;
+        _fd = -1;
+        return false;
+    }
+
+    fcntl(_wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_wakePipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(_urgentDonePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_urgentDonePipe[1], F_SETFL, O_NONBLOCK);
+
+    _receive = receiveCallback;
+    _quit = false;
+    _down = false;
+    _urgentPending = false;
+    _txChunkSize = _txChunkOffset = 0;
+    _txRing.clear();
+
+    start();
+    return true;
+}
+
+
+void SerialLink::close()
+{
+    if (_fd < 0)
+        return;
+
+    _quit = true;
+    wake();
+    wait();
+
+    ::close(_wakePipe[0]);
+    ::close(_wakePipe[1]);
+    ::close(_urgentDonePipe[0]);
+    ::close(_urgentDonePipe[1]);
+    ::close(_fd);
+    _wakePipe[0] = _wakePipe[1] = -1;
+    _urgentDonePipe[0] = _urgentDonePipe[1] = -1;
+    _fd = -1;
+}
+
+
+void SerialLink::setRealTimeConfig(const RealTimeConfig &config)
+{
+    _rtConfig = config;
+}
+
+
+void SerialLink::setLinkDownCallback(LINK_DOWN_CB linkDownCallback)
+{
+    _linkDown = linkDownCallback;
+}
+
+
+void SerialLink::wake()
+{
+    char c = 0;
+
+    // EAGAIN: pipe full, a wake-up is pending already
+    ssize_t ret = ::write(_wakePipe[1], &c, 1);
+    (void)ret;
+}
+
+
+bool SerialLink::send(const uint8_t *data, size_t size)
+{
+    uint8_t framed[1 + FRAME_MAX];
+
+    if (size > FRAME_MAX || _down)
+        return false;
+
+    // Size first, so that the I/O thread knows where frames end
+    framed[0] = (uint8_t)size;
+    memcpy(framed + 1, data, size);
+
+    if (!_txRing.push(framed, size + 1))
+        return false;
+
+    wake();
+    return true;
+}
+
+
+bool SerialLink::sendUrgent(const uint8_t *data, size_t size)
+{
+    struct timespec start, now;
+
+    if (_down)
+        return false;
+
+    if (size > URGENT_MAX)
+        size = URGENT_MAX;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // One urgent frame at a time, it's for stop frames: sleep until the I/O thread is done with the previous one
+    while (_urgentPending && !_down)
+    {
+        char drain[16];
+        struct pollfd fd;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        long elapsedMs = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+
+        if (elapsedMs >= URGENT_TIMEOUT_MS)
+            return false;
+
+        fd.fd = _urgentDonePipe[0];
+        fd.events = POLLIN;
+        fd.revents = 0;
+
+        // Bytes left by earlier frames only make us check again
+        if (poll(&fd, 1, (int)(URGENT_TIMEOUT_MS - elapsedMs)) > 0)
+        {
+            while (::read(_urgentDonePipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+    }
+
+    memcpy(_urgent, data, size);
+    _urgentSize = size;
+    _urgentPending = true;
+    wake();
+    return true;
+}
+
+
+void SerialLink::run()
+{
+    QString error;
+
+    if (!RealTime::applyToCurrentThread(_rtConfig, &error))
+        qWarning("SerialLink real-time mode: %s", error.toLocal8Bit().constData());
+
+    while (!_quit)
+    {
+        struct pollfd fds[2];
+        bool txPending = (_txChunkOffset < _txChunkSize) || !_txRing.empty();
+
+        fds[0].fd = _fd;
+        fds[0].events = POLLIN | (txPending ? POLLOUT : 0);
+        fds[0].revents = 0;
+        fds[1].fd = _wakePipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[64];
+            while (::read(_wakePipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+
+        if (_urgentPending)
+        {
+            // The driver has whole frames & the start of the current one: finish it rather than
+            // flush, a cut frame followed by the stop frame could be read as one corrupted frame
+            if (_txChunkOffset > 0)
+                writeAll(_txChunk + _txChunkOffset, _txChunkSize - _txChunkOffset);
+
+            _txChunkSize = _txChunkOffset = 0;
+            _txRing.clear();
+
+            writeAll(_urgent, _urgentSize);
+            _urgentPending = false;
+
+            char c = 0;
+            ssize_t ret = ::write(_urgentDonePipe[1], &c, 1);
+            (void)ret;
+        }
+
+        // Responses received before a hang-up are still delivered
+        if ((fds[0].revents & POLLIN) && !receive())
+            break;
+
+        // Reported whatever the requested events, poll() would return at once from now on
+        if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+        {
+            linkDown((fds[0].revents & POLLHUP) ? "hang-up" : "device error");
+            break;
+        }
+
+        transmit();
+    }
+
+    // Nothing can be written to a dead device
+    if (_down)
+        return;
+
+    // Flush what's still queued, e.g. a final stop frame, but don't hang on a dead device
+    for (int i = 0; i < CLOSE_FLUSH_TRIES && (_txChunkOffset < _txChunkSize || !_txRing.empty()); i++)
+    {
+        struct pollfd fd;
+
+        fd.fd = _fd;
+        fd.events = POLLOUT;
+        fd.revents = 0;
+
+        poll(&fd, 1, 10);
+        transmit();
+    }
+
+    tcdrain(_fd);
+}
+
+
+// Pass what the driver has to the receive callback; false once the device is gone
+bool SerialLink::receive()
+{
+    uint8_t rxBuf[256];
+    ssize_t size;
+
+    while ((size = ::read(_fd, rxBuf, sizeof(rxBuf))) > 0)
+    {
+        for (ssize_t i = 0; i < size; i++)
+            _receive(rxBuf[i]);
+    }
+
+    // Non-blocking, so no data is EAGAIN: end of file means the other end closed
+    if (size == 0)
+    {
+        linkDown("end of file");
+        return false;
+    }
+
+    if (errno != EAGAIN && errno != EINTR)
+    {
+        linkDown(strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+// I/O thread stops: frames queued or sent from now on are dropped, urgent senders are released
+void SerialLink::linkDown(const char *reason)
+{
+    qWarning("SerialLink down: %s", reason);
+
+    _down = true;
+    _txRing.clear();
+    _txChunkSize = _txChunkOffset = 0;
+    _urgentPending = false;
+
+    char c = 0;
+    ssize_t ret = ::write(_urgentDonePipe[1], &c, 1);
+    (void)ret;
+
+    if (_linkDown)
+        _linkDown();
+}
+
+
+// Write all of data, waiting for room in the driver up to WRITE_TIMEOUT_MS; false on error or timeout
+bool SerialLink::writeAll(const uint8_t *data, size_t size)
+{
+    struct timespec start, now;
+    size_t written = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (written < size)
+    {
+        ssize_t ret = ::write(_fd, data + written, size - written);
+
+        if (ret > 0)
+        {
+            written += ret;
+            continue;
+        }
+
+        if (ret < 0 && errno != EAGAIN && errno != EINTR)
+            return false;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        long elapsedMs = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        struct pollfd fd;
+
+        if (elapsedMs >= WRITE_TIMEOUT_MS)
+            return false;
+
+        fd.fd = _fd;
+        fd.events = POLLOUT;
+        fd.revents = 0;
+
+        poll(&fd, 1, (int)(WRITE_TIMEOUT_MS - elapsedMs));
+    }
+
+    return true;
+}
+
+
+// Write as much as the driver takes, a frame at a time
+void SerialLink::transmit()
+{
+    for (;;)
+    {
+        if (_txChunkOffset == _txChunkSize)
+        {
+            uint8_t size;
+
+            _txChunkSize = _txChunkOffset = 0;
+
+            if (!_txRing.pop(size))
+                break;
+
+            // Pushed at once with its size
+            while (_txChunkSize < size && _txRing.pop(_txChunk[_txChunkSize]))
+                _txChunkSize++;
+
+            if (_txChunkSize == 0)
+                continue;
+        }
+
+        ssize_t ret = ::write(_fd, _txChunk + _txChunkOffset, _txChunkSize - _txChunkOffset);
+
+        if (ret <= 0)
+            break;
+
+        _txChunkOffset += ret;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SERIALLINK_H
+#define SERIALLINK_H
+
+#include <QThread>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+#include "RealTime.h"
+#include "SpscRing.h"
+
+
+// Serial port driven by its own POSIX poll() thread, for use without a GUI event loop.
+// send() never blocks nor allocates, so it may be called from a real-time thread.
+class SerialLink : public QThread
+{
+public:
+    typedef std::function<void (uint8_t)> RECEIVE_CB;
+    typedef std::function<void ()> LINK_DOWN_CB;
+
+    SerialLink();
+    virtual ~SerialLink();
+
+    // Open device (serial port, or pty of a simulator) & start the I/O thread
+    bool open(const QString &device, int baudRate, RECEIVE_CB receiveCallback, QString *error);
+    void close();
+
+    // Takes effect on next open()
+    void setRealTimeConfig(const RealTimeConfig &config);
+
+    // Called once from the I/O thread when the device hangs up or fails (adapter unplugged, pty closed),
+    // the thread has stopped then & send() fails until the next open(). Takes effect on next open()
+    void setLinkDownCallback(LINK_DOWN_CB linkDownCallback);
+    bool isDown() const { return _down; }
+
+    // Queue a frame of up to FRAME_MAX bytes, from a single producer thread; false if not enough room
+    bool send(const uint8_t *data, size_t size);
+
+    // Priority lane: finish the frame being written, drop the frames queued after it,
+    // then transmit data ahead of anything else. Nodes only ever see whole frames.
+    // Sleeps while the previous urgent frame is written, false if it's still pending after URGENT_TIMEOUT_MS.
+    bool sendUrgent(const uint8_t *data, size_t size);
+
+    enum { FRAME_MAX = 255 };
+
+private:
+    void run() Q_DECL_OVERRIDE;
+    void wake();
+    void transmit();
+    bool writeAll(const uint8_t *data, size_t size);
+    bool receive();
+    void linkDown(const char *reason);
+
+    enum { URGENT_MAX = 64, TX_CHUNK = FRAME_MAX, CLOSE_FLUSH_TRIES = 10, WRITE_TIMEOUT_MS = 500 };
+    enum { URGENT_TIMEOUT_MS = 2 * WRITE_TIMEOUT_MS };     // Rest of the current frame, then the urgent one
+
+    int _fd;
+    int _wakePipe[2];
+    int _urgentDonePipe[2];             // Written by the I/O thread once an urgent frame is out
+    std::atomic<bool> _quit;
+    std::atomic<bool> _down;
+    RECEIVE_CB _receive;
+    LINK_DOWN_CB _linkDown;
+    RealTimeConfig _rtConfig;
+
+    SpscRing<uint8_t, 4096> _txRing;    // Frames, each one after its size byte
+    uint8_t _txChunk[TX_CHUNK];         // Frame popped from ring, partially written
+    size_t _txChunkSize;
+    size_t _txChunkOffset;
+
+    uint8_t _urgent[URGENT_MAX];
+    size_t _urgentSize;
+    std::atomic<bool> _urgentPending;
+};
+
+#endif // SERIALLINK_H
@@ -0,0 +1,76 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <stddef.h>
+
+
+// Lock-free single producer/single consumer ring of fixed capacity,
+// storage is preallocated so push() & pop() never allocate.
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert((N & (N - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+public:
+    SpscRing() : _head(0), _tail(0) {}
+
+    // Producer side, returns false if full
+    bool push(const T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head - _tail.load(std::memory_order_acquire) == N)
+            return false;
+
+        _items[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side, pushes all of items or nothing, returns false if not enough room
+    bool push(const T *items, size_t count)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+
+        if (N - (head - _tail.load(std::memory_order_acquire)) < count)
+            return false;
+
+        for (size_t i = 0; i < count; i++)
+            _items[(head + i) & (N - 1)] = items[i];
+
+        _head.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if empty
+    bool pop(T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+
+        item = _items[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, drops everything queued
+    void clear()
+    {
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    T _items[N];
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,146 @@
+
+/**
+  * Status of nodes polled in the background, one table per bus.
+  * Each entry is guarded by a sequence lock: the poller makes the sequence odd while
+  * it writes, readers copy the entry & retry if the sequence was odd or changed meanwhile.
+  * Readers never block the poller & never touch the bus.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "Telemetry.h"
+
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t sequence;          /* Odd while written, 0 if never published */
+    MMSCRIPT_NODE_STATUS status;
+}   TELEMETRY_ENTRY;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define NODE_COUNT  256
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SEQ_LOAD(p)         (*(volatile uint32_t*)(p))
+#define SEQ_STORE(p, v)     (*(volatile uint32_t*)(p) = (v))
+#define FENCE()             _ReadWriteBarrier()
+#define WATCH_SET(p, v)     _InterlockedOr((volatile long*)(p), (long)(v))
+#define WATCH_LOAD(p)       (*(volatile uint32_t*)(p))
+#else
+#define SEQ_LOAD(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SEQ_STORE(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define FENCE()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define WATCH_SET(p, v)     __atomic_fetch_or(p, v, __ATOMIC_RELAXED)
+#define WATCH_LOAD(p)       __atomic_load_n(p, __ATOMIC_RELAXED)
+#endif
+
+
+/* Private variables ---------------------------------------------------------*/
+
+static TELEMETRY_ENTRY _table[MMSCRIPT_MAX_BUSES][NODE_COUNT];
+static uint32_t _watched[MMSCRIPT_MAX_BUSES][NODE_COUNT / 32];
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+
+/* Private functions ---------------------------------------------------------*/
+
+
+/* Public functions ---------------------------------------------------------*/
+
+void MMScript_TelemetryReset(uint8_t bus)
+{
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return;
+
+    memset(_table[bus], 0, sizeof(_table[bus]));
+    memset(_watched[bus], 0, sizeof(_watched[bus]));
+}
+
+
+void MMScript_TelemetryWatch(uint8_t bus, uint8_t node_addr)
+{
+    if (bus >= MMSCRIPT_MAX_BUSES || node_addr == 0)
+        return;
+
+    WATCH_SET(&_watched[bus][node_addr / 32], (uint32_t)1 << (node_addr % 32));
+}
+
+
+uint8_t MMScript_TelemetryNextNode(uint8_t bus, uint8_t node_addr)
+{
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return 0;
+
+    for (int i=1; i<NODE_COUNT; i++)
+    {
+        uint8_t node = (uint8_t)((node_addr + i) % NODE_COUNT);
+
+        if (node != 0 && (WATCH_LOAD(&_watched[bus][node / 32]) & ((uint32_t)1 << (node % 32))))
+            return node;
+    }
+
+    /* Only node_addr itself, if watched */
+    if (node_addr != 0 && (WATCH_LOAD(&_watched[bus][node_addr / 32]) & ((uint32_t)1 << (node_addr % 32))))
+        return node_addr;
+
+    return 0;
+}
+
+
+void MMScript_TelemetryPublish(uint8_t bus, uint8_t node_addr, const MMSCRIPT_NODE_STATUS *status)
+{
+    TELEMETRY_ENTRY *entry;
+    uint32_t sequence;
+
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return;
+
+    entry = &_table[bus][node_addr];
+    sequence = entry->sequence;
+
+    SEQ_STORE(&entry->sequence, sequence + 1);
+    FENCE();
+
+    entry->status = *status;
+
+    SEQ_STORE(&entry->sequence, sequence + 2);
+}
+
+
+uint8_t MMScript_TelemetryRead(uint8_t bus, uint8_t node_addr, MMSCRIPT_NODE_STATUS *status)
+{
+    const TELEMETRY_ENTRY *entry;
+    uint32_t before, after = 0;
+
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return 0;
+
+    entry = &_table[bus][node_addr];
+
+    do
+    {
+        before = SEQ_LOAD(&entry->sequence);
+
+        if (before & 1)
+            continue;   /* Being written */
+
+        *status = entry->status;
+        FENCE();
+        after = SEQ_LOAD(&entry->sequence);
+    }
+    while ((before & 1) || before != after);
+
+    return before != 0;
+}
@@ -0,0 +1,88 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t status;             /* MMS_CTRL_STATUS_xxx */
+    uint8_t in_position;
+    uint8_t has_position;       /* position valid */
+    int32_t position;
+    uint64_t sampled_us;        /* Time the poll completed */
+    uint8_t has_velocity;       /* velocity valid, after two positions polled */
+    int32_t velocity;           /* counts/s, derived from the last two positions */
+}   MMSCRIPT_NODE_STATUS;
+
+
+/* Exported constants --------------------------------------------------------*/
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Forget status & watched nodes of bus
+  * @note   Not to be called while the poller of bus is running.
+  * @param  bus: bus index
+  * @retval None
+  */
+void MMScript_TelemetryReset(uint8_t bus);
+
+
+/**
+  * @brief  Add node to the nodes polled on bus, may be called from any thread
+  * @param  bus: bus index
+  * @param  node_addr: node address
+  * @retval None
+  */
+void MMScript_TelemetryWatch(uint8_t bus, uint8_t node_addr);
+
+
+/**
+  * @brief  Next watched node in round robin order
+  * @param  bus: bus index
+  * @param  node_addr: node polled last, 0 to start over
+  * @retval node address, 0 if no node watched
+  */
+uint8_t MMScript_TelemetryNextNode(uint8_t bus, uint8_t node_addr);
+
+
+/**
+  * @brief  Publish status of node
+  * @note   Single writer per bus: the poller.
+  * @param  bus: bus index
+  * @param  node_addr: node address
+  * @param  status: status polled
+  * @retval None
+  */
+void MMScript_TelemetryPublish(uint8_t bus, uint8_t node_addr, const MMSCRIPT_NODE_STATUS *status);
+
+
+/**
+  * @brief  Read last status of node published, without touching the bus
+  * @note   Lock free, may be called from any thread while the poller publishes.
+  * @param  bus: bus index
+  * @param  node_addr: node address
+  * @param  status: output of status
+  * @retval 1: status valid
+  *         0: node never polled
+  */
+uint8_t MMScript_TelemetryRead(uint8_t bus, uint8_t node_addr, MMSCRIPT_NODE_STATUS *status);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __TELEMETRY_H__ */
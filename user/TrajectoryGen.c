@@ -0,0 +1,462 @@
+
+/**
+  * Setpoint generation of SCURVE & SPLINE, into trajectories in the format of STREAM.
+  * Samples are computed in batches laid out axis by axis (structure of arrays), so that the
+  * inner loops run over contiguous samples with the same coefficients & are vectorized by the compiler.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "TrajectoryGen.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define BATCH_SIZE      256
+#define PLAN_STEPS      64          /* Bisection steps of peak velocity on short moves */
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#define WRITE_U16(p, v) do { (p)[0] = (uint8_t)(v); (p)[1] = (uint8_t)((v) >> 8); } while (0)
+#define WRITE_U32(p, v) do { (p)[0] = (uint8_t)(v); (p)[1] = (uint8_t)((v) >> 8); (p)[2] = (uint8_t)((v) >> 16); (p)[3] = (uint8_t)((v) >> 24); } while (0)
+
+
+/* Private variables ---------------------------------------------------------*/
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+static void MMScript_SCurveShape(MMSCRIPT_SCURVE *profile, double velocity, double amax);
+static double MMScript_SCurveAccelDistance(const MMSCRIPT_SCURVE *profile, double t);
+static uint8_t *MMScript_NewTrajectory(const uint8_t *nodes, uint8_t axes, uint32_t period_us, uint32_t frame_count, size_t *size);
+static void MMScript_WriteFrames(uint8_t *trajectory, uint8_t axes, uint32_t frame, uint32_t count, const double *positions);
+
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Set durations of acceleration to reach velocity from rest
+  * @param  profile: profile, jerk set
+  * @param  velocity: peak velocity
+  * @param  amax: acceleration limit
+  * @retval None
+  */
+static void MMScript_SCurveShape(MMSCRIPT_SCURVE *profile, double velocity, double amax)
+{
+    profile->velocity = velocity;
+
+    if (velocity * profile->jerk >= amax * amax)
+    {
+        /* Acceleration limit reached, constant acceleration between the jerk segments */
+        profile->t_jerk = amax / profile->jerk;
+        profile->acceleration = amax;
+        profile->t_accel = velocity / amax + profile->t_jerk;
+    }
+    else
+    {
+        profile->t_jerk = sqrt(velocity / profile->jerk);
+        profile->acceleration = profile->jerk * profile->t_jerk;
+        profile->t_accel = 2 * profile->t_jerk;
+    }
+}
+
+
+/**
+  * @brief  Distance covered t after start, within acceleration
+  * @param  profile: profile
+  * @param  t: 0 to t_accel
+  * @retval distance
+  */
+static double MMScript_SCurveAccelDistance(const MMSCRIPT_SCURVE *profile, double t)
+{
+    double tj = profile->t_jerk;
+    double u;
+
+    if (t <= tj)
+        return profile->jerk * t * t * t / 6;
+
+    if (t <= profile->t_accel - tj)
+    {
+        u = t - tj;
+        return profile->jerk * tj * tj * tj / 6 + profile->acceleration * tj / 2 * u + profile->acceleration * u * u / 2;
+    }
+
+    /* Last jerk segment, back from the end of acceleration */
+    u = profile->t_accel - t;
+    return profile->velocity * profile->t_accel / 2 - profile->velocity * u + profile->jerk * u * u * u / 6;
+}
+
+
+/**
+  * @brief  Allocate a trajectory & write its header
+  * @param  nodes: node of each axis
+  * @param  axes: nodes per frame
+  * @param  period_us: time between frames
+  * @param  frame_count: frames
+  * @param  size: output of size of trajectory
+  * @retval trajectory, setpoints not written, NULL if out of memory
+  */
+static uint8_t *MMScript_NewTrajectory(const uint8_t *nodes, uint8_t axes, uint32_t period_us, uint32_t frame_count, size_t *size)
+{
+    size_t nodes_size = (axes + 3) & ~(size_t)3;
+    uint8_t *trajectory;
+
+    *size = MMSCRIPT_STREAM_HEADER_SIZE + nodes_size + (size_t)frame_count * axes * 4;
+    trajectory = (uint8_t *)malloc(*size);
+
+    if (trajectory == NULL)
+        return NULL;
+
+    memcpy(trajectory, MMSCRIPT_STREAM_MAGIC, 4);
+    WRITE_U16(trajectory + 4, MMSCRIPT_STREAM_VERSION);
+    WRITE_U16(trajectory + 6, axes);
+    WRITE_U32(trajectory + 8, period_us);
+    WRITE_U32(trajectory + 12, frame_count);
+
+    memset(trajectory + MMSCRIPT_STREAM_HEADER_SIZE, 0, nodes_size);
+    memcpy(trajectory + MMSCRIPT_STREAM_HEADER_SIZE, nodes, axes);
+
+    return trajectory;
+}
+
+
+/**
+  * @brief  Round positions of a batch & write them frame by frame
+  * @param  trajectory: trajectory
+  * @param  axes: nodes per frame
+  * @param  frame: index of the first frame of the batch
+  * @param  count: frames in batch
+  * @param  positions: positions[axis * count + k]
+  * @retval None
+  */
+static void MMScript_WriteFrames(uint8_t *trajectory, uint8_t axes, uint32_t frame, uint32_t count, const double *positions)
+{
+    size_t nodes_size = (axes + 3) & ~(size_t)3;
+    uint8_t *p = trajectory + MMSCRIPT_STREAM_HEADER_SIZE + nodes_size + (size_t)frame * axes * 4;
+
+    for (uint32_t k=0; k<count; k++)
+    {
+        for (uint8_t axis=0; axis<axes; axis++)
+        {
+            double position = floor(positions[axis * count + k] + 0.5);
+            int32_t setpoint;
+
+            if (position > INT32_MAX)
+                setpoint = INT32_MAX;
+            else if (position < INT32_MIN)
+                setpoint = INT32_MIN;
+            else
+                setpoint = (int32_t)position;
+
+            WRITE_U32(p, (uint32_t)setpoint);
+            p += 4;
+        }
+    }
+}
+
+
+/* Public functions ---------------------------------------------------------*/
+
+uint8_t MMScript_SCurvePlan(MMSCRIPT_SCURVE *profile, double distance, double vmax, double amax, double jmax)
+{
+    memset(profile, 0, sizeof(MMSCRIPT_SCURVE));
+
+    if (!(distance > 0) || !(vmax > 0) || !(amax > 0) || !(jmax > 0))
+        return 0;
+
+    profile->distance = distance;
+    profile->jerk = jmax;
+    MMScript_SCurveShape(profile, vmax, amax);
+
+    if (profile->velocity * profile->t_accel > distance)
+    {
+        /* Too short to reach vmax, distance of acceleration & deceleration grows with peak velocity */
+        double low = 0, high = vmax;
+
+        for (int i=0; i<PLAN_STEPS; i++)
+        {
+            double velocity = (low + high) / 2;
+
+            MMScript_SCurveShape(profile, velocity, amax);
+
+            if (velocity * profile->t_accel > distance)
+                high = velocity;
+            else
+                low = velocity;
+        }
+
+        if (!(low > 0))
+            return 0;
+
+        MMScript_SCurveShape(profile, low, amax);
+    }
+
+    profile->t_cruise = (distance - profile->velocity * profile->t_accel) / profile->velocity;
+    profile->duration = 2 * profile->t_accel + profile->t_cruise;
+
+    return 1;
+}
+
+
+void MMScript_SCurveSample(const MMSCRIPT_SCURVE *profile, const double *t, double *s, uint32_t count)
+{
+    double accel_distance = profile->velocity * profile->t_accel / 2;
+    double cruise_end = profile->t_accel + profile->t_cruise;
+
+    for (uint32_t k=0; k<count; k++)
+    {
+        double time = t[k];
+        double distance;
+
+        if (time <= 0)
+            distance = 0;
+        else if (time >= profile->duration)
+            distance = profile->distance;
+        else if (time <= profile->t_accel)
+            distance = MMScript_SCurveAccelDistance(profile, time);
+        else if (time <= cruise_end)
+            distance = accel_distance + profile->velocity * (time - profile->t_accel);
+        else
+            distance = profile->distance - MMScript_SCurveAccelDistance(profile, profile->duration - time);
+
+        s[k] = distance / profile->distance;
+    }
+}
+
+
+uint8_t MMScript_SplinePlan(MMSCRIPT_SPLINE *spline, const double *points, uint8_t axes, uint8_t count, double segment_s)
+{
+    /* Second derivatives M at knots, from the tridiagonal system shared by all axes:
+     *   2 M0 + M1 = 6/h^2 (y1 - y0)                     (at rest at start)
+     *   M(i-1) + 4 Mi + M(i+1) = 6/h^2 (y(i+1) - 2 yi + y(i-1))
+     *   M(n-1) + 2 Mn = -6/h^2 (yn - y(n-1))            (at rest at end) */
+    double upper[MMSCRIPT_GEN_MAX_POINTS];
+    double m[MMSCRIPT_GEN_MAX_POINTS][MMSCRIPT_GEN_MAX_AXES];
+    double h = segment_s;
+    uint8_t n;
+
+    memset(spline, 0, sizeof(MMSCRIPT_SPLINE));
+
+    if (axes == 0 || axes > MMSCRIPT_GEN_MAX_AXES || count < 2 || count > MMSCRIPT_GEN_MAX_POINTS || !(h > 0))
+        return 0;
+
+    n = count - 1;
+    spline->axes = axes;
+    spline->segments = n;
+    spline->h = h;
+
+    /* Forward elimination, the matrix doesn't depend on the axis */
+    for (uint8_t i=0; i<=n; i++)
+    {
+        double diagonal = (i == 0 || i == n) ? 2 : 4;
+        double pivot = (i == 0) ? diagonal : diagonal - upper[i - 1];
+
+        upper[i] = 1 / pivot;
+
+        for (uint8_t axis=0; axis<axes; axis++)
+        {
+            const double *y = points + axis * count;
+            double rhs;
+
+            if (i == 0)
+                rhs = 6 / (h * h) * (y[1] - y[0]);
+            else if (i == n)
+                rhs = -6 / (h * h) * (y[n] - y[n - 1]);
+            else
+                rhs = 6 / (h * h) * (y[i + 1] - 2 * y[i] + y[i - 1]);
+
+            m[i][axis] = (i == 0) ? rhs / pivot : (rhs - m[i - 1][axis]) / pivot;
+        }
+    }
+
+    /* Back substitution */
+    for (int i=n-1; i>=0; i--)
+    {
+        for (uint8_t axis=0; axis<axes; axis++)
+            m[i][axis] -= upper[i] * m[i + 1][axis];
+    }
+
+    for (uint8_t axis=0; axis<axes; axis++)
+    {
+        const double *y = points + axis * count;
+
+        for (uint8_t i=0; i<n; i++)
+        {
+            spline->a[axis][i] = y[i];
+            spline->b[axis][i] = (y[i + 1] - y[i]) / h - h * (2 * m[i][axis] + m[i + 1][axis]) / 6;
+            spline->c[axis][i] = m[i][axis] / 2;
+            spline->d[axis][i] = (m[i + 1][axis] - m[i][axis]) / (6 * h);
+        }
+    }
+
+    return 1;
+}
+
+
+void MMScript_SplineSample(const MMSCRIPT_SPLINE *spline, double t0, double dt, uint32_t count, double *out)
+{
+    double h = spline->h;
+    uint32_t k = 0;
+
+    /* Samples are split in runs within one segment, evaluated for all axes with the same coefficients */
+    while (k < count)
+    {
+        double t = t0 + k * dt;
+        double segment_start;
+        uint32_t end = count;
+        int segment;
+
+        segment = (t <= 0) ? 0 : (int)(t / h);
+
+        if (segment >= spline->segments)
+            segment = spline->segments - 1;
+
+        segment_start = segment * h;
+
+        if (segment < spline->segments - 1 && dt > 0)
+        {
+            double next = ceil((segment_start + h - t0) / dt);
+
+            if (next < (double)count)
+                end = (next > k) ? (uint32_t)next : k + 1;
+        }
+
+        for (uint8_t axis=0; axis<spline->axes; axis++)
+        {
+            double a = spline->a[axis][segment];
+            double b = spline->b[axis][segment];
+            double c = spline->c[axis][segment];
+            double d = spline->d[axis][segment];
+            double *o = out + (size_t)axis * count;
+
+            for (uint32_t j=k; j<end; j++)
+            {
+                double u = t0 + j * dt - segment_start;
+
+                u = (u < 0) ? 0 : u;
+                u = (u > h) ? h : u;
+                o[j] = a + u * (b + u * (c + u * d));
+            }
+        }
+
+        k = end;
+    }
+}
+
+
+uint8_t *MMScript_GenerateSCurve(const uint8_t *nodes, const int32_t *start, const int32_t *target, uint8_t axes, double vmax, double amax, double jmax, uint32_t period_us, size_t *size)
+{
+    MMSCRIPT_SCURVE profile;
+    double t[BATCH_SIZE], s[BATCH_SIZE];
+    double positions[MMSCRIPT_GEN_MAX_AXES * BATCH_SIZE];
+    double longest = 0, frames;
+    uint32_t frame_count = 1;
+    uint8_t *trajectory;
+
+    if (axes == 0 || axes > MMSCRIPT_GEN_MAX_AXES || period_us == 0)
+        return NULL;
+
+    for (uint8_t axis=0; axis<axes; axis++)
+    {
+        double distance = fabs((double)target[axis] - start[axis]);
+
+        if (distance > longest)
+            longest = distance;
+    }
+
+    if (longest > 0)
+    {
+        if (!MMScript_SCurvePlan(&profile, longest, vmax, amax, jmax))
+            return NULL;
+
+        /* Last frame on target */
+        frames = ceil(profile.duration * 1e6 / period_us) + 1;
+
+        if (frames > MMSCRIPT_GEN_MAX_FRAMES)
+            return NULL;
+
+        frame_count = (uint32_t)frames;
+    }
+
+    trajectory = MMScript_NewTrajectory(nodes, axes, period_us, frame_count, size);
+
+    if (trajectory == NULL)
+        return NULL;
+
+    for (uint32_t frame=0; frame<frame_count; frame+=BATCH_SIZE)
+    {
+        uint32_t count = (frame_count - frame < BATCH_SIZE) ? frame_count - frame : BATCH_SIZE;
+
+        for (uint32_t k=0; k<count; k++)
+            t[k] = (double)(frame + k) * period_us * 1e-6;
+
+        if (longest > 0)
+            MMScript_SCurveSample(&profile, t, s, count);
+        else
+            for (uint32_t k=0; k<count; k++)
+                s[k] = 1;
+
+        for (uint8_t axis=0; axis<axes; axis++)
+        {
+            double origin = start[axis];
+            double delta = (double)target[axis] - start[axis];
+            double *p = positions + axis * count;
+
+            for (uint32_t k=0; k<count; k++)
+                p[k] = origin + s[k] * delta;
+        }
+
+        MMScript_WriteFrames(trajectory, axes, frame, count, positions);
+    }
+
+    return trajectory;
+}
+
+
+uint8_t *MMScript_GenerateSpline(const uint8_t *nodes, const int32_t *points, uint8_t axes, uint8_t count, uint32_t segment_us, uint32_t period_us, size_t *size)
+{
+    MMSCRIPT_SPLINE spline;
+    double knots[MMSCRIPT_GEN_MAX_AXES * MMSCRIPT_GEN_MAX_POINTS];
+    double positions[MMSCRIPT_GEN_MAX_AXES * BATCH_SIZE];
+    double frames;
+    uint32_t frame_count;
+    uint8_t *trajectory;
+
+    if (axes == 0 || axes > MMSCRIPT_GEN_MAX_AXES || count < 2 || count > MMSCRIPT_GEN_MAX_POINTS || segment_us == 0 || period_us == 0)
+        return NULL;
+
+    for (int i=0; i<axes * count; i++)
+        knots[i] = points[i];
+
+    if (!MMScript_SplinePlan(&spline, knots, axes, count, segment_us * 1e-6))
+        return NULL;
+
+    frames = ceil((double)segment_us * (count - 1) / period_us) + 1;
+
+    if (frames > MMSCRIPT_GEN_MAX_FRAMES)
+        return NULL;
+
+    frame_count = (uint32_t)frames;
+    trajectory = MMScript_NewTrajectory(nodes, axes, period_us, frame_count, size);
+
+    if (trajectory == NULL)
+        return NULL;
+
+    for (uint32_t frame=0; frame<frame_count; frame+=BATCH_SIZE)
+    {
+        uint32_t batch = (frame_count - frame < BATCH_SIZE) ? frame_count - frame : BATCH_SIZE;
+
+        MMScript_SplineSample(&spline, (double)frame * period_us * 1e-6, period_us * 1e-6, batch, positions);
+        MMScript_WriteFrames(trajectory, axes, frame, batch, positions);
+    }
+
+    return trajectory;
+}
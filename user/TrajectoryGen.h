@@ -0,0 +1,135 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRAJECTORY_GEN_H__
+#define __TRAJECTORY_GEN_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "TrajectoryStream.h"
+
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_GEN_MAX_AXES           8
+#define MMSCRIPT_GEN_MAX_POINTS         16          /* Spline knots per axis, start included */
+#define MMSCRIPT_GEN_MAX_FRAMES         (1UL << 20)
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Jerk limited point to point profile, 7 segments, at rest at both ends */
+typedef struct
+{
+    double distance;            /* > 0 */
+    double velocity;            /* Peak, may be below the limit on short moves */
+    double acceleration;        /* Peak */
+    double jerk;
+    double t_jerk;              /* Duration of each jerk segment */
+    double t_accel;             /* Duration of acceleration, jerk segments included */
+    double t_cruise;
+    double duration;
+}   MMSCRIPT_SCURVE;
+
+/* Cubic spline through equally spaced knots, at rest at both ends, one polynomial per axis & segment */
+typedef struct
+{
+    uint8_t axes;
+    uint8_t segments;
+    double h;                   /* Segment duration in s */
+    double a[MMSCRIPT_GEN_MAX_AXES][MMSCRIPT_GEN_MAX_POINTS - 1];  /* a + b.t + c.t^2 + d.t^3, t from segment start */
+    double b[MMSCRIPT_GEN_MAX_AXES][MMSCRIPT_GEN_MAX_POINTS - 1];
+    double c[MMSCRIPT_GEN_MAX_AXES][MMSCRIPT_GEN_MAX_POINTS - 1];
+    double d[MMSCRIPT_GEN_MAX_AXES][MMSCRIPT_GEN_MAX_POINTS - 1];
+}   MMSCRIPT_SPLINE;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Plan a jerk limited profile
+  * @note   Peak velocity is lowered until acceleration & deceleration fit in distance.
+  * @param  profile: output of profile
+  * @param  distance: > 0
+  * @param  vmax: velocity limit, > 0
+  * @param  amax: acceleration limit, > 0
+  * @param  jmax: jerk limit, > 0
+  * @retval 1: planned
+  *         0: invalid parameters
+  */
+uint8_t MMScript_SCurvePlan(MMSCRIPT_SCURVE *profile, double distance, double vmax, double amax, double jmax);
+
+
+/**
+  * @brief  Sample a profile normalized to [0, 1] at a batch of times
+  * @param  profile: profile
+  * @param  t: times in s, clamped to [0, duration]
+  * @param  s: output of fraction of distance covered
+  * @param  count: number of samples
+  * @retval None
+  */
+void MMScript_SCurveSample(const MMSCRIPT_SCURVE *profile, const double *t, double *s, uint32_t count);
+
+
+/**
+  * @brief  Plan a clamped cubic spline of several axes
+  * @param  spline: output of spline
+  * @param  points: knots, points[axis * count + i]
+  * @param  axes: 1 to MMSCRIPT_GEN_MAX_AXES
+  * @param  count: knots per axis, 2 to MMSCRIPT_GEN_MAX_POINTS
+  * @param  segment_s: time between two knots in s, > 0
+  * @retval 1: planned
+  *         0: invalid parameters
+  */
+uint8_t MMScript_SplinePlan(MMSCRIPT_SPLINE *spline, const double *points, uint8_t axes, uint8_t count, double segment_s);
+
+
+/**
+  * @brief  Sample all axes of a spline at t0, t0 + dt, ...
+  * @param  spline: spline
+  * @param  t0: time of the first sample in s, from the first knot
+  * @param  dt: time between samples in s
+  * @param  count: number of samples
+  * @param  out: output of positions, out[axis * count + k]
+  * @retval None
+  */
+void MMScript_SplineSample(const MMSCRIPT_SPLINE *spline, double t0, double dt, uint32_t count, double *out);
+
+
+/**
+  * @brief  Generate the trajectory file of a synchronized S-curve move of several axes
+  * @note   All axes follow the time law of the longest move, so that the path is a straight line.
+  * @param  nodes: node of each axis
+  * @param  start: start position of each axis
+  * @param  target: target position of each axis
+  * @param  axes: 1 to MMSCRIPT_GEN_MAX_AXES
+  * @param  vmax, amax, jmax: limits of the longest axis, per s
+  * @param  period_us: time between setpoints
+  * @param  size: output of size of trajectory
+  * @retval trajectory in the format of STREAM, to be freed, NULL if invalid or too long
+  */
+uint8_t *MMScript_GenerateSCurve(const uint8_t *nodes, const int32_t *start, const int32_t *target, uint8_t axes, double vmax, double amax, double jmax, uint32_t period_us, size_t *size);
+
+
+/**
+  * @brief  Generate the trajectory file of a spline through waypoints of several axes
+  * @param  nodes: node of each axis
+  * @param  points: knots, start position first, points[axis * count + i]
+  * @param  axes: 1 to MMSCRIPT_GEN_MAX_AXES
+  * @param  count: knots per axis, 2 to MMSCRIPT_GEN_MAX_POINTS
+  * @param  segment_us: time between two knots
+  * @param  period_us: time between setpoints
+  * @param  size: output of size of trajectory
+  * @retval trajectory in the format of STREAM, to be freed, NULL if invalid or too long
+  */
+uint8_t *MMScript_GenerateSpline(const uint8_t *nodes, const int32_t *points, uint8_t axes, uint8_t count, uint32_t segment_us, uint32_t period_us, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __TRAJECTORY_GEN_H__ */
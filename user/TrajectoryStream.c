@@ -0,0 +1,180 @@
+
+/**
+  * Trajectory files of STREAM, mapped read only so that setpoints are paged in
+  * as the stream goes instead of being loaded or parsed up front. In real-time mode,
+  * pages are locked as they are read (MCL_ONFAULT); without it (Linux before 4.4),
+  * mlockall(MCL_FUTURE) reads & locks the whole file when it is mapped.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "TrajectoryStream.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+
+/* Private define ------------------------------------------------------------*/
+
+
+/* Private macro -------------------------------------------------------------*/
+
+#define READ_U16(p)     ((uint16_t)((p)[0] | ((p)[1] << 8)))
+#define READ_U32(p)     ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+
+/* Private variables ---------------------------------------------------------*/
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+
+/* Private functions ---------------------------------------------------------*/
+
+
+/* Public functions ---------------------------------------------------------*/
+
+int16_t MMScript_StreamAttach(const uint8_t *data, size_t size, MMSCRIPT_STREAM *stream)
+{
+    size_t nodes_size;
+
+    memset(stream, 0, sizeof(MMSCRIPT_STREAM));
+
+    if (data == NULL || size < MMSCRIPT_STREAM_HEADER_SIZE || memcmp(data, MMSCRIPT_STREAM_MAGIC, 4) != 0)
+        return MMS_ERR_STREAM_FILE;
+
+    if (READ_U16(data + 4) != MMSCRIPT_STREAM_VERSION)
+        return MMS_ERR_STREAM_FILE;
+
+    stream->node_count = READ_U16(data + 6);
+    stream->period_us = READ_U32(data + 8);
+    stream->frame_count = READ_U32(data + 12);
+
+    if (stream->node_count == 0 || stream->node_count > 255 || stream->period_us == 0)
+        return MMS_ERR_STREAM_FILE;
+
+    nodes_size = (stream->node_count + 3) & ~(size_t)3;
+
+    if (size < MMSCRIPT_STREAM_HEADER_SIZE + nodes_size ||
+        (size - MMSCRIPT_STREAM_HEADER_SIZE - nodes_size) / 4 / stream->node_count < stream->frame_count)
+        return MMS_ERR_STREAM_FILE;
+
+    stream->data = data;
+    stream->size = size;
+    stream->nodes = data + MMSCRIPT_STREAM_HEADER_SIZE;
+    stream->setpoints = stream->nodes + nodes_size;
+
+    return 0;
+}
+
+
+int16_t MMScript_StreamOpen(const char *path, MMSCRIPT_STREAM *stream)
+{
+    const uint8_t *data;
+    size_t size;
+    void *mapping;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size;
+
+    memset(stream, 0, sizeof(MMSCRIPT_STREAM));
+
+    if (file == INVALID_HANDLE_VALUE)
+        return MMS_ERR_STREAM_FILE;
+
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return MMS_ERR_STREAM_FILE;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);  /* Kept open by the mapping */
+
+    if (mapping == NULL)
+        return MMS_ERR_STREAM_FILE;
+
+    data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)file_size.QuadPart;
+
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        return MMS_ERR_STREAM_FILE;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    memset(stream, 0, sizeof(MMSCRIPT_STREAM));
+
+    if (fd < 0)
+        return MMS_ERR_STREAM_FILE;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return MMS_ERR_STREAM_FILE;
+    }
+
+    size = (size_t)st.st_size;
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);          /* Kept open by the mapping */
+
+    if (mapping == MAP_FAILED)
+        return MMS_ERR_STREAM_FILE;
+
+    /* Setpoints are read in order */
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = (const uint8_t *)mapping;
+#endif
+
+    if (MMScript_StreamAttach(data, size, stream) != 0)
+    {
+        stream->data = data;
+        stream->size = size;
+        stream->mapping = mapping;
+        MMScript_StreamClose(stream);
+
+        return MMS_ERR_STREAM_FILE;
+    }
+
+    stream->mapping = mapping;
+    return 0;
+}
+
+
+void MMScript_StreamClose(MMSCRIPT_STREAM *stream)
+{
+    if (stream->mapping)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(stream->data);
+        CloseHandle(stream->mapping);
+#else
+        munmap(stream->mapping, stream->size);
+#endif
+    }
+
+    memset(stream, 0, sizeof(MMSCRIPT_STREAM));
+}
+
+
+int32_t MMScript_StreamSetpoint(const MMSCRIPT_STREAM *stream, uint32_t frame, uint16_t index)
+{
+    const uint8_t *p = stream->setpoints + ((size_t)frame * stream->node_count + index) * 4;
+
+    return (int32_t)READ_U32(p);
+}
@@ -0,0 +1,95 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRAJECTORY_STREAM_H__
+#define __TRAJECTORY_STREAM_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+#include <stddef.h>
+
+
+/**
+  * Binary trajectory file of STREAM, all fields little endian:
+  *   "MMST"                        magic
+  *   uint16 version                MMSCRIPT_STREAM_VERSION
+  *   uint16 node_count             nodes per frame, 1 to 255
+  *   uint32 period_us              time between two frames
+  *   uint32 frame_count
+  *   uint8  nodes[node_count]      node addresses, padded with 0 to a multiple of 4 bytes
+  *   int32  setpoints[frame_count][node_count]   absolute positions
+  */
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_STREAM_MAGIC           "MMST"
+#define MMSCRIPT_STREAM_VERSION         1
+#define MMSCRIPT_STREAM_HEADER_SIZE     16
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    const uint8_t *data;        /* Whole file */
+    size_t size;
+    uint16_t node_count;
+    uint32_t period_us;
+    uint32_t frame_count;
+    const uint8_t *nodes;
+    const uint8_t *setpoints;
+    void *mapping;              /* Platform handle of the mapping, NULL if not mapped */
+}   MMSCRIPT_STREAM;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Map a trajectory file read only & check its header
+  * @param  path: file path
+  * @param  stream: output of stream, to be closed by MMScript_StreamClose()
+  * @retval 0: succeeded
+  *         MMS_ERR_STREAM_FILE: can't be mapped or invalid
+  */
+int16_t MMScript_StreamOpen(const char *path, MMSCRIPT_STREAM *stream);
+
+
+/**
+  * @brief  Unmap a trajectory file
+  * @param  stream: stream opened by MMScript_StreamOpen()
+  * @retval None
+  */
+void MMScript_StreamClose(MMSCRIPT_STREAM *stream);
+
+
+/**
+  * @brief  Check a trajectory in memory & set up stream over it
+  * @param  data: trajectory, kept referenced by stream
+  * @param  size: size of data in bytes
+  * @param  stream: output of stream, not to be closed
+  * @retval 0: succeeded
+  *         MMS_ERR_STREAM_FILE: invalid
+  */
+int16_t MMScript_StreamAttach(const uint8_t *data, size_t size, MMSCRIPT_STREAM *stream);
+
+
+/**
+  * @brief  Get a setpoint
+  * @param  stream: stream
+  * @param  frame: frame index, < frame_count
+  * @param  index: node index in frame, < node_count
+  * @retval absolute position
+  */
+int32_t MMScript_StreamSetpoint(const MMSCRIPT_STREAM *stream, uint32_t frame, uint16_t index);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __TRAJECTORY_STREAM_H__ */
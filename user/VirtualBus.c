@@ -0,0 +1,629 @@
+
+/**
+  * Simulated nodes & virtual clock of dry runs, see VirtualBus.h.
+  */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "VirtualBus.h"
+#include "ScriptEstimator.h"
+#include "Telemetry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t addr;
+    uint8_t status;             /* MMS_CTRL_STATUS_xxx */
+    int32_t from;               /* Position the move started at */
+    int32_t target;
+    int32_t velocity_move;      /* counts/s of ProfiledVelocityMove, 0 for position moves */
+    uint32_t velocity;          /* Profile set by the script */
+    uint32_t acceleration;
+    uint32_t move_velocity;     /* Profile of the move */
+    uint32_t move_acceleration;
+    uint64_t start_us;
+    uint64_t end_us;
+}   VIRTUAL_NODE;
+
+typedef struct
+{
+    MMSCRIPT_VIRTUAL_CONFIG config;
+    MMSCRIPT_VIRTUAL_TRACE trace;
+    MMSCRIPT_VIRTUAL_STATS stats;
+    uint8_t node_count;
+    VIRTUAL_NODE nodes[MMSCRIPT_VIRTUAL_MAX_NODES];
+}   VIRTUAL_BUS;
+
+
+/* Private define ------------------------------------------------------------*/
+
+#define CURRENT_BUS         \
+    (&_buses[MMScript_CurrentBus()])
+
+
+/* Private macro -------------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+static VIRTUAL_BUS _buses[MMSCRIPT_MAX_BUSES];
+
+static const char *_event_names[MMSCRIPT_VIRTUAL_EVENT_COUNT] =
+{
+    "LINE",
+    "GetControlStatus",
+    "GetAbsolutePosition",
+    "StartServo",
+    "ResetError",
+    "StopServo",
+    "HaltServo",
+    "SetProfileAcceleration",
+    "SetProfileVelocity",
+    "ProfiledVelocityMove",
+    "AbsolutePositionMove",
+    "ProfiledAbsolutePositionMove",
+    "RelativePositionMove",
+    "ProfiledRelativePositionMove"
+};
+
+
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+  * @brief  Trace an event & count it
+  * @param  vb: virtual bus
+  * @param  type: MMSCRIPT_VIRTUAL_EVENT_TYPE
+  * @param  node_addr: node, 0 for lines
+  * @param  value: label, argument or value read
+  * @retval None
+  */
+static void MMScript_VirtualTrace(VIRTUAL_BUS *vb, uint8_t type, uint8_t node_addr, int32_t value);
+
+
+/**
+  * @brief  Make a call, traced & taking command_us
+  * @param  type: MMSCRIPT_VIRTUAL_EVENT_TYPE
+  * @param  node_addr: node address
+  * @param  value: argument
+  * @retval node, NULL if too many nodes
+  */
+static VIRTUAL_NODE *MMScript_VirtualCall(uint8_t type, uint8_t node_addr, int32_t value);
+
+
+/**
+  * @brief  Advance virtual time, stop the script once limit_us is reached
+  * @param  vb: virtual bus
+  * @param  us: time elapsed
+  * @param  delay: 1 for delays, 0 for calls
+  * @retval None
+  */
+static void MMScript_VirtualAdvance(VIRTUAL_BUS *vb, uint64_t us, uint8_t delay);
+
+
+/**
+  * @brief  Poll nodes watched by telemetry, as the poller would meanwhile
+  * @param  vb: virtual bus
+  * @retval None
+  */
+static void MMScript_VirtualPoll(VIRTUAL_BUS *vb);
+
+
+/**
+  * @brief  Position of a node at a time
+  * @param  node: node
+  * @param  now_us: virtual time
+  * @retval position
+  */
+static int32_t MMScript_VirtualPosition(const VIRTUAL_NODE *node, uint64_t now_us);
+
+
+/**
+  * @brief  Start a move of a node from where it is
+  * @param  vb: virtual bus
+  * @param  node: node, NULL if too many nodes
+  * @param  target: position
+  * @retval MMS_RESP_xxx
+  */
+static uint8_t MMScript_VirtualMove(VIRTUAL_BUS *vb, VIRTUAL_NODE *node, int32_t target);
+
+
+/**
+  * @brief  Target of a relative move
+  * @note   From the target of the position move in progress, or from where the node is during
+  *         a velocity move, whose target is stale
+  * @param  vb: virtual bus
+  * @param  node: node, NULL if too many nodes
+  * @param  distance: of the move
+  * @retval position
+  */
+static int32_t MMScript_VirtualRelativeTarget(VIRTUAL_BUS *vb, const VIRTUAL_NODE *node, int32_t distance);
+
+
+/**
+  * @brief  Stop a node where it is
+  * @param  vb: virtual bus
+  * @param  node: node
+  * @retval None
+  */
+static void MMScript_VirtualFreeze(VIRTUAL_BUS *vb, VIRTUAL_NODE *node);
+
+
+/* Calls of MMSCRIPT_BUS */
+static uint8_t MMScript_VirtualGetControlStatus(uint8_t node_addr, uint8_t *status, uint8_t *in_position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualGetAbsolutePosition(uint8_t node_addr, int32_t *position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualStartServo(uint8_t node_addr, uint8_t mode, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualResetError(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualStopServo(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualHaltServo(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualSetProfileAcceleration(uint8_t node_addr, uint32_t acceleration, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualSetProfileVelocity(uint8_t node_addr, uint32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualProfiledVelocityMove(uint8_t node_addr, int32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualAbsolutePositionMove(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualProfiledAbsolutePositionMove(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualRelativePositionMove(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+static uint8_t MMScript_VirtualProfiledRelativePositionMove(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback);
+
+
+static const MMSCRIPT_BUS _virtual_bus =
+{
+    MMScript_VirtualGetControlStatus,
+    MMScript_VirtualGetAbsolutePosition,
+    MMScript_VirtualStartServo,
+    MMScript_VirtualResetError,
+    MMScript_VirtualStopServo,
+    MMScript_VirtualHaltServo,
+    MMScript_VirtualSetProfileAcceleration,
+    MMScript_VirtualSetProfileVelocity,
+    MMScript_VirtualProfiledVelocityMove,
+    MMScript_VirtualAbsolutePositionMove,
+    MMScript_VirtualProfiledAbsolutePositionMove,
+    MMScript_VirtualRelativePositionMove,
+    MMScript_VirtualProfiledRelativePositionMove
+};
+
+
+/* Private functions ---------------------------------------------------------*/
+
+static void MMScript_VirtualTrace(VIRTUAL_BUS *vb, uint8_t type, uint8_t node_addr, int32_t value)
+{
+    vb->stats.counts[type]++;
+
+    if (vb->trace)
+    {
+        MMSCRIPT_VIRTUAL_EVENT event;
+
+        event.time_us = vb->stats.now_us;
+        event.type = type;
+        event.node = node_addr;
+        event.value = value;
+
+        vb->trace(&event);
+    }
+}
+
+
+static VIRTUAL_NODE *MMScript_VirtualCall(uint8_t type, uint8_t node_addr, int32_t value)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    uint8_t i;
+
+    MMScript_VirtualTrace(vb, type, node_addr, value);
+    MMScript_VirtualAdvance(vb, vb->config.command_us, 0);
+
+    for (i=0; i<vb->node_count; i++)
+    {
+        if (vb->nodes[i].addr == node_addr)
+            return &vb->nodes[i];
+    }
+
+    if (i == MMSCRIPT_VIRTUAL_MAX_NODES)
+        return NULL;
+
+    /* At rest at 0 in position control */
+    memset(&vb->nodes[i], 0, sizeof(VIRTUAL_NODE));
+    vb->nodes[i].addr = node_addr;
+    vb->nodes[i].status = MMS_CTRL_STATUS_POSITION_CONTROL;
+    vb->nodes[i].velocity = vb->config.velocity;
+    vb->nodes[i].acceleration = vb->config.acceleration;
+    vb->nodes[i].start_us = vb->stats.now_us;
+    vb->nodes[i].end_us = vb->stats.now_us;
+    vb->node_count++;
+
+    return &vb->nodes[i];
+}
+
+
+static void MMScript_VirtualAdvance(VIRTUAL_BUS *vb, uint64_t us, uint8_t delay)
+{
+    vb->stats.now_us += us;
+
+    if (delay)
+        vb->stats.delay_us += us;
+    else
+        vb->stats.bus_us += us;
+
+    if (vb->config.limit_us > 0 && vb->stats.now_us >= vb->config.limit_us && !vb->stats.limit_reached)
+    {
+        /* Out of WAIT & retries, the caller ends the run at the next line */
+        vb->stats.limit_reached = 1;
+        MMScript_Stop();
+    }
+}
+
+
+static void MMScript_VirtualPoll(VIRTUAL_BUS *vb)
+{
+    uint8_t bus = MMScript_CurrentBus();
+    uint8_t first, node;
+
+    if (!vb->config.telemetry || vb->stats.limit_reached)
+        return;
+
+    MMScript_PollGear(NULL);
+
+    first = MMScript_TelemetryNextNode(bus, 0);
+    node = first;
+
+    for (uint16_t i=0; node != 0 && i<256; i++)
+    {
+        MMScript_PollTelemetry(node, vb->config.with_position, NULL);
+
+        if ((node = MMScript_TelemetryNextNode(bus, node)) == first)
+            break;
+    }
+}
+
+
+static int32_t MMScript_VirtualPosition(const VIRTUAL_NODE *node, uint64_t now_us)
+{
+    int64_t position;
+    uint32_t distance;
+
+    if (node->velocity_move != 0)
+    {
+        position = node->from + (int64_t)node->velocity_move * (int64_t)(now_us - node->start_us) / 1000000;
+
+        if (position > INT32_MAX)
+            position = INT32_MAX;
+        else if (position < INT32_MIN)
+            position = INT32_MIN;
+
+        return (int32_t)position;
+    }
+
+    if (now_us >= node->end_us)
+        return node->target;
+
+    distance = (uint32_t)llabs((long long)node->target - node->from);
+    position = (int64_t)MMScript_MoveDistance(now_us - node->start_us, distance, node->move_velocity, node->move_acceleration);
+
+    return (int32_t)((node->target >= node->from) ? node->from + position : node->from - position);
+}
+
+
+static uint8_t MMScript_VirtualMove(VIRTUAL_BUS *vb, VIRTUAL_NODE *node, int32_t target)
+{
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    if (node->status != MMS_CTRL_STATUS_POSITION_CONTROL)
+        return MMS_RESP_SERVO_ERROR;
+
+    node->from = MMScript_VirtualPosition(node, vb->stats.now_us);
+    node->target = target;
+    node->velocity_move = 0;
+    node->move_velocity = node->velocity;
+    node->move_acceleration = node->acceleration;
+    node->start_us = vb->stats.now_us;
+    node->end_us = vb->stats.now_us + MMScript_MoveTime((uint32_t)llabs((long long)target - node->from), node->velocity, node->acceleration);
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static int32_t MMScript_VirtualRelativeTarget(VIRTUAL_BUS *vb, const VIRTUAL_NODE *node, int32_t distance)
+{
+    int64_t from;
+
+    if (node == NULL)
+        return 0;
+
+    from = (node->velocity_move != 0) ? MMScript_VirtualPosition(node, vb->stats.now_us) : node->target;
+
+    return (int32_t)(from + distance);
+}
+
+
+static void MMScript_VirtualFreeze(VIRTUAL_BUS *vb, VIRTUAL_NODE *node)
+{
+    node->from = MMScript_VirtualPosition(node, vb->stats.now_us);
+    node->target = node->from;
+    node->velocity_move = 0;
+    node->start_us = vb->stats.now_us;
+    node->end_us = vb->stats.now_us;
+}
+
+
+static uint8_t MMScript_VirtualGetControlStatus(uint8_t node_addr, uint8_t *status, uint8_t *in_position, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_GET_CONTROL_STATUS, node_addr, 0);
+    uint64_t now_us = CURRENT_BUS->stats.now_us;
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    *status = node->status;
+    *in_position = (node->velocity_move == 0 && now_us >= node->end_us);
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualGetAbsolutePosition(uint8_t node_addr, int32_t *position, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_GET_ABSOLUTE_POSITION, node_addr, 0);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    *position = MMScript_VirtualPosition(node, CURRENT_BUS->stats.now_us);
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualStartServo(uint8_t node_addr, uint8_t mode, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_START_SERVO, node_addr, mode);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    MMScript_VirtualFreeze(vb, node);
+    node->status = MMS_CTRL_STATUS_POSITION_CONTROL;
+
+    if (mode == MMS_MODE_ZERO)
+    {
+        node->from = 0;
+        node->target = 0;
+    }
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualResetError(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    (void)callback;
+
+    return MMScript_VirtualCall(MMSCRIPT_VIRTUAL_RESET_ERROR, node_addr, 0) ? MMS_RESP_SUCCESS : MMS_RESP_FAIL;
+}
+
+
+static uint8_t MMScript_VirtualStopServo(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_STOP_SERVO, node_addr, 0);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    MMScript_VirtualFreeze(vb, node);
+    node->status = MMS_CTRL_STATUS_NO_CONTROL;
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualHaltServo(uint8_t node_addr, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_HALT_SERVO, node_addr, 0);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    MMScript_VirtualFreeze(vb, node);
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualSetProfileAcceleration(uint8_t node_addr, uint32_t acceleration, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_SET_PROFILE_ACCELERATION, node_addr, (int32_t)acceleration);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    node->acceleration = acceleration;
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualSetProfileVelocity(uint8_t node_addr, uint32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_SET_PROFILE_VELOCITY, node_addr, (int32_t)velocity);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    node->velocity = velocity;
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualProfiledVelocityMove(uint8_t node_addr, int32_t velocity, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_PROFILED_VELOCITY_MOVE, node_addr, velocity);
+
+    (void)callback;
+
+    if (node == NULL)
+        return MMS_RESP_FAIL;
+
+    if (node->status != MMS_CTRL_STATUS_POSITION_CONTROL)
+        return MMS_RESP_SERVO_ERROR;
+
+    MMScript_VirtualFreeze(vb, node);
+    node->velocity_move = velocity;
+
+    return MMS_RESP_SUCCESS;
+}
+
+
+static uint8_t MMScript_VirtualAbsolutePositionMove(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    (void)callback;
+
+    return MMScript_VirtualMove(CURRENT_BUS, MMScript_VirtualCall(MMSCRIPT_VIRTUAL_ABSOLUTE_POSITION_MOVE, node_addr, position), position);
+}
+
+
+static uint8_t MMScript_VirtualProfiledAbsolutePositionMove(uint8_t node_addr, int32_t position, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    (void)callback;
+
+    return MMScript_VirtualMove(CURRENT_BUS, MMScript_VirtualCall(MMSCRIPT_VIRTUAL_PROFILED_ABSOLUTE_POSITION_MOVE, node_addr, position), position);
+}
+
+
+static uint8_t MMScript_VirtualRelativePositionMove(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_RELATIVE_POSITION_MOVE, node_addr, distance);
+
+    (void)callback;
+
+    return MMScript_VirtualMove(vb, node, MMScript_VirtualRelativeTarget(vb, node, distance));
+}
+
+
+static uint8_t MMScript_VirtualProfiledRelativePositionMove(uint8_t node_addr, int32_t distance, MMSCRIPT_NODE_ERROR_CALLBACK callback)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+    VIRTUAL_NODE *node = MMScript_VirtualCall(MMSCRIPT_VIRTUAL_PROFILED_RELATIVE_POSITION_MOVE, node_addr, distance);
+
+    (void)callback;
+
+    return MMScript_VirtualMove(vb, node, MMScript_VirtualRelativeTarget(vb, node, distance));
+}
+
+
+/* Exported functions --------------------------------------------------------*/
+
+void MMScript_VirtualInit(uint8_t bus, const MMSCRIPT_VIRTUAL_CONFIG *config, MMSCRIPT_VIRTUAL_TRACE trace)
+{
+    VIRTUAL_BUS *vb;
+
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return;
+
+    vb = &_buses[bus];
+
+    memset(vb, 0, sizeof(VIRTUAL_BUS));
+    vb->config = *config;
+    vb->trace = trace;
+}
+
+
+const MMSCRIPT_BUS *MMScript_VirtualBus(void)
+{
+    return &_virtual_bus;
+}
+
+
+uint64_t MMScript_VirtualMicroSeconds(void)
+{
+    return CURRENT_BUS->stats.now_us;
+}
+
+
+void MMScript_VirtualDelayUntil(uint64_t deadline_us)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+
+    if (deadline_us > vb->stats.now_us)
+        MMScript_VirtualAdvance(vb, deadline_us - vb->stats.now_us, 1);
+
+    MMScript_VirtualPoll(vb);
+}
+
+
+void MMScript_VirtualDelay(uint32_t ms)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+
+    MMScript_VirtualAdvance(vb, (uint64_t)ms * 1000, 1);
+    MMScript_VirtualPoll(vb);
+}
+
+
+uint8_t MMScript_VirtualLine(int16_t label)
+{
+    VIRTUAL_BUS *vb = CURRENT_BUS;
+
+    if (vb->stats.limit_reached)
+        return 0;
+
+    MMScript_VirtualTrace(vb, MMSCRIPT_VIRTUAL_LINE, 0, label);
+    return 1;
+}
+
+
+void MMScript_GetVirtualStats(uint8_t bus, MMSCRIPT_VIRTUAL_STATS *stats)
+{
+    if (bus < MMSCRIPT_MAX_BUSES)
+        *stats = _buses[bus].stats;
+    else
+        memset(stats, 0, sizeof(MMSCRIPT_VIRTUAL_STATS));
+}
+
+
+uint8_t MMScript_VirtualNode(uint8_t bus, uint8_t node_addr, int32_t *position, uint8_t *status)
+{
+    if (bus >= MMSCRIPT_MAX_BUSES)
+        return 0;
+
+    for (uint8_t i=0; i<_buses[bus].node_count; i++)
+    {
+        const VIRTUAL_NODE *node = &_buses[bus].nodes[i];
+
+        if (node->addr == node_addr)
+        {
+            *position = MMScript_VirtualPosition(node, _buses[bus].stats.now_us);
+            *status = node->status;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+const char *MMScript_VirtualEventName(uint8_t type)
+{
+    return (type < MMSCRIPT_VIRTUAL_EVENT_COUNT) ? _event_names[type] : "";
+}
@@ -0,0 +1,151 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VIRTUAL_BUS_H__
+#define __VIRTUAL_BUS_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------*/
+
+#include "ScriptProcessor.h"
+
+
+/**
+  * Dry runs of scripts (mmsplay --dry-run): simulated nodes answer the node calls of the interpreter
+  * through MMScript_SetBus() & time is virtual, advanced by each call & delay instead of elapsing.
+  * An hour of looping runs in as long as the interpreter takes to execute its lines.
+  * One virtual clock & set of nodes per bus, the bus of the context selected by the calling thread.
+  * Nodes start at 0 in position control & move along a trapezoidal profile from where they are,
+  * ProfiledVelocityMove at its velocity at once until stopped or halted. StopServo leaves them out
+  * of control, the next move answered MMS_RESP_SERVO_ERROR until restarted, as a node does.
+  * Each line & call is handed to the trace with its virtual time, for the timeline of the run.
+  */
+
+/* Exported constants --------------------------------------------------------*/
+
+#define MMSCRIPT_VIRTUAL_MAX_NODES      32
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef enum
+{
+    MMSCRIPT_VIRTUAL_LINE = 0,          /* Line about to execute */
+    MMSCRIPT_VIRTUAL_GET_CONTROL_STATUS,
+    MMSCRIPT_VIRTUAL_GET_ABSOLUTE_POSITION,
+    MMSCRIPT_VIRTUAL_START_SERVO,
+    MMSCRIPT_VIRTUAL_RESET_ERROR,
+    MMSCRIPT_VIRTUAL_STOP_SERVO,
+    MMSCRIPT_VIRTUAL_HALT_SERVO,
+    MMSCRIPT_VIRTUAL_SET_PROFILE_ACCELERATION,
+    MMSCRIPT_VIRTUAL_SET_PROFILE_VELOCITY,
+    MMSCRIPT_VIRTUAL_PROFILED_VELOCITY_MOVE,
+    MMSCRIPT_VIRTUAL_ABSOLUTE_POSITION_MOVE,
+    MMSCRIPT_VIRTUAL_PROFILED_ABSOLUTE_POSITION_MOVE,
+    MMSCRIPT_VIRTUAL_RELATIVE_POSITION_MOVE,
+    MMSCRIPT_VIRTUAL_PROFILED_RELATIVE_POSITION_MOVE,
+    MMSCRIPT_VIRTUAL_EVENT_COUNT
+}   MMSCRIPT_VIRTUAL_EVENT_TYPE;
+
+typedef struct
+{
+    uint64_t time_us;           /* Virtual time the line starts or the call is made */
+    uint8_t type;               /* MMSCRIPT_VIRTUAL_EVENT_TYPE */
+    uint8_t node;               /* 0 for lines */
+    int32_t value;              /* Label of lines, argument of calls, position or in position read */
+}   MMSCRIPT_VIRTUAL_EVENT;
+
+/* Timeline of the run, called by the script thread */
+typedef void (*MMSCRIPT_VIRTUAL_TRACE)(const MMSCRIPT_VIRTUAL_EVENT *event);
+
+typedef struct
+{
+    uint32_t command_us;        /* Bus time of one call, response included */
+    uint32_t velocity;          /* Profile of nodes until set by the script, counts/s, 0: moves done at once */
+    uint32_t acceleration;      /* counts/s^2 */
+    uint64_t limit_us;          /* Virtual time the script is stopped at, 0 to run until END */
+    uint8_t telemetry;          /* Delays poll the nodes watched as the telemetry poller would */
+    uint8_t with_position;      /* Polled with their position */
+}   MMSCRIPT_VIRTUAL_CONFIG;
+
+typedef struct
+{
+    uint64_t now_us;            /* Virtual time */
+    uint64_t bus_us;            /* In calls */
+    uint64_t delay_us;          /* In delays, DELAY, WAIT polling intervals, PERIOD... */
+    uint8_t limit_reached;      /* Stopped at limit_us */
+    uint32_t counts[MMSCRIPT_VIRTUAL_EVENT_COUNT];  /* Lines & calls by type */
+}   MMSCRIPT_VIRTUAL_STATS;
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Reset clock, nodes & statistics of a bus for a dry run
+  * @param  bus: bus index
+  * @param  config: bus time, profile, limit & telemetry
+  * @param  trace: timeline, NULL for none
+  * @retval None
+  */
+void MMScript_VirtualInit(uint8_t bus, const MMSCRIPT_VIRTUAL_CONFIG *config, MMSCRIPT_VIRTUAL_TRACE trace);
+
+
+/**
+  * @brief  Get simulated nodes, for MMScript_SetBus()
+  * @retval calls
+  */
+const MMSCRIPT_BUS *MMScript_VirtualBus(void);
+
+
+/**
+  * @brief  Time base of dry runs, for MMScript_SetTimeBase() & MMScript_ExecOneStep()
+  * @note   Delays return at once, the virtual time of the bus of the selected context advanced.
+  */
+uint64_t MMScript_VirtualMicroSeconds(void);
+void MMScript_VirtualDelayUntil(uint64_t deadline_us);
+void MMScript_VirtualDelay(uint32_t ms);
+
+
+/**
+  * @brief  Trace a line about to execute
+  * @param  label: label of the line
+  * @retval 0 once limit_us is reached, the run must end
+  */
+uint8_t MMScript_VirtualLine(int16_t label);
+
+
+/**
+  * @brief  Get statistics of the dry run of a bus
+  * @param  bus: bus index
+  * @param  stats: output of statistics
+  * @retval None
+  */
+void MMScript_GetVirtualStats(uint8_t bus, MMSCRIPT_VIRTUAL_STATS *stats);
+
+
+/**
+  * @brief  Get state of a simulated node
+  * @param  bus: bus index
+  * @param  node_addr: node address
+  * @param  position: output of position at the virtual time of the bus
+  * @param  status: output of MMS_CTRL_STATUS_xxx
+  * @retval 0 if the node was never addressed
+  */
+uint8_t MMScript_VirtualNode(uint8_t bus, uint8_t node_addr, int32_t *position, uint8_t *status);
+
+
+/**
+  * @brief  Get name of a type of event, as the API call
+  * @param  type: MMSCRIPT_VIRTUAL_EVENT_TYPE
+  * @retval name, "LINE" for lines
+  */
+const char *MMScript_VirtualEventName(uint8_t type);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __VIRTUAL_BUS_H__ */